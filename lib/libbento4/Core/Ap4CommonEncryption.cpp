@@ -1593,20 +1593,17 @@ AP4_CencSampleDecrypter::SetSampleIndex(AP4_Ordinal sample_index)
 }
 
 /*----------------------------------------------------------------------
-|   AP4_CencSampleDecrypter::DecryptSampleData
+|   AP4_CencSampleDecrypter::GetSampleParameters
 +---------------------------------------------------------------------*/
-AP4_Result 
-AP4_CencSampleDecrypter::DecryptSampleData(AP4_UI32 poolid,
-  AP4_DataBuffer& data_in,
-  AP4_DataBuffer& data_out,
-  const AP4_UI08* iv)
-
+AP4_Result
+AP4_CencSampleDecrypter::GetSampleParameters(unsigned int     sample_cursor,
+                                             const AP4_UI08*  iv,
+                                             unsigned char*   iv_block,
+                                             unsigned int&    subsample_count,
+                                             const AP4_UI16*& bytes_of_cleartext_data,
+                                             const AP4_UI32*& bytes_of_encrypted_data)
 {
-    // increment the sample cursor
-    unsigned int sample_cursor = m_SampleCursor++;
-
     // setup the IV
-    unsigned char iv_block[16];
     if (iv == NULL) {
         iv = m_SampleInfoTable->GetIv(sample_cursor);
     }
@@ -1616,13 +1613,35 @@ AP4_CencSampleDecrypter::DecryptSampleData(AP4_UI32 poolid,
     if (iv_size != 16) AP4_SetMemory(&iv_block[iv_size], 0, 16-iv_size);
 
     // get the subsample info to this sample if needed
-    unsigned int    subsample_count = 0;
-    const AP4_UI16* bytes_of_cleartext_data = NULL;
-    const AP4_UI32* bytes_of_encrypted_data = NULL;
+    subsample_count = 0;
+    bytes_of_cleartext_data = NULL;
+    bytes_of_encrypted_data = NULL;
     if (m_SampleInfoTable) {
         AP4_Result result = m_SampleInfoTable->GetSampleInfo(sample_cursor, subsample_count, bytes_of_cleartext_data, bytes_of_encrypted_data);
         if (AP4_FAILED(result)) return result;
     }
+    return AP4_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   AP4_CencSampleDecrypter::DecryptSampleData
++---------------------------------------------------------------------*/
+AP4_Result 
+AP4_CencSampleDecrypter::DecryptSampleData(AP4_UI32 poolid,
+  AP4_DataBuffer& data_in,
+  AP4_DataBuffer& data_out,
+  const AP4_UI08* iv)
+
+{
+    // increment the sample cursor
+    unsigned int sample_cursor = m_SampleCursor++;
+
+    unsigned char   iv_block[16];
+    unsigned int    subsample_count;
+    const AP4_UI16* bytes_of_cleartext_data;
+    const AP4_UI32* bytes_of_encrypted_data;
+    AP4_Result result = GetSampleParameters(sample_cursor, iv, iv_block, subsample_count, bytes_of_cleartext_data, bytes_of_encrypted_data);
+    if (AP4_FAILED(result)) return result;
     
     // decrypt the sample
     return m_SingleSampleDecrypter->DecryptSampleData(
@@ -1635,6 +1654,51 @@ AP4_CencSampleDecrypter::DecryptSampleData(AP4_UI32 poolid,
       bytes_of_encrypted_data);
 }
 
+/*----------------------------------------------------------------------
+|   AP4_CencSampleDecrypter::DecryptSecureSampleData
++---------------------------------------------------------------------*/
+AP4_Result 
+AP4_CencSampleDecrypter::DecryptSecureSampleData(AP4_UI32 poolid,
+  AP4_DataBuffer& data_in,
+  AP4_DataBuffer& data_out,
+  AP4_CencSecureSampleInfo& sample_info)
+{
+    // increment the sample cursor
+    unsigned int sample_cursor = m_SampleCursor++;
+
+    unsigned char   iv_block[16];
+    unsigned int    subsample_count;
+    const AP4_UI16* bytes_of_cleartext_data;
+    const AP4_UI32* bytes_of_encrypted_data;
+    AP4_Result result = GetSampleParameters(sample_cursor, NULL, iv_block, subsample_count, bytes_of_cleartext_data, bytes_of_encrypted_data);
+    if (AP4_FAILED(result)) return result;
+
+    return m_SingleSampleDecrypter->DecryptSecureSampleData(
+      poolid,
+      data_in,
+      data_out,
+      iv_block,
+      subsample_count,
+      bytes_of_cleartext_data,
+      bytes_of_encrypted_data,
+      sample_info);
+}
+
+/*----------------------------------------------------------------------
+|   AP4_CencSampleDecrypter::GetSubsampleCount
++---------------------------------------------------------------------*/
+unsigned int
+AP4_CencSampleDecrypter::GetSubsampleCount()
+{
+    unsigned int    subsample_count = 0;
+    const AP4_UI16* bytes_of_cleartext_data;
+    const AP4_UI32* bytes_of_encrypted_data;
+    if (m_SampleInfoTable) {
+        m_SampleInfoTable->GetSampleInfo(m_SampleCursor, subsample_count, bytes_of_cleartext_data, bytes_of_encrypted_data);
+    }
+    return subsample_count ? subsample_count : 1;
+}
+
 /*----------------------------------------------------------------------
 |   AP4_CencTrackDecrypter
 +---------------------------------------------------------------------*/
@@ -503,6 +503,20 @@ protected:
     const AP4_ProtectionKeyMap* m_KeyMap;
 };
 
+/*----------------------------------------------------------------------
+|   AP4_CencSecureSampleInfo
++---------------------------------------------------------------------*/
+// crypto parameters of a sample which is decrypted by a secure decoder.
+// the subsample arrays are owned by the caller and must hold at least
+// the subsample count of the sample.
+struct AP4_CencSecureSampleInfo {
+    AP4_UI16  subsample_count;
+    AP4_UI16* bytes_of_cleartext_data;
+    AP4_UI32* bytes_of_encrypted_data;
+    AP4_UI08  iv[16];
+    AP4_UI08  kid[16];
+};
+
 /*----------------------------------------------------------------------
 |   AP4_CencSingleSampleDecrypter
 +---------------------------------------------------------------------*/
@@ -539,6 +553,17 @@ public:
                                          
                                          // array of <subsample_count> integers. NULL if subsample_count is 0
                                          const AP4_UI32* bytes_of_encrypted_data);
+
+    // same as DecryptSampleData, but the crypto parameters are returned in
+    // sample_info instead of being packed in front of data_out
+    virtual AP4_Result DecryptSecureSampleData(AP4_UI32 poolid,
+                                               AP4_DataBuffer& data_in,
+                                               AP4_DataBuffer& data_out,
+                                               const AP4_UI08* iv,
+                                               unsigned int    subsample_count,
+                                               const AP4_UI16* bytes_of_cleartext_data,
+                                               const AP4_UI32* bytes_of_encrypted_data,
+                                               AP4_CencSecureSampleInfo& sample_info) { return AP4_ERROR_NOT_SUPPORTED; };
     bool GetParentIsOwner()const { return m_ParentIsOwner; };
 		void SetParentIsOwner(bool parent_is_owner){ m_ParentIsOwner = parent_is_owner; };
 
@@ -603,7 +628,19 @@ public:
     virtual AP4_Result DecryptSampleData(AP4_UI32 poolid, AP4_DataBuffer& data_in,
       AP4_DataBuffer& data_out,
       const AP4_UI08* iv);
+    virtual AP4_Result DecryptSecureSampleData(AP4_UI32 poolid, AP4_DataBuffer& data_in,
+      AP4_DataBuffer& data_out,
+      AP4_CencSecureSampleInfo& sample_info);
+    // number of subsamples of the sample at the cursor (at least 1)
+    unsigned int GetSubsampleCount();
 protected:
+    AP4_Result GetSampleParameters(unsigned int    sample_cursor,
+                                   const AP4_UI08* iv,
+                                   unsigned char*  iv_block,
+                                   unsigned int&   subsample_count,
+                                   const AP4_UI16*& bytes_of_cleartext_data,
+                                   const AP4_UI32*& bytes_of_encrypted_data);
+
     AP4_CencSingleSampleDecrypter* m_SingleSampleDecrypter;
     AP4_CencSampleInfoTable*       m_SampleInfoTable;
     AP4_Ordinal                    m_SampleCursor;
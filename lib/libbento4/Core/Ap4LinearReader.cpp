@@ -339,6 +339,16 @@ AP4_LinearReader::ProcessMoof(AP4_ContainerAtom* moof,
     return AP4_SUCCESS;
 }
 
+/*----------------------------------------------------------------------
+|   AP4_LinearReader::ProcessMoov
++---------------------------------------------------------------------*/
+AP4_Result
+AP4_LinearReader::ProcessMoov(AP4_MoovAtom* moov)
+{
+    delete moov;
+    return AP4_SUCCESS;
+}
+
 /*----------------------------------------------------------------------
 |   AP4_LinearReader::AdvanceFragment
 +---------------------------------------------------------------------*/
@@ -399,6 +409,14 @@ AP4_LinearReader::AdvanceFragment()
                 } else {
                     delete atom;
                 }
+            } else if (atom->GetType() == AP4_ATOM_TYPE_MOOV) {
+                AP4_MoovAtom* moov = AP4_DYNAMIC_CAST(AP4_MoovAtom, atom);
+                if (moov) {
+                    result = ProcessMoov(moov);
+                    if (AP4_FAILED(result)) return result;
+                } else {
+                    delete atom;
+                }
             } else {
                 delete atom;
             }            
@@ -165,6 +165,8 @@ protected:
       AP4_Position       moof_offset,
       AP4_Position       mdat_payload_offset,
       AP4_UI64 mdat_payload_size);
+    // called for moov atoms found between fragments, takes ownership of the atom
+    virtual AP4_Result ProcessMoov(AP4_MoovAtom* moov);
     
     // methods
     Tracker*   FindTracker(AP4_UI32 track_id);
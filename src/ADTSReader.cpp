@@ -18,6 +18,7 @@
 
 #include "ADTSReader.h"
 #include "Ap4ByteStream.h"
+#include "Istream_view.h"
 #include <stdlib.h>
 
 uint64_t ID3TAG::getSize(const uint8_t *data, unsigned int len, unsigned int shift)
@@ -95,6 +96,7 @@ uint64_t ADTSFrame::getBE(const uint8_t *data, unsigned int len)
 bool ADTSFrame::parse(AP4_ByteStream *stream)
 {
   uint8_t buffer[64];
+  m_borrowedData = nullptr;
 
   static const uint32_t freqTable[13] = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350 };
 
@@ -124,9 +126,14 @@ bool ADTSFrame::parse(AP4_ByteStream *stream)
   stream->Tell(currentPos);
   stream->Seek(currentPos - (m_innerHeaderSize + 2));
 
-  m_dataBuffer.SetDataSize(m_totalSize);
-  if (!AP4_SUCCEEDED(stream->Read(m_dataBuffer.UseData(), m_dataBuffer.GetDataSize())))
-    return false;
+  //Use the frame data in place if the stream provides it
+  IStreamView* streamView(dynamic_cast<IStreamView*>(stream));
+  if (!streamView || !(m_borrowedData = streamView->BorrowData(m_totalSize)))
+  {
+    m_dataBuffer.SetDataSize(m_totalSize);
+    if (!AP4_SUCCEEDED(stream->Read(m_dataBuffer.UseData(), m_dataBuffer.GetDataSize())))
+      return false;
+  }
 
   //ADTS Streams have padding, at EOF
   AP4_Position pos, posNew;
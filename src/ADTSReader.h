@@ -53,12 +53,12 @@ class ATTRIBUTE_HIDDEN ADTSFrame
 {
 public:
   bool parse(AP4_ByteStream *stream);
-  void reset() { m_summedFrameCount = 0; m_frameCount = 0; m_dataBuffer.SetDataSize(0); }
+  void reset() { m_summedFrameCount = 0; m_frameCount = 0; m_dataBuffer.SetDataSize(0); m_borrowedData = nullptr; }
   void resetFrameCount() { m_summedFrameCount = 0; }
   uint64_t getPtsOffset() const { return m_sampleRate ? (static_cast<uint64_t>(m_summedFrameCount) * 90000) / m_sampleRate : 0; }
   uint64_t getDuration() const { return m_sampleRate ? (static_cast<uint64_t>(m_frameCount) * 90000) / m_sampleRate : 0; }
-  const AP4_Byte *getData() const { return m_dataBuffer.GetData(); }
-  AP4_Size getDataSize() const { return m_dataBuffer.GetDataSize(); }
+  const AP4_Byte *getData() const { return m_borrowedData ? m_borrowedData : m_dataBuffer.GetData(); }
+  AP4_Size getDataSize() const { return m_borrowedData ? m_totalSize : m_dataBuffer.GetDataSize(); }
 private:
   uint64_t getBE(const uint8_t *data, unsigned int len);
   uint16_t m_outerHeader;
@@ -72,6 +72,8 @@ private:
   uint32_t m_channelConfig = 0;
 
   AP4_DataBuffer m_dataBuffer;
+  // frame data owned by the source stream, valid until the next parse
+  const AP4_Byte *m_borrowedData = nullptr;
 };
 
 class ATTRIBUTE_HIDDEN ADTSReader
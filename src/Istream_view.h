@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Ap4Types.h"
+
+class IStreamView
+{
+public:
+  virtual ~IStreamView() {};
+
+  // Returns the next size bytes of the stream without copying them and advances the read
+  // position. The data stays valid until the next read / seek, nullptr if not available.
+  virtual const AP4_Byte* BorrowData(AP4_Size size) = 0;
+};
@@ -21,6 +21,7 @@
 #include "../log.h"
 #include "../oscompat.h"
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <math.h>
@@ -35,10 +36,27 @@ AdaptiveStream::AdaptiveStream(AdaptiveTree& tree, AdaptiveTree::StreamType type
     current_period_(tree_.current_period_),
     current_adp_(nullptr),
     current_rep_(nullptr),
+    segment_buffers_(1),
+    borrowed_(false),
+    valid_segment_buffers_(1),
+    buffered_bytes_(0),
+    max_buffer_bytes_(0),
+    workers_processing_(0),
+    download_workers_(1),
+    range_split_size_(0),
+    look_ahead_segments_(0),
+    look_ahead_seconds_(0),
+    next_rep_(nullptr),
+    adaptive_switching_(false),
+    failover_bandwidth_(0),
+    failover_hold_(0),
     segment_read_pos_(0),
+    live_wait_(0),
     currentPTSOffset_(0),
     absolutePTSOffset_(0),
     lastUpdated_(std::chrono::system_clock::now()),
+    min_bandwidth_(0),
+    max_bandwidth_(0),
     m_fixateInitialization(false),
     m_segmentFileOffset(0),
     play_timeshift_buffer_(false)
@@ -53,7 +71,6 @@ AdaptiveStream::~AdaptiveStream()
 
 void AdaptiveStream::ResetSegment()
 {
-  segment_buffer_.clear();
   segment_read_pos_ = 0;
 
   if (current_rep_->current_segment_ &&
@@ -63,50 +80,707 @@ void AdaptiveStream::ResetSegment()
     absolute_position_ = current_rep_->current_segment_->range_begin_;
 }
 
-bool AdaptiveStream::download_segment()
+void AdaptiveStream::ClearSegmentBuffers()
 {
-  if (download_url_.empty())
+  std::unique_lock<std::mutex> lckdl;
+  if (thread_data_)
+  {
+    //stop downloading chunks and wait until all workers have left their running download
+    lckdl = std::unique_lock<std::mutex>(thread_data_->mutex_dl_);
+    bool stopped(stopped_);
+    stopped_ = true;
+    //Wakes workers waiting to retry a failed segment
+    thread_data_->signal_dl_.notify_all();
+    while (workers_processing_)
+      thread_data_->signal_dl_.wait(lckdl);
+    stopped_ = stopped;
+  }
+  segment_buffers_.resize(1);
+  segment_buffers_[0].buffer.clear();
+  segment_buffers_[0].download.url.clear();
+  segment_buffers_[0].failed = false;
+  valid_segment_buffers_ = 1;
+  buffered_bytes_ = 0;
+  segment_read_pos_ = 0;
+}
+
+void AdaptiveStream::ReleaseBuffer(std::string& buffer)
+{
+  //Keep the memory alive if borrow() has handed out a pointer into it
+  if (borrowed_)
+    borrowed_buffer_.swap(buffer);
+  else
+  {
+    spare_buffer_.swap(buffer);
+    spare_buffer_.clear();
+  }
+  buffer.clear();
+}
+
+uint32_t AdaptiveStream::GetLookAheadSegments() const
+{
+  uint32_t segments(look_ahead_segments_);
+
+  if (look_ahead_seconds_ && current_rep_->timescale_)
+  {
+    uint64_t duration(GetSegmentDuration(current_rep_));
+    if (duration)
+    {
+      uint32_t durationSegments(static_cast<uint32_t>(
+          (static_cast<uint64_t>(look_ahead_seconds_) * current_rep_->timescale_ + duration - 1) /
+          duration));
+      if (!segments || durationSegments < segments)
+        segments = durationSegments;
+    }
+  }
+  return segments;
+}
+
+uint64_t AdaptiveStream::GetSegmentDuration(const AdaptiveTree::Representation* rep)
+{
+  uint64_t duration(rep->duration_);
+  if (!duration && rep->segments_.size() > 1)
+    duration = (rep->segments_[rep->segments_.size() - 1]->startPTS_ -
+                rep->segments_[0]->startPTS_) /
+               (rep->segments_.size() - 1);
+  return duration;
+}
+
+bool AdaptiveStream::IsSwitchCandidate(const AdaptiveTree::Representation* rep) const
+{
+  //Segments are matched by position and the fragments of the new representation
+  //follow its initialization in the same byte stream
+  return rep->bandwidth_ && rep->hdcpVersion_ <= hdcpVersion_ &&
+         (!hdcpLimit_ || static_cast<uint32_t>(rep->width_) * rep->height_ <= hdcpLimit_) &&
+         (!max_bandwidth_ || rep->bandwidth_ <= max_bandwidth_) &&
+         (!width_ || (rep->width_ <= width_ && rep->height_ <= height_)) &&
+         rep->containerType_ == AdaptiveTree::CONTAINERTYPE_MP4 &&
+         rep->containerType_ == current_rep_->containerType_ &&
+         rep->pssh_set_ == current_rep_->pssh_set_ && rep->get_initialization() &&
+         !(rep->flags_ & (AdaptiveTree::Representation::SEGMENTBASE |
+                          AdaptiveTree::Representation::INITIALIZATION_PREFIXED)) &&
+         rep->startNumber_ == current_rep_->startNumber_ &&
+         rep->segments_.data().size() == current_rep_->segments_.data().size();
+}
+
+void AdaptiveStream::ChooseRepresentation()
+{
+  if (!adaptive_switching_)
+    return;
+
+  AdaptiveTree::Representation* lastRep(next_rep_ ? next_rep_ : current_rep_);
+  std::vector<AdaptiveTree::Representation*> candidates;
+  std::vector<uint32_t> bitrates;
+  size_t current(0);
+  for (AdaptiveTree::Representation* rep : current_adp_->representations_)
+  {
+    //Failed downloads are not reflected in the throughput, stay below a failed bitrate for a while
+    if (rep == lastRep)
+      current = candidates.size();
+    else if (!IsSwitchCandidate(rep) || (failover_hold_ && rep->bandwidth_ >= failover_bandwidth_))
+      continue;
+    candidates.push_back(rep);
+    bitrates.push_back(rep->bandwidth_);
+  }
+  if (failover_hold_)
+    --failover_hold_;
+  if (candidates.size() < 2)
+    return;
+
+  double segmentDuration(0.0);
+  if (current_rep_->timescale_)
+    segmentDuration =
+        static_cast<double>(GetSegmentDuration(current_rep_)) / current_rep_->timescale_;
+
+  double bufferLevel(0.0);
+  for (const SEGMENTBUFFER& segmentBuffer : segment_buffers_)
+    if (segmentBuffer.download.url.empty() && !segmentBuffer.failed &&
+        !segmentBuffer.download.initialization)
+      bufferLevel += segmentDuration;
+
+  //Same bandwidth share as the initial selection in prepare_stream
+  double throughput(tree_.get_average_download_speed() * 8);
+  if (throughput < min_bandwidth_)
+    throughput = min_bandwidth_;
+  if (max_bandwidth_ && throughput > max_bandwidth_)
+    throughput = max_bandwidth_;
+  throughput *= type_ == AdaptiveTree::VIDEO ? 0.9 : 0.1;
+
+  //When choosing, the queue holds at most the look-ahead segments
+  AdaptiveTree::Representation* rep(
+      candidates[chooser_.Choose(bitrates, current, bufferLevel,
+                                 GetLookAheadSegments() * segmentDuration, segmentDuration,
+                                 throughput)]);
+  if (rep == lastRep)
+    return;
+
+  Log(LOGLEVEL_DEBUG, "AdaptiveStream: switching to representation %s (bandwidth: %u, buffer: %.1fs)",
+      rep->id.c_str(), rep->bandwidth_, bufferLevel);
+  next_rep_ = rep;
+
+  //Segments queued but not started yet are loaded from the new representation
+  const size_t startedBuffers(valid_segment_buffers_ ? valid_segment_buffers_ : 1);
+  while (segment_buffers_.size() > startedBuffers)
+  {
+    if (!spare_buffer_.capacity())
+      spare_buffer_.swap(segment_buffers_.back().buffer);
+    segment_buffers_.pop_back();
+  }
+}
+
+void AdaptiveStream::SwitchRepresentation(AdaptiveTree::Representation* rep)
+{
+  uint32_t segPos(current_rep_->getCurrentSegmentPos());
+  current_rep_->flags_ &= ~AdaptiveTree::Representation::ENABLED;
+
+  current_rep_ = rep;
+  current_rep_->current_segment_ =
+      segPos < current_rep_->segments_.data().size() ? current_rep_->get_segment(segPos) : nullptr;
+  current_rep_->flags_ |= AdaptiveTree::Representation::ENABLED;
+
+  if (observer_)
+    observer_->OnStreamChange(this);
+}
+
+void AdaptiveStream::QueueSegments()
+{
+  //Continue after the last queued segment, it may belong to another representation
+  AdaptiveTree::Representation* rep(current_rep_);
+  const AdaptiveTree::Segment* seg(current_rep_->current_segment_);
+  if (segment_buffers_.size() > 1)
+  {
+    const DOWNLOADINFO& lastDownload(segment_buffers_.back().download);
+    uint32_t segPos(lastDownload.segNum - lastDownload.rep->startNumber_);
+    rep = lastDownload.rep;
+    seg = segPos < rep->segments_.data().size() ? rep->get_segment(segPos) : nullptr;
+  }
+  if (!seg)
+    return;
+
+  const size_t maxBuffers(GetLookAheadSegments() + 1);
+  while (segment_buffers_.size() < maxBuffers)
+  {
+    if (next_rep_ && next_rep_ != rep)
+    {
+      //Representation switch, its initialization is read in front of the next segment
+      uint32_t segPos(rep->get_segment_pos(seg));
+      if (segPos >= next_rep_->segments_.data().size())
+        break;
+      rep = next_rep_;
+      seg = rep->get_segment(segPos);
+      segment_buffers_.emplace_back();
+      segment_buffers_.back().buffer.swap(spare_buffer_);
+      prepareDownload(rep, rep->get_initialization(), segment_buffers_.back());
+      segment_buffers_.back().download.segNum = rep->startNumber_ + segPos;
+      continue;
+    }
+    if (!(seg = rep->get_next_segment(seg)))
+      break;
+    segment_buffers_.emplace_back();
+    segment_buffers_.back().buffer.swap(spare_buffer_);
+    prepareDownload(rep, seg, segment_buffers_.back());
+  }
+}
+
+void AdaptiveStream::SetLookAhead(uint32_t maxSegments, uint32_t maxSeconds)
+{
+  look_ahead_segments_ = maxSegments;
+  look_ahead_seconds_ = maxSeconds;
+}
+
+void AdaptiveStream::SetDownloadWorkers(uint32_t workers, size_t maxBufferBytes)
+{
+  download_workers_ = workers ? workers : 1;
+  max_buffer_bytes_ = maxBufferBytes;
+}
+
+void AdaptiveStream::SetRetryPolicy(const RetryPolicy::SETTINGS& settings)
+{
+  retry_policy_ = RetryPolicy(settings);
+}
+
+void AdaptiveStream::SetRangeSplitSize(size_t splitSize)
+{
+  range_split_size_ = splitSize;
+}
+
+bool AdaptiveStream::download_segment(SEGMENTBUFFER& segmentBuffer)
+{
+  const DOWNLOADINFO& downloadInfo(segmentBuffer.download);
+  if (downloadInfo.url.empty())
+    return false;
+
+  segmentBuffer.attemptOffset = segmentBuffer.buffer.size();
+  segmentBuffer.skipBytes = 0;
+  segmentBuffer.keepBytes = ~0ULL;
+  segmentBuffer.rangeIgnored = false;
+  segmentBuffer.requestStart = GetTime();
+  segmentBuffer.firstData = std::chrono::steady_clock::time_point();
+  segmentBuffer.sampleBytes = 0;
+
+  bool ret;
+  if (range_split_size_ && ~downloadInfo.rangeBegin && ~downloadInfo.rangeEnd &&
+      downloadInfo.rangeEnd - downloadInfo.rangeBegin >= range_split_size_ &&
+      !tree_.SequentialDataRequired(downloadInfo.psshSet))
+    ret = download_ranges(segmentBuffer);
+  else
+    ret = download(downloadInfo.url.c_str(), downloadInfo.headers, &segmentBuffer);
+
+  if (ret)
+    AddThroughputSample(segmentBuffer);
+  if (downloadInfo.baseUrl)
+  {
+    std::chrono::duration<double> ttfb(segmentBuffer.firstData - segmentBuffer.requestStart);
+    tree_.GetBaseUrlSelector().AddResult(
+        *downloadInfo.baseUrl,
+        ret && segmentBuffer.firstData != std::chrono::steady_clock::time_point(), ttfb.count());
+  }
+  return ret;
+}
+
+void AdaptiveStream::AddThroughputSample(const SEGMENTBUFFER& segmentBuffer)
+{
+  //Measured from the first chunk on, request latency is not part of the throughput
+  std::chrono::duration<double> transferTime(segmentBuffer.lastData - segmentBuffer.firstData);
+  if (segmentBuffer.sampleBytes && transferTime.count() > 0.0)
+    tree_.AddThroughputSample(segmentBuffer.sampleBytes, transferTime.count());
+}
+
+void AdaptiveStream::AddSegmentMetrics(const SEGMENTBUFFER& segmentBuffer)
+{
+  const DOWNLOADINFO& downloadInfo(segmentBuffer.download);
+  if (!downloadInfo.rep)
+    return;
+
+  StreamMetrics::SEGMENT segment;
+  segment.representation = downloadInfo.rep->id;
+  segment.segmentNumber = downloadInfo.segNum;
+  segment.initialization = downloadInfo.initialization;
+  segment.failed = segmentBuffer.failed;
+  segment.retries = segmentBuffer.retries;
+  segment.bytes = segmentBuffer.buffer.size();
+  segment.stallTime = segmentBuffer.stallTime;
+  //Prefetched / cached data has no download timing
+  if (segmentBuffer.firstData != std::chrono::steady_clock::time_point())
+  {
+    std::chrono::duration<double> ttfb(segmentBuffer.firstData - segmentBuffer.requestStart);
+    std::chrono::duration<double> download(segmentBuffer.lastData - segmentBuffer.requestStart);
+    std::chrono::duration<double> transfer(segmentBuffer.lastData - segmentBuffer.firstData);
+    segment.timeToFirstByte = ttfb.count();
+    segment.downloadTime = download.count();
+    if (transfer.count() > 0.0)
+      segment.throughput = segmentBuffer.sampleBytes * 8 / transfer.count();
+  }
+  metrics_.AddSegment(segment);
+}
+
+void AdaptiveStream::WaitForData(std::unique_lock<std::mutex>& lckrw)
+{
+  std::chrono::steady_clock::time_point waitStart(std::chrono::steady_clock::now());
+  thread_data_->signal_rw_.wait(lckrw);
+  std::chrono::duration<double> waited(std::chrono::steady_clock::now() - waitStart);
+  segment_buffers_[0].stallTime += waited.count();
+}
+
+void AdaptiveStream::WaitForLiveSegment(std::unique_lock<std::mutex>& lckrw)
+{
+  //mutex_rw_ is released while waiting, downloads of the other buffers continue
+  static const uint32_t MAX_LIVE_WAIT = 1000;
+  if (live_wait_)
+  {
+    thread_data_->signal_rw_.wait_for(
+        lckrw, std::chrono::milliseconds(std::min(live_wait_, MAX_LIVE_WAIT)));
+    live_wait_ = 0;
+  }
+}
+
+bool AdaptiveStream::download_ranges(SEGMENTBUFFER& segmentBuffer)
+{
+  static const uint64_t MAX_RANGE_PARTS = 4;
+
+  const DOWNLOADINFO& downloadInfo(segmentBuffer.download);
+  const uint64_t rangeSize(downloadInfo.rangeEnd - downloadInfo.rangeBegin + 1);
+  uint64_t numParts((rangeSize + range_split_size_ - 1) / range_split_size_);
+  if (numParts > MAX_RANGE_PARTS)
+    numParts = MAX_RANGE_PARTS;
+  const uint64_t partSize((rangeSize + numParts - 1) / numParts);
+  numParts = (rangeSize + partSize - 1) / partSize;
+
+  //The first part is written into the segment buffer while it arrives,
+  //the following parts are appended in order after all requests have finished
+  DOWNLOADINFO firstPart(downloadInfo);
+  SetRange(firstPart, downloadInfo.rangeBegin, downloadInfo.rangeBegin + partSize - 1);
+
+  std::vector<SEGMENTBUFFER> parts(static_cast<size_t>(numParts - 1));
+  std::vector<char> partResults(parts.size(), 0);
+  std::vector<std::thread> partThreads;
+  segmentBuffer.rangePart = true;
+  for (size_t i(0); i < parts.size(); ++i)
+  {
+    uint64_t partBegin(downloadInfo.rangeBegin + (i + 1) * partSize);
+    parts[i].rangePart = true;
+    parts[i].download = downloadInfo;
+    SetRange(parts[i].download, partBegin,
+             std::min(partBegin + partSize - 1, downloadInfo.rangeEnd));
+    partThreads.push_back(std::thread([this, &parts, &partResults, i]() {
+      partResults[i] =
+          download(parts[i].download.url.c_str(), parts[i].download.headers, &parts[i]);
+    }));
+  }
+
+  bool ret(download(firstPart.url.c_str(), firstPart.headers, &segmentBuffer));
+
+  for (std::thread& partThread : partThreads)
+    partThread.join();
+
+  bool rangeIgnored(segmentBuffer.rangeIgnored);
+  {
+    std::lock_guard<std::mutex> lckrw(thread_data_->mutex_rw_);
+    segmentBuffer.rangePart = false;
+    for (size_t i(0); i < parts.size(); ++i)
+    {
+      rangeIgnored = rangeIgnored || parts[i].rangeIgnored;
+      if (ret && (ret = partResults[i] != 0))
+        segmentBuffer.buffer += parts[i].buffer;
+      else
+        buffered_bytes_ -= parts[i].buffer.size();
+    }
+    //The server sends whole files instead of the parts, fetch the segment with one request
+    if (rangeIgnored)
+    {
+      buffered_bytes_ -= segmentBuffer.buffer.size() - segmentBuffer.attemptOffset;
+      segmentBuffer.buffer.resize(segmentBuffer.attemptOffset);
+    }
+  }
+  thread_data_->signal_rw_.notify_all();
+
+  if (rangeIgnored)
+  {
+    Log(LOGLEVEL_DEBUG, "AdaptiveStream: server ignores byte ranges, loading %s in one request",
+        downloadInfo.url.c_str());
+    ret = download(downloadInfo.url.c_str(), downloadInfo.headers, &segmentBuffer);
+  }
+  return ret;
+}
+
+bool AdaptiveStream::PrepareRetry(SEGMENTBUFFER& segmentBuffer)
+{
+  //Start over as long as the reader has not consumed data of the failed attempt,
+  //otherwise request only the bytes behind the received ones
+  if (!segmentBuffer.attemptOffset &&
+      (&segmentBuffer != &segment_buffers_[0] || !segment_read_pos_))
+  {
+    buffered_bytes_ -= segmentBuffer.buffer.size();
+    segmentBuffer.buffer.clear();
+    return true;
+  }
+
+  DOWNLOADINFO& downloadInfo(segmentBuffer.download);
+  const uint64_t rangeBegin((~downloadInfo.rangeBegin ? downloadInfo.rangeBegin : 0) +
+                            segmentBuffer.buffer.size() - segmentBuffer.attemptOffset);
+  if (~downloadInfo.rangeEnd && rangeBegin > downloadInfo.rangeEnd)
     return false;
+  SetRange(downloadInfo, rangeBegin, downloadInfo.rangeEnd);
+  return true;
+}
+
+bool AdaptiveStream::download_sync(const AdaptiveTree::Segment* seg)
+{
+  //The worker is idle here, download into the current segment buffer
+  SEGMENTBUFFER& segmentBuffer(segment_buffers_[0]);
+  if (!prepareDownload(current_rep_, seg, segmentBuffer))
+    return true;
+
+  ActivateSegment(seg);
+  buffered_bytes_ -= segmentBuffer.buffer.size();
+  segmentBuffer.buffer.clear();
+  segmentBuffer.failed = false;
+  segment_read_pos_ = 0;
+
+  //Representation switches load the same initialization segments again and again
+  std::string cacheKey;
+  if (seg == current_rep_->get_initialization())
+    cacheKey = segmentBuffer.download.url + ' ' + std::to_string(segmentBuffer.download.rangeBegin) +
+               '-' + std::to_string(segmentBuffer.download.rangeEnd);
+
+  bool ret(UsePrefetched(segmentBuffer));
+  if (!ret && !cacheKey.empty() && (ret = tree_.GetInitialization(cacheKey, segmentBuffer.buffer)))
+    buffered_bytes_ += segmentBuffer.buffer.size();
+  if (!ret)
+    ret = download_segment(segmentBuffer);
+  if (ret && !cacheKey.empty())
+    tree_.StoreInitialization(cacheKey, segmentBuffer.buffer);
+
+  // Signal that there is no data coming
+  segmentBuffer.download.url.clear();
+  return ret;
+}
+
+const AdaptiveTree::Segment* AdaptiveStream::GetIndexSegment(AdaptiveTree::Segment& seg) const
+{
+  // If indexRangeMin is set, we have a "real" SIDX stream position -> use it instead init segment
+  const AdaptiveTree::Segment* indexSeg(current_rep_->get_initialization());
+  if (current_rep_->indexRangeMin_ || !indexSeg)
+  {
+    seg.range_begin_ = current_rep_->indexRangeMin_;
+    seg.range_end_ = current_rep_->indexRangeMax_;
+    seg.startPTS_ = ~0ULL;
+    indexSeg = &seg;
+  }
+  return indexSeg;
+}
+
+void AdaptiveStream::PrefetchInitialization()
+{
+  WaitPrefetch();
+  prefetch_buffers_.clear();
+
+  if (!current_rep_ || stopped_)
+    return;
+
+  AdaptiveTree::Segment seg;
+  const AdaptiveTree::Segment* initSeg(current_rep_->get_initialization());
+  if (current_rep_->flags_ & AdaptiveTree::Representation::SEGMENTBASE)
+  {
+    const AdaptiveTree::Segment* indexSeg(GetIndexSegment(seg));
+    prefetch_buffers_.emplace_back();
+    prepareDownload(current_rep_, indexSeg, prefetch_buffers_.back());
+    if (indexSeg == initSeg)
+      initSeg = nullptr;
+  }
+  if (initSeg)
+  {
+    prefetch_buffers_.emplace_back();
+    prepareDownload(current_rep_, initSeg, prefetch_buffers_.back());
+  }
+
+  if (prefetch_buffers_.empty())
+    return;
+
+  //write_data needs the rw lock, the download workers are started later in start_stream
+  if (!thread_data_)
+    thread_data_ = new THREADDATA();
 
-  return download(download_url_.c_str(), download_headers_);
+  prefetch_thread_ = std::thread([this]() {
+    for (SEGMENTBUFFER& prefetchBuffer : prefetch_buffers_)
+      if (!prefetchBuffer.download.url.empty())
+        prefetchBuffer.failed = !download_segment(prefetchBuffer);
+  });
+}
+
+bool AdaptiveStream::UsePrefetched(SEGMENTBUFFER& segmentBuffer)
+{
+  WaitPrefetch();
+
+  const DOWNLOADINFO& downloadInfo(segmentBuffer.download);
+  for (const SEGMENTBUFFER& prefetchBuffer : prefetch_buffers_)
+  {
+    if (!prefetchBuffer.failed && prefetchBuffer.download.url == downloadInfo.url &&
+        prefetchBuffer.download.rangeBegin == downloadInfo.rangeBegin &&
+        prefetchBuffer.download.rangeEnd == downloadInfo.rangeEnd)
+    {
+      //SEGMENTBASE streams may load the initialization twice, keep the prefetched copy
+      segmentBuffer.buffer = prefetchBuffer.buffer;
+      buffered_bytes_ += segmentBuffer.buffer.size();
+      return true;
+    }
+  }
+  return false;
+}
+
+void AdaptiveStream::WaitPrefetch()
+{
+  if (prefetch_thread_.joinable())
+    prefetch_thread_.join();
 }
 
 void AdaptiveStream::worker()
 {
   std::unique_lock<std::mutex> lckdl(thread_data_->mutex_dl_);
-  thread_data_->signal_dl_.notify_one();
   do
   {
-    thread_data_->signal_dl_.wait(lckdl);
-
-    bool ret(download_segment());
-    unsigned int retryCount(10);
+    //The current segment is always fetched, prefetching respects the memory limit
+    while (!thread_data_->thread_stop_ &&
+           (stopped_ || valid_segment_buffers_ >= segment_buffers_.size() ||
+            (valid_segment_buffers_ && max_buffer_bytes_ &&
+             buffered_bytes_ >= max_buffer_bytes_)))
+      thread_data_->signal_dl_.wait(lckdl);
+
+    if (thread_data_->thread_stop_)
+      break;
+
+    // segment buffers are started strictly in order, the reference stays valid
+    // until we signal that the download has finished
+    SEGMENTBUFFER& segmentBuffer(segment_buffers_[valid_segment_buffers_++]);
+    ++workers_processing_;
+    lckdl.unlock();
+
+    const std::chrono::steady_clock::time_point firstRequest(std::chrono::steady_clock::now());
+    bool ret(download_segment(segmentBuffer)), failover(false);
+
+    while (!ret && !stopped_)
+    {
+      const unsigned int failedAttempts(segmentBuffer.retries + 1);
+      std::chrono::duration<double> elapsed(std::chrono::steady_clock::now() - firstRequest);
+
+      //Some streaming software offers subtitle tracks with missing fragments, usually live tv
+      //When a programme is broadcasted that has subtitles, subtitles fragments are offered
+      //TODO: Ensure we continue with the next segment after one retry on errors
+      if ((type_ == AdaptiveTree::SUBTITLE && segmentBuffer.retries) ||
+          !retry_policy_.Retry(failedAttempts, elapsed.count()))
+        break;
+
+      //Nothing is missing if the failed attempt ended after the last byte of the range,
+      //another location of the same content is tried first, without delay
+      bool switched(false);
+      {
+        std::lock_guard<std::mutex> lckrw(thread_data_->mutex_rw_);
+        if ((ret = !PrepareRetry(segmentBuffer)))
+          break;
+        lckdl.lock();
+        if (!(switched = SwitchBaseUrl(segmentBuffer)) &&
+            retry_policy_.Failover(failedAttempts, elapsed.count(),
+                                   GetBufferLevel(segmentBuffer)))
+          failover = FailoverSegment(segmentBuffer);
+        lckdl.unlock();
+      }
+      //segmentBuffer is invalid after a failover, the worker continues with the next buffer
+      if (failover)
+        break;
 
-    //Some streaming software offers subtitle tracks with missing fragments, usually live tv
-    //When a programme is broadcasted that has subtitles, subtitles fragments are offered
-    //TODO: Ensure we continue with the next segment after one retry on errors
-    if (type_ == AdaptiveTree::SUBTITLE)
-      retryCount = 1;
+      std::chrono::duration<double> delay(0.0);
+      if (!switched)
+      {
+        lckdl.lock();
+        delay = std::chrono::duration<double>(retry_policy_.GetDelay(failedAttempts));
+        thread_data_->signal_dl_.wait_for(
+            lckdl, delay, [this]() { return thread_data_->thread_stop_ || stopped_; });
+        lckdl.unlock();
+        if (stopped_)
+          break;
+      }
 
-    while (!ret && !stopped_ && retryCount--)
-    {
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-      Log(LOGLEVEL_DEBUG, "AdaptiveStream: trying to reload segment ...");
-      ret = download_segment();
+      ++segmentBuffer.retries;
+      Log(LOGLEVEL_DEBUG, "AdaptiveStream: trying to reload segment (retry %u after %.1fs) ...",
+          segmentBuffer.retries, delay.count());
+      ret = download_segment(segmentBuffer);
     }
 
-    //Signal finished download
+    //Signal finished download, the reader stops when it reaches a failed segment
+    if (!failover)
     {
       std::lock_guard<std::mutex> lckrw(thread_data_->mutex_rw_);
-      download_url_.clear();
-      if (!ret)
-        stopped_ = true;
+      segmentBuffer.download.url.clear();
+      segmentBuffer.failed = !ret;
     }
-    thread_data_->signal_rw_.notify_one();
+    thread_data_->signal_rw_.notify_all();
 
+    lckdl.lock();
+    --workers_processing_;
+    thread_data_->signal_dl_.notify_all();
   } while (!thread_data_->thread_stop_);
 }
 
+double AdaptiveStream::GetBufferLevel(const SEGMENTBUFFER& segmentBuffer) const
+{
+  //Downloaded media in front of segmentBuffer, the reader plays it before it needs segmentBuffer
+  double bufferLevel(0.0);
+  for (const SEGMENTBUFFER& buffered : segment_buffers_)
+  {
+    if (&buffered == &segmentBuffer)
+      break;
+    const AdaptiveTree::Representation* rep(buffered.download.rep);
+    if (buffered.download.url.empty() && !buffered.failed && !buffered.download.initialization &&
+        rep && rep->timescale_)
+      bufferLevel += static_cast<double>(GetSegmentDuration(rep)) / rep->timescale_;
+  }
+  return bufferLevel;
+}
+
+bool AdaptiveStream::FailoverSegment(SEGMENTBUFFER& segmentBuffer)
+{
+  const DOWNLOADINFO& downloadInfo(segmentBuffer.download);
+  AdaptiveTree::Representation* failedRep(downloadInfo.rep);
+  if (!adaptive_switching_ || !failedRep || downloadInfo.initialization)
+    return false;
+
+  //The buffers behind the failed one are rebuilt, none of them may be downloading
+  const size_t pos(valid_segment_buffers_ - 1);
+  if (workers_processing_ > 1 || &segment_buffers_[pos] != &segmentBuffer ||
+      (!pos && segment_read_pos_))
+    return false;
+
+  std::lock_guard<std::mutex> lckTree(tree_.GetTreeMutex());
+
+  //The next lower representation the reader can switch to
+  AdaptiveTree::Representation* rep(nullptr);
+  for (AdaptiveTree::Representation* candidate : current_adp_->representations_)
+    if (candidate->bandwidth_ < failedRep->bandwidth_ && IsSwitchCandidate(candidate) &&
+        (!rep || candidate->bandwidth_ > rep->bandwidth_))
+      rep = candidate;
+
+  const uint32_t segPos(downloadInfo.segNum - failedRep->startNumber_);
+  if (!rep || segPos >= rep->segments_.data().size())
+    return false;
+
+  Log(LOGLEVEL_DEBUG, "AdaptiveStream: segment %u of representation %s failed, failover to %s",
+      downloadInfo.segNum, failedRep->id.c_str(), rep->id.c_str());
+
+  //The failed segment stays as empty buffer which the reader skips,
+  //the initialization and the segment of the new representation follow it
+  while (segment_buffers_.size() > pos + 1)
+  {
+    if (!spare_buffer_.capacity())
+      spare_buffer_.swap(segment_buffers_.back().buffer);
+    segment_buffers_.pop_back();
+  }
+  buffered_bytes_ -= segmentBuffer.buffer.size();
+  segmentBuffer.buffer.clear();
+  segmentBuffer.download.url.clear();
+  segmentBuffer.failed = false;
+  next_rep_ = rep;
+  failover_bandwidth_ = failedRep->bandwidth_;
+  failover_hold_ = FAILOVER_HOLD_SEGMENTS;
+
+  segment_buffers_.emplace_back();
+  segment_buffers_.back().buffer.swap(spare_buffer_);
+  prepareDownload(rep, rep->get_initialization(), segment_buffers_.back());
+  segment_buffers_.back().download.segNum = rep->startNumber_ + segPos;
+  segment_buffers_.emplace_back();
+  prepareDownload(rep, rep->get_segment(segPos), segment_buffers_.back());
+  valid_segment_buffers_ = pos + 1;
+  return true;
+}
+
+bool AdaptiveStream::SwitchBaseUrl(SEGMENTBUFFER& segmentBuffer)
+{
+  DOWNLOADINFO& downloadInfo(segmentBuffer.download);
+  if (!downloadInfo.baseUrl)
+    return false;
+
+  //The failed location is blocked now unless all of them are
+  const std::vector<BaseUrl>& baseUrls(downloadInfo.rep->base_urls_);
+  const BaseUrl* baseUrl(&baseUrls[tree_.GetBaseUrlSelector().Select(baseUrls)]);
+  if (baseUrl == downloadInfo.baseUrl)
+    return false;
+
+  Log(LOGLEVEL_DEBUG, "AdaptiveStream: segment %u failed on %s, continuing with %s",
+      downloadInfo.segNum, downloadInfo.baseUrl->url.c_str(), baseUrl->url.c_str());
+  downloadInfo.baseUrl = baseUrl;
+  downloadInfo.url = tree_.BuildDownloadUrl(baseUrl->url + downloadInfo.baseUrlPath);
+  return true;
+}
+
+bool AdaptiveStream::IsDownloading() const
+{
+  if (!thread_data_)
+    return false;
+
+  std::lock_guard<std::mutex> lckdl(thread_data_->mutex_dl_);
+  return workers_processing_ ||
+         (!stopped_ && valid_segment_buffers_ < segment_buffers_.size());
+}
+
 int AdaptiveStream::SecondsSinceUpdate() const
 {
   const std::chrono::time_point<std::chrono::system_clock>& tPoint(
@@ -116,7 +790,7 @@ int AdaptiveStream::SecondsSinceUpdate() const
           .count());
 }
 
-bool AdaptiveStream::write_data(const void* buffer, size_t buffer_size)
+bool AdaptiveStream::write_data(const void* buffer, size_t buffer_size, void* opaque)
 {
   {
     std::lock_guard<std::mutex> lckrw(thread_data_->mutex_rw_);
@@ -124,16 +798,81 @@ bool AdaptiveStream::write_data(const void* buffer, size_t buffer_size)
     if (stopped_)
       return false;
 
-    size_t insertPos(segment_buffer_.size());
-    segment_buffer_.resize(insertPos + buffer_size);
-    tree_.OnDataArrived(download_segNum_, download_pssh_set_, m_iv,
-                        reinterpret_cast<const uint8_t*>(buffer),
-                        reinterpret_cast<uint8_t*>(&segment_buffer_[0]), insertPos, buffer_size);
+    SEGMENTBUFFER* segmentBuffer(reinterpret_cast<SEGMENTBUFFER*>(opaque));
+    std::string& segment_buffer(segmentBuffer->buffer);
+    size_t insertPos(segment_buffer.size());
+
+    segmentBuffer->lastData = GetTime();
+    if (segmentBuffer->firstData == std::chrono::steady_clock::time_point())
+      segmentBuffer->firstData = segmentBuffer->lastData;
+    else
+      segmentBuffer->sampleBytes += buffer_size;
+
+    //Only the requested bytes of a whole file sent instead of a range are kept
+    if (segmentBuffer->skipBytes)
+    {
+      const size_t skip(
+          static_cast<size_t>(std::min<uint64_t>(segmentBuffer->skipBytes, buffer_size)));
+      buffer = static_cast<const char*>(buffer) + skip;
+      buffer_size -= skip;
+      segmentBuffer->skipBytes -= skip;
+    }
+    if (~segmentBuffer->keepBytes)
+    {
+      if (buffer_size > segmentBuffer->keepBytes)
+        buffer_size = static_cast<size_t>(segmentBuffer->keepBytes);
+      segmentBuffer->keepBytes -= buffer_size;
+    }
+    if (!buffer_size)
+      return true;
+
+    //Byte range downloads have a known size, allocate it once
+    if (!insertPos && ~segmentBuffer->download.rangeEnd)
+      segment_buffer.reserve(static_cast<size_t>(segmentBuffer->download.rangeEnd -
+                                                 segmentBuffer->download.rangeBegin + 1));
+    segment_buffer.resize(insertPos + buffer_size);
+    buffered_bytes_ += buffer_size;
+    tree_.OnDataArrived(segmentBuffer->download.segNum, segmentBuffer->download.psshSet,
+                        segmentBuffer->iv, reinterpret_cast<const uint8_t*>(buffer),
+                        reinterpret_cast<uint8_t*>(&segment_buffer[0]), insertPos, buffer_size);
   }
-  thread_data_->signal_rw_.notify_one();
+  thread_data_->signal_rw_.notify_all();
   return true;
 }
 
+bool AdaptiveStream::range_ignored(void* opaque)
+{
+  std::lock_guard<std::mutex> lckrw(thread_data_->mutex_rw_);
+
+  SEGMENTBUFFER* segmentBuffer(reinterpret_cast<SEGMENTBUFFER*>(opaque));
+  segmentBuffer->rangeIgnored = true;
+  //A split download is repeated with a single request, see download_ranges
+  if (segmentBuffer->rangePart)
+    return false;
+
+  //A resumed download starts over unless the reader consumed data of an earlier attempt
+  const DOWNLOADINFO& downloadInfo(segmentBuffer->download);
+  const uint64_t segmentBegin(downloadInfo.rangeBegin - segmentBuffer->buffer.size());
+  if (segment_buffers_.empty() || &segment_buffers_[0] != segmentBuffer || !segment_read_pos_)
+  {
+    buffered_bytes_ -= segmentBuffer->buffer.size();
+    segmentBuffer->buffer.clear();
+  }
+  segmentBuffer->skipBytes = segmentBegin + segmentBuffer->buffer.size();
+  if (~downloadInfo.rangeEnd)
+    segmentBuffer->keepBytes = downloadInfo.rangeEnd + 1 - segmentBuffer->skipBytes;
+  return true;
+}
+
+void AdaptiveStream::reserve_data(size_t size, void* opaque)
+{
+  std::lock_guard<std::mutex> lckrw(thread_data_->mutex_rw_);
+
+  std::string& segment_buffer(reinterpret_cast<SEGMENTBUFFER*>(opaque)->buffer);
+  if (segment_buffer.capacity() < segment_buffer.size() + size)
+    segment_buffer.reserve(segment_buffer.size() + size);
+}
+
 bool AdaptiveStream::prepare_stream(AdaptiveTree::AdaptationSet* adp,
                                     const uint32_t width,
                                     const uint32_t height,
@@ -149,6 +888,9 @@ bool AdaptiveStream::prepare_stream(AdaptiveTree::AdaptationSet* adp,
   hdcpLimit_ = hdcpLimit;
   hdcpVersion_ = hdcpVersion;
 
+  min_bandwidth_ = min_bandwidth;
+  max_bandwidth_ = max_bandwidth;
+
   uint32_t avg_bandwidth = tree_.bandwidth_;
 
   bandwidth_ = min_bandwidth;
@@ -173,12 +915,19 @@ bool AdaptiveStream::start_stream(const uint32_t seg_offset,
                                   uint16_t height,
                                   bool play_timeshift_buffer)
 {
-  if (!play_timeshift_buffer && !~seg_offset && tree_.has_timeshift_buffer_ &&
-      current_rep_->segments_.data.size() > 1 && tree_.periods_.size() == 1)
+  //Low latency live starts the target latency behind the live edge
+  uint32_t livePos(~0U);
+  if (!play_timeshift_buffer && !~seg_offset && tree_.low_latency_)
+    livePos = tree_.GetLiveStartPosition(current_period_, current_rep_);
+
+  if (~livePos)
+    current_rep_->current_segment_ = livePos ? current_rep_->get_segment(livePos - 1) : nullptr;
+  else if (!play_timeshift_buffer && !~seg_offset && tree_.has_timeshift_buffer_ &&
+      current_rep_->segments_.data().size() > 1 && tree_.periods_.size() == 1)
   {
     std::int32_t pos;
     if (tree_.has_timeshift_buffer_ || tree_.available_time_ >= tree_.stream_start_)
-      pos = static_cast<int32_t>(current_rep_->segments_.data.size() - 1);
+      pos = static_cast<int32_t>(current_rep_->segments_.data().size() - 1);
     else
     {
       pos = static_cast<int32_t>(
@@ -196,8 +945,9 @@ bool AdaptiveStream::start_stream(const uint32_t seg_offset,
   else
     current_rep_->current_segment_ = ~seg_offset ? current_rep_->get_segment(seg_offset) : 0;
 
-  segment_buffer_.clear();
-  segment_read_pos_ = 0;
+  //Prefetched bytes are counted in buffered_bytes_, which is reset here
+  WaitPrefetch();
+  ClearSegmentBuffers();
 
   if (!current_rep_->get_next_segment(current_rep_->current_segment_))
   {
@@ -222,13 +972,9 @@ bool AdaptiveStream::start_stream(const uint32_t seg_offset,
   }
 
   if (!thread_data_)
-  {
     thread_data_ = new THREADDATA();
-    std::unique_lock<std::mutex> lckdl(thread_data_->mutex_dl_);
-    thread_data_->Start(this);
-    // Wait until worker thread is waiting for input
-    thread_data_->signal_dl_.wait(lckdl);
-  }
+  if (thread_data_->download_threads_.empty())
+    thread_data_->Start(this, download_workers_);
 
   return true;
 }
@@ -239,11 +985,7 @@ bool AdaptiveStream::restart_stream()
     return false;
 
   /* lets download the initialization */
-  if (prepareDownload(current_rep_->get_initialization()) && !download_segment())
-    return false;
-  download_url_.clear();
-
-  return true;
+  return download_sync(current_rep_->get_initialization());
 }
 
 void AdaptiveStream::ReplacePlaceholder(std::string& url, const std::string placeholder, uint64_t value)
@@ -269,11 +1011,28 @@ void AdaptiveStream::ReplacePlaceholder(std::string& url, const std::string plac
   url.replace(np - lenReplace, npe - np + lenReplace + 1, rangebuf);
 }
 
-bool AdaptiveStream::prepareDownload(const AdaptiveTree::Segment* seg)
+void AdaptiveStream::SetRange(DOWNLOADINFO& downloadInfo, uint64_t rangeBegin, uint64_t rangeEnd)
 {
-  if (!seg)
-    return false;
+  char rangebuf[128];
 
+  downloadInfo.rangeBegin = rangeBegin;
+  downloadInfo.rangeEnd = rangeEnd;
+
+  if (!~rangeBegin)
+  {
+    downloadInfo.headers.erase("Range");
+    return;
+  }
+
+  if (~rangeEnd)
+    sprintf(rangebuf, "bytes=%" PRIu64 "-%" PRIu64, rangeBegin, rangeEnd);
+  else
+    sprintf(rangebuf, "bytes=%" PRIu64 "-", rangeBegin);
+  downloadInfo.headers["Range"] = rangebuf;
+}
+
+void AdaptiveStream::ActivateSegment(const AdaptiveTree::Segment* seg)
+{
   if (!current_rep_->segments_.empty())
   {
     currentPTSOffset_ =
@@ -284,73 +1043,89 @@ bool AdaptiveStream::prepareDownload(const AdaptiveTree::Segment* seg)
 
   if (observer_ && seg != &current_rep_->initialization_ && ~seg->startPTS_)
     observer_->OnSegmentChanged(this);
+}
+
+bool AdaptiveStream::prepareDownload(AdaptiveTree::Representation* rep,
+                                     const AdaptiveTree::Segment* seg,
+                                     SEGMENTBUFFER& segmentBuffer)
+{
+  if (!seg)
+    return false;
 
-  char rangebuf[128], *rangeHeader(0);
+  std::string& downloadUrl(segmentBuffer.download.url);
+  uint64_t rangeBegin(~0ULL), rangeEnd(~0ULL);
 
-  if (!(current_rep_->flags_ & AdaptiveTree::Representation::SEGMENTBASE))
+  if (!(rep->flags_ & AdaptiveTree::Representation::SEGMENTBASE))
   {
-    if (!(current_rep_->flags_ & AdaptiveTree::Representation::TEMPLATE))
+    if (!(rep->flags_ & AdaptiveTree::Representation::TEMPLATE))
     {
-      if (current_rep_->flags_ & AdaptiveTree::Representation::URLSEGMENTS)
+      if (rep->flags_ & AdaptiveTree::Representation::URLSEGMENTS)
       {
-        download_url_ = seg->url;
-        if (download_url_.find("://") == std::string::npos)
-          download_url_ = current_rep_->url_ + download_url_;
+        downloadUrl = seg->url;
+        if (downloadUrl.find("://") == std::string::npos)
+          downloadUrl = rep->url_ + downloadUrl;
       }
       else
-        download_url_ = current_rep_->url_;
+        downloadUrl = rep->url_;
       if (~seg->range_begin_)
       {
-        uint64_t fileOffset = seg != &current_rep_->initialization_ ? m_segmentFileOffset : 0;
+        uint64_t fileOffset = seg != &rep->initialization_ ? m_segmentFileOffset : 0;
+        rangeBegin = seg->range_begin_ + fileOffset;
         if (~seg->range_end_)
-          sprintf(rangebuf, "bytes=%" PRIu64 "-%" PRIu64, seg->range_begin_ + fileOffset,
-                  seg->range_end_ + fileOffset);
-        else
-          sprintf(rangebuf, "bytes=%" PRIu64 "-", seg->range_begin_ + fileOffset);
-        rangeHeader = rangebuf;
+          rangeEnd = seg->range_end_ + fileOffset;
       }
     }
-    else if (seg != &current_rep_->initialization_) //templated segment
+    else if (seg != &rep->initialization_) //templated segment
     {
-      download_url_ = current_rep_->segtpl_.media;
-      ReplacePlaceholder(download_url_, "$Number", seg->range_end_);
-      ReplacePlaceholder(download_url_, "$Time", seg->range_begin_);
+      downloadUrl = rep->segtpl_.media;
+      ReplacePlaceholder(downloadUrl, "$Number", seg->range_end_);
+      ReplacePlaceholder(downloadUrl, "$Time", seg->range_begin_);
     }
     else //templated initialization segment
-      download_url_ = current_rep_->url_;
+      downloadUrl = rep->url_;
   }
   else
   {
-    if (current_rep_->flags_ & AdaptiveTree::Representation::TEMPLATE &&
-        seg != &current_rep_->initialization_)
+    if (rep->flags_ & AdaptiveTree::Representation::TEMPLATE && seg != &rep->initialization_)
     {
-      download_url_ = current_rep_->segtpl_.media;
-      ReplacePlaceholder(download_url_, "$Number", current_rep_->startNumber_);
-      ReplacePlaceholder(download_url_, "$Time", 0);
+      downloadUrl = rep->segtpl_.media;
+      ReplacePlaceholder(downloadUrl, "$Number", rep->startNumber_);
+      ReplacePlaceholder(downloadUrl, "$Time", 0);
     }
     else
-      download_url_ = current_rep_->url_;
+      downloadUrl = rep->url_;
     if (~seg->range_begin_)
     {
-      uint64_t fileOffset = seg != &current_rep_->initialization_ ? m_segmentFileOffset : 0;
+      uint64_t fileOffset = seg != &rep->initialization_ ? m_segmentFileOffset : 0;
+      rangeBegin = seg->range_begin_ + fileOffset;
       if (~seg->range_end_)
-        sprintf(rangebuf, "bytes=%" PRIu64 "-%" PRIu64, seg->range_begin_ + fileOffset,
-                seg->range_end_ + fileOffset);
-      else
-        sprintf(rangebuf, "bytes=%" PRIu64 "-", seg->range_begin_ + fileOffset);
-      rangeHeader = rangebuf;
+        rangeEnd = seg->range_end_ + fileOffset;
     }
   }
 
-  download_segNum_ = current_rep_->startNumber_ + current_rep_->get_segment_pos(seg);
-  download_pssh_set_ = seg->pssh_set_;
-  download_headers_ = media_headers_;
-  if (rangeHeader)
-    download_headers_["Range"] = rangeHeader;
-  else
-    download_headers_.erase("Range");
+  //Alternate locations of the same content, the tree's selector spreads and scores them
+  segmentBuffer.download.baseUrl = nullptr;
+  if (rep->base_urls_.size() > 1 &&
+      downloadUrl.compare(0, rep->base_url_.size(), rep->base_url_) == 0)
+  {
+    segmentBuffer.download.baseUrlPath = downloadUrl.substr(rep->base_url_.size());
+    segmentBuffer.download.baseUrl =
+        &rep->base_urls_[tree_.GetBaseUrlSelector().Select(rep->base_urls_)];
+    downloadUrl = segmentBuffer.download.baseUrl->url + segmentBuffer.download.baseUrlPath;
+  }
+
+  segmentBuffer.download.rep = rep;
+  segmentBuffer.firstData = segmentBuffer.lastData = std::chrono::steady_clock::time_point();
+  segmentBuffer.sampleBytes = 0;
+  segmentBuffer.retries = 0;
+  segmentBuffer.stallTime = 0.0;
+  segmentBuffer.download.initialization = seg == &rep->initialization_;
+  segmentBuffer.download.segNum = rep->startNumber_ + rep->get_segment_pos(seg);
+  segmentBuffer.download.psshSet = seg->pssh_set_;
+  segmentBuffer.download.headers = media_headers_;
+  SetRange(segmentBuffer.download, rangeBegin, rangeEnd);
 
-  download_url_ = tree_.BuildDownloadUrl(download_url_);
+  downloadUrl = tree_.BuildDownloadUrl(downloadUrl);
 
   return true;
 }
@@ -360,11 +1135,19 @@ bool AdaptiveStream::ensureSegment()
   if (stopped_)
     return false;
 
-  if (download_url_.empty() && segment_read_pos_ >= segment_buffer_.size())
+  if (segment_buffers_[0].failed)
+  {
+    AddSegmentMetrics(segment_buffers_[0]);
+    stopped_ = true;
+    return false;
+  }
+
+  if (segment_buffers_[0].download.url.empty() &&
+      segment_read_pos_ >= segment_buffers_[0].buffer.size())
   {
     //wait until worker is ready for new segment
-    std::lock_guard<std::mutex> lck(thread_data_->mutex_dl_);
-    std::lock_guard<std::mutex> lckTree(tree_.GetTreeMutex());
+    std::unique_lock<std::mutex> lck(thread_data_->mutex_dl_);
+    std::unique_lock<std::mutex> lckTree(tree_.GetTreeMutex());
 
     if (tree_.HasUpdateThread() && SecondsSinceUpdate() > 1)
     {
@@ -372,17 +1155,66 @@ bool AdaptiveStream::ensureSegment()
       lastUpdated_ = std::chrono::system_clock::now();
     }
 
+    //Low latency live segments become available with the wall clock
+    uint32_t liveWait(~0U);
+    if (tree_.low_latency_ && current_period_ == tree_.periods_.back())
+      liveWait = tree_.ExtendLiveSegments(current_period_, current_adp_);
+
     if (m_fixateInitialization)
       return false;
 
-    const AdaptiveTree::Segment* nextSegment =
-        current_rep_->get_next_segment(current_rep_->current_segment_);
-    if (nextSegment)
+    const AdaptiveTree::Segment* nextSegment(nullptr);
+    if (segment_buffers_.size() > 1)
     {
-      current_rep_->current_segment_ = nextSegment;
-      prepareDownload(nextSegment);
-      ResetSegment();
-      thread_data_->signal_dl_.notify_one();
+      //Next segment is already prefetched / downloading
+      AddSegmentMetrics(segment_buffers_[0]);
+      buffered_bytes_ -= segment_buffers_[0].buffer.size();
+      ReleaseBuffer(segment_buffers_[0].buffer);
+      segment_buffers_.pop_front();
+      --valid_segment_buffers_;
+
+      const DOWNLOADINFO& download(segment_buffers_[0].download);
+      if (download.rep != current_rep_)
+        SwitchRepresentation(download.rep);
+
+      //Live updates may have moved the segments, locate it by segment number
+      uint32_t segPos(download.segNum - current_rep_->startNumber_);
+      nextSegment = segPos < current_rep_->segments_.data().size()
+                        ? current_rep_->get_segment(segPos)
+                        : current_rep_->get_next_segment(current_rep_->current_segment_);
+
+      //The initialization of a switched representation, the segment before it was played
+      if (download.initialization)
+      {
+        current_rep_->current_segment_ = nextSegment;
+        nextSegment = nullptr;
+      }
+    }
+    else if ((nextSegment = current_rep_->get_next_segment(current_rep_->current_segment_)))
+    {
+      AddSegmentMetrics(segment_buffers_[0]);
+      if (next_rep_ && next_rep_ != current_rep_ &&
+          current_rep_->getCurrentSegmentPos() < next_rep_->segments_.data().size())
+      {
+        //Nothing queued, the new representation starts with its initialization
+        SwitchRepresentation(next_rep_);
+        prepareDownload(current_rep_, current_rep_->get_initialization(), segment_buffers_[0]);
+        nextSegment = nullptr;
+      }
+      else
+        prepareDownload(current_rep_, nextSegment, segment_buffers_[0]);
+      buffered_bytes_ -= segment_buffers_[0].buffer.size();
+      ReleaseBuffer(segment_buffers_[0].buffer);
+      valid_segment_buffers_ = 0;
+    }
+    else if (~liveWait)
+    {
+      //The caller waits until the next segment can be requested, not holding the locks
+      current_rep_->flags_ |= AdaptiveTree::Representation::WAITFORSEGMENT;
+      Log(LOGLEVEL_DEBUG, "Begin WaitForSegment stream %s (%u ms)", current_rep_->id.c_str(),
+          liveWait);
+      live_wait_ = liveWait;
+      return false;
     }
     else if (tree_.HasUpdateThread() && current_period_ == tree_.periods_.back())
     {
@@ -393,9 +1225,20 @@ bool AdaptiveStream::ensureSegment()
     }
     else
     {
+      AddSegmentMetrics(segment_buffers_[0]);
       stopped_ = true;
       return false;
     }
+
+    if (nextSegment)
+    {
+      current_rep_->current_segment_ = nextSegment;
+      ActivateSegment(nextSegment);
+    }
+    ResetSegment();
+    ChooseRepresentation();
+    QueueSegments();
+    thread_data_->signal_dl_.notify_all();
   }
   return true;
 }
@@ -408,15 +1251,19 @@ uint32_t AdaptiveStream::read(void* buffer, uint32_t bytesToRead)
 
   std::unique_lock<std::mutex> lckrw(thread_data_->mutex_rw_);
 
+  if (bytesToRead)
+    borrowed_ = false;
+
 NEXTSEGMENT:
   if (ensureSegment() && bytesToRead)
   {
     while (true)
     {
-      uint32_t avail = segment_buffer_.size() - segment_read_pos_;
-      if (avail < bytesToRead && !download_url_.empty())
+      const SEGMENTBUFFER& segmentBuffer(segment_buffers_[0]);
+      uint32_t avail = segmentBuffer.buffer.size() - segment_read_pos_;
+      if (avail < bytesToRead && !segmentBuffer.download.url.empty())
       {
-        thread_data_->signal_rw_.wait(lckrw);
+        WaitForData(lckrw);
         continue;
       }
 
@@ -428,7 +1275,7 @@ NEXTSEGMENT:
 
       if (avail == bytesToRead)
       {
-        memcpy(buffer, segment_buffer_.data() + (segment_read_pos_ - avail), avail);
+        memcpy(buffer, segmentBuffer.buffer.data() + (segment_read_pos_ - avail), avail);
         return avail;
       }
       // If we call read after the last chunk was read but before worker finishes download, we end up here.
@@ -437,9 +1284,46 @@ NEXTSEGMENT:
       return 0;
     }
   }
+  WaitForLiveSegment(lckrw);
   return 0;
 }
 
+const uint8_t* AdaptiveStream::borrow(uint32_t bytes)
+{
+  if (stopped_)
+    return nullptr;
+
+  std::unique_lock<std::mutex> lckrw(thread_data_->mutex_rw_);
+
+  borrowed_ = false;
+
+NEXTSEGMENT:
+  if (ensureSegment() && bytes)
+  {
+    //The buffer can be reallocated as long as data arrives, the caller
+    //falls back to read() instead of waiting for the whole segment
+    const SEGMENTBUFFER& segmentBuffer(segment_buffers_[0]);
+    if (!segmentBuffer.download.url.empty())
+      return nullptr;
+
+    size_t avail(segmentBuffer.buffer.size() - segment_read_pos_);
+    if (!avail)
+      goto NEXTSEGMENT;
+    if (avail < bytes)
+      return nullptr;
+
+    const uint8_t* data(reinterpret_cast<const uint8_t*>(segmentBuffer.buffer.data()) +
+                        segment_read_pos_);
+    segment_read_pos_ += bytes;
+    absolute_position_ += bytes;
+    borrowed_ = true;
+    return data;
+  }
+  //read() waits for the next live segment
+  live_wait_ = 0;
+  return nullptr;
+}
+
 bool AdaptiveStream::seek(uint64_t const pos)
 {
   if (stopped_)
@@ -452,12 +1336,13 @@ bool AdaptiveStream::seek(uint64_t const pos)
   {
     segment_read_pos_ = static_cast<uint32_t>(pos - (absolute_position_ - segment_read_pos_));
 
-    while (segment_read_pos_ > segment_buffer_.size() && !download_url_.empty())
-      thread_data_->signal_rw_.wait(lckrw);
+    const SEGMENTBUFFER& segmentBuffer(segment_buffers_[0]);
+    while (segment_read_pos_ > segmentBuffer.buffer.size() && !segmentBuffer.download.url.empty())
+      WaitForData(lckrw);
 
-    if (segment_read_pos_ > segment_buffer_.size())
+    if (segment_read_pos_ > segmentBuffer.buffer.size())
     {
-      segment_read_pos_ = static_cast<uint32_t>(segment_buffer_.size());
+      segment_read_pos_ = static_cast<uint32_t>(segmentBuffer.buffer.size());
       return false;
     }
     absolute_position_ = pos;
@@ -477,15 +1362,16 @@ bool AdaptiveStream::getSize(unsigned long long& sz)
   {
     while (true)
     {
-      if (!download_url_.empty())
+      if (!segment_buffers_[0].download.url.empty())
       {
-        thread_data_->signal_rw_.wait(lckrw);
+        WaitForData(lckrw);
         continue;
       }
-      sz = segment_buffer_.size();
+      sz = segment_buffers_[0].buffer.size();
       return true;
     }
   }
+  WaitForLiveSegment(lckrw);
   return false;
 }
 
@@ -529,11 +1415,11 @@ bool AdaptiveStream::seek_time(double seek_seconds, bool preceeding, bool& needR
 
   uint64_t sec_in_ts = static_cast<uint64_t>(seek_seconds * current_rep_->timescale_);
   choosen_seg = 0; //Skip initialization
-  while (choosen_seg < current_rep_->segments_.data.size() &&
+  while (choosen_seg < current_rep_->segments_.data().size() &&
          sec_in_ts > current_rep_->get_segment(choosen_seg)->startPTS_)
     ++choosen_seg;
 
-  if (choosen_seg == current_rep_->segments_.data.size())
+  if (choosen_seg == current_rep_->segments_.data().size())
   {
     if (sec_in_ts < current_rep_->segments_[0]->startPTS_ + current_rep_->duration_)
       --choosen_seg;
@@ -559,18 +1445,19 @@ bool AdaptiveStream::seek_time(double seek_seconds, bool preceeding, bool& needR
     needReset = true;
     if (newSeg != old_seg)
     {
-      //stop downloading chunks
-      stopped_ = true;
-      //wait until last reading operation stopped
+      //stop downloading chunks and drop prefetched segments
       lckTree.unlock(); //writing downloadrate takes the tree lock / avoid dead-lock
+      ClearSegmentBuffers();
       std::lock_guard<std::mutex> lck(thread_data_->mutex_dl_);
       lckTree.lock();
-      stopped_ = false;
       current_rep_->current_segment_ = newSeg;
-      prepareDownload(newSeg);
+      prepareDownload(current_rep_, newSeg, segment_buffers_[0]);
+      valid_segment_buffers_ = 0;
+      ActivateSegment(newSeg);
       absolute_position_ = 0;
       ResetSegment();
-      thread_data_->signal_dl_.notify_one();
+      QueueSegments();
+      thread_data_->signal_dl_.notify_all();
     }
     else if (!preceeding)
     {
@@ -588,11 +1475,11 @@ bool AdaptiveStream::seek_time(double seek_seconds, bool preceeding, bool& needR
 
 bool AdaptiveStream::waitingForSegment(bool checkTime) const
 {
-  if (tree_.HasUpdateThread())
+  if (tree_.HasUpdateThread() || tree_.low_latency_)
   {
     std::lock_guard<std::mutex> lckTree(tree_.GetTreeMutex());
     if (current_rep_ && (current_rep_->flags_ & AdaptiveTree::Representation::WAITFORSEGMENT) != 0)
-      return !checkTime ||
+      return !checkTime || tree_.low_latency_ ||
              (current_adp_->type_ != AdaptiveTree::VIDEO &&
               current_adp_->type_ != AdaptiveTree::AUDIO) ||
              SecondsSinceUpdate() < 1;
@@ -640,19 +1527,22 @@ bool AdaptiveStream::select_stream(bool force, bool justInit, unsigned int repId
 
   if (justInit)
   {
-    current_rep_ = new_rep;
+    current_rep_ = next_rep_ = new_rep;
     return true;
   }
 
   if (!force && new_rep == current_rep_)
     return false;
 
+  //Prefetched segments belong to the old representation
+  ClearSegmentBuffers();
+
   uint32_t segid(current_rep_ ? current_rep_->getCurrentSegmentPos() : 0);
   if (current_rep_)
     const_cast<adaptive::AdaptiveTree::Representation*>(current_rep_)->flags_ &=
         ~adaptive::AdaptiveTree::Representation::ENABLED;
 
-  current_rep_ = new_rep;
+  current_rep_ = next_rep_ = new_rep;
   current_rep_->current_segment_ = current_rep_->get_segment(segid);
 
   const_cast<adaptive::AdaptiveTree::Representation*>(current_rep_)->flags_ |=
@@ -666,26 +1556,12 @@ bool AdaptiveStream::select_stream(bool force, bool justInit, unsigned int repId
   if (current_rep_->flags_ & AdaptiveTree::Representation::SEGMENTBASE)
   {
     AdaptiveTree::Segment seg;
-    const AdaptiveTree::Segment* downloadSeg;
-
-    // If indexRangeMin is set, we have a "real" SIDX stream position -> use it instead init segment
-    if (current_rep_->indexRangeMin_ || !(downloadSeg = current_rep_->get_initialization()))
-    {
-      seg.range_begin_ = current_rep_->indexRangeMin_;
-      seg.range_end_ = current_rep_->indexRangeMax_;
-      seg.startPTS_ = ~0ULL;
-      downloadSeg = &seg;
-    }
-
-    if (prepareDownload(downloadSeg) && !download_segment())
+    if (!download_sync(GetIndexSegment(seg)))
     {
       stopped_ = true;
       return false;
     }
 
-    // Signal that there is no data coming
-    download_url_.clear();
-
     AdaptiveTree::Representation* rep(const_cast<AdaptiveTree::Representation*>(current_rep_));
     absolute_position_ = 0;
     if (!parseIndexRange())
@@ -695,8 +1571,7 @@ bool AdaptiveStream::select_stream(bool force, bool justInit, unsigned int repId
     }
     rep->indexRangeMin_ = rep->indexRangeMax_ = 0;
     absolute_position_ = 0;
-    segment_buffer_.clear();
-    segment_read_pos_ = 0;
+    ClearSegmentBuffers();
     rep->flags_ &= ~AdaptiveTree::Representation::SEGMENTBASE;
   }
 
@@ -707,14 +1582,12 @@ bool AdaptiveStream::select_stream(bool force, bool justInit, unsigned int repId
   if (!loadingSeg && current_rep_->flags_ & AdaptiveTree::Representation::INITIALIZATION_PREFIXED)
     loadingSeg = current_rep_->get_segment(segid);
 
-  if (prepareDownload(loadingSeg) && !download_segment())
+  if (!download_sync(loadingSeg))
   {
     stopped_ = true;
     return false;
   }
 
-  download_url_.clear();
-
   return true;
 }
 
@@ -729,6 +1602,8 @@ void AdaptiveStream::info(std::ostream& s)
 void AdaptiveStream::stop()
 {
   stopped_ = true;
+  WaitPrefetch();
+  prefetch_buffers_.clear();
   if (current_rep_)
     const_cast<adaptive::AdaptiveTree::Representation*>(current_rep_)->flags_ &=
         ~adaptive::AdaptiveTree::Representation::ENABLED;
@@ -19,12 +19,19 @@
 #pragma once
 
 #include "AdaptiveTree.h"
+#include "RepresentationChooser.h"
+#include "RetryPolicy.h"
+#include "StreamMetrics.h"
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <map>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <kodi/AddonBase.h>
 
@@ -69,6 +76,10 @@ namespace adaptive
 
     bool ensureSegment();
     uint32_t read(void* buffer, uint32_t  bytesToRead);
+    // Like read() but returns a pointer into the segment buffer instead of copying.
+    // The data stays valid until the next read / borrow / seek call. nullptr if the
+    // segment is still downloading or doesn't provide enough bytes, never waits.
+    const uint8_t* borrow(uint32_t bytes);
     uint64_t tell(){ read(0, 0);  return absolute_position_; };
     bool seek(uint64_t const pos);
     bool getSize(unsigned long long& sz);
@@ -84,20 +95,113 @@ namespace adaptive
     bool waitingForSegment(bool checkTime = false) const;
     void FixateInitialization(bool on);
     void SetSegmentFileOffset(uint64_t offset) { m_segmentFileOffset = offset; };
+    // Number of segments / seconds downloaded ahead of the segment currently read (0 = no limit)
+    // If both are set, the smaller resulting segment count is used. Both 0 disables look-ahead.
+    void SetLookAhead(uint32_t maxSegments, uint32_t maxSeconds);
+    // Number of segments downloaded in parallel, takes effect with the next start_stream.
+    // Prefetching pauses while the segment buffers hold more than maxBufferBytes (0 = no limit)
+    void SetDownloadWorkers(uint32_t workers, size_t maxBufferBytes);
+    // Byte range segments larger than splitSize are fetched with several range requests (0 = off)
+    void SetRangeSplitSize(size_t splitSize);
+    // Backoff and failover of failed segment downloads, set before start_stream
+    void SetRetryPolicy(const RetryPolicy::SETTINGS& settings);
+    // Start downloading the index / initialization data of the selected representation
+    // in the background, select_stream picks it up instead of downloading it again.
+    void PrefetchInitialization();
+    // Choose the representation again at each segment boundary from buffer level and throughput
+    void SetAdaptiveSwitching(bool enable) { adaptive_switching_ = enable; };
+    // True while queued segments wait for or run their download
+    bool IsDownloading() const;
+    // Download timing of the segments read so far
+    const StreamMetrics& GetMetrics() const { return metrics_; };
   protected:
-    virtual bool download(const char* url, const std::map<std::string, std::string> &mediaHeaders){ return false; };
+    virtual bool download(const char* url, const std::map<std::string, std::string> &mediaHeaders, void *opaque){ return false; };
     virtual bool parseIndexRange() { return false; };
-    bool write_data(const void *buffer, size_t buffer_size);
-    bool prepareDownload(const AdaptiveTree::Segment *seg);
+    bool write_data(const void *buffer, size_t buffer_size, void *opaque);
+    // Announce the remaining size of a running download (e.g. Content-Length) to avoid reallocations
+    void reserve_data(size_t size, void *opaque);
+    // The response to a Range request is not partial (no 206 / Content-Range) but the whole
+    // file, call it before writing data. False if the download has to fail
+    bool range_ignored(void *opaque);
+    // Arrival time of downloaded data, the throughput is measured with it
+    virtual std::chrono::steady_clock::time_point GetTime() const
+    {
+      return std::chrono::steady_clock::now();
+    };
     adaptive::AdaptiveTree& GetTree() { return tree_; };
 
   private:
+    struct DOWNLOADINFO
+    {
+      std::string url;
+      std::map<std::string, std::string> headers;
+      unsigned int segNum = 0;
+      uint16_t psshSet = 0;
+      // byte range of the segment, ~0 if not set / open ended
+      uint64_t rangeBegin = ~0ULL;
+      uint64_t rangeEnd = ~0ULL;
+      // representation the segment belongs to, queued segments may belong to a new one
+      AdaptiveTree::Representation* rep = nullptr;
+      bool initialization = false;
+      // location the url starts with if rep has alternate BaseURLs, url = location + path
+      const BaseUrl* baseUrl = nullptr;
+      std::string baseUrlPath;
+    };
+
+    struct SEGMENTBUFFER
+    {
+      std::string buffer;
+      // download.url is cleared when the download has finished
+      DOWNLOADINFO download;
+      bool failed = false;
+      uint8_t iv[16];
+      // request start of the last attempt, arrival of the first / last chunk,
+      // bytes after the first one
+      std::chrono::steady_clock::time_point requestStart, firstData, lastData;
+      uint64_t sampleBytes = 0;
+      unsigned int retries = 0;
+      // buffer size when the last attempt started, data before it came from earlier attempts
+      size_t attemptOffset = 0;
+      // A server ignoring the Range header sends the whole file, write_data drops skipBytes
+      // and keeps at most keepBytes (~0 = all) of it. rangePart marks parts of a split download
+      uint64_t skipBytes = 0, keepBytes = ~0ULL;
+      bool rangePart = false, rangeIgnored = false;
+      // seconds the reader waited for data of this segment
+      double stallTime = 0.0;
+    };
+
     // Segment download section
+    bool prepareDownload(AdaptiveTree::Representation* rep,
+                         const AdaptiveTree::Segment* seg,
+                         SEGMENTBUFFER& segmentBuffer);
+    void ActivateSegment(const AdaptiveTree::Segment* seg);
     void ResetSegment();
-    bool download_segment();
+    void ClearSegmentBuffers();
+    void ReleaseBuffer(std::string& buffer);
+    void QueueSegments();
+    uint32_t GetLookAheadSegments() const;
+    static uint64_t GetSegmentDuration(const AdaptiveTree::Representation* rep);
+    bool IsSwitchCandidate(const AdaptiveTree::Representation* rep) const;
+    void ChooseRepresentation();
+    void SwitchRepresentation(AdaptiveTree::Representation* rep);
+    bool download_segment(SEGMENTBUFFER& segmentBuffer);
+    bool download_ranges(SEGMENTBUFFER& segmentBuffer);
+    bool PrepareRetry(SEGMENTBUFFER& segmentBuffer);
+    void AddThroughputSample(const SEGMENTBUFFER& segmentBuffer);
+    void AddSegmentMetrics(const SEGMENTBUFFER& segmentBuffer);
+    void WaitForData(std::unique_lock<std::mutex>& lckrw);
+    void WaitForLiveSegment(std::unique_lock<std::mutex>& lckrw);
+    bool download_sync(const AdaptiveTree::Segment* seg);
+    const AdaptiveTree::Segment* GetIndexSegment(AdaptiveTree::Segment& seg) const;
+    bool UsePrefetched(SEGMENTBUFFER& segmentBuffer);
+    void WaitPrefetch();
     void worker();
+    double GetBufferLevel(const SEGMENTBUFFER& segmentBuffer) const;
+    bool FailoverSegment(SEGMENTBUFFER& segmentBuffer);
+    bool SwitchBaseUrl(SEGMENTBUFFER& segmentBuffer);
     int SecondsSinceUpdate() const;
     static void ReplacePlaceholder(std::string &url, const std::string placeholder, uint64_t value);
+    static void SetRange(DOWNLOADINFO& downloadInfo, uint64_t rangeBegin, uint64_t rangeEnd);
 
     struct THREADDATA
     {
@@ -106,21 +210,27 @@ namespace adaptive
       {
       }
 
-      void Start(AdaptiveStream *parent)
+      void Start(AdaptiveStream *parent, uint32_t workers)
       {
-        download_thread_ = std::thread(&AdaptiveStream::worker, parent);
+        do
+          download_threads_.push_back(std::thread(&AdaptiveStream::worker, parent));
+        while (--workers > 0);
       }
 
       ~THREADDATA()
       {
-        thread_stop_ = true;
-        signal_dl_.notify_one();
-        download_thread_.join();
+        {
+          std::lock_guard<std::mutex> lckdl(mutex_dl_);
+          thread_stop_ = true;
+        }
+        signal_dl_.notify_all();
+        for (std::thread& downloadThread : download_threads_)
+          downloadThread.join();
       };
 
       std::mutex mutex_rw_, mutex_dl_;
       std::condition_variable signal_rw_, signal_dl_;
-      std::thread download_thread_;
+      std::vector<std::thread> download_threads_;
       bool thread_stop_;
     };
     THREADDATA *thread_data_;
@@ -132,23 +242,50 @@ namespace adaptive
     AdaptiveTree::Period* current_period_;
     AdaptiveTree::AdaptationSet* current_adp_;
     AdaptiveTree::Representation *current_rep_;
-    std::string download_url_;
     //We assume that a single segment can build complete frames
-    std::string segment_buffer_;
-    std::map<std::string, std::string> media_headers_, download_headers_;
+    //segment_buffers_[0] is the segment currently read, followed by prefetched segments
+    std::deque<SEGMENTBUFFER> segment_buffers_;
+    //Memory of the last consumed segment, reused for the next queued one
+    std::string spare_buffer_;
+    //Consumed segment which still backs the data returned by borrow()
+    std::string borrowed_buffer_;
+    bool borrowed_;
+    //Index / initialization data downloaded by PrefetchInitialization
+    std::vector<SEGMENTBUFFER> prefetch_buffers_;
+    std::thread prefetch_thread_;
+    //Number of leading segment_buffers_ which are downloaded or downloading
+    //Downloads may finish out of order, read() always waits for segment_buffers_[0]
+    std::size_t valid_segment_buffers_;
+    //Sum of all segment_buffers_ sizes, checked against max_buffer_bytes_
+    std::atomic<std::size_t> buffered_bytes_;
+    std::size_t max_buffer_bytes_;
+    uint32_t workers_processing_, download_workers_;
+    std::size_t range_split_size_;
+    uint32_t look_ahead_segments_, look_ahead_seconds_;
+    //Representation for newly queued segments, current_rep_ follows when they are read
+    AdaptiveTree::Representation* next_rep_;
+    RepresentationChooser chooser_;
+    bool adaptive_switching_;
+    RetryPolicy retry_policy_;
+    //After a failover the next segments are chosen below the failed bandwidth
+    static const unsigned int FAILOVER_HOLD_SEGMENTS = 5;
+    uint32_t failover_bandwidth_;
+    unsigned int failover_hold_;
+    StreamMetrics metrics_;
+    std::map<std::string, std::string> media_headers_;
     std::size_t segment_read_pos_;
+    //Low latency live: ms until the next segment can be requested, set by ensureSegment
+    uint32_t live_wait_;
     uint64_t absolute_position_;
     uint64_t currentPTSOffset_, absolutePTSOffset_;
     std::chrono::time_point<std::chrono::system_clock> lastUpdated_;
 
     uint16_t width_, height_;
     uint32_t bandwidth_;
+    uint32_t min_bandwidth_, max_bandwidth_;
     uint32_t hdcpLimit_;
     uint16_t hdcpVersion_;
-    uint16_t download_pssh_set_;
-    unsigned int download_segNum_;
-    bool stopped_;
-    uint8_t m_iv[16];
+    std::atomic<bool> stopped_;
     bool m_fixateInitialization;
     uint64_t m_segmentFileOffset;
     bool play_timeshift_buffer_;
@@ -50,21 +50,25 @@ namespace adaptive
     , minPresentationOffset(0)
     , has_timeshift_buffer_(false)
     , has_overall_seconds_(false)
+    , low_latency_(false)
+    , live_latency_(0)
     , download_speed_(0.0)
     , average_download_speed_(0.0f)
     , updateInterval_(~0)
     , updateThread_(nullptr)
     , lastUpdated_(std::chrono::system_clock::now())
+    , bandwidth_estimator_(BandwidthEstimator::Create(BandwidthEstimator::TYPE_EWMA))
   {
   }
 
   AdaptiveTree::~AdaptiveTree()
   {
-    has_timeshift_buffer_ = false;
     if (updateThread_)
     {
       {
+        // The update thread checks it while it holds the lock
         std::lock_guard<std::mutex> lck(updateMutex_);
+        has_timeshift_buffer_ = false;
         updateVar_.notify_one();
       }
       updateThread_->join();
@@ -74,23 +78,57 @@ namespace adaptive
     std::lock_guard<std::mutex> lck(treeMutex_);
     for (std::vector<Period*>::const_iterator bp(periods_.begin()), ep(periods_.end()); bp != ep; ++bp)
       delete *bp;
+    delete bandwidth_estimator_;
   }
 
   void AdaptiveTree::FreeSegments(Period* period, Representation* rep)
   {
-    for (std::vector<Segment>::iterator bs(rep->segments_.data.begin()), es(rep->segments_.data.end()); bs != es; ++bs)
+    for (std::vector<Segment>::iterator bs(rep->segments_.data().begin()), es(rep->segments_.data().end()); bs != es; ++bs)
     {
       --period->psshSets_[bs->pssh_set_].use_count_;
       if (rep->flags_ & Representation::URLSEGMENTS)
-        delete[] bs->url;
+        StringArena::Release(bs->url);
     }
     if ((rep->flags_ & (Representation::INITIALIZATION | Representation::URLSEGMENTS))
       == (Representation::INITIALIZATION | Representation::URLSEGMENTS))
-      delete[]rep->initialization_.url;
+      StringArena::Release(rep->initialization_.url);
     rep->segments_.clear();
     rep->current_segment_ = nullptr;
   }
 
+  static bool SameSegments(const std::vector<AdaptiveTree::Segment>& a,
+                           const std::vector<AdaptiveTree::Segment>& b)
+  {
+    if (a.size() != b.size())
+      return false;
+    for (std::vector<AdaptiveTree::Segment>::const_iterator sa(a.begin()), sb(b.begin());
+         sa != a.end(); ++sa, ++sb)
+      if (sa->startPTS_ != sb->startPTS_ || sa->range_begin_ != sb->range_begin_ ||
+          sa->range_end_ != sb->range_end_ || sa->url != sb->url || sa->pssh_set_ != sb->pssh_set_)
+        return false;
+    return true;
+  }
+
+  void AdaptiveTree::ShareSegments(AdaptationSet* adp)
+  {
+    for (std::vector<Representation*>::iterator b(adp->representations_.begin()),
+         e(adp->representations_.end());
+         b != e; ++b)
+    {
+      // Segment urls are owned by their representation
+      if (((*b)->flags_ & Representation::URLSEGMENTS) || (*b)->segments_.empty())
+        continue;
+      for (std::vector<Representation*>::iterator bp(adp->representations_.begin()); bp != b; ++bp)
+        if (!((*bp)->flags_ & Representation::URLSEGMENTS) &&
+            (*bp)->segments_.basePos() == (*b)->segments_.basePos() &&
+            SameSegments((*bp)->segments_.data(), (*b)->segments_.data()))
+        {
+          (*b)->segments_.share((*bp)->segments_);
+          break;
+        }
+    }
+  }
+
 
   bool AdaptiveTree::has_type(StreamType t)
   {
@@ -114,12 +152,28 @@ namespace adaptive
     std::lock_guard<std::mutex> lck(treeMutex_);
 
     download_speed_ = speed;
-    if (!average_download_speed_)
-      average_download_speed_ = download_speed_;
-    else
-      average_download_speed_ = average_download_speed_*0.9 + download_speed_*0.1;
+    bandwidth_estimator_->SetInitialEstimate(speed);
+    average_download_speed_ = bandwidth_estimator_->GetEstimate();
   };
 
+  void AdaptiveTree::AddThroughputSample(uint64_t bytes, double seconds)
+  {
+    std::lock_guard<std::mutex> lck(treeMutex_);
+
+    download_speed_ = bytes / seconds;
+    bandwidth_estimator_->AddSample(bytes, seconds);
+    average_download_speed_ = bandwidth_estimator_->GetEstimate();
+  }
+
+  void AdaptiveTree::SetBandwidthEstimator(BandwidthEstimator* estimator)
+  {
+    std::lock_guard<std::mutex> lck(treeMutex_);
+
+    estimator->SetInitialEstimate(average_download_speed_);
+    delete bandwidth_estimator_;
+    bandwidth_estimator_ = estimator;
+  }
+
   void AdaptiveTree::SetFragmentDuration(const AdaptationSet* adp, const Representation* rep, size_t pos, uint64_t timestamp, uint32_t fragmentDuration, uint32_t movie_timescale)
   {
     if (!has_timeshift_buffer_ || !update_parameter_.empty() ||
@@ -130,9 +184,9 @@ namespace adaptive
     AdaptationSet *adpm(const_cast<AdaptationSet *>(adp));
 
     // Check if its the last frame we watch
-    if (adp->segment_durations_.data.size())
+    if (adp->segment_durations_.data().size())
     {
-      if (pos == adp->segment_durations_.data.size() - 1)
+      if (pos == adp->segment_durations_.data().size() - 1)
       {
         adpm->segment_durations_.insert(static_cast<std::uint64_t>(fragmentDuration)*adp->timescale_ / movie_timescale);
       }
@@ -142,7 +196,7 @@ namespace adaptive
         return;
       }
     }
-    else if (pos != rep->segments_.data.size() - 1)
+    else if (pos != rep->segments_.data().size() - 1)
       return;
 
     Segment seg(*(rep->segments_[pos]));
@@ -165,7 +219,14 @@ namespace adaptive
     Log(LOGLEVEL_DEBUG, "AdaptiveTree: insert live segment: pts: %llu range_end: %llu", seg.startPTS_, seg.range_end_);
 
     for (std::vector<Representation*>::iterator b(adpm->representations_.begin()), e(adpm->representations_.end()); b != e; ++b)
-      (*b)->segments_.insert(seg);
+    {
+      // Shared segments are inserted once
+      std::vector<Representation*>::iterator bp(adpm->representations_.begin());
+      while (bp != b && !(*bp)->segments_.shares((*b)->segments_))
+        ++bp;
+      if (bp == b)
+        (*b)->segments_.insert(seg);
+    }
   }
 
   void AdaptiveTree::OnDataArrived(unsigned int segNum, uint16_t psshSet, uint8_t iv[16], const uint8_t *src, uint8_t *dst, size_t dstOffset, size_t dataSize)
@@ -248,6 +309,7 @@ namespace adaptive
     language_ = src->language_;
     mimeType_ = src->mimeType_;
     base_url_ = src->base_url_;
+    base_urls_ = src->base_urls_;
     id_ = src->id_;
     group_ = src->group_;
     codecs_ = src->codecs_;
@@ -267,6 +329,7 @@ namespace adaptive
     }
 
     base_url_ = period->base_url_;
+    base_urls_ = period->base_urls_;
     id_ = period->id_;
     timescale_ = period->timescale_;
     startNumber_ = period->startNumber_;
@@ -277,6 +340,7 @@ namespace adaptive
     encryptionState_ = period->encryptionState_;
     included_types_ = period->included_types_;
     need_secure_decoder_ = period->need_secure_decoder_;
+    IndexRepresentations();
   }
 
   uint16_t AdaptiveTree::Period::InsertPSSHSet(PSSH* pssh)
@@ -311,6 +375,36 @@ namespace adaptive
         }
         else
           ++br;
+    IndexRepresentations();
+  }
+
+  void AdaptiveTree::Period::IndexRepresentations()
+  {
+    representation_index_.clear();
+    for (AdaptationSet* adp : adaptationSets_)
+    {
+      adp->key_hash_ = AdaptationSet::keyHash(adp);
+      for (Representation* rep : adp->representations_)
+        if (!FindRepresentation(adp, rep))
+          representation_index_.emplace(adp->key_hash_ * 31 + std::hash<std::string>()(rep->id),
+                                        std::make_pair(adp, rep));
+    }
+  }
+
+  AdaptiveTree::Representation* AdaptiveTree::Period::FindRepresentation(
+      const AdaptationSet* adp, const Representation* rep, AdaptationSet** found) const
+  {
+    auto range(representation_index_.equal_range(AdaptationSet::keyHash(adp) * 31 +
+                                                 std::hash<std::string>()(rep->id)));
+    for (; range.first != range.second; ++range.first)
+      if (range.first->second.second->id == rep->id &&
+          AdaptationSet::sameKey(range.first->second.first, adp))
+      {
+        if (found)
+          *found = range.first->second.first;
+        return range.first->second.second;
+      }
+    return nullptr;
   }
 
   bool AdaptiveTree::PreparePaths(const std::string &url)
@@ -379,11 +473,50 @@ namespace adaptive
     return url;
   }
 
+  bool AdaptiveTree::GetInitialization(const std::string& key, std::string& data)
+  {
+    std::lock_guard<std::mutex> lck(initialization_cache_mutex_);
+    for (auto it(initialization_cache_.begin()); it != initialization_cache_.end(); ++it)
+      if (it->first == key)
+      {
+        data = it->second;
+        initialization_cache_.splice(initialization_cache_.begin(), initialization_cache_, it);
+        return true;
+      }
+    return false;
+  }
+
+  void AdaptiveTree::StoreInitialization(const std::string& key, const std::string& data)
+  {
+    static const size_t MAX_INITIALIZATION_CACHE_SIZE = 8 * 1024 * 1024;
+    if (data.empty() || data.size() > MAX_INITIALIZATION_CACHE_SIZE)
+      return;
+
+    std::lock_guard<std::mutex> lck(initialization_cache_mutex_);
+    for (auto it(initialization_cache_.begin()); it != initialization_cache_.end(); ++it)
+      if (it->first == key)
+      {
+        initialization_cache_size_ -= it->second.size();
+        initialization_cache_.erase(it);
+        break;
+      }
+
+    initialization_cache_.emplace_front(key, data);
+    initialization_cache_size_ += data.size();
+    while (initialization_cache_size_ > MAX_INITIALIZATION_CACHE_SIZE)
+    {
+      initialization_cache_size_ -= initialization_cache_.back().second.size();
+      initialization_cache_.pop_back();
+    }
+  }
+
   void AdaptiveTree::SortTree()
   {
     for (std::vector<Period*>::const_iterator bp(periods_.begin()), ep(periods_.end()); bp != ep; ++bp)
     {
       std::stable_sort((*bp)->adaptationSets_.begin(), (*bp)->adaptationSets_.end(), AdaptationSet::compare);
+      for (AdaptationSet* adp : (*bp)->adaptationSets_)
+        adp->key_hash_ = AdaptationSet::keyHash(adp);
 
       // Merge AUDIO streams, some provider pass everythng in own Audio sets
       for (std::vector<AdaptationSet*>::iterator ba((*bp)->adaptationSets_.begin()), ea((*bp)->adaptationSets_.end()); ba != ea;)
@@ -409,6 +542,7 @@ namespace adaptive
         for (std::vector<Representation*>::iterator br((*ba)->representations_.begin()), er((*ba)->representations_.end()); br != er; ++br)
           (*br)->SetScaling();
       }
+      (*bp)->IndexRepresentations();
     }
   }
 
@@ -421,6 +555,16 @@ namespace adaptive
     }
   }
 
+  void AdaptiveTree::RequestUpdate()
+  {
+    if (HasUpdateThread())
+    {
+      std::lock_guard<std::mutex> lck(updateMutex_);
+      updateRequested_ = true;
+      updateVar_.notify_one();
+    }
+  }
+
   void AdaptiveTree::StartUpdateThread()
   {
     if (!updateThread_ && ~updateInterval_ && has_timeshift_buffer_ && !update_parameter_.empty())
@@ -432,11 +576,25 @@ namespace adaptive
     std::unique_lock<std::mutex> updLck(updateMutex_);
     while (~updateInterval_ && has_timeshift_buffer_)
     {
-      if (updateVar_.wait_for(updLck, std::chrono::milliseconds(updateInterval_)) == std::cv_status::timeout)
+      if (updateRequested_ ||
+        updateVar_.wait_for(updLck, std::chrono::milliseconds(updateInterval_)) == std::cv_status::timeout ||
+        updateRequested_)
       {
-        std::lock_guard<std::mutex> lck(treeMutex_);
-        lastUpdated_ = std::chrono::system_clock::now();
+        updateRequested_ = false;
+        // The manifest is downloaded and parsed while streams keep reading the tree,
+        // requests for updates meanwhile don't block. RequestUpdate is called with the
+        // tree lock held, the tree is never locked while holding updateMutex_
+        updLck.unlock();
+        {
+          std::lock_guard<std::mutex> lck(treeMutex_);
+          lastUpdated_ = std::chrono::system_clock::now();
+        }
         RefreshLiveSegments();
+        {
+          std::lock_guard<std::mutex> lck(treeMutex_);
+          lastUpdated_ = std::chrono::system_clock::now();
+        }
+        updLck.lock();
       }
     }
   }
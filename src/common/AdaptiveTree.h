@@ -18,15 +18,21 @@
 
 #pragma once
 
+#include "BandwidthEstimator.h"
+#include "BaseUrlSelector.h"
+#include "StringArena.h"
 #include "expat.h"
 
 #include <chrono>
 #include <condition_variable>
 #include <inttypes.h>
+#include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include <kodi/AddonBase.h>
@@ -34,62 +40,109 @@
 namespace adaptive
 {
 
+// Ring of elements, the storage can be shared by several owners (see share)
 template<typename T>
 struct ATTRIBUTE_HIDDEN SPINCACHE
 {
-  SPINCACHE() :basePos(0) {};
-
-  size_t basePos;
+  SPINCACHE() : storage_(std::make_shared<STORAGE>()) {};
+  SPINCACHE(const SPINCACHE<T>& other) : storage_(std::make_shared<STORAGE>(*other.storage_)) {};
+  SPINCACHE<T>& operator=(const SPINCACHE<T>& other)
+  {
+    storage_ = std::make_shared<STORAGE>(*other.storage_);
+    return *this;
+  };
 
   const T *operator[](uint32_t pos) const
   {
     if (!~pos)
       return 0;
-    size_t realPos = basePos + pos;
-    if (realPos >= data.size())
+    size_t realPos = storage_->basePos + pos;
+    if (realPos >= storage_->data.size())
     {
-      realPos -= data.size();
-      if (realPos == basePos)
+      realPos -= storage_->data.size();
+      if (realPos == storage_->basePos)
         return 0;
     }
-    return &data[realPos];
+    return &storage_->data[realPos];
   };
 
   uint32_t pos(const T* elem) const
   {
-    size_t realPos = elem - &data[0];
-    if (realPos < basePos)
-      realPos += data.size() - basePos;
+    size_t realPos = elem - &storage_->data[0];
+    if (realPos < storage_->basePos)
+      realPos += storage_->data.size() - storage_->basePos;
     else
-      realPos -= basePos;
+      realPos -= storage_->basePos;
     return static_cast<std::uint32_t>(realPos);
   };
 
+  // Replaces the oldest element, visible to all owners of the storage
   void insert(const T &elem)
   {
-    data[basePos] = elem;
-    ++basePos;
-    if (basePos == data.size())
-      basePos = 0;
+    storage_->data[storage_->basePos] = elem;
+    ++storage_->basePos;
+    if (storage_->basePos == storage_->data.size())
+      storage_->basePos = 0;
+  }
+
+  // Drops the count oldest elements and appends elems, visible to all owners of the storage
+  void slide(size_t count, const std::vector<T>& elems)
+  {
+    const size_t size(storage_->data.size());
+    if (count > size)
+      count = size;
+    if (count == elems.size())
+    {
+      for (const T& elem : elems)
+        insert(elem);
+      return;
+    }
+    std::vector<T> data;
+    data.reserve(size - count + elems.size());
+    for (size_t i(count); i < size; ++i)
+      data.push_back(storage_->data[(storage_->basePos + i) % size]);
+    data.insert(data.end(), elems.begin(), elems.end());
+    storage_->data.swap(data);
+    storage_->basePos = 0;
   }
 
   void swap(SPINCACHE<T> &other)
   {
-    data.swap(other.data);
-    std::swap(basePos, other.basePos);
+    storage_.swap(other.storage_);
   }
 
+  // Releases the storage, other owners keep it
   void clear()
   {
-    data.clear();
-    basePos = 0;
+    storage_ = std::make_shared<STORAGE>();
   }
 
-  bool empty() const { return data.empty(); };
+  // Uses the storage of other instead of an own copy of the same elements
+  void share(const SPINCACHE<T>& other) { storage_ = other.storage_; };
+  bool shares(const SPINCACHE<T>& other) const { return storage_ == other.storage_; };
+  // Own copy of the storage before elements are changed for this owner only
+  void detach()
+  {
+    if (storage_.use_count() > 1)
+      storage_ = std::make_shared<STORAGE>(*storage_);
+  };
+
+  bool empty() const { return storage_->data.empty(); };
 
-  size_t size() const { return data.size(); };
+  size_t size() const { return storage_->data.size(); };
 
-  std::vector<T> data;
+  size_t basePos() const { return storage_->basePos; };
+
+  std::vector<T>& data() { return storage_->data; };
+  const std::vector<T>& data() const { return storage_->data; };
+
+private:
+  struct STORAGE
+  {
+    size_t basePos = 0;
+    std::vector<T> data;
+  };
+  std::shared_ptr<STORAGE> storage_;
 };
 
 class ATTRIBUTE_HIDDEN AdaptiveTree
@@ -144,10 +197,13 @@ public:
 
   struct SegmentTemplate
   {
-    SegmentTemplate() : timescale(0), duration(0) {};
+    SegmentTemplate() : timescale(0), duration(0), startNumber(1), availabilityTimeOffset(0) {};
     std::string initialization;
     std::string media;
     unsigned int timescale, duration;
+    // Number of the segment starting with the period, segments can be requested
+    // availabilityTimeOffset ms (~0 = INF) before they are complete
+    unsigned int startNumber, availabilityTimeOffset;
   };
 
   struct Representation
@@ -163,10 +219,10 @@ public:
     ~Representation() {
       if (flags_ & Representation::URLSEGMENTS)
       {
-        for (std::vector<Segment>::iterator bs(segments_.data.begin()), es(segments_.data.end()); bs != es; ++bs)
-          delete[] bs->url;
+        for (std::vector<Segment>::iterator bs(segments_.data().begin()), es(segments_.data().end()); bs != es; ++bs)
+          StringArena::Release(bs->url);
         if (flags_ & Representation::INITIALIZATION)
-          delete[]initialization_.url;
+          StringArena::Release(initialization_.url);
       }
     };
     std::string url_;
@@ -175,6 +231,8 @@ public:
     std::string codec_private_data_;
     std::string source_url_;
     std::string base_url_;
+    // Locations of the BaseURL elements, the first one is base_url_
+    std::vector<BaseUrl> base_urls_;
     uint32_t bandwidth_;
     uint32_t samplingRate_;
     uint16_t width_, height_;
@@ -219,7 +277,7 @@ public:
     {
       if (!seg || seg == &initialization_)
         return segments_[0];
-      else if (segments_.pos(seg) + 1 == segments_.data.size())
+      else if (segments_.pos(seg) + 1 == segments_.data().size())
         return nullptr;
       else
         return segments_[segments_.pos(seg) + 1];
@@ -232,7 +290,7 @@ public:
 
     const uint32_t get_segment_pos(const Segment *segment)const
     {
-      return segment ? segments_.data.empty() ? 0 : segments_.pos(segment) : ~0;
+      return segment ? segments_.data().empty() ? 0 : segments_.pos(segment) : ~0;
     }
 
     const uint16_t get_psshset() const
@@ -287,6 +345,7 @@ public:
     std::string language_;
     std::string mimeType_;
     std::string base_url_;
+    std::vector<BaseUrl> base_urls_;
     std::string id_, group_;
     std::string codecs_;
     std::string audio_track_id_;
@@ -294,12 +353,31 @@ public:
     std::vector<Representation*> representations_;
     SPINCACHE<uint32_t> segment_durations_;
     SegmentTemplate segtpl_;
+    // keyHash() of this adaptation set, set by SortTree and Period::IndexRepresentations
+    size_t key_hash_ = 0;
 
     const uint32_t get_segment_duration(uint32_t pos)const
     {
       return *segment_durations_[pos];
     };
 
+    // Hash of the fields identifying an adaptation set across manifest updates
+    static size_t keyHash(const AdaptationSet* adp)
+    {
+      const std::hash<std::string> hash;
+      size_t key(hash(adp->id_));
+      key = key * 31 + hash(adp->group_);
+      key = key * 31 + hash(adp->mimeType_);
+      key = key * 31 + hash(adp->language_);
+      return key * 31 + adp->type_;
+    };
+
+    static bool sameKey(const AdaptationSet* a, const AdaptationSet* b)
+    {
+      return a->type_ == b->type_ && a->id_ == b->id_ && a->group_ == b->group_ &&
+             a->mimeType_ == b->mimeType_ && a->language_ == b->language_;
+    };
+
     static bool compare(const AdaptationSet* a, const AdaptationSet *b)
     {
       if (a->type_ != b->type_)
@@ -350,7 +428,8 @@ public:
 
     static bool mergeable(const AdaptationSet* a, const AdaptationSet *b)
     {
-      if (a->type_ == b->type_
+      if (a->key_hash_ == b->key_hash_
+        && a->type_ == b->type_
         && a->timescale_ == b->timescale_
         && a->duration_ == b->duration_
         && a->startPTS_ == b->startPTS_
@@ -399,9 +478,17 @@ public:
     uint16_t InsertPSSHSet(PSSH* pssh);
     void InsertPSSHSet(uint16_t pssh_set) { ++psshSets_[pssh_set].use_count_; };
     void RemovePSSHSet(uint16_t pssh_set);
+    // Rebuilds representation_index_ after adaptation sets or representations changed
+    void IndexRepresentations();
+    // The representation of this period with the key of adp and the id of rep, which may belong
+    // to another tree (e.g. a manifest update). found receives its adaptation set.
+    Representation* FindRepresentation(const AdaptationSet* adp,
+                                       const Representation* rep,
+                                       AdaptationSet** found = nullptr) const;
 
     std::vector<AdaptationSet*> adaptationSets_;
     std::string base_url_, id_;
+    std::vector<BaseUrl> base_urls_;
     uint32_t timescale_ = 1000, startNumber_ = 1, sequence_ = 0;
     uint64_t start_ = 0;
     uint64_t startPTS_ = 0;
@@ -411,9 +498,14 @@ public:
     bool need_secure_decoder_ = false;
     SPINCACHE<uint32_t> segment_durations_;
     SegmentTemplate segtpl_;
+    // Representations by the key hash of their adaptation set combined with their id,
+    // representations with an equal key after the first one are not indexed
+    std::unordered_multimap<size_t, std::pair<AdaptationSet*, Representation*>> representation_index_;
   }*current_period_, *next_period_;
 
   std::vector<Period*> periods_;
+  // Urls of URLSEGMENTS segments and their initialization
+  StringArena url_arena_;
   std::string manifest_url_;
   std::string base_url_;
   std::string effective_url_;
@@ -430,6 +522,10 @@ public:
   uint64_t overallSeconds_, stream_start_, available_time_, base_time_;
   uint64_t minPresentationOffset;
   bool has_timeshift_buffer_, has_overall_seconds_;
+  // Low latency live (LL-DASH), segments are requested while they are produced
+  bool low_latency_;
+  // Target live latency in ms, 0 = from the manifest
+  uint32_t live_latency_;
 
   uint32_t bandwidth_;
   std::map<std::string, std::string> manifest_headers_;
@@ -463,17 +559,35 @@ public:
     return PREPARE_RESULT_OK;
   };
   virtual void OnDataArrived(unsigned int segNum, uint16_t psshSet, uint8_t iv[16], const uint8_t *src, uint8_t *dst, size_t dstOffset, size_t dataSize);
+  // true if OnDataArrived needs the segment data in order (e.g. chained decryption)
+  virtual bool SequentialDataRequired(uint16_t psshSet) const { return false; };
+  // Called before a stream moves to its next segment, the caller holds treeMutex_
   virtual void RefreshSegments(Period* period,
                                AdaptationSet* adp,
                                Representation* rep,
                                StreamType type){};
+  // Low latency live: position of the segment to start with to play live_latency_ behind
+  // the live edge, ~0 if the representation is not suitable
+  virtual uint32_t GetLiveStartPosition(const Period* period, const Representation* rep)
+  {
+    return ~0U;
+  };
+  // Low latency live: appends the segments which can be requested by now,
+  // returns the ms until the next one can be requested (~0 = not available)
+  virtual uint32_t ExtendLiveSegments(const Period* period, AdaptationSet* adp) { return ~0U; };
 
   bool has_type(StreamType t);
   void FreeSegments(Period* period, Representation* rep);
+  // Representations of adp with equal segments (templates) keep a single copy of them
+  void ShareSegments(AdaptationSet* adp);
   uint32_t estimate_segcount(uint64_t duration, uint32_t timescale);
   double get_download_speed() const { return download_speed_; };
   double get_average_download_speed() const { return average_download_speed_; };
   void set_download_speed(double speed);
+  // A finished transfer, updates the download speed estimation
+  void AddThroughputSample(uint64_t bytes, double seconds);
+  // Takes ownership of estimator
+  void SetBandwidthEstimator(BandwidthEstimator* estimator);
   void SetFragmentDuration(const AdaptationSet* adp, const Representation* rep, size_t pos, uint64_t timestamp, uint32_t fragmentDuration, uint32_t movie_timescale);
   uint16_t insert_psshset(StreamType type, Period* period = nullptr, AdaptationSet* adp = nullptr);
 
@@ -486,10 +600,18 @@ public:
   };
 
   std::string BuildDownloadUrl(const std::string& url) const;
+  // Chooses between the alternate BaseURLs of a representation, shared by all streams
+  BaseUrlSelector& GetBaseUrlSelector() { return base_url_selector_; };
+
+  // Initialization segments shared by all streams, the least recently used ones are dropped
+  bool GetInitialization(const std::string& key, std::string& data);
+  void StoreInitialization(const std::string& key, const std::string& data);
 
   std::mutex &GetTreeMutex() { return treeMutex_; };
   bool HasUpdateThread() const { return updateThread_ != 0 && has_timeshift_buffer_ && updateInterval_ && !update_parameter_.empty(); };
   void RefreshUpdateThread();
+  // Lets the update thread refresh the manifest now instead of after updateInterval_
+  void RequestUpdate();
   const std::chrono::time_point<std::chrono::system_clock> GetLastUpdated() const { return lastUpdated_; };
 
 protected:
@@ -504,16 +626,26 @@ protected:
 
   // Live segment update section
   virtual void StartUpdateThread();
+  // Called without the tree lock, implementations take it while they change the tree
   virtual void RefreshLiveSegments(){};
 
   uint32_t updateInterval_;
   std::mutex treeMutex_, updateMutex_;
   std::condition_variable updateVar_;
   std::thread *updateThread_;
+  // Set by RequestUpdate, guarded by updateMutex_
+  bool updateRequested_ = false;
   std::chrono::time_point<std::chrono::system_clock> lastUpdated_;
 
 private:
   void SegmentUpdateWorker();
+
+  BandwidthEstimator* bandwidth_estimator_;
+  BaseUrlSelector base_url_selector_;
+
+  std::list<std::pair<std::string, std::string>> initialization_cache_;
+  size_t initialization_cache_size_ = 0;
+  std::mutex initialization_cache_mutex_;
 };
 
 }
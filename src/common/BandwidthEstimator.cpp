@@ -0,0 +1,113 @@
+/*
+*      Copyright (C) 2016-2016 peak3d
+*      http://www.peak3d.de
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include "BandwidthEstimator.h"
+
+#include <math.h>
+
+using namespace adaptive;
+
+BandwidthEstimator* BandwidthEstimator::Create(Type type)
+{
+  switch (type)
+  {
+    case TYPE_HARMONIC_MEAN:
+      return new HarmonicMeanBandwidthEstimator();
+    default:
+      return new EwmaBandwidthEstimator();
+  }
+}
+
+/*******************************************************
+|   EwmaBandwidthEstimator
+********************************************************/
+
+EwmaBandwidthEstimator::EWMA::EWMA(double halfLife)
+  : alpha_(exp(log(0.5) / halfLife)), estimate_(0.0), totalWeight_(0.0)
+{
+}
+
+void EwmaBandwidthEstimator::EWMA::Add(double weight, double value)
+{
+  double adjAlpha(pow(alpha_, weight));
+  estimate_ = value * (1.0 - adjAlpha) + adjAlpha * estimate_;
+  totalWeight_ += weight;
+}
+
+double EwmaBandwidthEstimator::EWMA::Get() const
+{
+  //The average starts at 0, remove this bias
+  double zeroFactor(1.0 - pow(alpha_, totalWeight_));
+  return estimate_ / zeroFactor;
+}
+
+EwmaBandwidthEstimator::EwmaBandwidthEstimator(double fastHalfLife, double slowHalfLife)
+  : fast_(fastHalfLife), slow_(slowHalfLife), total_bytes_(0)
+{
+}
+
+void EwmaBandwidthEstimator::AddSample(uint64_t bytes, double seconds)
+{
+  if (bytes < MIN_SAMPLE_BYTES || seconds <= 0.0)
+    return;
+
+  double bytesPerSecond(bytes / seconds);
+  fast_.Add(seconds, bytesPerSecond);
+  slow_.Add(seconds, bytesPerSecond);
+  total_bytes_ += bytes;
+}
+
+double EwmaBandwidthEstimator::GetEstimate() const
+{
+  static const uint64_t MIN_TOTAL_BYTES = 128 * 1024;
+  if (total_bytes_ < MIN_TOTAL_BYTES)
+    return initial_estimate_;
+
+  double fast(fast_.Get()), slow(slow_.Get());
+  return fast < slow ? fast : slow;
+}
+
+/*******************************************************
+|   HarmonicMeanBandwidthEstimator
+********************************************************/
+
+HarmonicMeanBandwidthEstimator::HarmonicMeanBandwidthEstimator(size_t windowSize)
+  : window_size_(windowSize ? windowSize : 1)
+{
+}
+
+void HarmonicMeanBandwidthEstimator::AddSample(uint64_t bytes, double seconds)
+{
+  if (bytes < MIN_SAMPLE_BYTES || seconds <= 0.0)
+    return;
+
+  samples_.push_back(bytes / seconds);
+  if (samples_.size() > window_size_)
+    samples_.pop_front();
+}
+
+double HarmonicMeanBandwidthEstimator::GetEstimate() const
+{
+  if (samples_.empty())
+    return initial_estimate_;
+
+  double inverseSum(0.0);
+  for (double sample : samples_)
+    inverseSum += 1.0 / sample;
+  return samples_.size() / inverseSum;
+}
@@ -0,0 +1,85 @@
+/*
+*      Copyright (C) 2016-2016 peak3d
+*      http://www.peak3d.de
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+#include <kodi/AddonBase.h>
+
+namespace adaptive
+{
+  class ATTRIBUTE_HIDDEN BandwidthEstimator
+  {
+  public:
+    enum Type
+    {
+      TYPE_EWMA = 0,
+      TYPE_HARMONIC_MEAN = 1
+    };
+    static BandwidthEstimator* Create(Type type);
+
+    virtual ~BandwidthEstimator() = default;
+    // A transfer received bytes within seconds, small transfers are ignored
+    virtual void AddSample(uint64_t bytes, double seconds) = 0;
+    // Bytes per second, the initial estimate is used until enough data was measured
+    virtual double GetEstimate() const = 0;
+    void SetInitialEstimate(double bytesPerSecond) { initial_estimate_ = bytesPerSecond; };
+
+  protected:
+    static const uint64_t MIN_SAMPLE_BYTES = 16 * 1024;
+    double initial_estimate_ = 0.0;
+  };
+
+  // Fast and slow exponentially weighted average, weighted by transfer time.
+  // The lower one wins: throughput drops are followed quickly, raises slowly.
+  class ATTRIBUTE_HIDDEN EwmaBandwidthEstimator : public BandwidthEstimator
+  {
+  public:
+    EwmaBandwidthEstimator(double fastHalfLife = 2.0, double slowHalfLife = 5.0);
+    void AddSample(uint64_t bytes, double seconds) override;
+    double GetEstimate() const override;
+
+  private:
+    struct EWMA
+    {
+      EWMA(double halfLife);
+      void Add(double weight, double value);
+      double Get() const;
+
+      double alpha_, estimate_, totalWeight_;
+    };
+    EWMA fast_, slow_;
+    uint64_t total_bytes_;
+  };
+
+  // Harmonic mean of the throughput of the last transfers, robust against single spikes
+  class ATTRIBUTE_HIDDEN HarmonicMeanBandwidthEstimator : public BandwidthEstimator
+  {
+  public:
+    HarmonicMeanBandwidthEstimator(size_t windowSize = 10);
+    void AddSample(uint64_t bytes, double seconds) override;
+    double GetEstimate() const override;
+
+  private:
+    size_t window_size_;
+    std::deque<double> samples_;
+  };
+}
@@ -0,0 +1,158 @@
+/*
+*      Copyright (C) 2016-2016 peak3d
+*      http://www.peak3d.de
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+#include "BaseUrlSelector.h"
+
+#include <algorithm>
+
+using namespace adaptive;
+
+namespace
+{
+// A location is blocked 5s after its first error, doubled per further error up to 2 minutes
+const double BLOCK_SECONDS = 5.0;
+const double MAX_BLOCK_SECONDS = 120.0;
+// Leave the current location if it is this much slower than an alternate
+const double LATENCY_FACTOR = 2.0;
+const double LATENCY_ALPHA = 0.3;
+} // namespace
+
+BaseUrlSelector::BaseUrlSelector(uint32_t seed) : random_(seed)
+{
+}
+
+std::string BaseUrlSelector::GetKey(const BaseUrl& baseUrl)
+{
+  if (!baseUrl.serviceLocation.empty())
+    return baseUrl.serviceLocation;
+
+  std::string::size_type hostPos(baseUrl.url.find("://"));
+  hostPos = hostPos == std::string::npos ? 0 : hostPos + 3;
+  return baseUrl.url.substr(0, baseUrl.url.find('/', hostPos));
+}
+
+bool BaseUrlSelector::IsBlocked(const std::string& key,
+                                std::chrono::steady_clock::time_point now) const
+{
+  std::map<std::string, LOCATION>::const_iterator location(locations_.find(key));
+  return location != locations_.end() && location->second.blockedUntil > now;
+}
+
+double BaseUrlSelector::GetLatency(const std::string& key) const
+{
+  std::map<std::string, LOCATION>::const_iterator location(locations_.find(key));
+  return location != locations_.end() ? location->second.latency : 0.0;
+}
+
+bool BaseUrlSelector::IsBlocked(const BaseUrl& baseUrl) const
+{
+  std::lock_guard<std::mutex> lck(mutex_);
+  return IsBlocked(GetKey(baseUrl), std::chrono::steady_clock::now());
+}
+
+size_t BaseUrlSelector::Select(const std::vector<BaseUrl>& baseUrls)
+{
+  if (baseUrls.size() < 2)
+    return 0;
+
+  std::lock_guard<std::mutex> lck(mutex_);
+  const std::chrono::steady_clock::time_point now(std::chrono::steady_clock::now());
+
+  //Best priority of the available locations, all blocked: the one blocked shortest
+  std::vector<size_t> candidates;
+  for (size_t i(0); i < baseUrls.size(); ++i)
+    if (!IsBlocked(GetKey(baseUrls[i]), now))
+    {
+      if (!candidates.empty() && baseUrls[i].priority < baseUrls[candidates[0]].priority)
+        candidates.clear();
+      if (candidates.empty() || baseUrls[i].priority == baseUrls[candidates[0]].priority)
+        candidates.push_back(i);
+    }
+  if (candidates.empty())
+  {
+    size_t best(0);
+    for (size_t i(1); i < baseUrls.size(); ++i)
+      if (locations_[GetKey(baseUrls[i])].blockedUntil <
+          locations_[GetKey(baseUrls[best])].blockedUntil)
+        best = i;
+    return best;
+  }
+
+  //Stay with the current location unless an alternate is known to be much faster
+  double bestLatency(0.0);
+  for (size_t candidate : candidates)
+  {
+    double latency(GetLatency(GetKey(baseUrls[candidate])));
+    if (latency > 0.0 && (bestLatency == 0.0 || latency < bestLatency))
+      bestLatency = latency;
+  }
+  for (size_t candidate : candidates)
+    if (GetKey(baseUrls[candidate]) == current_)
+    {
+      double latency(GetLatency(current_));
+      if (latency <= bestLatency * LATENCY_FACTOR)
+        return candidate;
+      candidates.erase(std::find(candidates.begin(), candidates.end(), candidate));
+      break;
+    }
+
+  //Load balancing by weight
+  uint64_t totalWeight(0);
+  for (size_t candidate : candidates)
+    totalWeight += std::max<uint32_t>(baseUrls[candidate].weight, 1);
+  uint64_t pick(std::uniform_int_distribution<uint64_t>(0, totalWeight - 1)(random_));
+  for (size_t candidate : candidates)
+  {
+    uint64_t weight(std::max<uint32_t>(baseUrls[candidate].weight, 1));
+    if (pick < weight)
+    {
+      current_ = GetKey(baseUrls[candidate]);
+      return candidate;
+    }
+    pick -= weight;
+  }
+  return candidates.back();
+}
+
+void BaseUrlSelector::AddResult(const BaseUrl& baseUrl, bool success, double timeToFirstByte)
+{
+  std::lock_guard<std::mutex> lck(mutex_);
+  const std::string key(GetKey(baseUrl));
+  LOCATION& location(locations_[key]);
+
+  if (success)
+  {
+    location.errors = 0;
+    location.latency = location.latency > 0.0 ? location.latency * (1.0 - LATENCY_ALPHA) +
+                                                    timeToFirstByte * LATENCY_ALPHA
+                                              : timeToFirstByte;
+    return;
+  }
+
+  double blockSeconds(BLOCK_SECONDS);
+  for (unsigned int i(0); i < location.errors && blockSeconds < MAX_BLOCK_SECONDS; ++i)
+    blockSeconds *= 2;
+  ++location.errors;
+  location.blockedUntil =
+      std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(std::min(blockSeconds, MAX_BLOCK_SECONDS)));
+  if (current_ == key)
+    current_.clear();
+}
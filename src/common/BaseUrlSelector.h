@@ -0,0 +1,78 @@
+/*
+*      Copyright (C) 2016-2016 peak3d
+*      http://www.peak3d.de
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <kodi/AddonBase.h>
+
+namespace adaptive
+{
+  // One location of the content (DASH BaseURL), alternates serve the same segments
+  struct BaseUrl
+  {
+    std::string url;
+    std::string serviceLocation;
+    // DVB-DASH: lower priority values are preferred, weight balances within a priority
+    uint32_t priority = 1;
+    uint32_t weight = 1;
+  };
+
+  // Picks the location segments are loaded from. Locations are identified by their
+  // serviceLocation (or host) and scored across all streams: errors block a location
+  // for a while, a location much slower than an alternate of the same priority is left.
+  class ATTRIBUTE_HIDDEN BaseUrlSelector
+  {
+  public:
+    BaseUrlSelector(uint32_t seed = std::random_device()());
+
+    // Index into baseUrls, baseUrls must not be empty
+    size_t Select(const std::vector<BaseUrl>& baseUrls);
+    // timeToFirstByte in seconds, only used if success
+    void AddResult(const BaseUrl& baseUrl, bool success, double timeToFirstByte);
+    bool IsBlocked(const BaseUrl& baseUrl) const;
+
+    static std::string GetKey(const BaseUrl& baseUrl);
+
+  private:
+    struct LOCATION
+    {
+      unsigned int errors = 0;
+      std::chrono::steady_clock::time_point blockedUntil;
+      // time to first byte, exponentially weighted (seconds), 0 if unknown
+      double latency = 0.0;
+    };
+    bool IsBlocked(const std::string& key, std::chrono::steady_clock::time_point now) const;
+    double GetLatency(const std::string& key) const;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, LOCATION> locations_;
+    // Location used last, the selection stays with it while it performs
+    std::string current_;
+    std::mt19937 random_;
+  };
+}
@@ -0,0 +1,79 @@
+/*
+*      Copyright (C) 2016-2016 peak3d
+*      http://www.peak3d.de
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include "RepresentationChooser.h"
+
+#include <algorithm>
+#include <math.h>
+
+using namespace adaptive;
+
+size_t RepresentationChooser::ChooseByThroughput(const std::vector<uint32_t>& bitrates,
+                                                 double throughput)
+{
+  size_t index(0);
+  while (index + 1 < bitrates.size() && bitrates[index + 1] <= throughput)
+    ++index;
+  return index;
+}
+
+size_t RepresentationChooser::Choose(const std::vector<uint32_t>& bitrates,
+                                     size_t current,
+                                     double bufferLevel,
+                                     double bufferTarget,
+                                     double segmentDuration,
+                                     double throughput) const
+{
+  if (bitrates.size() < 2)
+    return 0;
+
+  const size_t throughputIndex(ChooseByThroughput(bitrates, throughput));
+
+  //BOLA needs at least one segment in the buffer and room for more
+  const double minimumBuffer(segmentDuration);
+  if (segmentDuration <= 0.0 || bufferTarget <= minimumBuffer || bufferLevel < minimumBuffer)
+    return throughputIndex;
+
+  //Utility ln(bitrate) with 1 for the lowest one. gp / Vp are chosen so that the
+  //lowest bitrate wins at minimumBuffer and the highest one near bufferTarget
+  const double utilityMax(log(static_cast<double>(bitrates.back()) / bitrates[0]) + 1.0);
+  const double gp((utilityMax - 1.0) / (bufferTarget / minimumBuffer - 1.0));
+  const double vp(minimumBuffer / gp);
+
+  size_t bolaIndex(0);
+  double bestScore(0.0);
+  for (size_t i(0); i < bitrates.size(); ++i)
+  {
+    double utility(log(static_cast<double>(bitrates[i]) / bitrates[0]) + 1.0);
+    double score((vp * (utility + gp) - bufferLevel) / bitrates[i]);
+    if (!i || score >= bestScore)
+    {
+      bestScore = score;
+      bolaIndex = i;
+    }
+  }
+
+  //Don't switch up beyond the throughput, but don't leave a higher bitrate
+  //while the buffer still allows it either (avoids oscillation)
+  if (bolaIndex > throughputIndex)
+    bolaIndex = current > throughputIndex ? std::min(current, bolaIndex) : throughputIndex;
+  //Keep the current bitrate as long as the throughput sustains it
+  else if (bolaIndex < current && current <= throughputIndex)
+    bolaIndex = current;
+  return bolaIndex;
+}
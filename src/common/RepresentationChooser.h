@@ -0,0 +1,46 @@
+/*
+*      Copyright (C) 2016-2016 peak3d
+*      http://www.peak3d.de
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <kodi/AddonBase.h>
+
+namespace adaptive
+{
+  // Picks the bitrate for the next segment from the buffer level (BOLA) and the
+  // measured throughput. The throughput rule is used while the buffer is low.
+  class ATTRIBUTE_HIDDEN RepresentationChooser
+  {
+  public:
+    // bitrates: bit/s in ascending order, current: index of the bitrate loaded last
+    // bufferLevel: seconds downloaded ahead, bufferTarget: seconds the look-ahead holds at most
+    // throughput: bit/s available for this stream
+    size_t Choose(const std::vector<uint32_t>& bitrates,
+                  size_t current,
+                  double bufferLevel,
+                  double bufferTarget,
+                  double segmentDuration,
+                  double throughput) const;
+
+    static size_t ChooseByThroughput(const std::vector<uint32_t>& bitrates, double throughput);
+  };
+}
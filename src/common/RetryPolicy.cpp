@@ -0,0 +1,56 @@
+/*
+*      Copyright (C) 2016-2016 peak3d
+*      http://www.peak3d.de
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+#include "RetryPolicy.h"
+
+#include <algorithm>
+
+using namespace adaptive;
+
+RetryPolicy::RetryPolicy() : RetryPolicy(SETTINGS())
+{
+}
+
+RetryPolicy::RetryPolicy(const SETTINGS& settings, uint32_t seed)
+  : settings_(settings), random_(seed)
+{
+}
+
+double RetryPolicy::GetDelay(unsigned int failedAttempts)
+{
+  double backoff(settings_.initialDelay);
+  for (unsigned int i(1); i < failedAttempts && backoff < settings_.maxDelay; ++i)
+    backoff *= 2;
+  backoff = std::min(backoff, settings_.maxDelay);
+
+  std::uniform_real_distribution<double> jitter(0.5, 1.0);
+  return backoff * jitter(random_);
+}
+
+bool RetryPolicy::Retry(unsigned int failedAttempts, double elapsed) const
+{
+  return failedAttempts <= settings_.maxRetries && elapsed < settings_.maxTime;
+}
+
+bool RetryPolicy::Failover(unsigned int failedAttempts, double elapsed, double bufferLevel) const
+{
+  //The reader runs dry when the retries take longer than the buffered media lasts
+  return failedAttempts >= settings_.failoverAttempts ||
+         elapsed >= std::max(settings_.minDeadline, bufferLevel);
+}
@@ -0,0 +1,64 @@
+/*
+*      Copyright (C) 2016-2016 peak3d
+*      http://www.peak3d.de
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+#include <kodi/AddonBase.h>
+
+namespace adaptive
+{
+  // Decides how failed segment downloads are repeated: exponential backoff with
+  // jitter, and when to give the segment a chance from another source instead
+  class ATTRIBUTE_HIDDEN RetryPolicy
+  {
+  public:
+    struct SETTINGS
+    {
+      unsigned int maxRetries = 10;
+      // Delay before the first retry, doubled with every further retry up to maxDelay (seconds)
+      double initialDelay = 0.5;
+      double maxDelay = 4.0;
+      // Retries stop after this many seconds since the first request
+      double maxTime = 10.0;
+      // Fail over after this many failed attempts or when the deadline has passed
+      unsigned int failoverAttempts = 2;
+      // Lower bound of the deadline, the buffer level extends it (seconds)
+      double minDeadline = 3.0;
+    };
+
+    RetryPolicy();
+    RetryPolicy(const SETTINGS& settings, uint32_t seed = std::random_device()());
+
+    // Seconds to wait before the next attempt after failedAttempts failures (>= 1).
+    // Randomized between half and the full backoff so that streams don't retry in lockstep.
+    double GetDelay(unsigned int failedAttempts);
+    // elapsed: seconds since the first request of the segment
+    bool Retry(unsigned int failedAttempts, double elapsed) const;
+    // bufferLevel: seconds of media downloaded ahead of the failing segment
+    bool Failover(unsigned int failedAttempts, double elapsed, double bufferLevel) const;
+    const SETTINGS& GetSettings() const { return settings_; };
+
+  private:
+    SETTINGS settings_;
+    std::mt19937 random_;
+  };
+}
@@ -0,0 +1,106 @@
+/*
+*      Copyright (C) 2016-2016 peak3d
+*      http://www.peak3d.de
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+#include "StreamMetrics.h"
+
+#include <stdio.h>
+
+using namespace adaptive;
+
+StreamMetrics::StreamMetrics(size_t capacity)
+  : capacity_(capacity ? capacity : 1), next_(0)
+{
+}
+
+void StreamMetrics::AddSegment(const SEGMENT& segment)
+{
+  std::lock_guard<std::mutex> lck(mutex_);
+
+  if (segments_.size() < capacity_)
+    segments_.push_back(segment);
+  else
+    segments_[next_] = segment;
+  next_ = (next_ + 1) % capacity_;
+
+  ++counters_.segments;
+  if (segment.failed)
+    ++counters_.failedSegments;
+  counters_.retries += segment.retries;
+  counters_.bytes += segment.bytes;
+  counters_.downloadTime += segment.downloadTime;
+  if (segment.stallTime > 0.0)
+  {
+    ++counters_.stalls;
+    counters_.stallTime += segment.stallTime;
+  }
+}
+
+std::vector<StreamMetrics::SEGMENT> StreamMetrics::GetSegments() const
+{
+  std::lock_guard<std::mutex> lck(mutex_);
+
+  if (segments_.size() < capacity_)
+    return segments_;
+
+  std::vector<SEGMENT> segments(segments_.begin() + next_, segments_.end());
+  segments.insert(segments.end(), segments_.begin(), segments_.begin() + next_);
+  return segments;
+}
+
+StreamMetrics::COUNTERS StreamMetrics::GetCounters() const
+{
+  std::lock_guard<std::mutex> lck(mutex_);
+  return counters_;
+}
+
+void StreamMetrics::Clear()
+{
+  std::lock_guard<std::mutex> lck(mutex_);
+  segments_.clear();
+  next_ = 0;
+  counters_ = COUNTERS();
+}
+
+std::string StreamMetrics::Format(const SEGMENT& segment)
+{
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "%s #%u%s: %llu bytes, ttfb %.0f ms, download %.0f ms, %.0f kbit/s, retries %u, "
+           "stall %.0f ms%s",
+           segment.representation.c_str(), segment.segmentNumber,
+           segment.initialization ? " (init)" : "",
+           static_cast<unsigned long long>(segment.bytes), segment.timeToFirstByte * 1000,
+           segment.downloadTime * 1000, segment.throughput / 1000, segment.retries,
+           segment.stallTime * 1000, segment.failed ? ", failed" : "");
+  return buf;
+}
+
+std::string StreamMetrics::Format(const COUNTERS& counters)
+{
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "%llu segments (%llu failed), %llu bytes, download %.1f s, retries %llu, "
+           "%llu stalls %.1f s",
+           static_cast<unsigned long long>(counters.segments),
+           static_cast<unsigned long long>(counters.failedSegments),
+           static_cast<unsigned long long>(counters.bytes), counters.downloadTime,
+           static_cast<unsigned long long>(counters.retries),
+           static_cast<unsigned long long>(counters.stalls), counters.stallTime);
+  return buf;
+}
@@ -0,0 +1,80 @@
+/*
+*      Copyright (C) 2016-2016 peak3d
+*      http://www.peak3d.de
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <kodi/AddonBase.h>
+
+namespace adaptive
+{
+  // Timing of the last segment downloads of a stream (ring buffer) and totals since start
+  class ATTRIBUTE_HIDDEN StreamMetrics
+  {
+  public:
+    struct SEGMENT
+    {
+      std::string representation;
+      uint32_t segmentNumber = 0;
+      bool initialization = false;
+      bool failed = false;
+      unsigned int retries = 0;
+      uint64_t bytes = 0;
+      // request -> first byte, request -> last byte of the last attempt (seconds)
+      double timeToFirstByte = 0.0;
+      double downloadTime = 0.0;
+      // bit/s measured after the first chunk, 0 if too small to measure
+      double throughput = 0.0;
+      // time the reader waited for this segment (seconds)
+      double stallTime = 0.0;
+    };
+
+    struct COUNTERS
+    {
+      uint64_t segments = 0;
+      uint64_t failedSegments = 0;
+      uint64_t retries = 0;
+      uint64_t bytes = 0;
+      uint64_t stalls = 0;
+      double downloadTime = 0.0;
+      double stallTime = 0.0;
+    };
+
+    StreamMetrics(size_t capacity = 64);
+
+    void AddSegment(const SEGMENT& segment);
+    // Oldest first
+    std::vector<SEGMENT> GetSegments() const;
+    COUNTERS GetCounters() const;
+    void Clear();
+
+    static std::string Format(const SEGMENT& segment);
+    static std::string Format(const COUNTERS& counters);
+
+  private:
+    mutable std::mutex mutex_;
+    std::vector<SEGMENT> segments_;
+    size_t capacity_, next_;
+    COUNTERS counters_;
+  };
+}
@@ -0,0 +1,110 @@
+/*
+*      Copyright (C) 2016-2016 peak3d
+*      http://www.peak3d.de
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+#include "StringArena.h"
+
+#include <cstring>
+#include <new>
+
+using namespace adaptive;
+
+// Each string is preceded by the address of its chunk
+struct StringArena::Chunk
+{
+  // Unreleased strings, +1 while the chunk is the current one of an arena
+  std::atomic<uint32_t> strings;
+  size_t used, size;
+
+  char* data() { return reinterpret_cast<char*>(this + 1); };
+};
+
+std::atomic<uint32_t> StringArena::chunkCount_(0);
+
+static size_t Align(size_t pos)
+{
+  return (pos + alignof(void*) - 1) & ~(alignof(void*) - 1);
+}
+
+StringArena::StringArena(size_t chunkSize) : chunkSize_(chunkSize), current_(nullptr)
+{
+}
+
+StringArena::~StringArena()
+{
+  if (current_)
+    ReleaseChunk(current_);
+}
+
+StringArena::Chunk* StringArena::NewChunk(size_t size, uint32_t strings)
+{
+  Chunk* chunk(static_cast<Chunk*>(::operator new(sizeof(Chunk) + size)));
+  new (&chunk->strings) std::atomic<uint32_t>(strings);
+  chunk->used = 0;
+  chunk->size = size;
+  ++chunkCount_;
+  return chunk;
+}
+
+void StringArena::ReleaseChunk(Chunk* chunk)
+{
+  if (--chunk->strings == 0)
+  {
+    --chunkCount_;
+    ::operator delete(chunk);
+  }
+}
+
+char* StringArena::Allocate(size_t size)
+{
+  const size_t needed(sizeof(Chunk*) + size);
+  // Large strings get a chunk of their own, the current one is kept
+  if (needed > chunkSize_ / 4)
+  {
+    Chunk* chunk(NewChunk(needed, 1));
+    *reinterpret_cast<Chunk**>(chunk->data()) = chunk;
+    return chunk->data() + sizeof(Chunk*);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!current_ || Align(current_->used) + needed > current_->size)
+  {
+    if (current_)
+      ReleaseChunk(current_);
+    current_ = NewChunk(chunkSize_, 1);
+  }
+  char* pos(current_->data() + Align(current_->used));
+  *reinterpret_cast<Chunk**>(pos) = current_;
+  current_->used = pos - current_->data() + needed;
+  ++current_->strings;
+  return pos + sizeof(Chunk*);
+}
+
+const char* StringArena::Store(const char* str, size_t size)
+{
+  char* dst(Allocate(size + 1));
+  memcpy(dst, str, size);
+  dst[size] = 0;
+  return dst;
+}
+
+void StringArena::Release(const char* str)
+{
+  if (str)
+    ReleaseChunk(*reinterpret_cast<Chunk* const*>(str - sizeof(Chunk*)));
+}
@@ -0,0 +1,65 @@
+/*
+*      Copyright (C) 2016-2016 peak3d
+*      http://www.peak3d.de
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include <kodi/AddonBase.h>
+
+namespace adaptive
+{
+  // Storage of segment urls: the strings are placed one after another in large chunks
+  // instead of being allocated one by one. A chunk is freed when all its strings are
+  // released, strings may outlive their arena (e.g. segments moved into another tree).
+  class ATTRIBUTE_HIDDEN StringArena
+  {
+  public:
+    static const size_t DEFAULT_CHUNK_SIZE = 32 * 1024;
+
+    explicit StringArena(size_t chunkSize = DEFAULT_CHUNK_SIZE);
+    ~StringArena();
+
+    // Room for size chars (terminator included), valid until passed to Release. Thread safe.
+    char* Allocate(size_t size);
+    // Zero terminated copy of the first size chars of str
+    const char* Store(const char* str, size_t size);
+    // Releases a string of any arena, nullptr is ignored. Thread safe.
+    static void Release(const char* str);
+
+    // Chunks not freed yet, of all arenas
+    static uint32_t GetChunkCount() { return chunkCount_; };
+
+  private:
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    struct Chunk;
+    static Chunk* NewChunk(size_t size, uint32_t strings);
+    static void ReleaseChunk(Chunk* chunk);
+
+    size_t chunkSize_;
+    std::mutex mutex_;
+    Chunk* current_;
+    static std::atomic<uint32_t> chunkCount_;
+  };
+}
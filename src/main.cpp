@@ -20,6 +20,7 @@
 
 #include "ADTSReader.h"
 #include "Ap4Utils.h"
+#include "Istream_view.h"
 #include "TSReader.h"
 #include "WebmReader.h"
 #include "aes_decrypter.h"
@@ -209,7 +210,7 @@ private:
 Bento4 Streams
 ********************************************************/
 
-class ATTRIBUTE_HIDDEN AP4_DASHStream : public AP4_ByteStream
+class ATTRIBUTE_HIDDEN AP4_DASHStream : public AP4_ByteStream, public IStreamView
 {
 public:
   // Constructor
@@ -238,6 +239,8 @@ public:
     return AP4_SUCCESS;
   };
   AP4_Result GetSize(AP4_LargeSize& size) override { return AP4_ERROR_NOT_SUPPORTED; };
+  // IStreamView methods
+  const AP4_Byte* BorrowData(AP4_Size size) override { return stream_->borrow(size); };
   AP4_Result GetSegmentSize(AP4_LargeSize& size)
   {
     return stream_->getSize(size) ? AP4_SUCCESS : AP4_ERROR_EOS;
@@ -311,7 +314,8 @@ bool adaptive::AdaptiveTree::download(const char* url,
 }
 
 bool KodiAdaptiveStream::download(const char* url,
-                                  const std::map<std::string, std::string>& mediaHeaders)
+                                  const std::map<std::string, std::string>& mediaHeaders,
+                                  void* opaque)
 {
   kodi::vfs::CFile file;
 
@@ -320,7 +324,11 @@ bool KodiAdaptiveStream::download(const char* url,
     return false;
   file.CURLAddOption(ADDON_CURL_OPTION_PROTOCOL, "seekable", "0");
   file.CURLAddOption(ADDON_CURL_OPTION_PROTOCOL, "acceptencoding", "gzip, deflate");
-  if (mediaHeaders.find("connection") == mediaHeaders.end())
+  // Header names are case insensitive, a user supplied one replaces ours
+  if (std::none_of(mediaHeaders.begin(), mediaHeaders.end(),
+                   [](const std::pair<const std::string, std::string>& header) {
+                     return stricmp(header.first.c_str(), "connection") == 0;
+                   }))
     file.CURLAddOption(ADDON_CURL_OPTION_HEADER, "connection", "keep-alive");
   file.CURLAddOption(ADDON_CURL_OPTION_PROTOCOL, "failonerror", "false");
 
@@ -346,10 +354,26 @@ bool KodiAdaptiveStream::download(const char* url,
     }
     else
     {
+      // Only a partial response contains the requested range, others the whole file
+      const bool rangeRequest(mediaHeaders.find("Range") != mediaHeaders.end());
+      if (rangeRequest && returnCode != 206 &&
+          file.GetPropertyValue(ADDON_FILE_PROPERTY_RESPONSE_HEADER, "content-range").empty())
+      {
+        kodi::Log(ADDON_LOG_DEBUG, "Range request answered with the whole file (%d): %s",
+                  returnCode, url);
+        if (!range_ignored(opaque))
+          return false;
+      }
+
+      // Range responses may report the size of the whole file
+      int64_t length = file.GetLength();
+      if (length > 0 && !rangeRequest)
+        reserve_data(static_cast<size_t>(length), opaque);
+
       // read the file
       char* buf = (char*)malloc(32 * 1024);
       size_t nbReadOverall = 0;
-      while ((nbRead = file.Read(buf, 32 * 1024)) > 0 && ~nbRead && write_data(buf, nbRead))
+      while ((nbRead = file.Read(buf, 32 * 1024)) > 0 && ~nbRead && write_data(buf, nbRead, opaque))
         nbReadOverall += nbRead;
       free(buf);
 
@@ -359,20 +383,10 @@ bool KodiAdaptiveStream::download(const char* url,
         return false;
       }
 
-      double current_download_speed_ = file.GetFileDownloadSpeed();
-      //Calculate the new downloadspeed to 1MB
-      static const size_t ref_packet = 1024 * 1024;
-      if (nbReadOverall >= ref_packet)
-        set_download_speed(current_download_speed_);
-      else
-      {
-        double ratio = (double)nbReadOverall / ref_packet;
-        set_download_speed((get_download_speed() * (1.0 - ratio)) +
-                           current_download_speed_ * ratio);
-      }
+      // The throughput is measured while the data arrives, see write_data
       kodi::Log(ADDON_LOG_DEBUG,
                 "Download finished: %s , avg speed: %0.2lfbyte/s, current speed: %0.2lfbyte/s", url,
-                get_download_speed(), current_download_speed_);
+                GetTree().get_average_download_speed(), file.GetFileDownloadSpeed());
     }
     file.Close();
     return nbRead == 0;
@@ -405,18 +419,18 @@ bool KodiAdaptiveStream::parseIndexRange()
       rep->timescale_ = 1000;
       rep->SetScaling();
 
-      rep->segments_.data.reserve(cuepoints.size());
-      adp->segment_durations_.data.reserve(cuepoints.size());
+      rep->segments_.data().reserve(cuepoints.size());
+      adp->segment_durations_.data().reserve(cuepoints.size());
 
       for (const WebmReader::CUEPOINT& cue : cuepoints)
       {
         seg.startPTS_ = cue.pts;
         seg.range_begin_ = cue.pos_start;
         seg.range_end_ = cue.pos_end;
-        rep->segments_.data.push_back(seg);
+        rep->segments_.data().push_back(seg);
 
-        if (adp->segment_durations_.data.size() < rep->segments_.data.size())
-          adp->segment_durations_.data.push_back(static_cast<const uint32_t>(cue.duration));
+        if (adp->segment_durations_.data().size() < rep->segments_.data().size())
+          adp->segment_durations_.data().push_back(static_cast<const uint32_t>(cue.duration));
       }
       return true;
     }
@@ -485,9 +499,9 @@ bool KodiAdaptiveStream::parseIndexRange()
       {
         seg.range_begin_ = seg.range_end_ + 1;
         seg.range_end_ = seg.range_begin_ + refs[i].m_ReferencedSize - 1;
-        rep->segments_.data.push_back(seg);
-        if (adp->segment_durations_.data.size() < rep->segments_.data.size())
-          adp->segment_durations_.data.push_back(refs[i].m_SubsegmentDuration);
+        rep->segments_.data().push_back(seg);
+        if (adp->segment_durations_.data().size() < rep->segments_.data().size())
+          adp->segment_durations_.data().push_back(refs[i].m_SubsegmentDuration);
         seg.startPTS_ += refs[i].m_SubsegmentDuration;
       }
       delete atom;
@@ -1020,6 +1034,8 @@ public:
   virtual const AP4_Byte* GetSampleData() const = 0;
   virtual uint64_t GetDuration() const = 0;
   virtual bool IsEncrypted() const = 0;
+  virtual bool GetSamplePacketInfo(AP4_Size& size, unsigned int& numSubSamples) { return false; };
+  virtual bool ReadSamplePacket(DEMUX_PACKET* packet) { return false; };
   virtual void AddStreamType(INPUTSTREAM_TYPE type, uint32_t sid){};
   virtual void SetStreamType(INPUTSTREAM_TYPE type, uint32_t sid){};
   virtual bool RemoveStreamType(INPUTSTREAM_TYPE type) { return true; };
@@ -1071,11 +1087,14 @@ public:
                          const SSD::SSD_DECRYPTER::SSD_CAPS& dcaps)
     : AP4_LinearReader(*movie, input),
       m_track(track),
+      m_descTrack(track),
+      m_switchedMovie(nullptr),
       m_streamId(streamId),
       m_sampleDescIndex(1),
       m_bSampleDescChanged(false),
       m_decrypterCaps(dcaps),
       m_failCount(0),
+      m_securePending(false),
       m_eos(false),
       m_started(false),
       m_dts(0),
@@ -1137,6 +1156,7 @@ public:
     if (m_singleSampleDecryptor)
       m_singleSampleDecryptor->RemovePool(m_poolId);
     delete m_decrypter;
+    delete m_switchedMovie;
     delete m_codecHandler;
   }
 
@@ -1153,6 +1173,7 @@ public:
   AP4_Result ReadSample() override
   {
     AP4_Result result;
+    m_securePending = false;
     if (!m_codecHandler || !m_codecHandler->ReadNextSample(m_sample, m_sampleData))
     {
       bool useDecryptingDecoder =
@@ -1183,7 +1204,12 @@ public:
       else if (decrypterPresent && m_decrypter == nullptr && !useDecryptingDecoder)
         m_sampleData.SetData(m_encrypted.GetData(), m_encrypted.GetDataSize());
 
-      if (m_decrypter)
+      if (m_decrypter && IsEncrypted())
+      {
+        // Decrypted in ReadSamplePacket straight into the demux packet
+        m_securePending = true;
+      }
+      else if (m_decrypter)
       {
         // Make sure that the decrypter is NOT allocating memory!
         // If decrypter and addon are compiled with different DEBUG / RELEASE
@@ -1211,7 +1237,8 @@ public:
                                                    nullptr, nullptr);
       }
 
-      if (m_codecHandler->Transform(m_sample.GetDts(), m_sample.GetDuration(), m_sampleData,
+      if (!m_securePending &&
+          m_codecHandler->Transform(m_sample.GetDts(), m_sample.GetDuration(), m_sampleData,
                                     m_track->GetMediaTimeScale()))
         m_codecHandler->ReadNextSample(m_sample, m_sampleData);
     }
@@ -1219,11 +1246,53 @@ public:
     m_dts = (m_sample.GetDts() * m_timeBaseExt) / m_timeBaseInt;
     m_pts = (m_sample.GetCts() * m_timeBaseExt) / m_timeBaseInt;
 
-    m_codecHandler->UpdatePPSId(m_sampleData);
+    m_codecHandler->UpdatePPSId(m_securePending ? m_encrypted : m_sampleData);
 
     return AP4_SUCCESS;
   };
 
+  bool GetSamplePacketInfo(AP4_Size& size, unsigned int& numSubSamples) override
+  {
+    if (!m_securePending)
+      return false;
+    // Room for annexb start codes and injected SPS / PPS
+    size = m_encrypted.GetDataSize() + 4096;
+    numSubSamples = m_decrypter->GetSubsampleCount();
+    return true;
+  }
+
+  bool ReadSamplePacket(DEMUX_PACKET* packet) override
+  {
+    if (!m_securePending)
+      return false;
+    m_securePending = false;
+
+    AP4_DataBuffer packetData;
+    packetData.SetBuffer(packet->pData, packet->iSize);
+
+    AP4_CencSecureSampleInfo sampleInfo;
+    sampleInfo.subsample_count = 0;
+    sampleInfo.bytes_of_cleartext_data = packet->cryptoInfo->clearBytes;
+    sampleInfo.bytes_of_encrypted_data = packet->cryptoInfo->cipherBytes;
+
+    if (AP4_FAILED(m_decrypter->DecryptSecureSampleData(m_poolId, m_encrypted, packetData,
+                                                        sampleInfo)))
+    {
+      kodi::Log(ADDON_LOG_ERROR, "Decrypt Sample returns failure!");
+      if (++m_failCount > 50)
+        Reset(true);
+      return false;
+    }
+    m_failCount = 0;
+
+    packet->iSize = packetData.GetDataSize();
+    packet->cryptoInfo->numSubSamples = sampleInfo.subsample_count;
+    packet->cryptoInfo->flags = 0;
+    memcpy(packet->cryptoInfo->iv, sampleInfo.iv, 16);
+    memcpy(packet->cryptoInfo->kid, sampleInfo.kid, 16);
+    return true;
+  }
+
   void Reset(bool bEOS) override
   {
     AP4_LinearReader::Reset();
@@ -1263,7 +1332,7 @@ public:
       edchanged = true;
     }
 
-    AP4_SampleDescription* desc(m_track->GetSampleDescription(0));
+    AP4_SampleDescription* desc(m_descTrack->GetSampleDescription(0));
     if (desc->GetType() == AP4_SampleDescription::TYPE_MPEG)
     {
       switch (static_cast<AP4_MpegSampleDescription*>(desc)->GetObjectTypeId())
@@ -1434,6 +1503,25 @@ protected:
     return AP4_SUCCESS;
   }
 
+  //A representation switch inserts the initialization segment of the new representation
+  AP4_Result ProcessMoov(AP4_MoovAtom* moov) override
+  {
+    AP4_Movie* movie(new AP4_Movie(moov, *m_FragmentStream));
+    AP4_Track* track(movie->GetTrack(m_track->GetType()));
+    if (!track || track->GetId() != m_track->GetId())
+    {
+      delete movie;
+      return AP4_SUCCESS;
+    }
+    m_descTrack = track;
+    m_sampleDescIndex = 1;
+    UpdateSampleDescription();
+
+    delete m_switchedMovie;
+    m_switchedMovie = movie;
+    return AP4_SUCCESS;
+  }
+
 private:
   void UpdateSampleDescription()
   {
@@ -1442,7 +1530,7 @@ private:
     m_codecHandler = 0;
     m_bSampleDescChanged = true;
 
-    AP4_SampleDescription* desc(m_track->GetSampleDescription(m_sampleDescIndex - 1));
+    AP4_SampleDescription* desc(m_descTrack->GetSampleDescription(m_sampleDescIndex - 1));
     if (desc->GetType() == AP4_SampleDescription::TYPE_PROTECTED)
     {
       m_protectedDesc = static_cast<AP4_ProtectedSampleDescription*>(desc);
@@ -1486,11 +1574,15 @@ private:
 
 private:
   AP4_Track* m_track;
+  //Track of the last initialization segment, differs from m_track after a representation switch
+  AP4_Track* m_descTrack;
+  AP4_Movie* m_switchedMovie;
   AP4_UI32 m_streamId;
   AP4_UI32 m_sampleDescIndex;
   bool m_bSampleDescChanged;
   SSD::SSD_DECRYPTER::SSD_CAPS m_decrypterCaps;
   unsigned int m_failCount;
+  bool m_securePending;
   AP4_UI32 m_poolId;
 
   bool m_eos, m_started;
@@ -1530,6 +1622,7 @@ public:
 
     file.CURLAddOption(ADDON_CURL_OPTION_PROTOCOL, "seekable", "0");
     file.CURLAddOption(ADDON_CURL_OPTION_PROTOCOL, "acceptencoding", "gzip");
+
     file.CURLOpen(ADDON_READ_CHUNKED | ADDON_READ_NO_CACHE);
 
     AP4_DataBuffer result;
@@ -2021,6 +2114,9 @@ Session::Session(MANIFEST_TYPE manifestType,
     default:;
   };
 
+  adaptiveTree_->SetBandwidthEstimator(adaptive::BandwidthEstimator::Create(
+      static_cast<adaptive::BandwidthEstimator::Type>(kodi::GetSettingInt("BANDWIDTHESTIMATOR"))));
+
   std::string fn(profile_path_ + "bandwidth.bin");
   FILE* f = fopen(fn.c_str(), "rb");
   if (f)
@@ -2035,9 +2131,16 @@ Session::Session(MANIFEST_TYPE manifestType,
     fclose(f);
   }
   else
+  {
     adaptiveTree_->bandwidth_ = 4000000;
+    adaptiveTree_->set_download_speed(adaptiveTree_->bandwidth_ / 8);
+  }
   kodi::Log(ADDON_LOG_DEBUG, "Initial bandwidth: %u ", adaptiveTree_->bandwidth_);
 
+  adaptiveTree_->live_latency_ = kodi::GetSettingInt("LIVELATENCY") * 1000;
+  if (adaptiveTree_->live_latency_)
+    kodi::Log(ADDON_LOG_DEBUG, "Low latency live target: %u ms", adaptiveTree_->live_latency_);
+
   max_resolution_ = kodi::GetSettingInt("MAXRESOLUTION");
   kodi::Log(ADDON_LOG_DEBUG, "MAXRESOLUTION selected: %d ", max_resolution_);
 
@@ -2069,6 +2172,22 @@ Session::Session(MANIFEST_TYPE manifestType,
 
   ignore_display_ = kodi::GetSettingBoolean("IGNOREDISPLAY");
 
+  look_ahead_segments_ = kodi::GetSettingInt("LOOKAHEADSEGMENTS");
+  look_ahead_seconds_ = kodi::GetSettingInt("LOOKAHEADSECONDS");
+  kodi::Log(ADDON_LOG_DEBUG, "Segment look-ahead: %u segments, %u seconds", look_ahead_segments_,
+            look_ahead_seconds_);
+
+  download_workers_ = kodi::GetSettingInt("DOWNLOADWORKERS");
+  segment_buffer_memory_ = kodi::GetSettingInt("SEGMENTBUFFERMEMORY");
+  kodi::Log(ADDON_LOG_DEBUG, "Segment downloads: %u parallel, buffer limit %u MB", download_workers_,
+            segment_buffer_memory_);
+
+  range_split_size_ = kodi::GetSettingInt("RANGESPLITSIZE");
+  if (range_split_size_)
+    kodi::Log(ADDON_LOG_DEBUG, "Split byte range segments larger than %u MB", range_split_size_);
+
+  segment_metrics_ = kodi::GetSettingInt("SEGMENTMETRICS");
+
   if (!strCert.empty())
   {
     unsigned int sz(strCert.length()), dstsz((sz * 3) / 4);
@@ -2082,6 +2201,7 @@ Session::Session(MANIFEST_TYPE manifestType,
 Session::~Session()
 {
   kodi::Log(ADDON_LOG_DEBUG, "Session::~Session()");
+  DumpMetrics();
   for (std::vector<STREAM*>::iterator b(streams_.begin()), e(streams_.end()); b != e; ++b)
     SAFE_DELETE(*b);
   streams_.clear();
@@ -2100,6 +2220,47 @@ Session::~Session()
   adaptiveTree_ = nullptr;
 }
 
+void Session::DumpMetrics()
+{
+  if (!segment_metrics_)
+    return;
+
+  FILE* f(nullptr);
+  if (segment_metrics_ == 2)
+  {
+    std::string fn(profile_path_ + "segment_metrics.log");
+    if (!(f = fopen(fn.c_str(), "a")))
+    {
+      kodi::Log(ADDON_LOG_ERROR, "Unable to open %s", fn.c_str());
+      return;
+    }
+    fprintf(f, "%s\n", manifestURL_.c_str());
+  }
+
+  for (const STREAM* stream : streams_)
+  {
+    const adaptive::StreamMetrics& metrics(stream->stream_.GetMetrics());
+    adaptive::StreamMetrics::COUNTERS counters(metrics.GetCounters());
+    if (!counters.segments)
+      continue;
+
+    std::vector<std::string> lines;
+    lines.push_back("Stream " + std::to_string(stream->info_.GetPhysicalIndex()) + " (" +
+                    stream->info_.GetName() + "): " + adaptive::StreamMetrics::Format(counters));
+    for (const adaptive::StreamMetrics::SEGMENT& segment : metrics.GetSegments())
+      lines.push_back("  " + adaptive::StreamMetrics::Format(segment));
+
+    for (const std::string& line : lines)
+      if (f)
+        fprintf(f, "%s\n", line.c_str());
+      else
+        kodi::Log(ADDON_LOG_INFO, "%s", line.c_str());
+  }
+
+  if (f)
+    fclose(f);
+}
+
 void Session::GetSupportedDecrypterURN(std::string& key_system)
 {
   typedef SSD::SSD_DECRYPTER* (*CreateDecryptorInstanceFunc)(SSD::SSD_HOST * host,
@@ -2580,6 +2741,11 @@ bool Session::InitializePeriod()
 
       stream.stream_.prepare_stream(adp, GetVideoWidth(), GetVideoHeight(), hdcpLimit, hdcpVersion,
                                     min_bandwidth, max_bandwidth, repId, media_headers_);
+      stream.stream_.SetLookAhead(look_ahead_segments_, look_ahead_seconds_);
+      stream.stream_.SetDownloadWorkers(download_workers_,
+                                        static_cast<size_t>(segment_buffer_memory_) * 1024 * 1024);
+      stream.stream_.SetRangeSplitSize(static_cast<size_t>(range_split_size_) * 1024 * 1024);
+      stream.stream_.SetAdaptiveSwitching(adp->type_ == adaptive::AdaptiveTree::VIDEO && !repId);
       uint32_t flags = INPUTSTREAM_FLAG_NONE;
       size_t copySize = adp->name_.size() > 255 ? 255 : adp->name_.size();
       stream.info_.SetName(adp->name_);
@@ -2624,6 +2790,23 @@ bool Session::InitializePeriod()
 
     } while (repId-- != (manual_streams ? 1 : 0));
   }
+
+  // Kodi opens the selected streams one by one, download the initialization data
+  // of the default video / audio stream in parallel before OpenStream needs it
+  for (INPUTSTREAM_TYPE type : {INPUTSTREAM_TYPE_VIDEO, INPUTSTREAM_TYPE_AUDIO})
+  {
+    STREAM* prefetchStream(nullptr);
+    for (STREAM* stream : streams_)
+    {
+      if (stream->info_.GetStreamType() != type)
+        continue;
+      if (!prefetchStream || (!(prefetchStream->info_.GetFlags() & INPUTSTREAM_FLAG_DEFAULT) &&
+                              (stream->info_.GetFlags() & INPUTSTREAM_FLAG_DEFAULT)))
+        prefetchStream = stream;
+    }
+    if (prefetchStream)
+      prefetchStream->stream_.PrefetchInitialization();
+  }
   return true;
 }
 
@@ -3017,6 +3200,16 @@ void Session::OnSegmentChanged(adaptive::AdaptiveStream* stream)
 
 void Session::OnStreamChange(adaptive::AdaptiveStream* stream)
 {
+  for (STREAM* s : streams_)
+    if (&s->stream_ == stream)
+    {
+      if (s->reader_)
+      {
+        UpdateStream(*s, GetDecrypterCaps(stream->getRepresentation()->pssh_set_));
+        changed_ = true;
+      }
+      break;
+    }
 }
 
 void Session::CheckFragmentDuration(STREAM& stream)
@@ -3747,28 +3940,43 @@ DEMUX_PACKET* CInputStreamAdaptive::DemuxRead(void)
 
   if (sr)
   {
-    AP4_Size iSize(sr->GetSampleDataSize());
-    const AP4_UI08* pData(sr->GetSampleData());
+    AP4_Size iSize;
+    unsigned int numSubSamples;
+    const AP4_UI08* pData(nullptr);
     DEMUX_PACKET* p;
 
-    if (iSize && pData && sr->IsEncrypted())
+    if (sr->GetSamplePacketInfo(iSize, numSubSamples))
     {
-      unsigned int numSubSamples(*((unsigned int*)pData));
-      pData += sizeof(numSubSamples);
+      // The reader fills packet data and crypto info without intermediate copy
       p = AllocateEncryptedDemuxPacket(iSize, numSubSamples);
-      memcpy(p->cryptoInfo->clearBytes, pData, numSubSamples * sizeof(uint16_t));
-      pData += (numSubSamples * sizeof(uint16_t));
-      memcpy(p->cryptoInfo->cipherBytes, pData, numSubSamples * sizeof(uint32_t));
-      pData += (numSubSamples * sizeof(uint32_t));
-      memcpy(p->cryptoInfo->iv, pData, 16);
-      pData += 16;
-      memcpy(p->cryptoInfo->kid, pData, 16);
-      pData += 16;
-      iSize -= (pData - sr->GetSampleData());
-      p->cryptoInfo->flags = 0;
+      p->iSize = iSize;
+      if (!sr->ReadSamplePacket(p))
+        p->iSize = 0;
+      iSize = p->iSize;
     }
     else
-      p = AllocateDemuxPacket(iSize);
+    {
+      iSize = sr->GetSampleDataSize();
+      pData = sr->GetSampleData();
+      if (iSize && pData && sr->IsEncrypted())
+      {
+        numSubSamples = *((unsigned int*)pData);
+        pData += sizeof(numSubSamples);
+        p = AllocateEncryptedDemuxPacket(iSize, numSubSamples);
+        memcpy(p->cryptoInfo->clearBytes, pData, numSubSamples * sizeof(uint16_t));
+        pData += (numSubSamples * sizeof(uint16_t));
+        memcpy(p->cryptoInfo->cipherBytes, pData, numSubSamples * sizeof(uint32_t));
+        pData += (numSubSamples * sizeof(uint32_t));
+        memcpy(p->cryptoInfo->iv, pData, 16);
+        pData += 16;
+        memcpy(p->cryptoInfo->kid, pData, 16);
+        pData += 16;
+        iSize -= (pData - sr->GetSampleData());
+        p->cryptoInfo->flags = 0;
+      }
+      else
+        p = AllocateDemuxPacket(iSize);
+    }
 
     if (iSize)
     {
@@ -3778,7 +3986,8 @@ DEMUX_PACKET* CInputStreamAdaptive::DemuxRead(void)
       p->iStreamId = sr->GetStreamId();
       p->iGroupId = 0;
       p->iSize = iSize;
-      memcpy(p->pData, pData, iSize);
+      if (pData)
+        memcpy(p->pData, pData, iSize);
     }
 
     //kodi::Log(ADDON_LOG_DEBUG, "DTS: %0.4f, PTS:%0.4f, ID: %u SZ: %d", p->dts, p->pts, p->iStreamId, p->iSize);
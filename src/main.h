@@ -65,7 +65,7 @@ public:
   KodiAdaptiveStream(adaptive::AdaptiveTree &tree, adaptive::AdaptiveTree::StreamType type)
     :adaptive::AdaptiveStream(tree, type){};
 protected:
-  virtual bool download(const char* url, const std::map<std::string, std::string> &mediaHeaders) override;
+  virtual bool download(const char* url, const std::map<std::string, std::string> &mediaHeaders, void *opaque) override;
   virtual bool parseIndexRange() override;
 };
 
@@ -169,6 +169,7 @@ public:
 
 protected:
   void CheckFragmentDuration(STREAM &stream);
+  void DumpMetrics();
   void GetSupportedDecrypterURN(std::string &key_system);
   void DisposeSampleDecrypter();
   void DisposeDecrypter();
@@ -203,6 +204,9 @@ private:
   int max_resolution_, max_secure_resolution_;
   uint32_t fixed_bandwidth_;
   uint32_t maxUserBandwidth_;
+  uint32_t look_ahead_segments_, look_ahead_seconds_;
+  uint32_t download_workers_, segment_buffer_memory_, range_split_size_;
+  int segment_metrics_;
   bool changed_;
   int manual_streams_;
   uint64_t elapsed_time_, chapter_start_time_; // In STREAM_TIME_BASE
@@ -23,6 +23,7 @@
 #include "../oscompat.h"
 #include "PRProtectionParser.h"
 
+#include <algorithm>
 #include <cstring>
 #include <float.h>
 #include <string>
@@ -52,7 +53,216 @@ enum
   MPDNODE_PLAYREADYWRMHEADER = 1 << 16
 };
 
-static const char* CONTENTPROTECTION_TAG = "ContentProtection";
+// Elements and attributes the parser handles, every name is looked up once
+enum MPDElement
+{
+  MPDELEMENT_UNKNOWN,
+  MPDELEMENT_ADAPTATIONSET,
+  MPDELEMENT_AUDIOCHANNELCONFIGURATION,
+  MPDELEMENT_BASEURL,
+  MPDELEMENT_CONTENTCOMPONENT,
+  MPDELEMENT_CONTENTPROTECTION,
+  MPDELEMENT_INITIALIZATION,
+  MPDELEMENT_LATENCY,
+  MPDELEMENT_LOCATION,
+  MPDELEMENT_MPD,
+  MPDELEMENT_MSPR_PRO,
+  MPDELEMENT_PERIOD,
+  MPDELEMENT_REPRESENTATION,
+  MPDELEMENT_ROLE,
+  MPDELEMENT_S,
+  MPDELEMENT_SEGMENTBASE,
+  MPDELEMENT_SEGMENTDURATIONS,
+  MPDELEMENT_SEGMENTLIST,
+  MPDELEMENT_SEGMENTTEMPLATE,
+  MPDELEMENT_SEGMENTTIMELINE,
+  MPDELEMENT_SEGMENTURL,
+  MPDELEMENT_WIDEVINE_LICENSE
+};
+
+enum MPDAttribute
+{
+  MPDATTRIBUTE_UNKNOWN,
+  MPDATTRIBUTE_AUDIOSAMPLINGRATE,
+  MPDATTRIBUTE_AUDIOTRACKID,
+  MPDATTRIBUTE_AVAILABILITYSTARTTIME,
+  MPDATTRIBUTE_AVAILABILITYTIMEOFFSET,
+  MPDATTRIBUTE_BANDWIDTH,
+  MPDATTRIBUTE_CODECPRIVATEDATA,
+  MPDATTRIBUTE_CODECS,
+  MPDATTRIBUTE_CONTENTTYPE,
+  MPDATTRIBUTE_D,
+  MPDATTRIBUTE_DEFAULT,
+  MPDATTRIBUTE_DURATION,
+  MPDATTRIBUTE_DVB_PRIORITY,
+  MPDATTRIBUTE_DVB_WEIGHT,
+  MPDATTRIBUTE_FORCED,
+  MPDATTRIBUTE_FRAMERATE,
+  MPDATTRIBUTE_GROUP,
+  MPDATTRIBUTE_HDCP,
+  MPDATTRIBUTE_HEIGHT,
+  MPDATTRIBUTE_ID,
+  MPDATTRIBUTE_IMPAIRED,
+  MPDATTRIBUTE_INDEXRANGE,
+  MPDATTRIBUTE_INDEXRANGEEXACT,
+  MPDATTRIBUTE_INITIALIZATION,
+  MPDATTRIBUTE_LANG,
+  MPDATTRIBUTE_MEDIA,
+  MPDATTRIBUTE_MEDIAPRESENTATIONDURATION,
+  MPDATTRIBUTE_MEDIARANGE,
+  MPDATTRIBUTE_MIMETYPE,
+  MPDATTRIBUTE_MINIMUMUPDATEPERIOD,
+  MPDATTRIBUTE_NAME,
+  MPDATTRIBUTE_ORIGINAL,
+  MPDATTRIBUTE_PAR,
+  MPDATTRIBUTE_PRESENTATIONTIMEOFFSET,
+  MPDATTRIBUTE_R,
+  MPDATTRIBUTE_RANGE,
+  MPDATTRIBUTE_ROBUSTNESS_LEVEL,
+  MPDATTRIBUTE_SCHEMEIDURI,
+  MPDATTRIBUTE_SERVICELOCATION,
+  MPDATTRIBUTE_SOURCEURL,
+  MPDATTRIBUTE_START,
+  MPDATTRIBUTE_STARTNUMBER,
+  MPDATTRIBUTE_T,
+  MPDATTRIBUTE_TARGET,
+  MPDATTRIBUTE_TIMESCALE,
+  MPDATTRIBUTE_TIMESHIFTBUFFERDEPTH,
+  MPDATTRIBUTE_TYPE,
+  MPDATTRIBUTE_VALUE,
+  MPDATTRIBUTE_WIDTH
+};
+
+// Open addressing hash table from names to ids, filled once at startup.
+// A lookup hashes the name and usually compares it with a single entry.
+template<typename ID, unsigned int BITS>
+class NameTable
+{
+public:
+  struct Name
+  {
+    const char* name;
+    ID id;
+  };
+
+  template<size_t N>
+  NameTable(const Name (&names)[N])
+  {
+    static_assert(N * 2 <= SIZE, "NameTable too small");
+    for (const Name& name : names)
+    {
+      uint32_t slot(Hash(name.name));
+      while (slots_[slot & (SIZE - 1)].name)
+        ++slot;
+      slots_[slot & (SIZE - 1)] = name;
+    }
+  }
+
+  ID Get(const char* name) const
+  {
+    for (uint32_t slot(Hash(name));; ++slot)
+    {
+      const Name& entry(slots_[slot & (SIZE - 1)]);
+      if (!entry.name)
+        return ID();
+      if (strcmp(entry.name, name) == 0)
+        return entry.id;
+    }
+  }
+
+private:
+  static const uint32_t SIZE = 1U << BITS;
+
+  // FNV-1a
+  static uint32_t Hash(const char* name)
+  {
+    uint32_t hash(2166136261U);
+    for (; *name; ++name)
+      hash = (hash ^ static_cast<uint8_t>(*name)) * 16777619U;
+    return hash;
+  }
+
+  Name slots_[SIZE] = {};
+};
+
+typedef NameTable<MPDElement, 6> MPDElementTable;
+typedef NameTable<MPDAttribute, 7> MPDAttributeTable;
+
+static const MPDElementTable::Name ELEMENT_NAMES[] = {
+    {"AdaptationSet", MPDELEMENT_ADAPTATIONSET},
+    {"AudioChannelConfiguration", MPDELEMENT_AUDIOCHANNELCONFIGURATION},
+    {"BaseURL", MPDELEMENT_BASEURL},
+    {"ContentComponent", MPDELEMENT_CONTENTCOMPONENT},
+    {"ContentProtection", MPDELEMENT_CONTENTPROTECTION},
+    {"Initialization", MPDELEMENT_INITIALIZATION},
+    {"Latency", MPDELEMENT_LATENCY},
+    {"Location", MPDELEMENT_LOCATION},
+    {"MPD", MPDELEMENT_MPD},
+    {"mspr:pro", MPDELEMENT_MSPR_PRO},
+    {"Period", MPDELEMENT_PERIOD},
+    {"Representation", MPDELEMENT_REPRESENTATION},
+    {"Role", MPDELEMENT_ROLE},
+    {"S", MPDELEMENT_S},
+    {"SegmentBase", MPDELEMENT_SEGMENTBASE},
+    {"SegmentDurations", MPDELEMENT_SEGMENTDURATIONS},
+    {"SegmentList", MPDELEMENT_SEGMENTLIST},
+    {"SegmentTemplate", MPDELEMENT_SEGMENTTEMPLATE},
+    {"SegmentTimeline", MPDELEMENT_SEGMENTTIMELINE},
+    {"SegmentURL", MPDELEMENT_SEGMENTURL},
+    {"widevine:license", MPDELEMENT_WIDEVINE_LICENSE}};
+
+static const MPDAttributeTable::Name ATTRIBUTE_NAMES[] = {
+    {"audioSamplingRate", MPDATTRIBUTE_AUDIOSAMPLINGRATE},
+    {"audioTrackId", MPDATTRIBUTE_AUDIOTRACKID},
+    {"availabilityStartTime", MPDATTRIBUTE_AVAILABILITYSTARTTIME},
+    {"availabilityTimeOffset", MPDATTRIBUTE_AVAILABILITYTIMEOFFSET},
+    {"bandwidth", MPDATTRIBUTE_BANDWIDTH},
+    {"codecPrivateData", MPDATTRIBUTE_CODECPRIVATEDATA},
+    {"codecs", MPDATTRIBUTE_CODECS},
+    {"contentType", MPDATTRIBUTE_CONTENTTYPE},
+    {"d", MPDATTRIBUTE_D},
+    {"default", MPDATTRIBUTE_DEFAULT},
+    {"duration", MPDATTRIBUTE_DURATION},
+    {"dvb:priority", MPDATTRIBUTE_DVB_PRIORITY},
+    {"dvb:weight", MPDATTRIBUTE_DVB_WEIGHT},
+    {"forced", MPDATTRIBUTE_FORCED},
+    {"frameRate", MPDATTRIBUTE_FRAMERATE},
+    {"group", MPDATTRIBUTE_GROUP},
+    {"hdcp", MPDATTRIBUTE_HDCP},
+    {"height", MPDATTRIBUTE_HEIGHT},
+    {"id", MPDATTRIBUTE_ID},
+    {"impaired", MPDATTRIBUTE_IMPAIRED},
+    {"indexRange", MPDATTRIBUTE_INDEXRANGE},
+    {"indexRangeExact", MPDATTRIBUTE_INDEXRANGEEXACT},
+    {"initialization", MPDATTRIBUTE_INITIALIZATION},
+    {"lang", MPDATTRIBUTE_LANG},
+    {"media", MPDATTRIBUTE_MEDIA},
+    {"mediaPresentationDuration", MPDATTRIBUTE_MEDIAPRESENTATIONDURATION},
+    {"mediaRange", MPDATTRIBUTE_MEDIARANGE},
+    {"mimeType", MPDATTRIBUTE_MIMETYPE},
+    {"minimumUpdatePeriod", MPDATTRIBUTE_MINIMUMUPDATEPERIOD},
+    {"name", MPDATTRIBUTE_NAME},
+    {"original", MPDATTRIBUTE_ORIGINAL},
+    {"par", MPDATTRIBUTE_PAR},
+    {"presentationTimeOffset", MPDATTRIBUTE_PRESENTATIONTIMEOFFSET},
+    {"r", MPDATTRIBUTE_R},
+    {"range", MPDATTRIBUTE_RANGE},
+    {"robustness_level", MPDATTRIBUTE_ROBUSTNESS_LEVEL},
+    {"schemeIdUri", MPDATTRIBUTE_SCHEMEIDURI},
+    {"serviceLocation", MPDATTRIBUTE_SERVICELOCATION},
+    {"sourceURL", MPDATTRIBUTE_SOURCEURL},
+    {"start", MPDATTRIBUTE_START},
+    {"startNumber", MPDATTRIBUTE_STARTNUMBER},
+    {"t", MPDATTRIBUTE_T},
+    {"target", MPDATTRIBUTE_TARGET},
+    {"timescale", MPDATTRIBUTE_TIMESCALE},
+    {"timeShiftBufferDepth", MPDATTRIBUTE_TIMESHIFTBUFFERDEPTH},
+    {"type", MPDATTRIBUTE_TYPE},
+    {"value", MPDATTRIBUTE_VALUE},
+    {"width", MPDATTRIBUTE_WIDTH}};
+
+static const MPDElementTable ELEMENTS(ELEMENT_NAMES);
+static const MPDAttributeTable ATTRIBUTES(ATTRIBUTE_NAMES);
 
 DASHTree::DASHTree()
 {
@@ -62,13 +272,19 @@ static uint8_t GetChannels(const char** attr)
 {
   const char *schemeIdUri(0), *value(0);
 
-  for (; *attr;)
+  for (; *attr; attr += 2)
   {
-    if (strcmp((const char*)*attr, "schemeIdUri") == 0)
-      schemeIdUri = (const char*)*(attr + 1);
-    else if (strcmp((const char*)*attr, "value") == 0)
-      value = (const char*)*(attr + 1);
-    attr += 2;
+    switch (ATTRIBUTES.Get(*attr))
+    {
+      case MPDATTRIBUTE_SCHEMEIDURI:
+        schemeIdUri = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_VALUE:
+        value = *(attr + 1);
+        break;
+      default:
+        break;
+    }
   }
   if (schemeIdUri && value)
   {
@@ -93,20 +309,40 @@ static unsigned int ParseSegmentTemplate(const char** attr,
                                          DASHTree::SegmentTemplate& tpl,
                                          unsigned int startNumber)
 {
-  for (; *attr;)
+  for (; *attr; attr += 2)
   {
-    if (strcmp((const char*)*attr, "timescale") == 0)
-      tpl.timescale = atoi((const char*)*(attr + 1));
-    else if (strcmp((const char*)*attr, "duration") == 0)
-      tpl.duration = atoi((const char*)*(attr + 1));
-    else if (strcmp((const char*)*attr, "media") == 0)
-      tpl.media = (const char*)*(attr + 1);
-    else if (strcmp((const char*)*attr, "startNumber") == 0)
-      startNumber = atoi((const char*)*(attr + 1));
-    else if (strcmp((const char*)*attr, "initialization") == 0)
-      tpl.initialization = (const char*)*(attr + 1);
-    attr += 2;
+    switch (ATTRIBUTES.Get(*attr))
+    {
+      case MPDATTRIBUTE_TIMESCALE:
+        tpl.timescale = atoi(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_DURATION:
+        tpl.duration = atoi(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_MEDIA:
+        tpl.media = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_STARTNUMBER:
+        startNumber = atoi(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_INITIALIZATION:
+        tpl.initialization = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_AVAILABILITYTIMEOFFSET:
+      {
+        // Segments with a negative offset are requested as if they had none
+        const double offset(atof(*(attr + 1)));
+        if (strcmp(*(attr + 1), "INF") == 0)
+          tpl.availabilityTimeOffset = ~0U;
+        else
+          tpl.availabilityTimeOffset = offset > 0 ? static_cast<unsigned int>(offset * 1000) : 0;
+        break;
+      }
+      default:
+        break;
+    }
   }
+  tpl.startNumber = startNumber;
 
   if (!tpl.timescale) // if not specified timescale defaults to seconds
     tpl.timescale = 1;
@@ -134,6 +370,13 @@ static unsigned int ParseSegmentTemplate(const char** attr,
   return startNumber;
 }
 
+// Time in ms templated segments can be requested before they are complete
+static uint64_t GetAvailabilityTimeOffset(const DASHTree::SegmentTemplate& tpl)
+{
+  return std::min<uint64_t>(tpl.availabilityTimeOffset,
+                            static_cast<uint64_t>(tpl.duration) * 1000 / tpl.timescale);
+}
+
 static time_t getTime(const char* timeStr)
 {
   int year, mon, day, hour, minu, sec;
@@ -195,18 +438,18 @@ bool ParseContentProtection(const char** attr, DASHTree* dash)
   dash->current_period_->encryptionState_ |= DASHTree::ENCRYTIONSTATE_ENCRYPTED;
   bool urnFound(false), mpdFound(false);
   const char* defaultKID(0);
-  for (; *attr;)
+  for (; *attr; attr += 2)
   {
-    if (strcmp((const char*)*attr, "schemeIdUri") == 0)
+    if (ATTRIBUTES.Get(*attr) == MPDATTRIBUTE_SCHEMEIDURI)
     {
-      if (strcmp((const char*)*(attr + 1), "urn:mpeg:dash:mp4protection:2011") == 0)
+      if (strcmp(*(attr + 1), "urn:mpeg:dash:mp4protection:2011") == 0)
         mpdFound = true;
       else
-        urnFound = stricmp(dash->supportedKeySystem_.c_str(), (const char*)*(attr + 1)) == 0;
+        urnFound = stricmp(dash->supportedKeySystem_.c_str(), *(attr + 1)) == 0;
     }
-    else if (endswith((const char*)*attr, "default_KID"))
-      defaultKID = (const char*)*(attr + 1);
-    attr += 2;
+    // The namespace prefix of default_KID varies
+    else if (endswith(*attr, "default_KID"))
+      defaultKID = *(attr + 1);
   }
   if (urnFound)
   {
@@ -234,6 +477,66 @@ bool ParseContentProtection(const char** attr, DASHTree* dash)
 |   expat start
 +---------------------------------------------------------------------*/
 
+static void ParseBaseUrl(const char** attr, BaseUrl& baseUrl)
+{
+  baseUrl = BaseUrl();
+  for (; *attr; attr += 2)
+  {
+    switch (ATTRIBUTES.Get(*attr))
+    {
+      case MPDATTRIBUTE_SERVICELOCATION:
+        baseUrl.serviceLocation = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_DVB_PRIORITY:
+        baseUrl.priority = atoi(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_DVB_WEIGHT:
+        baseUrl.weight = atoi(*(attr + 1));
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+// Resolves the BaseURL in strXMLText_ against every alternate of the parent level.
+// Returns true for the first BaseURL of a level, it replaces the inherited alternates.
+static bool AddBaseUrl(DASHTree* dash,
+                       std::vector<BaseUrl>& baseUrls,
+                       const std::vector<BaseUrl>& parentUrls,
+                       const std::string& parentUrl)
+{
+  const bool first(++dash->base_url_count_ == 1);
+  if (first)
+    baseUrls.clear();
+
+  BaseUrl baseUrl(dash->current_base_url_);
+  if (dash->strXMLText_.compare(0, 1, "/") == 0 ||
+      dash->strXMLText_.compare(0, 7, "http://") == 0 ||
+      dash->strXMLText_.compare(0, 8, "https://") == 0)
+  {
+    baseUrl.url = dash->strXMLText_;
+    baseUrls.push_back(baseUrl);
+  }
+  else if (parentUrls.empty())
+  {
+    baseUrl.url = parentUrl + dash->strXMLText_;
+    baseUrls.push_back(baseUrl);
+  }
+  else
+  {
+    //A relative BaseURL is served by each location of its parent
+    for (const BaseUrl& parent : parentUrls)
+    {
+      baseUrls.push_back(parent);
+      baseUrls.back().url += dash->strXMLText_;
+      if (!baseUrl.serviceLocation.empty())
+        baseUrls.back().serviceLocation = baseUrl.serviceLocation;
+    }
+  }
+  return first;
+}
+
 static void ReplacePlaceHolders(std::string& rep, const std::string& id, uint32_t bandwidth)
 {
   std::string::size_type repPos = rep.find("$RepresentationID$");
@@ -249,830 +552,981 @@ static void ReplacePlaceHolders(std::string& rep, const std::string& id, uint32_
   }
 }
 
-static void XMLCALL start(void* data, const char* el, const char** attr)
+static void StartBaseUrl(DASHTree* dash, const char** attr)
 {
-  DASHTree* dash(reinterpret_cast<DASHTree*>(data));
+  ParseBaseUrl(attr, dash->current_base_url_);
+  dash->strXMLText_.clear();
+  dash->currentNode_ |= MPDNODE_BASEURL;
+}
 
-  if (dash->currentNode_ & MPDNODE_MPD)
+static DASHTree::StreamType GetContentType(const char* contentType)
+{
+  return stricmp(contentType, "video") == 0
+             ? DASHTree::VIDEO
+             : stricmp(contentType, "audio") == 0
+                   ? DASHTree::AUDIO
+                   : stricmp(contentType, "text") == 0 ? DASHTree::SUBTITLE : DASHTree::NOTYPE;
+}
+
+// Children of a supported ContentProtection
+static void StartContentProtectionChild(DASHTree* dash,
+                                        MPDElement element,
+                                        const char* el,
+                                        const char** attr)
+{
+  if (endswith(el, "pssh"))
+    dash->currentNode_ |= MPDNODE_PSSH;
+  else if (element == MPDELEMENT_WIDEVINE_LICENSE)
+  {
+    for (; *attr; attr += 2)
+      if (ATTRIBUTES.Get(*attr) == MPDATTRIBUTE_ROBUSTNESS_LEVEL)
+        dash->current_period_->need_secure_decoder_ = strncmp(*(attr + 1), "HW", 2) == 0;
+  }
+}
+
+// <S t="3600" d="900000" r="2398"/> of a Representation
+static void StartRepresentationTimelineS(DASHTree* dash, const char** attr)
+{
+  DASHTree::Representation* rep(dash->current_representation_);
+  DASHTree::UpdateTarget* target(dash->current_update_target_);
+  unsigned int d(0), r(1);
+
+  for (; *attr; attr += 2)
   {
-    if (dash->currentNode_ & MPDNODE_LOCATION)
+    switch (ATTRIBUTES.Get(*attr))
     {
+      case MPDATTRIBUTE_T:
+        dash->timeline_time_ = atoll(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_D:
+        d = atoi(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_R:
+        r = atoi(*(attr + 1)) + 1;
+        break;
+      default:
+        break;
     }
-    if (dash->currentNode_ & MPDNODE_PERIOD)
+  }
+  if (d && r)
+  {
+    DASHTree::Segment s;
+    if (rep->segments_.data().empty())
     {
-      if (dash->currentNode_ & MPDNODE_ADAPTIONSET)
+      uint64_t overallSeconds =
+          dash->current_period_->duration_
+              ? dash->current_period_->duration_ / dash->current_period_->timescale_
+              : dash->overallSeconds_;
+      if (rep->segtpl_.duration && rep->segtpl_.timescale && !target)
+        rep->segments_.data().reserve(
+            (unsigned int)((double)overallSeconds /
+                           (((double)rep->segtpl_.duration) / rep->segtpl_.timescale)) +
+            1);
+
+      if (rep->flags_ & DASHTree::Representation::INITIALIZATION)
       {
-        if (dash->currentNode_ & MPDNODE_REPRESENTATION)
-        {
-          if (dash->currentNode_ & MPDNODE_BASEURL)
-          {
-          }
-          else if (dash->currentNode_ & MPDNODE_SEGMENTLIST)
-          {
-            DASHTree::Segment seg;
-            seg.pssh_set_ = 0;
-            seg.range_begin_ = ~0ULL;
-            if (strcmp(el, "SegmentURL") == 0)
-            {
-              for (; *attr;)
-              {
-                if (strcmp((const char*)*attr, "mediaRange") == 0)
-                {
-                  seg.SetRange((const char*)*(attr + 1));
-                  break;
-                }
-                else if (strcmp((const char*)*attr, "media") == 0)
-                {
-                  dash->current_representation_->flags_ |= DASHTree::Representation::URLSEGMENTS;
-                  size_t sz(strlen((const char*)*(attr + 1)) + 1);
-                  seg.url = new char[sz];
-                  memcpy((char*)seg.url, (const char*)*(attr + 1), sz);
+        s.range_begin_ = 0ULL, s.range_end_ = 0;
+        rep->initialization_ = s;
+      }
+      s.range_end_ = rep->startNumber_ + (target ? target->skipped_ : 0);
+    }
+    else
+      s.range_end_ = rep->segments_.data().back().range_end_ + 1;
+    s.range_begin_ = s.startPTS_ = dash->timeline_time_;
+    s.startPTS_ -= dash->base_time_ * rep->segtpl_.timescale;
 
-                  if (dash->current_representation_->segments_.data.empty())
-                    seg.range_end_ = dash->current_representation_->startNumber_;
-                }
-                attr += 2;
-              }
+    for (; r; --r)
+    {
+      if (!target)
+        rep->segments_.data().push_back(s);
+      else
+      {
+        if (!~target->firstTime_)
+          target->firstTime_ = s.range_begin_;
+        if (s.range_begin_ > target->lastTime_)
+          rep->segments_.data().push_back(s);
+        else
+          ++target->skipped_;
+      }
+      ++s.range_end_;
+      s.range_begin_ = (dash->timeline_time_ += d);
+      s.startPTS_ += d;
+    }
+    rep->nextPts_ = s.startPTS_;
+  }
+  else //Failure
+  {
+    dash->currentNode_ &= ~MPDNODE_SEGMENTTIMELINE;
+    rep->timescale_ = 0;
+  }
+}
 
-              if (dash->current_representation_->segments_.data.empty())
-                seg.startPTS_ = dash->base_time_ + dash->current_representation_->ptsOffset_;
-              else
-                seg.startPTS_ = dash->current_representation_->nextPts_ +
-                                dash->current_representation_->duration_;
+// <S t="3600" d="900000" r="2398"/> of an AdaptationSet or Period, only durations are kept.
+// A non zero timescale reserves the durations of the whole period.
+static void StartTimelineDurationS(DASHTree* dash,
+                                   const char** attr,
+                                   SPINCACHE<uint32_t>& durations,
+                                   uint64_t& startPTS,
+                                   uint32_t reserveTimescale)
+{
+  unsigned int d(0), r(1);
+  uint64_t t(0);
+  for (; *attr; attr += 2)
+  {
+    switch (ATTRIBUTES.Get(*attr))
+    {
+      case MPDATTRIBUTE_T:
+        t = atoll(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_D:
+        d = atoi(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_R:
+        r = atoi(*(attr + 1)) + 1;
+        break;
+      default:
+        break;
+    }
+  }
+  if (durations.data().empty())
+  {
+    if (reserveTimescale && d)
+      durations.data().reserve(dash->estimate_segcount(d, reserveTimescale));
+    startPTS = dash->pts_helper_ = t;
+  }
+  else if (t)
+  {
+    //Go back to the previous timestamp to calculate the real gap.
+    dash->pts_helper_ -= durations.data().back();
+    durations.data().back() = static_cast<uint32_t>(t - dash->pts_helper_);
+    dash->pts_helper_ = t;
+  }
+  if (d && r)
+  {
+    for (; r; --r)
+    {
+      durations.data().push_back(d);
+      dash->pts_helper_ += d;
+    }
+  }
+}
 
-              dash->current_representation_->nextPts_ = seg.startPTS_;
-              dash->current_representation_->segments_.data.push_back(seg);
-            }
-            else if (strcmp(el, "Initialization") == 0)
-            {
-              for (; *attr;)
-              {
-                if (strcmp((const char*)*attr, "range") == 0)
-                {
-                  seg.SetRange((const char*)*(attr + 1));
-                  break;
-                }
-                else if (strcmp((const char*)*attr, "sourceURL") == 0)
-                {
-                  seg.range_begin_ = ~0ULL;
-                  size_t sz(strlen((const char*)*(attr + 1)) + 1);
-                  seg.url = new char[sz];
-                  memcpy(const_cast<char*>(seg.url), (const char*)*(attr + 1), sz);
-                  dash->current_representation_->flags_ |= DASHTree::Representation::URLSEGMENTS;
-                }
-                attr += 2;
-              }
-              dash->current_representation_->flags_ |= DASHTree::Representation::INITIALIZATION;
-              dash->current_representation_->initialization_ = seg;
-            }
-            else
-              return;
-          }
-          else if (dash->currentNode_ & MPDNODE_SEGMENTTEMPLATE)
-          {
-            if (dash->currentNode_ & MPDNODE_SEGMENTTIMELINE)
-            {
-              // <S t="3600" d="900000" r="2398"/>
-              unsigned int d(0), r(1);
+static void StartSegmentURL(DASHTree* dash, const char** attr)
+{
+  DASHTree::Representation* rep(dash->current_representation_);
+  DASHTree::Segment seg;
+  seg.pssh_set_ = 0;
+  seg.range_begin_ = ~0ULL;
 
-              for (; *attr;)
-              {
-                if (strcmp((const char*)*attr, "t") == 0)
-                  dash->timeline_time_ = atoll((const char*)*(attr + 1));
-                else if (strcmp((const char*)*attr, "d") == 0)
-                  d = atoi((const char*)*(attr + 1));
-                if (strcmp((const char*)*attr, "r") == 0)
-                  r = atoi((const char*)*(attr + 1)) + 1;
-                attr += 2;
-              }
-              if (d && r)
-              {
-                DASHTree::Segment s;
-                if (dash->current_representation_->segments_.data.empty())
-                {
-                  uint64_t overallSeconds =
-                      dash->current_period_->duration_
-                          ? dash->current_period_->duration_ / dash->current_period_->timescale_
-                          : dash->overallSeconds_;
-                  if (dash->current_representation_->segtpl_.duration &&
-                      dash->current_representation_->segtpl_.timescale)
-                    dash->current_representation_->segments_.data.reserve(
-                        (unsigned int)((double)overallSeconds /
-                                       (((double)dash->current_representation_->segtpl_.duration) /
-                                        dash->current_representation_->segtpl_.timescale)) +
-                        1);
+  for (; *attr; attr += 2)
+  {
+    const MPDAttribute name(ATTRIBUTES.Get(*attr));
+    if (name == MPDATTRIBUTE_MEDIARANGE)
+    {
+      seg.SetRange(*(attr + 1));
+      break;
+    }
+    else if (name == MPDATTRIBUTE_MEDIA)
+    {
+      rep->flags_ |= DASHTree::Representation::URLSEGMENTS;
+      seg.url = dash->url_arena_.Store(*(attr + 1), strlen(*(attr + 1)));
 
-                  if (dash->current_representation_->flags_ &
-                      DASHTree::Representation::INITIALIZATION)
-                  {
-                    s.range_begin_ = 0ULL, s.range_end_ = 0;
-                    dash->current_representation_->initialization_ = s;
-                  }
-                  s.range_end_ = dash->current_representation_->startNumber_;
-                }
-                else
-                  s.range_end_ =
-                      dash->current_representation_->segments_.data.back().range_end_ + 1;
-                s.range_begin_ = s.startPTS_ = dash->timeline_time_;
-                s.startPTS_ -= dash->base_time_ * dash->current_representation_->segtpl_.timescale;
+      if (rep->segments_.data().empty())
+        seg.range_end_ = rep->startNumber_;
+    }
+  }
 
-                for (; r; --r)
-                {
-                  dash->current_representation_->segments_.data.push_back(s);
-                  ++s.range_end_;
-                  s.range_begin_ = (dash->timeline_time_ += d);
-                  s.startPTS_ += d;
-                }
-                dash->current_representation_->nextPts_ = s.startPTS_;
-              }
-              else //Failure
-              {
-                dash->currentNode_ &= ~MPDNODE_SEGMENTTIMELINE;
-                dash->current_representation_->timescale_ = 0;
-              }
-            }
-            else if (strcmp(el, "SegmentTimeline") == 0)
-            {
-              dash->current_representation_->flags_ |= DASHTree::Representation::TIMELINE;
-              dash->currentNode_ |= MPDNODE_SEGMENTTIMELINE;
-            }
-          }
-          else if (dash->currentNode_ & MPDNODE_CONTENTPROTECTION)
-          {
-            if (endswith(el, "pssh"))
-              dash->currentNode_ |= MPDNODE_PSSH;
-            else if (strcmp(el, "widevine:license") == 0)
-            {
-              for (; *attr;)
-              {
-                if (strcmp((const char*)*attr, "robustness_level") == 0)
-                  dash->current_period_->need_secure_decoder_ =
-                      strncmp((const char*)*(attr + 1), "HW", 2) == 0;
-                attr += 2;
-              }
-            }
-          }
-          else if (strcmp(el, "AudioChannelConfiguration") == 0)
-          {
-            dash->current_representation_->channelCount_ = GetChannels(attr);
-          }
-          else if (strcmp(el, "BaseURL") == 0) //Inside Representation
-          {
-            dash->strXMLText_.clear();
-            dash->currentNode_ |= MPDNODE_BASEURL;
-          }
-          else if (strcmp(el, "SegmentList") == 0)
-          {
-            uint32_t dur(0), ts(1), pto(0), sn(0);
-            for (; *attr;)
-            {
-              if (strcmp((const char*)*attr, "duration") == 0)
-                dur = atoi((const char*)*(attr + 1));
-              else if (strcmp((const char*)*attr, "timescale") == 0)
-                ts = atoi((const char*)*(attr + 1));
-              else if (strcmp((const char*)*attr, "presentationTimeOffset") == 0)
-                pto = atoi((const char*)*(attr + 1));
-              else if (strcmp((const char*)*attr, "startNumber") == 0)
-                sn = atoi((const char*)*(attr + 1));
-              attr += 2;
-            }
-            if (sn)
-            {
-              dash->current_representation_->startNumber_ = sn;
-              pto += sn * dur;
-            }
-            if (pto)
-              dash->current_representation_->ptsOffset_ = pto;
-            if (ts && dur)
-            {
-              dash->current_representation_->duration_ = dur;
-              dash->current_representation_->timescale_ = ts;
-              dash->current_representation_->segments_.data.reserve(
-                  dash->estimate_segcount(dash->current_representation_->duration_,
-                                          dash->current_representation_->timescale_));
-            }
-            else if (dash->current_adaptationset_->segment_durations_.data.size())
-            {
-              dash->current_representation_->segments_.data.reserve(
-                  dash->current_adaptationset_->segment_durations_.data.size());
-            }
-            else
-              return;
-            dash->currentNode_ |= MPDNODE_SEGMENTLIST;
-          }
-          else if (strcmp(el, "SegmentBase") == 0)
-          {
-            //<SegmentBase indexRangeExact = "true" indexRange = "867-1618">
-            for (; *attr;)
-            {
-              if (strcmp((const char*)*attr, "indexRange") == 0)
-                sscanf((const char*)*(attr + 1), "%u-%u",
-                       &dash->current_representation_->indexRangeMin_,
-                       &dash->current_representation_->indexRangeMax_);
-              else if (strcmp((const char*)*attr, "indexRangeExact") == 0 &&
-                       strcmp((const char*)*(attr + 1), "true") == 0)
-                dash->current_representation_->flags_ |= DASHTree::Representation::INDEXRANGEEXACT;
-              dash->current_representation_->flags_ |= DASHTree::Representation::SEGMENTBASE;
-              attr += 2;
-            }
-            if (dash->current_representation_->indexRangeMax_)
-              dash->currentNode_ |= MPDNODE_SEGMENTLIST;
-          }
-          else if (strcmp(el, "SegmentTemplate") == 0)
-          {
-            dash->current_representation_->segtpl_ = dash->current_adaptationset_->segtpl_;
-
-            dash->current_representation_->startNumber_ = ParseSegmentTemplate(
-                attr, dash->current_representation_->base_url_, dash->base_domain_,
-                dash->current_representation_->segtpl_, dash->current_adaptationset_->startNumber_);
-            ReplacePlaceHolders(dash->current_representation_->segtpl_.media,
-                                dash->current_representation_->id,
-                                dash->current_representation_->bandwidth_);
-            dash->current_representation_->flags_ |= DASHTree::Representation::TEMPLATE;
-            if (!dash->current_representation_->segtpl_.initialization.empty())
-            {
-              ReplacePlaceHolders(dash->current_representation_->segtpl_.initialization,
-                                  dash->current_representation_->id,
-                                  dash->current_representation_->bandwidth_);
-              dash->current_representation_->flags_ |= DASHTree::Representation::INITIALIZATION;
-              dash->current_representation_->url_ =
-                  dash->current_representation_->segtpl_.initialization;
-              dash->current_representation_->timescale_ =
-                  dash->current_representation_->segtpl_.timescale;
-            }
-            dash->timeline_time_ = 0;
-            dash->currentNode_ |= MPDNODE_SEGMENTTEMPLATE;
-          }
-          else if (strcmp(el, CONTENTPROTECTION_TAG) == 0)
-          {
-            if (!dash->current_representation_->pssh_set_ ||
-                dash->current_representation_->pssh_set_ == 0xFF)
-            {
-              //Mark protected but invalid
-              dash->current_representation_->pssh_set_ = 0xFF;
-              if (ParseContentProtection(attr, dash))
-                dash->current_hasRepURN_ = true;
-            }
-          }
-        }
-        else if (dash->currentNode_ & (MPDNODE_SEGMENTTEMPLATE | MPDNODE_SEGMENTLIST))
-        {
-          if (dash->currentNode_ & MPDNODE_SEGMENTTIMELINE)
-          {
-            // <S t="3600" d="900000" r="2398"/>
-            unsigned int d(0), r(1);
-            uint64_t t(0);
-            for (; *attr;)
-            {
-              if (strcmp((const char*)*attr, "t") == 0)
-                t = atoll((const char*)*(attr + 1));
-              else if (strcmp((const char*)*attr, "d") == 0)
-                d = atoi((const char*)*(attr + 1));
-              if (strcmp((const char*)*attr, "r") == 0)
-                r = atoi((const char*)*(attr + 1)) + 1;
-              attr += 2;
-            }
-            if (dash->current_adaptationset_->segment_durations_.data.empty())
-              dash->current_adaptationset_->startPTS_ = dash->pts_helper_ = t;
-            else if (t)
-            {
-              //Go back to the previous timestamp to calculate the real gap.
-              dash->pts_helper_ -= dash->current_adaptationset_->segment_durations_.data.back();
-              dash->current_adaptationset_->segment_durations_.data.back() =
-                  static_cast<uint32_t>(t - dash->pts_helper_);
-              dash->pts_helper_ = t;
-            }
-            if (d && r)
-            {
-              for (; r; --r)
-              {
-                dash->current_adaptationset_->segment_durations_.data.push_back(d);
-                dash->pts_helper_ += d;
-              }
-            }
-          }
-          else if (strcmp(el, "SegmentTimeline") == 0)
-          {
-            dash->currentNode_ |= MPDNODE_SEGMENTTIMELINE;
-            dash->adp_timelined_ = true;
+  if (rep->segments_.data().empty())
+    seg.startPTS_ = dash->base_time_ + rep->ptsOffset_;
+  else
+    seg.startPTS_ = rep->nextPts_ + rep->duration_;
 
-            if (dash->update_parameter_.empty() && dash->has_timeshift_buffer_)
-              dash->update_parameter_ = "full";
-          }
-        }
-        else if (dash->currentNode_ & MPDNODE_SEGMENTDURATIONS)
-        {
-          if (strcmp(el, "S") == 0 && *(const char*)*attr == 'd')
-            dash->current_adaptationset_->segment_durations_.data.push_back(
-                atoi((const char*)*(attr + 1)));
-        }
-        else if (dash->currentNode_ & MPDNODE_CONTENTPROTECTION)
-        {
-          if (endswith(el, "pssh"))
-            dash->currentNode_ |= MPDNODE_PSSH;
-          else if (strcmp(el, "widevine:license") == 0)
-          {
-            for (; *attr;)
-            {
-              if (strcmp((const char*)*attr, "robustness_level") == 0)
-                dash->current_period_->need_secure_decoder_ =
-                    strncmp((const char*)*(attr + 1), "HW", 2) == 0;
-              attr += 2;
-            }
-          }
-        }
-        else if (strcmp(el, "ContentComponent") == 0)
-        {
-          for (; *attr;)
-          {
-            if (strcmp((const char*)*attr, "contentType") == 0)
-            {
-              dash->current_adaptationset_->type_ =
-                  stricmp((const char*)*(attr + 1), "video") == 0
-                      ? DASHTree::VIDEO
-                      : stricmp((const char*)*(attr + 1), "audio") == 0
-                            ? DASHTree::AUDIO
-                            : stricmp((const char*)*(attr + 1), "text") == 0 ? DASHTree::SUBTITLE
-                                                                             : DASHTree::NOTYPE;
-              break;
-            }
-            attr += 2;
-          }
-        }
-        else if (dash->currentNode_ & MPDNODE_BASEURL)
-        {
-        }
-        else if (strcmp(el, "SegmentTemplate") == 0)
-        {
-          dash->current_adaptationset_->startNumber_ = ParseSegmentTemplate(
-              attr, dash->current_adaptationset_->base_url_, dash->base_domain_,
-              dash->current_adaptationset_->segtpl_, dash->current_adaptationset_->startNumber_);
-          dash->current_adaptationset_->timescale_ =
-              dash->current_adaptationset_->segtpl_.timescale;
-          dash->currentNode_ |= MPDNODE_SEGMENTTEMPLATE;
-        }
-        else if (strcmp(el, "SegmentList") == 0)
-        {
-          for (; *attr;)
-          {
-            if (strcmp((const char*)*attr, "duration") == 0)
-              dash->current_adaptationset_->duration_ = atoi((const char*)*(attr + 1));
-            else if (strcmp((const char*)*attr, "timescale") == 0)
-              dash->current_adaptationset_->timescale_ = atoi((const char*)*(attr + 1));
-            attr += 2;
-          }
-          dash->currentNode_ |= MPDNODE_SEGMENTLIST;
-        }
-        else if (strcmp(el, "Role") == 0)
-        {
-          bool schemeOk = false;
-          const char* value = nullptr;
-          for (; *attr;)
-          {
-            if (strcmp((const char*)*attr, "schemeIdUri") == 0)
-            {
-              if (strcmp((const char*)*(attr + 1), "urn:mpeg:dash:role:2011") == 0)
-                schemeOk = true;
-            }
-            else if (strcmp((const char*)*attr, "value") == 0)
-              value = (const char*)*(attr + 1);
-            attr += 2;
-          }
-          if (schemeOk && value)
-          {
-            if (strcmp(value, "subtitle") == 0)
-              dash->current_adaptationset_->type_ = DASHTree::SUBTITLE;
-            //Legacy compatibility
-            if (strcmp(value, "forced") == 0)
-              dash->current_adaptationset_->forced_ = true;
-            if (strcmp(value, "main") == 0)
-              dash->current_adaptationset_->default_ = true;
-          }
-        }
-        else if (strcmp(el, "Representation") == 0)
-        {
-          dash->current_representation_ = new DASHTree::Representation();
-          dash->current_representation_->channelCount_ = dash->adpChannelCount_;
-          dash->current_representation_->codecs_ = dash->current_adaptationset_->codecs_;
-          dash->current_representation_->url_ = dash->current_adaptationset_->base_url_;
-          dash->current_representation_->timescale_ = dash->current_adaptationset_->timescale_;
-          dash->current_representation_->duration_ = dash->current_adaptationset_->duration_;
-          dash->current_representation_->startNumber_ = dash->current_adaptationset_->startNumber_;
-          dash->current_representation_->width_ = dash->adpwidth_;
-          dash->current_representation_->height_ = dash->adpheight_;
-          dash->current_representation_->fpsRate_ = dash->adpfpsRate_;
-          dash->current_representation_->fpsScale_ = dash->adpfpsScale_;
-          dash->current_representation_->aspect_ = dash->adpaspect_;
-          dash->current_representation_->containerType_ = dash->adpContainerType_;
-          dash->current_representation_->base_url_ = dash->current_adaptationset_->base_url_;
-          dash->current_adaptationset_->representations_.push_back(dash->current_representation_);
-
-          dash->current_pssh_.clear();
-          dash->current_hasRepURN_ = false;
-
-          for (; *attr;)
-          {
-            if (strcmp((const char*)*attr, "bandwidth") == 0)
-              dash->current_representation_->bandwidth_ = atoi((const char*)*(attr + 1));
-            else if (strcmp((const char*)*attr, "codecs") == 0)
-              dash->current_representation_->codecs_ = (const char*)*(attr + 1);
-            else if (strcmp((const char*)*attr, "width") == 0)
-              dash->current_representation_->width_ =
-                  static_cast<uint16_t>(atoi((const char*)*(attr + 1)));
-            else if (strcmp((const char*)*attr, "height") == 0)
-              dash->current_representation_->height_ =
-                  static_cast<uint16_t>(atoi((const char*)*(attr + 1)));
-            else if (strcmp((const char*)*attr, "audioSamplingRate") == 0)
-              dash->current_representation_->samplingRate_ =
-                  static_cast<uint32_t>(atoi((const char*)*(attr + 1)));
-            else if (strcmp((const char*)*attr, "frameRate") == 0)
-            {
-              dash->current_representation_->fpsScale_ = 1;
-              sscanf((const char*)*(attr + 1), "%" SCNu32 "/%" SCNu32,
-                     &dash->current_representation_->fpsRate_,
-                     &dash->current_representation_->fpsScale_);
-            }
-            else if (strcmp((const char*)*attr, "id") == 0)
-              dash->current_representation_->id = (const char*)*(attr + 1);
-            else if (strcmp((const char*)*attr, "codecPrivateData") == 0)
-              dash->current_representation_->codec_private_data_ =
-                  annexb_to_avc((const char*)*(attr + 1));
-            else if (strcmp((const char*)*attr, "hdcp") == 0)
-              dash->current_representation_->hdcpVersion_ =
-                  static_cast<uint16_t>(atof((const char*)*(attr + 1)) * 10);
-            else if (dash->current_adaptationset_->mimeType_.empty() &&
-                     strcmp((const char*)*attr, "mimeType") == 0)
-            {
-              dash->current_adaptationset_->mimeType_ = (const char*)*(attr + 1);
-              if (dash->current_adaptationset_->type_ == DASHTree::NOTYPE)
-              {
-                if (strncmp(dash->current_adaptationset_->mimeType_.c_str(), "video", 5) == 0)
-                  dash->current_adaptationset_->type_ = DASHTree::VIDEO;
-                else if (strncmp(dash->current_adaptationset_->mimeType_.c_str(), "audio", 5) == 0)
-                  dash->current_adaptationset_->type_ = DASHTree::AUDIO;
-                else if (strncmp(dash->current_adaptationset_->mimeType_.c_str(), "application",
-                                 11) == 0 ||
-                         strncmp(dash->current_adaptationset_->mimeType_.c_str(), "text", 4) == 0)
-                  dash->current_adaptationset_->type_ = DASHTree::SUBTITLE;
-              }
-              if (strstr(dash->current_adaptationset_->mimeType_.c_str(), "/webm"))
-                dash->current_representation_->containerType_ = AdaptiveTree::CONTAINERTYPE_WEBM;
-              else if (strstr(dash->current_adaptationset_->mimeType_.c_str(), "/x-matroska"))
-                dash->current_representation_->containerType_ =
-                    AdaptiveTree::CONTAINERTYPE_MATROSKA;
-            }
-            attr += 2;
-          }
+  rep->nextPts_ = seg.startPTS_;
+  rep->segments_.data().push_back(seg);
+}
 
-          if (dash->current_representation_->codecs_.empty())
-          {
-            if (dash->current_adaptationset_->mimeType_ == "text/vtt")
-              dash->current_representation_->codecs_ = "wvtt";
-            else if (dash->current_adaptationset_->mimeType_ == "application/ttml+xml")
-              dash->current_representation_->codecs_ = "ttml";
-          }
+static void StartInitialization(DASHTree* dash, const char** attr)
+{
+  DASHTree::Representation* rep(dash->current_representation_);
+  DASHTree::Segment seg;
+  seg.pssh_set_ = 0;
+  seg.range_begin_ = ~0ULL;
 
-          if (dash->current_adaptationset_->type_ != DASHTree::SUBTITLE)
-          {
-            if (dash->current_representation_->codecs_ == "wvtt")
-            {
-              dash->current_adaptationset_->type_ = DASHTree::SUBTITLE;
-              dash->current_adaptationset_->mimeType_ = "text/vtt";
-            }
-            else if (dash->current_representation_->codecs_ == "ttml")
-            {
-              dash->current_adaptationset_->type_ = DASHTree::SUBTITLE;
-              dash->current_adaptationset_->mimeType_ = "application/ttml+xml";
-            }
-          }
+  for (; *attr; attr += 2)
+  {
+    const MPDAttribute name(ATTRIBUTES.Get(*attr));
+    if (name == MPDATTRIBUTE_RANGE)
+    {
+      seg.SetRange(*(attr + 1));
+      break;
+    }
+    else if (name == MPDATTRIBUTE_SOURCEURL)
+    {
+      seg.range_begin_ = ~0ULL;
+      seg.url = dash->url_arena_.Store(*(attr + 1), strlen(*(attr + 1)));
+      rep->flags_ |= DASHTree::Representation::URLSEGMENTS;
+    }
+  }
+  rep->flags_ |= DASHTree::Representation::INITIALIZATION;
+  rep->initialization_ = seg;
+}
 
-          if (dash->current_adaptationset_->type_ == DASHTree::SUBTITLE &&
-              (dash->current_adaptationset_->mimeType_ == "application/ttml+xml" ||
-               dash->current_adaptationset_->mimeType_ == "text/vtt"))
-          {
-            if (dash->current_adaptationset_->segment_durations_.empty())
-              dash->current_representation_->flags_ |= DASHTree::Representation::SUBTITLESTREAM;
-            else
-              dash->current_representation_->containerType_ = AdaptiveTree::CONTAINERTYPE_TEXT;
-          }
+static void StartRepresentationSegmentList(DASHTree* dash, const char** attr)
+{
+  DASHTree::Representation* rep(dash->current_representation_);
+  uint32_t dur(0), ts(1), pto(0), sn(0);
+  for (; *attr; attr += 2)
+  {
+    switch (ATTRIBUTES.Get(*attr))
+    {
+      case MPDATTRIBUTE_DURATION:
+        dur = atoi(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_TIMESCALE:
+        ts = atoi(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_PRESENTATIONTIMEOFFSET:
+        pto = atoi(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_STARTNUMBER:
+        sn = atoi(*(attr + 1));
+        break;
+      default:
+        break;
+    }
+  }
+  if (sn)
+  {
+    rep->startNumber_ = sn;
+    pto += sn * dur;
+  }
+  if (pto)
+    rep->ptsOffset_ = pto;
+  if (ts && dur)
+  {
+    rep->duration_ = dur;
+    rep->timescale_ = ts;
+    rep->segments_.data().reserve(dash->estimate_segcount(rep->duration_, rep->timescale_));
+  }
+  else if (dash->current_adaptationset_->segment_durations_.data().size())
+  {
+    rep->segments_.data().reserve(dash->current_adaptationset_->segment_durations_.data().size());
+  }
+  else
+    return;
+  dash->currentNode_ |= MPDNODE_SEGMENTLIST;
+}
 
-          dash->current_representation_->segtpl_ = dash->current_adaptationset_->segtpl_;
-          if (!dash->current_adaptationset_->segtpl_.media.empty())
-          {
-            dash->current_representation_->flags_ |= DASHTree::Representation::TEMPLATE;
-            ReplacePlaceHolders(dash->current_representation_->segtpl_.media,
-                                dash->current_representation_->id,
-                                dash->current_representation_->bandwidth_);
+static void StartSegmentBase(DASHTree* dash, const char** attr)
+{
+  //<SegmentBase indexRangeExact = "true" indexRange = "867-1618">
+  DASHTree::Representation* rep(dash->current_representation_);
+  for (; *attr; attr += 2)
+  {
+    switch (ATTRIBUTES.Get(*attr))
+    {
+      case MPDATTRIBUTE_INDEXRANGE:
+        sscanf(*(attr + 1), "%u-%u", &rep->indexRangeMin_, &rep->indexRangeMax_);
+        break;
+      case MPDATTRIBUTE_INDEXRANGEEXACT:
+        if (strcmp(*(attr + 1), "true") == 0)
+          rep->flags_ |= DASHTree::Representation::INDEXRANGEEXACT;
+        break;
+      default:
+        break;
+    }
+    rep->flags_ |= DASHTree::Representation::SEGMENTBASE;
+  }
+  if (rep->indexRangeMax_)
+    dash->currentNode_ |= MPDNODE_SEGMENTLIST;
+}
 
-            if (!dash->current_representation_->segtpl_.initialization.empty())
-            {
-              dash->current_representation_->flags_ |= DASHTree::Representation::INITIALIZATION;
-              ReplacePlaceHolders(dash->current_representation_->segtpl_.initialization,
-                                  dash->current_representation_->id,
-                                  dash->current_representation_->bandwidth_);
-              dash->current_representation_->url_ =
-                  dash->current_representation_->segtpl_.initialization;
-            }
-          }
-          dash->currentNode_ |= MPDNODE_REPRESENTATION;
-        }
-        else if (strcmp(el, "SegmentDurations") == 0)
-        {
-          dash->current_adaptationset_->segment_durations_.data.reserve(dash->segcount_);
-          for (; *attr;)
-          {
-            if (strcmp((const char*)*attr, "timescale") == 0)
-            {
-              dash->current_adaptationset_->timescale_ = atoi((const char*)*(attr + 1));
-              break;
-            }
-            attr += 2;
-          }
-          dash->currentNode_ |= MPDNODE_SEGMENTDURATIONS;
-        }
-        else if (strcmp(el, CONTENTPROTECTION_TAG) == 0)
-        {
-          if (!dash->adp_pssh_set_ || dash->adp_pssh_set_ == 0xFF)
-          {
-            //Mark protected but invalid
-            dash->adp_pssh_set_ = 0xFF;
-            if (ParseContentProtection(attr, dash))
-              dash->current_hasAdpURN_ = true;
-          }
-        }
-        else if (strcmp(el, "AudioChannelConfiguration") == 0)
-        {
-          dash->adpChannelCount_ = GetChannels(attr);
-        }
-        else if (strcmp(el, "BaseURL") == 0) //Inside AdaptationSet
+static void StartRepresentationSegmentTemplate(DASHTree* dash, const char** attr)
+{
+  DASHTree::Representation* rep(dash->current_representation_);
+  rep->segtpl_ = dash->current_adaptationset_->segtpl_;
+
+  rep->startNumber_ = ParseSegmentTemplate(attr, rep->base_url_, dash->base_domain_, rep->segtpl_,
+                                           dash->current_adaptationset_->startNumber_);
+  ReplacePlaceHolders(rep->segtpl_.media, rep->id, rep->bandwidth_);
+  rep->flags_ |= DASHTree::Representation::TEMPLATE;
+  if (!rep->segtpl_.initialization.empty())
+  {
+    ReplacePlaceHolders(rep->segtpl_.initialization, rep->id, rep->bandwidth_);
+    rep->flags_ |= DASHTree::Representation::INITIALIZATION;
+    rep->url_ = rep->segtpl_.initialization;
+    rep->timescale_ = rep->segtpl_.timescale;
+  }
+  dash->timeline_time_ = 0;
+  dash->currentNode_ |= MPDNODE_SEGMENTTEMPLATE;
+}
+
+// Elements inside a Representation
+static void StartInRepresentation(DASHTree* dash,
+                                  MPDElement element,
+                                  const char* el,
+                                  const char** attr)
+{
+  if (dash->currentNode_ & MPDNODE_BASEURL)
+  {
+  }
+  else if (dash->currentNode_ & MPDNODE_SEGMENTLIST)
+  {
+    if (element == MPDELEMENT_SEGMENTURL)
+      StartSegmentURL(dash, attr);
+    else if (element == MPDELEMENT_INITIALIZATION)
+      StartInitialization(dash, attr);
+  }
+  else if (dash->currentNode_ & MPDNODE_SEGMENTTEMPLATE)
+  {
+    if (dash->currentNode_ & MPDNODE_SEGMENTTIMELINE)
+      StartRepresentationTimelineS(dash, attr);
+    else if (element == MPDELEMENT_SEGMENTTIMELINE)
+    {
+      dash->current_representation_->flags_ |= DASHTree::Representation::TIMELINE;
+      dash->currentNode_ |= MPDNODE_SEGMENTTIMELINE;
+    }
+  }
+  else if (dash->currentNode_ & MPDNODE_CONTENTPROTECTION)
+    StartContentProtectionChild(dash, element, el, attr);
+  else
+  {
+    switch (element)
+    {
+      case MPDELEMENT_AUDIOCHANNELCONFIGURATION:
+        dash->current_representation_->channelCount_ = GetChannels(attr);
+        break;
+      case MPDELEMENT_BASEURL:
+        StartBaseUrl(dash, attr);
+        break;
+      case MPDELEMENT_SEGMENTLIST:
+        StartRepresentationSegmentList(dash, attr);
+        break;
+      case MPDELEMENT_SEGMENTBASE:
+        StartSegmentBase(dash, attr);
+        break;
+      case MPDELEMENT_SEGMENTTEMPLATE:
+        StartRepresentationSegmentTemplate(dash, attr);
+        break;
+      case MPDELEMENT_CONTENTPROTECTION:
+        if (!dash->current_representation_->pssh_set_ ||
+            dash->current_representation_->pssh_set_ == 0xFF)
         {
-          dash->strXMLText_.clear();
-          dash->currentNode_ |= MPDNODE_BASEURL;
+          //Mark protected but invalid
+          dash->current_representation_->pssh_set_ = 0xFF;
+          if (ParseContentProtection(attr, dash))
+            dash->current_hasRepURN_ = true;
         }
-        else if (strcmp(el, "mspr:pro") == 0)
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static void StartRole(DASHTree* dash, const char** attr)
+{
+  bool schemeOk = false;
+  const char* value = nullptr;
+  for (; *attr; attr += 2)
+  {
+    switch (ATTRIBUTES.Get(*attr))
+    {
+      case MPDATTRIBUTE_SCHEMEIDURI:
+        if (strcmp(*(attr + 1), "urn:mpeg:dash:role:2011") == 0)
+          schemeOk = true;
+        break;
+      case MPDATTRIBUTE_VALUE:
+        value = *(attr + 1);
+        break;
+      default:
+        break;
+    }
+  }
+  if (schemeOk && value)
+  {
+    if (strcmp(value, "subtitle") == 0)
+      dash->current_adaptationset_->type_ = DASHTree::SUBTITLE;
+    //Legacy compatibility
+    if (strcmp(value, "forced") == 0)
+      dash->current_adaptationset_->forced_ = true;
+    if (strcmp(value, "main") == 0)
+      dash->current_adaptationset_->default_ = true;
+  }
+}
+
+// While a refresh is parsed, timeline segments the live representation already has are skipped
+static void SetUpdateTarget(DASHTree* dash)
+{
+  dash->current_update_target_ = nullptr;
+  if (!dash->live_tree_)
+    return;
+
+  std::lock_guard<std::mutex> lck(dash->live_tree_->GetTreeMutex());
+  const size_t period(dash->periods_.size() - 1);
+  if (period >= dash->live_tree_->periods_.size())
+    return;
+
+  DASHTree::AdaptationSet* adp;
+  DASHTree::Representation* live(dash->live_tree_->periods_[period]->FindRepresentation(
+      dash->current_adaptationset_, dash->current_representation_, &adp));
+  // Only live timelines are extended
+  if (live && (live->flags_ & DASHTree::Representation::TIMELINE) && !live->segments_.empty())
+  {
+    // The targets of deleted representations may have the same address
+    dash->current_update_target_ = &dash->update_targets_[dash->current_representation_];
+    *dash->current_update_target_ = DASHTree::UpdateTarget();
+    dash->current_update_target_->adp_ = adp;
+    dash->current_update_target_->rep_ = live;
+    dash->current_update_target_->lastTime_ =
+        live->segments_[static_cast<uint32_t>(live->segments_.size() - 1)]->range_begin_;
+  }
+}
+
+static void StartRepresentation(DASHTree* dash, const char** attr)
+{
+  DASHTree::AdaptationSet* adp(dash->current_adaptationset_);
+  DASHTree::Representation* rep(new DASHTree::Representation());
+  dash->current_representation_ = rep;
+  rep->channelCount_ = dash->adpChannelCount_;
+  rep->codecs_ = adp->codecs_;
+  rep->url_ = adp->base_url_;
+  rep->timescale_ = adp->timescale_;
+  rep->duration_ = adp->duration_;
+  rep->startNumber_ = adp->startNumber_;
+  rep->width_ = dash->adpwidth_;
+  rep->height_ = dash->adpheight_;
+  rep->fpsRate_ = dash->adpfpsRate_;
+  rep->fpsScale_ = dash->adpfpsScale_;
+  rep->aspect_ = dash->adpaspect_;
+  rep->containerType_ = dash->adpContainerType_;
+  rep->base_url_ = adp->base_url_;
+  rep->base_urls_ = adp->base_urls_;
+  dash->base_url_count_ = 0;
+  adp->representations_.push_back(rep);
+
+  dash->current_pssh_.clear();
+  dash->current_hasRepURN_ = false;
+
+  for (; *attr; attr += 2)
+  {
+    switch (ATTRIBUTES.Get(*attr))
+    {
+      case MPDATTRIBUTE_BANDWIDTH:
+        rep->bandwidth_ = atoi(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_CODECS:
+        rep->codecs_ = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_WIDTH:
+        rep->width_ = static_cast<uint16_t>(atoi(*(attr + 1)));
+        break;
+      case MPDATTRIBUTE_HEIGHT:
+        rep->height_ = static_cast<uint16_t>(atoi(*(attr + 1)));
+        break;
+      case MPDATTRIBUTE_AUDIOSAMPLINGRATE:
+        rep->samplingRate_ = static_cast<uint32_t>(atoi(*(attr + 1)));
+        break;
+      case MPDATTRIBUTE_FRAMERATE:
+        rep->fpsScale_ = 1;
+        sscanf(*(attr + 1), "%" SCNu32 "/%" SCNu32, &rep->fpsRate_, &rep->fpsScale_);
+        break;
+      case MPDATTRIBUTE_ID:
+        rep->id = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_CODECPRIVATEDATA:
+        rep->codec_private_data_ = annexb_to_avc(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_HDCP:
+        rep->hdcpVersion_ = static_cast<uint16_t>(atof(*(attr + 1)) * 10);
+        break;
+      case MPDATTRIBUTE_MIMETYPE:
+        if (!adp->mimeType_.empty())
+          break;
+        adp->mimeType_ = *(attr + 1);
+        if (adp->type_ == DASHTree::NOTYPE)
         {
-          dash->strXMLText_.clear();
-          dash->currentNode_ |= MPDNODE_PLAYREADYWRMHEADER;
+          if (strncmp(adp->mimeType_.c_str(), "video", 5) == 0)
+            adp->type_ = DASHTree::VIDEO;
+          else if (strncmp(adp->mimeType_.c_str(), "audio", 5) == 0)
+            adp->type_ = DASHTree::AUDIO;
+          else if (strncmp(adp->mimeType_.c_str(), "application", 11) == 0 ||
+                   strncmp(adp->mimeType_.c_str(), "text", 4) == 0)
+            adp->type_ = DASHTree::SUBTITLE;
         }
-      }
-      else if (dash->currentNode_ & (MPDNODE_SEGMENTLIST | MPDNODE_SEGMENTTEMPLATE))
-      {
-        if (dash->currentNode_ & MPDNODE_SEGMENTTIMELINE)
-        {
-          // <S t="3600" d="900000" r="2398"/>
-          unsigned int d(0), r(1);
-          uint64_t t(0);
-          for (; *attr;)
-          {
-            if (strcmp((const char*)*attr, "t") == 0)
-              t = atoll((const char*)*(attr + 1));
-            else if (strcmp((const char*)*attr, "d") == 0)
-              d = atoi((const char*)*(attr + 1));
-            if (strcmp((const char*)*attr, "r") == 0)
-              r = atoi((const char*)*(attr + 1)) + 1;
-            attr += 2;
-          }
-          if (dash->current_period_->segment_durations_.data.empty())
-          {
-            if (!dash->current_period_->duration_ && d)
-              dash->current_period_->segment_durations_.data.reserve(
-                  dash->estimate_segcount(d, dash->current_period_->timescale_));
-            dash->current_period_->startPTS_ = dash->pts_helper_ = t;
-          }
-          else if (t)
+        if (strstr(adp->mimeType_.c_str(), "/webm"))
+          rep->containerType_ = AdaptiveTree::CONTAINERTYPE_WEBM;
+        else if (strstr(adp->mimeType_.c_str(), "/x-matroska"))
+          rep->containerType_ = AdaptiveTree::CONTAINERTYPE_MATROSKA;
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (rep->codecs_.empty())
+  {
+    if (adp->mimeType_ == "text/vtt")
+      rep->codecs_ = "wvtt";
+    else if (adp->mimeType_ == "application/ttml+xml")
+      rep->codecs_ = "ttml";
+  }
+
+  if (adp->type_ != DASHTree::SUBTITLE)
+  {
+    if (rep->codecs_ == "wvtt")
+    {
+      adp->type_ = DASHTree::SUBTITLE;
+      adp->mimeType_ = "text/vtt";
+    }
+    else if (rep->codecs_ == "ttml")
+    {
+      adp->type_ = DASHTree::SUBTITLE;
+      adp->mimeType_ = "application/ttml+xml";
+    }
+  }
+
+  if (adp->type_ == DASHTree::SUBTITLE &&
+      (adp->mimeType_ == "application/ttml+xml" || adp->mimeType_ == "text/vtt"))
+  {
+    if (adp->segment_durations_.empty())
+      rep->flags_ |= DASHTree::Representation::SUBTITLESTREAM;
+    else
+      rep->containerType_ = AdaptiveTree::CONTAINERTYPE_TEXT;
+  }
+
+  rep->segtpl_ = adp->segtpl_;
+  if (!adp->segtpl_.media.empty())
+  {
+    rep->flags_ |= DASHTree::Representation::TEMPLATE;
+    ReplacePlaceHolders(rep->segtpl_.media, rep->id, rep->bandwidth_);
+
+    if (!rep->segtpl_.initialization.empty())
+    {
+      rep->flags_ |= DASHTree::Representation::INITIALIZATION;
+      ReplacePlaceHolders(rep->segtpl_.initialization, rep->id, rep->bandwidth_);
+      rep->url_ = rep->segtpl_.initialization;
+    }
+  }
+  SetUpdateTarget(dash);
+  dash->currentNode_ |= MPDNODE_REPRESENTATION;
+}
+
+// Elements inside an AdaptationSet, but outside of its Representations
+static void StartInAdaptationSet(DASHTree* dash,
+                                 MPDElement element,
+                                 const char* el,
+                                 const char** attr)
+{
+  DASHTree::AdaptationSet* adp(dash->current_adaptationset_);
+
+  if (dash->currentNode_ & (MPDNODE_SEGMENTTEMPLATE | MPDNODE_SEGMENTLIST))
+  {
+    if (dash->currentNode_ & MPDNODE_SEGMENTTIMELINE)
+      StartTimelineDurationS(dash, attr, adp->segment_durations_, adp->startPTS_, 0);
+    else if (element == MPDELEMENT_SEGMENTTIMELINE)
+    {
+      dash->currentNode_ |= MPDNODE_SEGMENTTIMELINE;
+      dash->adp_timelined_ = true;
+
+      if (dash->update_parameter_.empty() && dash->has_timeshift_buffer_)
+        dash->update_parameter_ = "full";
+    }
+  }
+  else if (dash->currentNode_ & MPDNODE_SEGMENTDURATIONS)
+  {
+    if (element == MPDELEMENT_S && *attr && **attr == 'd')
+      adp->segment_durations_.data().push_back(atoi(*(attr + 1)));
+  }
+  else if (dash->currentNode_ & MPDNODE_CONTENTPROTECTION)
+    StartContentProtectionChild(dash, element, el, attr);
+  else if (dash->currentNode_ & MPDNODE_BASEURL)
+  {
+  }
+  else
+  {
+    switch (element)
+    {
+      case MPDELEMENT_CONTENTCOMPONENT:
+        for (; *attr; attr += 2)
+          if (ATTRIBUTES.Get(*attr) == MPDATTRIBUTE_CONTENTTYPE)
           {
-            //Go back to the previous timestamp to calculate the real gap.
-            dash->pts_helper_ -= dash->current_adaptationset_->segment_durations_.data.back();
-            dash->current_period_->segment_durations_.data.back() =
-                static_cast<uint32_t>(t - dash->pts_helper_);
-            dash->pts_helper_ = t;
+            adp->type_ = GetContentType(*(attr + 1));
+            break;
           }
-          if (d && r)
+        break;
+      case MPDELEMENT_SEGMENTTEMPLATE:
+        adp->startNumber_ = ParseSegmentTemplate(attr, adp->base_url_, dash->base_domain_,
+                                                 adp->segtpl_, adp->startNumber_);
+        adp->timescale_ = adp->segtpl_.timescale;
+        dash->currentNode_ |= MPDNODE_SEGMENTTEMPLATE;
+        break;
+      case MPDELEMENT_SEGMENTLIST:
+        for (; *attr; attr += 2)
+        {
+          switch (ATTRIBUTES.Get(*attr))
           {
-            for (; r; --r)
-            {
-              dash->current_period_->segment_durations_.data.push_back(d);
-              dash->pts_helper_ += d;
-            }
+            case MPDATTRIBUTE_DURATION:
+              adp->duration_ = atoi(*(attr + 1));
+              break;
+            case MPDATTRIBUTE_TIMESCALE:
+              adp->timescale_ = atoi(*(attr + 1));
+              break;
+            default:
+              break;
           }
         }
-        else if (strcmp(el, "SegmentTimeline") == 0)
-        {
-          dash->currentNode_ |= MPDNODE_SEGMENTTIMELINE;
-          dash->period_timelined_ = true;
-        }
-      }
-      else if (strcmp(el, "AdaptationSet") == 0)
-      {
-        //<AdaptationSet contentType="video" group="2" lang="en" mimeType="video/mp4" par="16:9" segmentAlignment="true" startWithSAP="1" subsegmentAlignment="true" subsegmentStartsWithSAP="1">
-        dash->current_adaptationset_ = new DASHTree::AdaptationSet();
-        dash->current_period_->adaptationSets_.push_back(dash->current_adaptationset_);
-        dash->current_adaptationset_->base_url_ = dash->current_period_->base_url_;
-        dash->current_pssh_.clear();
-        dash->adpChannelCount_ = 0;
-        dash->adpwidth_ = 0;
-        dash->adpheight_ = 0;
-        dash->adpfpsRate_ = 0;
-        dash->adpfpsScale_ = 1;
-        dash->adpaspect_ = 0.0f;
-        dash->adp_pssh_set_ = 0;
-        dash->adpContainerType_ = AdaptiveTree::CONTAINERTYPE_MP4;
-        dash->current_hasAdpURN_ = false;
-        dash->adp_timelined_ = dash->period_timelined_;
-        dash->current_adaptationset_->timescale_ = dash->current_period_->timescale_;
-        dash->current_adaptationset_->duration_ = dash->current_period_->duration_;
-        dash->current_adaptationset_->segment_durations_ =
-            dash->current_period_->segment_durations_;
-        dash->current_adaptationset_->segtpl_ = dash->current_period_->segtpl_;
-        dash->current_adaptationset_->startNumber_ = dash->current_period_->startNumber_;
-        dash->current_playready_wrmheader_.clear();
-
-        for (; *attr;)
-        {
-          if (strcmp((const char*)*attr, "contentType") == 0)
-            dash->current_adaptationset_->type_ =
-                stricmp((const char*)*(attr + 1), "video") == 0
-                    ? DASHTree::VIDEO
-                    : stricmp((const char*)*(attr + 1), "audio") == 0
-                          ? DASHTree::AUDIO
-                          : stricmp((const char*)*(attr + 1), "text") == 0 ? DASHTree::SUBTITLE
-                                                                           : DASHTree::NOTYPE;
-          else if (strcmp((const char*)*attr, "id") == 0)
-            dash->current_adaptationset_->id_ = (const char*)*(attr + 1);
-          else if (strcmp((const char*)*attr, "group") == 0)
-            dash->current_adaptationset_->group_ = (const char*)*(attr + 1);
-          else if (strcmp((const char*)*attr, "lang") == 0)
-            dash->current_adaptationset_->language_ = (const char*)*(attr + 1);
-          else if (strcmp((const char*)*attr, "mimeType") == 0)
-            dash->current_adaptationset_->mimeType_ = (const char*)*(attr + 1);
-          else if (strcmp((const char*)*attr, "name") == 0)
-            dash->current_adaptationset_->name_ = (const char*)*(attr + 1);
-          else if (strcmp((const char*)*attr, "codecs") == 0)
-            dash->current_adaptationset_->codecs_ = (const char*)*(attr + 1);
-          else if (strcmp((const char*)*attr, "width") == 0)
-            dash->adpwidth_ = static_cast<uint16_t>(atoi((const char*)*(attr + 1)));
-          else if (strcmp((const char*)*attr, "height") == 0)
-            dash->adpheight_ = static_cast<uint16_t>(atoi((const char*)*(attr + 1)));
-          else if (strcmp((const char*)*attr, "frameRate") == 0)
-            sscanf((const char*)*(attr + 1), "%" SCNu32 "/%" SCNu32,
-                    &dash->adpfpsRate_,
-                    &dash->adpfpsScale_);
-          else if (strcmp((const char*)*attr, "par") == 0)
+        dash->currentNode_ |= MPDNODE_SEGMENTLIST;
+        break;
+      case MPDELEMENT_ROLE:
+        StartRole(dash, attr);
+        break;
+      case MPDELEMENT_REPRESENTATION:
+        StartRepresentation(dash, attr);
+        break;
+      case MPDELEMENT_SEGMENTDURATIONS:
+        adp->segment_durations_.data().reserve(dash->segcount_);
+        for (; *attr; attr += 2)
+          if (ATTRIBUTES.Get(*attr) == MPDATTRIBUTE_TIMESCALE)
           {
-            int w, h;
-            if (sscanf((const char*)*(attr + 1), "%d:%d", &w, &h) == 2)
-              dash->adpaspect_ = (float)w / h;
+            adp->timescale_ = atoi(*(attr + 1));
+            break;
           }
-          else if (strcmp((const char*)*attr, "audioTrackId") == 0)
-            dash->current_adaptationset_->audio_track_id_ = (const char*)*(attr + 1);
-          else if (strcmp((const char*)*attr, "impaired") == 0)
-            dash->current_adaptationset_->impaired_ = strcmp((const char*)*(attr + 1), "true") == 0;
-          else if (strcmp((const char*)*attr, "forced") == 0)
-            dash->current_adaptationset_->forced_ = strcmp((const char*)*(attr + 1), "true") == 0;
-          else if (strcmp((const char*)*attr, "original") == 0)
-            dash->current_adaptationset_->original_ = strcmp((const char*)*(attr + 1), "true") == 0;
-          else if (strcmp((const char*)*attr, "default") == 0)
-            dash->current_adaptationset_->default_ = strcmp((const char*)*(attr + 1), "true") == 0;
-          attr += 2;
-        }
-
-        if (dash->current_adaptationset_->type_ == DASHTree::NOTYPE)
+        dash->currentNode_ |= MPDNODE_SEGMENTDURATIONS;
+        break;
+      case MPDELEMENT_CONTENTPROTECTION:
+        if (!dash->adp_pssh_set_ || dash->adp_pssh_set_ == 0xFF)
         {
-          if (strncmp(dash->current_adaptationset_->mimeType_.c_str(), "video", 5) == 0)
-            dash->current_adaptationset_->type_ = DASHTree::VIDEO;
-          else if (strncmp(dash->current_adaptationset_->mimeType_.c_str(), "audio", 5) == 0)
-            dash->current_adaptationset_->type_ = DASHTree::AUDIO;
-          else if (strncmp(dash->current_adaptationset_->mimeType_.c_str(), "application", 11) ==
-                       0 ||
-                   strncmp(dash->current_adaptationset_->mimeType_.c_str(), "text", 4) == 0)
-            dash->current_adaptationset_->type_ = DASHTree::SUBTITLE;
+          //Mark protected but invalid
+          dash->adp_pssh_set_ = 0xFF;
+          if (ParseContentProtection(attr, dash))
+            dash->current_hasAdpURN_ = true;
         }
+        break;
+      case MPDELEMENT_AUDIOCHANNELCONFIGURATION:
+        dash->adpChannelCount_ = GetChannels(attr);
+        break;
+      case MPDELEMENT_BASEURL:
+        StartBaseUrl(dash, attr);
+        break;
+      case MPDELEMENT_MSPR_PRO:
+        dash->strXMLText_.clear();
+        dash->currentNode_ |= MPDNODE_PLAYREADYWRMHEADER;
+        break;
+      default:
+        break;
+    }
+  }
+}
 
-        if (strstr(dash->current_adaptationset_->mimeType_.c_str(), "/webm"))
-          dash->adpContainerType_ = AdaptiveTree::CONTAINERTYPE_WEBM;
-        else if (strstr(dash->current_adaptationset_->mimeType_.c_str(), "/x-matroska"))
-          dash->adpContainerType_ = AdaptiveTree::CONTAINERTYPE_MATROSKA;
-
-        dash->segcount_ = 0;
-        dash->currentNode_ |= MPDNODE_ADAPTIONSET;
-      }
-      else if (strcmp(el, "SegmentTemplate") == 0)
+static void StartAdaptationSet(DASHTree* dash, const char** attr)
+{
+  //<AdaptationSet contentType="video" group="2" lang="en" mimeType="video/mp4" par="16:9" segmentAlignment="true" startWithSAP="1" subsegmentAlignment="true" subsegmentStartsWithSAP="1">
+  DASHTree::Period* period(dash->current_period_);
+  DASHTree::AdaptationSet* adp(new DASHTree::AdaptationSet());
+  dash->current_adaptationset_ = adp;
+  period->adaptationSets_.push_back(adp);
+  adp->base_url_ = period->base_url_;
+  adp->base_urls_ = period->base_urls_;
+  dash->base_url_count_ = 0;
+  dash->current_pssh_.clear();
+  dash->adpChannelCount_ = 0;
+  dash->adpwidth_ = 0;
+  dash->adpheight_ = 0;
+  dash->adpfpsRate_ = 0;
+  dash->adpfpsScale_ = 1;
+  dash->adpaspect_ = 0.0f;
+  dash->adp_pssh_set_ = 0;
+  dash->adpContainerType_ = AdaptiveTree::CONTAINERTYPE_MP4;
+  dash->current_hasAdpURN_ = false;
+  dash->adp_timelined_ = dash->period_timelined_;
+  adp->timescale_ = period->timescale_;
+  adp->duration_ = period->duration_;
+  adp->segment_durations_ = period->segment_durations_;
+  adp->segtpl_ = period->segtpl_;
+  adp->startNumber_ = period->startNumber_;
+  dash->current_playready_wrmheader_.clear();
+
+  for (; *attr; attr += 2)
+  {
+    switch (ATTRIBUTES.Get(*attr))
+    {
+      case MPDATTRIBUTE_CONTENTTYPE:
+        adp->type_ = GetContentType(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_ID:
+        adp->id_ = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_GROUP:
+        adp->group_ = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_LANG:
+        adp->language_ = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_MIMETYPE:
+        adp->mimeType_ = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_NAME:
+        adp->name_ = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_CODECS:
+        adp->codecs_ = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_WIDTH:
+        dash->adpwidth_ = static_cast<uint16_t>(atoi(*(attr + 1)));
+        break;
+      case MPDATTRIBUTE_HEIGHT:
+        dash->adpheight_ = static_cast<uint16_t>(atoi(*(attr + 1)));
+        break;
+      case MPDATTRIBUTE_FRAMERATE:
+        sscanf(*(attr + 1), "%" SCNu32 "/%" SCNu32, &dash->adpfpsRate_, &dash->adpfpsScale_);
+        break;
+      case MPDATTRIBUTE_PAR:
       {
-        dash->current_period_->startNumber_ = ParseSegmentTemplate(
-            attr, dash->current_period_->base_url_, dash->base_domain_,
-            dash->current_period_->segtpl_, dash->current_period_->startNumber_);
-        dash->current_period_->timescale_ = dash->current_period_->segtpl_.timescale;
-        dash->currentNode_ |= MPDNODE_SEGMENTTEMPLATE;
+        int w, h;
+        if (sscanf(*(attr + 1), "%d:%d", &w, &h) == 2)
+          dash->adpaspect_ = (float)w / h;
+        break;
       }
-      else if (strcmp(el, "SegmentList") == 0)
+      case MPDATTRIBUTE_AUDIOTRACKID:
+        adp->audio_track_id_ = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_IMPAIRED:
+        adp->impaired_ = strcmp(*(attr + 1), "true") == 0;
+        break;
+      case MPDATTRIBUTE_FORCED:
+        adp->forced_ = strcmp(*(attr + 1), "true") == 0;
+        break;
+      case MPDATTRIBUTE_ORIGINAL:
+        adp->original_ = strcmp(*(attr + 1), "true") == 0;
+        break;
+      case MPDATTRIBUTE_DEFAULT:
+        adp->default_ = strcmp(*(attr + 1), "true") == 0;
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (adp->type_ == DASHTree::NOTYPE)
+  {
+    if (strncmp(adp->mimeType_.c_str(), "video", 5) == 0)
+      adp->type_ = DASHTree::VIDEO;
+    else if (strncmp(adp->mimeType_.c_str(), "audio", 5) == 0)
+      adp->type_ = DASHTree::AUDIO;
+    else if (strncmp(adp->mimeType_.c_str(), "application", 11) == 0 ||
+             strncmp(adp->mimeType_.c_str(), "text", 4) == 0)
+      adp->type_ = DASHTree::SUBTITLE;
+  }
+
+  if (strstr(adp->mimeType_.c_str(), "/webm"))
+    dash->adpContainerType_ = AdaptiveTree::CONTAINERTYPE_WEBM;
+  else if (strstr(adp->mimeType_.c_str(), "/x-matroska"))
+    dash->adpContainerType_ = AdaptiveTree::CONTAINERTYPE_MATROSKA;
+
+  dash->segcount_ = 0;
+  dash->currentNode_ |= MPDNODE_ADAPTIONSET;
+}
+
+// Elements inside a Period, but outside of its AdaptationSets
+static void StartInPeriod(DASHTree* dash, MPDElement element, const char** attr)
+{
+  DASHTree::Period* period(dash->current_period_);
+
+  if (dash->currentNode_ & (MPDNODE_SEGMENTLIST | MPDNODE_SEGMENTTEMPLATE))
+  {
+    if (dash->currentNode_ & MPDNODE_SEGMENTTIMELINE)
+      StartTimelineDurationS(dash, attr, period->segment_durations_, period->startPTS_,
+                             period->duration_ ? 0 : period->timescale_);
+    else if (element == MPDELEMENT_SEGMENTTIMELINE)
+    {
+      dash->currentNode_ |= MPDNODE_SEGMENTTIMELINE;
+      dash->period_timelined_ = true;
+    }
+    return;
+  }
+
+  switch (element)
+  {
+    case MPDELEMENT_ADAPTATIONSET:
+      StartAdaptationSet(dash, attr);
+      break;
+    case MPDELEMENT_SEGMENTTEMPLATE:
+      period->startNumber_ = ParseSegmentTemplate(attr, period->base_url_, dash->base_domain_,
+                                                  period->segtpl_, period->startNumber_);
+      period->timescale_ = period->segtpl_.timescale;
+      dash->currentNode_ |= MPDNODE_SEGMENTTEMPLATE;
+      break;
+    case MPDELEMENT_SEGMENTLIST:
+      for (; *attr; attr += 2)
       {
-        for (; *attr;)
-        {
-          if (strcmp((const char*)*attr, "duration") == 0)
-            dash->current_period_->duration_ = atoi((const char*)*(attr + 1));
-          else if (strcmp((const char*)*attr, "timescale") == 0)
-            dash->current_period_->timescale_ = atoi((const char*)*(attr + 1));
-          else if (strcmp((const char*)*attr, "startNumber") == 0)
-            dash->current_period_->startNumber_ = atoi((const char*)*(attr + 1));
-          attr += 2;
-        }
-        if (dash->current_period_->timescale_)
+        switch (ATTRIBUTES.Get(*attr))
         {
-          if (dash->current_period_->duration_)
-            dash->current_period_->segment_durations_.data.reserve(dash->estimate_segcount(
-                dash->current_period_->duration_, dash->current_period_->timescale_));
-          dash->currentNode_ |= MPDNODE_SEGMENTLIST;
+          case MPDATTRIBUTE_DURATION:
+            period->duration_ = atoi(*(attr + 1));
+            break;
+          case MPDATTRIBUTE_TIMESCALE:
+            period->timescale_ = atoi(*(attr + 1));
+            break;
+          case MPDATTRIBUTE_STARTNUMBER:
+            period->startNumber_ = atoi(*(attr + 1));
+            break;
+          default:
+            break;
         }
       }
-      else if (strcmp(el, "BaseURL") == 0) // Inside Period
+      if (period->timescale_)
       {
-        dash->strXMLText_.clear();
-        dash->currentNode_ |= MPDNODE_BASEURL;
+        if (period->duration_)
+          period->segment_durations_.data().reserve(
+              dash->estimate_segcount(period->duration_, period->timescale_));
+        dash->currentNode_ |= MPDNODE_SEGMENTLIST;
       }
-    }
-    else if (strcmp(el, "BaseURL") == 0) // Out of Period
-    {
-      dash->strXMLText_.clear();
-      dash->currentNode_ |= MPDNODE_BASEURL;
-    }
-    else if (strcmp(el, "Period") == 0)
-    {
-      dash->current_period_ = new DASHTree::Period();
-      dash->current_period_->base_url_ = dash->mpd_url_;
-      dash->periods_.push_back(dash->current_period_);
-      dash->period_timelined_ = false;
-      dash->current_period_->start_ = 0;
+      break;
+    case MPDELEMENT_BASEURL:
+      StartBaseUrl(dash, attr);
+      break;
+    default:
+      break;
+  }
+}
 
-      for (; *attr;)
-      {
-        if (strcmp((const char*)*attr, "start") == 0)
-          AddDuration((const char*)*(attr + 1), dash->current_period_->start_, 1000);
-        else if (strcmp((const char*)*attr, "id") == 0)
-          dash->current_period_->id_ = (const char*)*(attr + 1);
-        else if (strcmp((const char*)*attr, "duration") == 0)
-          AddDuration((const char*)*(attr + 1), dash->current_period_->duration_, 1000);
-        attr += 2;
-      }
-      dash->currentNode_ |= MPDNODE_PERIOD;
-    }
-    else if (strcmp(el, "Location") == 0)
+static void StartPeriod(DASHTree* dash, const char** attr)
+{
+  DASHTree::Period* period(new DASHTree::Period());
+  dash->current_period_ = period;
+  period->base_url_ = dash->mpd_url_;
+  period->base_urls_ = dash->mpd_base_urls_;
+  dash->base_url_count_ = 0;
+  dash->periods_.push_back(period);
+  dash->period_timelined_ = false;
+  period->start_ = 0;
+
+  for (; *attr; attr += 2)
+  {
+    switch (ATTRIBUTES.Get(*attr))
     {
-      dash->strXMLText_.clear();
-      dash->currentNode_ |= MPDNODE_LOCATION;
+      case MPDATTRIBUTE_START:
+        AddDuration(*(attr + 1), period->start_, 1000);
+        break;
+      case MPDATTRIBUTE_ID:
+        period->id_ = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_DURATION:
+        AddDuration(*(attr + 1), period->duration_, 1000);
+        break;
+      default:
+        break;
     }
   }
-  else if (strcmp(el, "MPD") == 0)
-  {
-    const char *mpt(0), *tsbd(0);
+  dash->currentNode_ |= MPDNODE_PERIOD;
+}
+
+static void StartMPD(DASHTree* dash, const char** attr)
+{
+  const char *mpt(0), *tsbd(0);
 
-    dash->firstStartNumber_ = 0;
+  dash->firstStartNumber_ = 0;
 
-    dash->overallSeconds_ = 0;
-    dash->stream_start_ = dash->GetNowTime();
-    dash->mpd_url_ = dash->base_url_;
+  dash->overallSeconds_ = 0;
+  dash->stream_start_ = dash->GetNowTime();
+  dash->mpd_url_ = dash->base_url_;
+  dash->mpd_base_urls_.clear();
+  dash->base_url_count_ = 0;
 
-    for (; *attr;)
+  for (; *attr; attr += 2)
+  {
+    switch (ATTRIBUTES.Get(*attr))
     {
-      if (strcmp((const char*)*attr, "mediaPresentationDuration") == 0)
-      {
-        mpt = (const char*)*(attr + 1);
-      }
-      else if (strcmp((const char*)*attr, "type") == 0 &&
-               strcmp((const char*)*(attr + 1), "dynamic") == 0)
-      {
+      case MPDATTRIBUTE_MEDIAPRESENTATIONDURATION:
+        mpt = *(attr + 1);
+        break;
+      case MPDATTRIBUTE_TYPE:
+        if (strcmp(*(attr + 1), "dynamic") == 0)
+          dash->has_timeshift_buffer_ = true;
+        break;
+      case MPDATTRIBUTE_TIMESHIFTBUFFERDEPTH:
+        tsbd = *(attr + 1);
         dash->has_timeshift_buffer_ = true;
-      }
-      else if (strcmp((const char*)*attr, "timeShiftBufferDepth") == 0)
-      {
-        tsbd = (const char*)*(attr + 1);
-        dash->has_timeshift_buffer_ = true;
-      }
-      else if (strcmp((const char*)*attr, "availabilityStartTime") == 0)
-        dash->available_time_ = getTime((const char*)*(attr + 1));
-      else if (strcmp((const char*)*attr, "minimumUpdatePeriod") == 0)
+        break;
+      case MPDATTRIBUTE_AVAILABILITYSTARTTIME:
+        dash->available_time_ = getTime(*(attr + 1));
+        break;
+      case MPDATTRIBUTE_MINIMUMUPDATEPERIOD:
       {
         uint64_t dur(0);
-        AddDuration((const char*)*(attr + 1), dur, 1500);
+        AddDuration(*(attr + 1), dur, 1500);
         // 0S minimumUpdatePeriod = refresh after every segment
         // We already do that so lets set our minimum updateInterval to 30s
         if (dur == 0)
           dur = 30000;
         dash->SetUpdateInterval(static_cast<uint32_t>(dur));
+        break;
       }
-      attr += 2;
+      default:
+        break;
     }
+  }
+
+  if (!mpt)
+    mpt = tsbd;
+
+  AddDuration(mpt, dash->overallSeconds_, 1);
+  dash->has_overall_seconds_ = dash->overallSeconds_ > 0;
+
+  dash->minPresentationOffset = ~0ULL;
 
-    if (!mpt)
-      mpt = tsbd;
+  dash->currentNode_ |= MPDNODE_MPD;
+}
 
-    AddDuration(mpt, dash->overallSeconds_, 1);
-    dash->has_overall_seconds_ = dash->overallSeconds_ > 0;
+static void XMLCALL start(void* data, const char* el, const char** attr)
+{
+  DASHTree* dash(reinterpret_cast<DASHTree*>(data));
+  const MPDElement element(ELEMENTS.Get(el));
 
-    uint64_t overallsecs(dash->overallSeconds_ ? dash->overallSeconds_ + 60 : 86400);
-    dash->minPresentationOffset = ~0ULL;
+  if (dash->currentNode_ & MPDNODE_MPD)
+  {
+    if (dash->currentNode_ & MPDNODE_PERIOD)
+    {
+      if (dash->currentNode_ & MPDNODE_ADAPTIONSET)
+      {
+        if (dash->currentNode_ & MPDNODE_REPRESENTATION)
+          StartInRepresentation(dash, element, el, attr);
+        else
+          StartInAdaptationSet(dash, element, el, attr);
+      }
+      else
+        StartInPeriod(dash, element, attr);
+      return;
+    }
 
-    dash->currentNode_ |= MPDNODE_MPD;
+    switch (element)
+    {
+      case MPDELEMENT_BASEURL: // Out of Period
+        StartBaseUrl(dash, attr);
+        break;
+      case MPDELEMENT_PERIOD:
+        StartPeriod(dash, attr);
+        break;
+      case MPDELEMENT_LOCATION:
+        dash->strXMLText_.clear();
+        dash->currentNode_ |= MPDNODE_LOCATION;
+        break;
+      case MPDELEMENT_LATENCY: // Inside ServiceDescription
+        for (; *attr; attr += 2)
+          if (ATTRIBUTES.Get(*attr) == MPDATTRIBUTE_TARGET && dash->has_timeshift_buffer_)
+          {
+            dash->low_latency_ = true;
+            if (!dash->live_latency_)
+              dash->live_latency_ = atoi(*(attr + 1));
+          }
+        break;
+      default:
+        break;
+    }
   }
+  else if (element == MPDELEMENT_MPD)
+    StartMPD(dash, attr);
 }
 
 /*----------------------------------------------------------------------
@@ -1093,6 +1547,7 @@ static void XMLCALL text(void* data, const char* s, int len)
 static void XMLCALL end(void* data, const char* el)
 {
   DASHTree* dash(reinterpret_cast<DASHTree*>(data));
+  const MPDElement element(ELEMENTS.Get(el));
 
   if (dash->currentNode_ & MPDNODE_MPD)
   {
@@ -1104,51 +1559,57 @@ static void XMLCALL end(void* data, const char* el)
         {
           if (dash->currentNode_ & MPDNODE_BASEURL) // Inside Representation
           {
-            if (strcmp(el, "BaseURL") == 0)
+            if (element == MPDELEMENT_BASEURL)
             {
               while (dash->strXMLText_.size() &&
                      (dash->strXMLText_[0] == '\n' || dash->strXMLText_[0] == '\r'))
                 dash->strXMLText_.erase(dash->strXMLText_.begin());
 
-              std::string url;
-              if (dash->strXMLText_.compare(0, 1, "/") == 0 ||
-                  dash->strXMLText_.compare(0, 7, "http://") == 0 ||
-                  dash->strXMLText_.compare(0, 8, "https://") == 0)
-                url = dash->strXMLText_;
-              else
-                url = dash->current_adaptationset_->base_url_ + dash->strXMLText_;
+              //Segment urls are built from the first BaseURL, further ones are alternates
+              if (AddBaseUrl(dash, dash->current_representation_->base_urls_,
+                             dash->current_adaptationset_->base_urls_,
+                             dash->current_adaptationset_->base_url_))
+              {
+                std::string url;
+                if (dash->strXMLText_.compare(0, 1, "/") == 0 ||
+                    dash->strXMLText_.compare(0, 7, "http://") == 0 ||
+                    dash->strXMLText_.compare(0, 8, "https://") == 0)
+                  url = dash->strXMLText_;
+                else
+                  url = dash->current_adaptationset_->base_url_ + dash->strXMLText_;
 
-              dash->current_representation_->base_url_ = url;
+                dash->current_representation_->base_url_ = url;
 
-              if (dash->current_representation_->flags_ & AdaptiveTree::Representation::TEMPLATE)
-              {
-                if (dash->current_representation_->flags_ &
-                    AdaptiveTree::Representation::INITIALIZATION)
-                  dash->current_representation_->url_ =
-                      url + dash->current_representation_->url_.substr(
+                if (dash->current_representation_->flags_ & AdaptiveTree::Representation::TEMPLATE)
+                {
+                  if (dash->current_representation_->flags_ &
+                      AdaptiveTree::Representation::INITIALIZATION)
+                    dash->current_representation_->url_ =
+                        url + dash->current_representation_->url_.substr(
+                                  dash->current_adaptationset_->base_url_.size());
+                  dash->current_representation_->segtpl_.media =
+                      url + dash->current_representation_->segtpl_.media.substr(
                                 dash->current_adaptationset_->base_url_.size());
-                dash->current_representation_->segtpl_.media =
-                    url + dash->current_representation_->segtpl_.media.substr(
-                              dash->current_adaptationset_->base_url_.size());
+                }
+                else
+                  dash->current_representation_->url_ = url;
               }
-              else
-                dash->current_representation_->url_ = url;
               dash->currentNode_ &= ~MPDNODE_BASEURL;
             }
           }
           else if (dash->currentNode_ & MPDNODE_SEGMENTLIST)
           {
-            if (strcmp(el, "SegmentList") == 0 || strcmp(el, "SegmentBase") == 0)
+            if (element == MPDELEMENT_SEGMENTLIST || element == MPDELEMENT_SEGMENTBASE)
             {
               dash->currentNode_ &= ~MPDNODE_SEGMENTLIST;
               if (!dash->segcount_)
-                dash->segcount_ = dash->current_representation_->segments_.data.size();
+                dash->segcount_ = dash->current_representation_->segments_.data().size();
               if (!dash->current_period_->duration_ && dash->current_representation_->timescale_)
               {
                 dash->current_period_->timescale_ = dash->current_representation_->timescale_;
                 dash->current_period_->duration_ =
                     dash->current_representation_->duration_ *
-                    dash->current_representation_->segments_.data.size();
+                    dash->current_representation_->segments_.data().size();
               }
             }
           }
@@ -1156,10 +1617,10 @@ static void XMLCALL end(void* data, const char* el)
           {
             if (dash->currentNode_ & MPDNODE_SEGMENTTIMELINE)
             {
-              if (strcmp(el, "SegmentTimeline") == 0)
+              if (element == MPDELEMENT_SEGMENTTIMELINE)
                 dash->currentNode_ &= ~MPDNODE_SEGMENTTIMELINE;
             }
-            else if (strcmp(el, "SegmentTemplate") == 0)
+            else if (element == MPDELEMENT_SEGMENTTEMPLATE)
             {
               dash->currentNode_ &= ~MPDNODE_SEGMENTTEMPLATE;
             }
@@ -1174,7 +1635,7 @@ static void XMLCALL end(void* data, const char* el)
                 dash->currentNode_ &= ~MPDNODE_PSSH;
               }
             }
-            else if (strcmp(el, "ContentProtection") == 0)
+            else if (element == MPDELEMENT_CONTENTPROTECTION)
             {
               if (dash->current_pssh_.empty())
                 dash->current_pssh_ = "FILE";
@@ -1183,7 +1644,7 @@ static void XMLCALL end(void* data, const char* el)
               dash->currentNode_ &= ~MPDNODE_CONTENTPROTECTION;
             }
           }
-          else if (strcmp(el, "Representation") == 0)
+          else if (element == MPDELEMENT_REPRESENTATION)
           {
             dash->currentNode_ &= ~MPDNODE_REPRESENTATION;
 
@@ -1206,7 +1667,9 @@ static void XMLCALL end(void* data, const char* el)
               }
             }
 
-            if (dash->current_representation_->segments_.data.empty())
+            // A refreshed timeline may have no segments the live representation lacks
+            if (dash->current_representation_->segments_.data().empty() &&
+                !(dash->current_update_target_ && ~dash->current_update_target_->firstTime_))
             {
               DASHTree::SegmentTemplate& tpl(dash->current_representation_->segtpl_);
 
@@ -1216,11 +1679,11 @@ static void XMLCALL end(void* data, const char* el)
                       : dash->overallSeconds_;
               if (!tpl.media.empty() && overallSeconds > 0 && tpl.timescale > 0 &&
                   (tpl.duration > 0 ||
-                   dash->current_adaptationset_->segment_durations_.data.size()))
+                   dash->current_adaptationset_->segment_durations_.data().size()))
               {
                 unsigned int countSegs =
-                    !dash->current_adaptationset_->segment_durations_.data.empty()
-                        ? dash->current_adaptationset_->segment_durations_.data.size()
+                    !dash->current_adaptationset_->segment_durations_.data().empty()
+                        ? dash->current_adaptationset_->segment_durations_.data().size()
                         : (unsigned int)((double)overallSeconds /
                                          (((double)tpl.duration) / tpl.timescale)) +
                               1;
@@ -1231,7 +1694,11 @@ static void XMLCALL end(void* data, const char* el)
 
                   dash->current_representation_->flags_ |= DASHTree::Representation::TEMPLATE;
 
-                  dash->current_representation_->segments_.data.reserve(countSegs);
+                  // Refreshed timelines keep only the segments the live representation lacks
+                  DASHTree::UpdateTarget* target(
+                      dash->adp_timelined_ ? dash->current_update_target_ : nullptr);
+                  if (!target)
+                    dash->current_representation_->segments_.data().reserve(countSegs);
                   if (!tpl.initialization.empty())
                   {
                     seg.range_end_ = ~0;
@@ -1241,8 +1708,8 @@ static void XMLCALL end(void* data, const char* el)
                   }
 
                   std::vector<uint32_t>::const_iterator sdb(
-                      dash->current_adaptationset_->segment_durations_.data.begin()),
-                      sde(dash->current_adaptationset_->segment_durations_.data.end());
+                      dash->current_adaptationset_->segment_durations_.data().begin()),
+                      sde(dash->current_adaptationset_->segment_durations_.data().end());
                   bool timeBased = sdb != sde && tpl.media.find("$Time") != std::string::npos;
                   if (dash->adp_timelined_)
                     dash->current_representation_->flags_ |= AdaptiveTree::Representation::TIMELINE;
@@ -1256,7 +1723,22 @@ static void XMLCALL end(void* data, const char* el)
                     seg.startPTS_ = 0;
                   seg.range_begin_ = dash->current_adaptationset_->startPTS_;
 
-                  if (!timeBased && dash->has_timeshift_buffer_ &&
+                  if (!timeBased && dash->has_timeshift_buffer_ && tpl.duration &&
+                      tpl.availabilityTimeOffset)
+                    dash->low_latency_ = true;
+
+                  if (!timeBased && dash->has_timeshift_buffer_ && tpl.duration &&
+                      dash->low_latency_)
+                  {
+                    // The list ends with the newest segment which can be requested,
+                    // it may still be produced
+                    const uint32_t next(dash->GetLiveSegmentNumber(
+                        dash->current_period_, dash->current_representation_,
+                        dash->GetNowTimeMs() + GetAvailabilityTimeOffset(tpl)));
+                    seg.range_end_ =
+                        next > tpl.startNumber + countSegs ? next - countSegs : tpl.startNumber;
+                  }
+                  else if (!timeBased && dash->has_timeshift_buffer_ &&
                       tpl.duration)
                   {
                     uint64_t sample_time = dash->current_period_->start_ /  1000;
@@ -1269,11 +1751,21 @@ static void XMLCALL end(void* data, const char* el)
                   else if (!tpl.duration)
                     tpl.duration = static_cast<unsigned int>(
                         (overallSeconds * tpl.timescale) /
-                        dash->current_adaptationset_->segment_durations_.data.size());
+                        dash->current_adaptationset_->segment_durations_.data().size());
 
                   for (; countSegs; --countSegs)
                   {
-                    dash->current_representation_->segments_.data.push_back(seg);
+                    if (!target)
+                      dash->current_representation_->segments_.data().push_back(seg);
+                    else
+                    {
+                      if (!~target->firstTime_)
+                        target->firstTime_ = seg.range_begin_;
+                      if (seg.range_begin_ > target->lastTime_)
+                        dash->current_representation_->segments_.data().push_back(seg);
+                      else
+                        ++target->skipped_;
+                    }
                     uint32_t duration((sdb != sde) ? *(sdb++) : tpl.duration);
                     seg.startPTS_ += duration, seg.range_begin_ += duration;
                     ++seg.range_end_;
@@ -1315,19 +1807,24 @@ static void XMLCALL end(void* data, const char* el)
         }
         else if (dash->currentNode_ & MPDNODE_SEGMENTDURATIONS)
         {
-          if (strcmp(el, "SegmentDurations") == 0)
+          if (element == MPDELEMENT_SEGMENTDURATIONS)
             dash->currentNode_ &= ~MPDNODE_SEGMENTDURATIONS;
         }
         else if (dash->currentNode_ & MPDNODE_BASEURL) // Inside AdaptationSet
         {
-          if (strcmp(el, "BaseURL") == 0)
+          if (element == MPDELEMENT_BASEURL)
           {
-            if (dash->strXMLText_.compare(0, 1, "/") == 0 ||
-                dash->strXMLText_.compare(0, 7, "http://") == 0 ||
-                dash->strXMLText_.compare(0, 8, "https://") == 0)
+            //Urls are built from the first BaseURL, further ones are alternates
+            if (AddBaseUrl(dash, dash->current_adaptationset_->base_urls_,
+                           dash->current_period_->base_urls_, dash->current_period_->base_url_))
+            {
+              if (dash->strXMLText_.compare(0, 1, "/") == 0 ||
+                  dash->strXMLText_.compare(0, 7, "http://") == 0 ||
+                  dash->strXMLText_.compare(0, 8, "https://") == 0)
                 dash->current_adaptationset_->base_url_ = dash->strXMLText_;
-            else
+              else
                 dash->current_adaptationset_->base_url_ = dash->current_period_->base_url_ + dash->strXMLText_;
+            }
             dash->currentNode_ &= ~MPDNODE_BASEURL;
           }
         }
@@ -1335,25 +1832,25 @@ static void XMLCALL end(void* data, const char* el)
         {
           if (dash->currentNode_ & MPDNODE_SEGMENTTIMELINE)
           {
-            if (strcmp(el, "SegmentTimeline") == 0)
+            if (element == MPDELEMENT_SEGMENTTIMELINE)
             {
               if (!dash->current_period_->duration_ &&
                   dash->current_adaptationset_->segtpl_.timescale)
               {
                 dash->current_period_->timescale_ = dash->current_adaptationset_->segtpl_.timescale;
                 uint64_t sum(0);
-                for (auto dur : dash->current_adaptationset_->segment_durations_.data)
+                for (auto dur : dash->current_adaptationset_->segment_durations_.data())
                   sum += dur;
                 dash->current_period_->duration_ = sum;
               }
               dash->currentNode_ &= ~MPDNODE_SEGMENTTIMELINE;
             }
           }
-          else if (strcmp(el, "SegmentTemplate") == 0)
+          else if (element == MPDELEMENT_SEGMENTTEMPLATE)
           {
             dash->currentNode_ &= ~MPDNODE_SEGMENTTEMPLATE;
           }
-          else if (strcmp(el, "SegmentList") == 0)
+          else if (element == MPDELEMENT_SEGMENTLIST)
           {
             dash->currentNode_ &= ~MPDNODE_SEGMENTLIST;
           }
@@ -1368,7 +1865,7 @@ static void XMLCALL end(void* data, const char* el)
               dash->currentNode_ &= ~MPDNODE_PSSH;
             }
           }
-          else if (strcmp(el, "ContentProtection") == 0)
+          else if (element == MPDELEMENT_CONTENTPROTECTION)
           {
             if (dash->current_pssh_.empty())
               dash->current_pssh_ = "FILE";
@@ -1382,7 +1879,7 @@ static void XMLCALL end(void* data, const char* el)
           dash->current_playready_wrmheader_ = dash->strXMLText_;
           dash->currentNode_ &= ~MPDNODE_PLAYREADYWRMHEADER;
         }
-        else if (strcmp(el, "AdaptationSet") == 0)
+        else if (element == MPDELEMENT_ADAPTATIONSET)
         {
           dash->currentNode_ &= ~MPDNODE_ADAPTIONSET;
           if (dash->current_adaptationset_->type_ == DASHTree::NOTYPE ||
@@ -1416,7 +1913,7 @@ static void XMLCALL end(void* data, const char* el)
                   (*b)->pssh_set_ = dash->adp_pssh_set_;
             }
 
-            if (dash->current_adaptationset_->segment_durations_.data.empty() &&
+            if (dash->current_adaptationset_->segment_durations_.data().empty() &&
                 !dash->current_adaptationset_->segtpl_.media.empty())
             {
               for (std::vector<DASHTree::Representation*>::iterator
@@ -1431,7 +1928,7 @@ static void XMLCALL end(void* data, const char* el)
                 }
               }
             }
-            else if (!dash->current_adaptationset_->segment_durations_.data.empty())
+            else if (!dash->current_adaptationset_->segment_durations_.data().empty())
             //If representation are not timelined, we have to adjust startPTS_ in rep::segments
             {
               for (std::vector<DASHTree::Representation*>::iterator
@@ -1442,11 +1939,11 @@ static void XMLCALL end(void* data, const char* el)
                 if ((*b)->flags_ & DASHTree::Representation::TIMELINE)
                   continue;
                 std::vector<uint32_t>::const_iterator sdb(
-                    dash->current_adaptationset_->segment_durations_.data.begin()),
-                    sde(dash->current_adaptationset_->segment_durations_.data.end());
+                    dash->current_adaptationset_->segment_durations_.data().begin()),
+                    sde(dash->current_adaptationset_->segment_durations_.data().end());
                 uint64_t spts(0);
-                for (std::vector<DASHTree::Segment>::iterator sb((*b)->segments_.data.begin()),
-                     se((*b)->segments_.data.end());
+                for (std::vector<DASHTree::Segment>::iterator sb((*b)->segments_.data().begin()),
+                     se((*b)->segments_.data().end());
                      sb != se && sdb != sde; ++sb, ++sdb)
                 {
                   sb->startPTS_ = spts;
@@ -1455,22 +1952,28 @@ static void XMLCALL end(void* data, const char* el)
                 (*b)->nextPts_ = spts;
               }
             }
+            dash->ShareSegments(dash->current_adaptationset_);
           }
         }
       }
       else if (dash->currentNode_ & MPDNODE_BASEURL) // Inside Period
       {
-        if (strcmp(el, "BaseURL") == 0)
+        if (element == MPDELEMENT_BASEURL)
         {
           while (dash->strXMLText_.size() &&
                  (dash->strXMLText_[0] == '\n' || dash->strXMLText_[0] == '\r'))
             dash->strXMLText_.erase(dash->strXMLText_.begin());
-          if (dash->strXMLText_.compare(0, 1, "/") == 0 ||
-              dash->strXMLText_.compare(0, 7, "http://") == 0 ||
-              dash->strXMLText_.compare(0, 8, "https://") == 0)
-            dash->current_period_->base_url_ = dash->strXMLText_;
-          else
-            dash->current_period_->base_url_ += dash->strXMLText_;
+          //Urls are built from the first BaseURL, further ones are alternates
+          if (AddBaseUrl(dash, dash->current_period_->base_urls_, dash->mpd_base_urls_,
+                         dash->mpd_url_))
+          {
+            if (dash->strXMLText_.compare(0, 1, "/") == 0 ||
+                dash->strXMLText_.compare(0, 7, "http://") == 0 ||
+                dash->strXMLText_.compare(0, 8, "https://") == 0)
+              dash->current_period_->base_url_ = dash->strXMLText_;
+            else
+              dash->current_period_->base_url_ += dash->strXMLText_;
+          }
           dash->currentNode_ &= ~MPDNODE_BASEURL;
         }
       }
@@ -1478,38 +1981,42 @@ static void XMLCALL end(void* data, const char* el)
       {
         if (dash->currentNode_ & MPDNODE_SEGMENTTIMELINE)
         {
-          if (strcmp(el, "SegmentTimeline") == 0)
+          if (element == MPDELEMENT_SEGMENTTIMELINE)
             dash->currentNode_ &= ~MPDNODE_SEGMENTTIMELINE;
         }
-        else if (strcmp(el, "SegmentList") == 0)
+        else if (element == MPDELEMENT_SEGMENTLIST)
           dash->currentNode_ &= ~MPDNODE_SEGMENTLIST;
-        else if (strcmp(el, "SegmentTemplate") == 0)
+        else if (element == MPDELEMENT_SEGMENTTEMPLATE)
           dash->currentNode_ &= ~MPDNODE_SEGMENTTEMPLATE;
       }
-      else if (strcmp(el, "Period") == 0)
+      else if (element == MPDELEMENT_PERIOD)
       {
         dash->currentNode_ &= ~MPDNODE_PERIOD;
       }
     }
     else if (dash->currentNode_ & MPDNODE_BASEURL) // Outside Period
     {
-      if (strcmp(el, "BaseURL") == 0)
+      if (element == MPDELEMENT_BASEURL)
       {
         while (dash->strXMLText_.size() &&
                (dash->strXMLText_[0] == '\n' || dash->strXMLText_[0] == '\r'))
           dash->strXMLText_.erase(dash->strXMLText_.begin());
-        if (dash->strXMLText_.compare(0, 1, "/") == 0 ||
-            dash->strXMLText_.compare(0, 7, "http://") == 0 ||
-            dash->strXMLText_.compare(0, 8, "https://") == 0)
-          dash->mpd_url_ = dash->strXMLText_;
-        else
-          dash->mpd_url_ += dash->strXMLText_;
+        //Urls are built from the first BaseURL, further ones are alternates
+        if (AddBaseUrl(dash, dash->mpd_base_urls_, std::vector<BaseUrl>(), dash->base_url_))
+        {
+          if (dash->strXMLText_.compare(0, 1, "/") == 0 ||
+              dash->strXMLText_.compare(0, 7, "http://") == 0 ||
+              dash->strXMLText_.compare(0, 8, "https://") == 0)
+            dash->mpd_url_ = dash->strXMLText_;
+          else
+            dash->mpd_url_ += dash->strXMLText_;
+        }
         dash->currentNode_ &= ~MPDNODE_BASEURL;
       }
     }
     else if (dash->currentNode_ & MPDNODE_LOCATION)
     {
-      if (strcmp(el, "Location") == 0)
+      if (element == MPDELEMENT_LOCATION)
       {
         while (dash->strXMLText_.size() &&
                (dash->strXMLText_[0] == '\n' || dash->strXMLText_[0] == '\r'))
@@ -1520,7 +2027,7 @@ static void XMLCALL end(void* data, const char* el)
         dash->currentNode_ &= ~MPDNODE_LOCATION;
       }
     }
-    else if (strcmp(el, "MPD") == 0)
+    else if (element == MPDELEMENT_MPD)
     {
       //cleanup periods
       for (std::vector<AdaptiveTree::Period*>::iterator b(dash->periods_.begin());
@@ -1605,9 +2112,170 @@ void DASHTree::RefreshSegments(Period* period,
   if ((type == VIDEO || type == AUDIO))
   {
     lastUpdated_ = std::chrono::system_clock::now();
-    RefreshUpdateThread();
-    RefreshLiveSegments();
+    // The caller holds the tree lock, only the update thread refreshes (without it)
+    RequestUpdate();
+  }
+}
+
+// Number based templates without timeline, their segments follow the wall clock
+static bool IsLiveTemplate(const DASHTree::Representation* rep)
+{
+  return (rep->flags_ & DASHTree::Representation::TEMPLATE) &&
+         !(rep->flags_ & DASHTree::Representation::TIMELINE) && rep->segtpl_.duration &&
+         !rep->segments_.empty();
+}
+
+uint32_t DASHTree::GetLiveSegmentNumber(const Period* period,
+                                        const Representation* rep,
+                                        uint64_t time) const
+{
+  const SegmentTemplate& tpl(rep->segtpl_);
+  const uint64_t periodStart(available_time_ * 1000 + period->start_);
+  if (time <= periodStart)
+    return tpl.startNumber;
+  return tpl.startNumber + static_cast<uint32_t>((time - periodStart) * tpl.timescale /
+                                                 (static_cast<uint64_t>(tpl.duration) * 1000));
+}
+
+uint64_t DASHTree::GetLiveSegmentAvailability(const Period* period,
+                                              const Representation* rep,
+                                              uint32_t number) const
+{
+  const SegmentTemplate& tpl(rep->segtpl_);
+  return available_time_ * 1000 + period->start_ +
+         static_cast<uint64_t>(number - tpl.startNumber + 1) * tpl.duration * 1000 /
+             tpl.timescale -
+         GetAvailabilityTimeOffset(tpl);
+}
+
+uint32_t DASHTree::GetLiveStartPosition(const Period* period, const Representation* rep)
+{
+  static const uint32_t DEFAULT_LIVE_LATENCY = 3000;
+
+  if (!low_latency_ || !IsLiveTemplate(rep))
+    return ~0U;
+
+  const uint32_t number(GetLiveSegmentNumber(
+      period, rep, GetNowTimeMs() - (live_latency_ ? live_latency_ : DEFAULT_LIVE_LATENCY)));
+  const uint32_t first(rep->segments_[0]->range_end_);
+  if (number <= first)
+    return 0;
+  return std::min(number - first, static_cast<uint32_t>(rep->segments_.size() - 1));
+}
+
+uint32_t DASHTree::ExtendLiveSegments(const Period* period, AdaptationSet* adp)
+{
+  uint32_t wait(~0U);
+  const uint64_t now(GetNowTimeMs());
+
+  for (Representation* rep : adp->representations_)
+  {
+    if (!IsLiveTemplate(rep))
+      continue;
+
+    const SegmentTemplate& tpl(rep->segtpl_);
+    const uint32_t next(GetLiveSegmentNumber(period, rep, now + GetAvailabilityTimeOffset(tpl)));
+    Segment seg(*rep->segments_[static_cast<uint32_t>(rep->segments_.size() - 1)]);
+    while (seg.range_end_ + 1 < next)
+    {
+      seg.startPTS_ += tpl.duration, seg.range_begin_ += tpl.duration;
+      ++seg.range_end_;
+      //The oldest segment is replaced, also for the representations sharing the segments
+      for (Representation* shared : adp->representations_)
+        if (shared->segments_.shares(rep->segments_))
+        {
+          if (shared->current_segment_ == shared->segments_[0])
+            shared->current_segment_ = nullptr;
+          ++shared->startNumber_;
+        }
+      rep->segments_.insert(seg);
+    }
+    rep->nextPts_ = seg.startPTS_ + tpl.duration;
+
+    if ((rep->flags_ & Representation::WAITFORSEGMENT) &&
+        rep->get_next_segment(rep->current_segment_))
+    {
+      rep->flags_ &= ~Representation::WAITFORSEGMENT;
+      Log(LOGLEVEL_DEBUG, "End WaitForSegment stream %s", rep->id.c_str());
+    }
+
+    const uint64_t available(GetLiveSegmentAvailability(period, rep, seg.range_end_ + 1));
+    if (available > now && available - now < wait)
+      wait = static_cast<uint32_t>(available - now);
+    else if (available <= now)
+      wait = 0;
+  }
+  return wait;
+}
+
+// Positions the representation at segment number segmentId again after its segments changed
+static void SetCurrentSegment(DASHTree::Representation* rep, uint32_t segmentId)
+{
+  if (!~segmentId || segmentId < rep->startNumber_)
+    rep->current_segment_ = nullptr;
+  else
+  {
+    if (segmentId >= rep->startNumber_ + rep->segments_.size())
+      segmentId = rep->startNumber_ + rep->segments_.size() - 1;
+    rep->current_segment_ = rep->get_segment(segmentId - rep->startNumber_);
+  }
+
+  if ((rep->flags_ & DASHTree::Representation::WAITFORSEGMENT) &&
+      rep->get_next_segment(rep->current_segment_))
+    rep->flags_ &= ~DASHTree::Representation::WAITFORSEGMENT;
+}
+
+// Merges a timeline parsed against its live representation: the segments before the refreshed
+// manifest are dropped, the new ones appended. Representations sharing the segments are merged
+// with it, they are added to merged.
+static void MergeTimeline(const DASHTree::Representation* update,
+                          const DASHTree::UpdateTarget& target,
+                          std::vector<const DASHTree::Representation*>& merged)
+{
+  DASHTree::Representation* live(target.rep_);
+  const bool numbered(update->startNumber_ > 1);
+  if (numbered && (update->startNumber_ < live->startNumber_ ||
+                   (update->startNumber_ == live->startNumber_ && update->segments_.empty())))
+    return;
+
+  // The segments are ordered by time
+  uint32_t drop(0), count(static_cast<uint32_t>(live->segments_.size()));
+  while (count)
+  {
+    const uint32_t half(count / 2);
+    if (live->segments_[drop + half]->range_begin_ < target.firstTime_)
+    {
+      drop += half + 1;
+      count -= half + 1;
+    }
+    else
+      count = half;
+  }
+  if (!drop && update->segments_.empty())
+    return;
+
+  std::vector<DASHTree::Representation*> sharing;
+  std::vector<uint32_t> segmentIds;
+  for (DASHTree::Representation* rep : target.adp_->representations_)
+    if (rep->segments_.shares(live->segments_))
+    {
+      sharing.push_back(rep);
+      segmentIds.push_back(rep->getCurrentSegmentNumber());
+    }
+
+  live->segments_.slide(drop, update->segments_.data());
+
+  for (size_t i(0); i < sharing.size(); ++i)
+  {
+    if (numbered && !live->segments_.empty())
+      sharing[i]->startNumber_ = static_cast<unsigned int>(live->segments_[0]->range_end_);
+    else
+      sharing[i]->startNumber_ += drop;
+    SetCurrentSegment(sharing[i], segmentIds[i]);
+    merged.push_back(sharing[i]);
   }
+  Log(LOGLEVEL_DEBUG, "DASH Timeline update: repid: %s dropped: %u added: %zu current_start:%u",
+      live->id.c_str(), drop, update->segments_.size(), live->startNumber_);
 }
 
 //Can be called form update-thread!
@@ -1618,6 +2286,10 @@ void DASHTree::RefreshLiveSegments()
     std::string replaced;
     uint32_t numReplace = ~0U;
     unsigned int nextStartNumber(~0);
+    DASHTree updateTree;
+
+    // The tree is locked while it is read and changed, not while the manifest is loaded
+    std::unique_lock<std::mutex> lck(treeMutex_);
     std::string::size_type update_parameter_pos = update_parameter_.find("$START_NUMBER$");
 
     if (~update_parameter_pos)
@@ -1651,7 +2323,6 @@ void DASHTree::RefreshLiveSegments()
       replaced.replace(update_parameter_pos, 14, buf);
     }
 
-    DASHTree updateTree;
     updateTree.manifest_headers_ = manifest_headers_;
     updateTree.base_time_ = base_time_;
     updateTree.supportedKeySystem_ = supportedKeySystem_;
@@ -1664,10 +2335,15 @@ void DASHTree::RefreshLiveSegments()
         updateTree.manifest_headers_["If-None-Match"] = "\"" + etag_ + "\"";
       if (!last_modified_.empty())
         updateTree.manifest_headers_["If-Modified-Since"] = last_modified_;
+      // Timelines are parsed as far as they are new
+      updateTree.live_tree_ = this;
     }
+    const std::string url(manifest_url_ + replaced);
+    lck.unlock();
 
-    if (updateTree.open(manifest_url_ + replaced, ""))
+    if (updateTree.open(url, ""))
     {
+      lck.lock();
       etag_ = updateTree.etag_;
       last_modified_ = updateTree.last_modified_;
       location_ = updateTree.location_;
@@ -1676,153 +2352,128 @@ void DASHTree::RefreshLiveSegments()
       if (~update_parameter_pos && updateTree.firstStartNumber_ < nextStartNumber)
         return;
 
-      std::vector<Period*>::const_iterator bpd(periods_.begin()), epd(periods_.end());
-      for (std::vector<Period*>::const_iterator bp(updateTree.periods_.begin()),
-           ep(updateTree.periods_.end());
-           bp != ep && bpd != epd; ++bp, ++bpd)
+      std::vector<const Representation*> merged;
+      for (size_t i(0); i < updateTree.periods_.size() && i < periods_.size(); ++i)
       {
-        for (std::vector<AdaptationSet*>::const_iterator ba((*bp)->adaptationSets_.begin()),
-             ea((*bp)->adaptationSets_.end());
-             ba != ea; ++ba)
+        for (AdaptationSet* adp : updateTree.periods_[i]->adaptationSets_)
         {
-          //Locate adaptationset
-          std::vector<AdaptationSet*>::const_iterator bad((*bpd)->adaptationSets_.begin()),
-              ead((*bpd)->adaptationSets_.end());
-          for (; bad != ead &&
-                 ((*bad)->id_ != (*ba)->id_ || (*bad)->group_ != (*ba)->group_ ||
-                  (*bad)->type_ != (*ba)->type_ || (*bad)->mimeType_ != (*ba)->mimeType_ ||
-                  (*bad)->language_ != (*ba)->language_);
-               ++bad)
-            ;
-          if (bad != ead)
+          for (Representation* rep : adp->representations_)
           {
-            for (std::vector<Representation*>::iterator br((*ba)->representations_.begin()),
-                 er((*ba)->representations_.end());
-                 br != er; ++br)
+            //Locate representation
+            AdaptationSet* liveAdp;
+            Representation* live(periods_[i]->FindRepresentation(adp, rep, &liveAdp));
+            if (!live)
+              continue;
+
+            const auto target(updateTree.update_targets_.find(rep));
+            if (target != updateTree.update_targets_.end() && ~target->second.firstTime_)
             {
-              //Locate representation
-              std::vector<Representation*>::const_iterator brd((*bad)->representations_.begin()),
-                  erd((*bad)->representations_.end());
-              for (; brd != erd && (*brd)->id != (*br)->id; ++brd)
-                ;
-              if (brd != erd && !(*br)->segments_.empty())
+              // Only the new segments were parsed, the live segments must be unchanged since
+              if (target->second.rep_ == live && target->second.adp_ == liveAdp &&
+                  !live->segments_.empty() &&
+                  live->segments_[static_cast<uint32_t>(live->segments_.size() - 1)]
+                          ->range_begin_ == target->second.lastTime_ &&
+                  std::find(merged.begin(), merged.end(), live) == merged.end())
               {
-                if (~update_parameter_pos) // partitial update
-                {
-                  //Here we go -> Insert new segments
-                  uint64_t ptsOffset = (*brd)->nextPts_ - (*br)->segments_[0]->startPTS_;
-                  uint32_t currentPos = (*brd)->getCurrentSegmentPos();
-                  unsigned int repFreeSegments(numReplace);
-                  std::vector<Segment>::iterator bs((*br)->segments_.data.begin()),
-                      es((*br)->segments_.data.end());
-                  for (; bs != es && repFreeSegments; ++bs)
-                  {
-                    Log(LOGLEVEL_DEBUG, "DASH Update: insert repid: %s url: %s", (*br)->id.c_str(),
-                        bs->url);
-                    if ((*brd)->flags_ & Representation::URLSEGMENTS)
-                      delete[](*brd)->segments_[0]->url;
-                    bs->startPTS_ += ptsOffset;
-                    (*brd)->segments_.insert(*bs);
-                    if ((*brd)->flags_ & Representation::URLSEGMENTS)
-                      bs->url = nullptr;
-                    ++(*brd)->startNumber_;
-                    --repFreeSegments;
-                  }
-                  //We have renewed the current segment
-                  if (!repFreeSegments && numReplace == currentPos + 1)
-                    (*brd)->current_segment_ = nullptr;
+                MergeTimeline(rep, target->second, merged);
+                overallSeconds_ = updateTree.overallSeconds_;
+              }
+              continue;
+            }
+            if (rep->segments_.empty())
+              continue;
 
-                  if (((*brd)->flags_ & Representation::WAITFORSEGMENT) &&
-                      (*brd)->get_next_segment((*brd)->current_segment_))
-                  {
-                    (*brd)->flags_ &= ~Representation::WAITFORSEGMENT;
-                    Log(LOGLEVEL_DEBUG, "End WaitForSegment stream %s", (*brd)->id.c_str());
-                  }
+            if (~update_parameter_pos) // partitial update
+            {
+              //Here we go -> Insert new segments, they may differ from the shared ones
+              live->segments_.detach();
+              uint64_t ptsOffset = live->nextPts_ - rep->segments_[0]->startPTS_;
+              uint32_t currentPos = live->getCurrentSegmentPos();
+              unsigned int repFreeSegments(numReplace);
+              std::vector<Segment>::iterator bs(rep->segments_.data().begin()),
+                  es(rep->segments_.data().end());
+              for (; bs != es && repFreeSegments; ++bs)
+              {
+                Log(LOGLEVEL_DEBUG, "DASH Update: insert repid: %s url: %s", rep->id.c_str(),
+                    bs->url);
+                if (live->flags_ & Representation::URLSEGMENTS)
+                  StringArena::Release(live->segments_[0]->url);
+                bs->startPTS_ += ptsOffset;
+                live->segments_.insert(*bs);
+                if (live->flags_ & Representation::URLSEGMENTS)
+                  bs->url = nullptr;
+                ++live->startNumber_;
+                --repFreeSegments;
+              }
+              //We have renewed the current segment
+              if (!repFreeSegments && numReplace == currentPos + 1)
+                live->current_segment_ = nullptr;
 
-                  if (bs == es)
-                    (*brd)->nextPts_ += (*br)->nextPts_;
-                  else
-                    (*brd)->nextPts_ += bs->startPTS_;
+              if ((live->flags_ & Representation::WAITFORSEGMENT) &&
+                  live->get_next_segment(live->current_segment_))
+              {
+                live->flags_ &= ~Representation::WAITFORSEGMENT;
+                Log(LOGLEVEL_DEBUG, "End WaitForSegment stream %s", live->id.c_str());
+              }
+
+              if (bs == es)
+                live->nextPts_ += rep->nextPts_;
+              else
+                live->nextPts_ += bs->startPTS_;
+            }
+            else if (rep->startNumber_ <= 1) //Full update, be careful with startnumbers!
+            {
+              //TODO: check if first element or size differs
+              unsigned int segmentId(live->getCurrentSegmentNumber());
+              if (rep->flags_ & DASHTree::Representation::TIMELINE)
+              {
+                uint64_t search_pts = rep->segments_[0]->range_begin_;
+                for (const auto& s : live->segments_.data())
+                {
+                  if (s.range_begin_ >= search_pts)
+                    break;
+                  ++live->startNumber_;
                 }
-                else if ((*br)->startNumber_ <= 1) //Full update, be careful with startnumbers!
+              }
+              else if (rep->segments_[0]->startPTS_ == live->segments_[0]->startPTS_)
+              {
+                uint64_t search_re = rep->segments_[0]->range_end_;
+                for (const auto& s : live->segments_.data())
                 {
-                  //TODO: check if first element or size differs
-                  unsigned int segmentId((*brd)->getCurrentSegmentNumber());
-                  if ((*br)->flags_ & DASHTree::Representation::TIMELINE)
-                  {
-                    uint64_t search_pts = (*br)->segments_[0]->range_begin_;
-                    for (const auto& s : (*brd)->segments_.data)
-                    {
-                      if (s.range_begin_ >= search_pts)
-                        break;
-                      ++(*brd)->startNumber_;
-                    }
-                  }
-                  else if ((*br)->segments_[0]->startPTS_ == (*brd)->segments_[0]->startPTS_)
-                  {
-                    uint64_t search_re = (*br)->segments_[0]->range_end_;
-                    for (const auto& s : (*brd)->segments_.data)
-                    {
-                      if (s.range_end_ >= search_re)
-                        break;
-                      ++(*brd)->startNumber_;
-                    }
-                  }
-                  else
-                  {
-                    uint64_t search_pts = (*br)->segments_[0]->startPTS_;
-                    for (const auto& s : (*brd)->segments_.data)
-                    {
-                      if (s.startPTS_ >= search_pts)
-                        break;
-                      ++(*brd)->startNumber_;
-                    }
-                  }
-
-                  (*br)->segments_.swap((*brd)->segments_);
-                  if (!~segmentId || segmentId < (*brd)->startNumber_)
-                    (*brd)->current_segment_ = nullptr;
-                  else
-                  {
-                    if (segmentId >= (*brd)->startNumber_ + (*brd)->segments_.size())
-                      segmentId = (*brd)->startNumber_ + (*brd)->segments_.size() - 1;
-                    (*brd)->current_segment_ =
-                        (*brd)->get_segment(segmentId - (*brd)->startNumber_);
-                  }
-
-                  if (((*brd)->flags_ & Representation::WAITFORSEGMENT) &&
-                      (*brd)->get_next_segment((*brd)->current_segment_))
-                    (*brd)->flags_ &= ~Representation::WAITFORSEGMENT;
-
-                  Log(LOGLEVEL_DEBUG, "DASH Full update (w/o startnum): repid: %s current_start:%u",
-                      (*br)->id.c_str(), (*brd)->startNumber_);
-                  overallSeconds_ = updateTree.overallSeconds_;
+                  if (s.range_end_ >= search_re)
+                    break;
+                  ++live->startNumber_;
                 }
-                else if ((*br)->startNumber_ > (*brd)->startNumber_ ||
-                         ((*br)->startNumber_ == (*brd)->startNumber_ &&
-                          (*br)->segments_.size() > (*brd)->segments_.size()))
+              }
+              else
+              {
+                uint64_t search_pts = rep->segments_[0]->startPTS_;
+                for (const auto& s : live->segments_.data())
                 {
-                  unsigned int segmentId((*brd)->getCurrentSegmentNumber());
-                  (*br)->segments_.swap((*brd)->segments_);
-                  (*brd)->startNumber_ = (*br)->startNumber_;
-                  if (!~segmentId || segmentId < (*brd)->startNumber_)
-                    (*brd)->current_segment_ = nullptr;
-                  else
-                  {
-                    if (segmentId >= (*brd)->startNumber_ + (*brd)->segments_.size())
-                      segmentId = (*brd)->startNumber_ + (*brd)->segments_.size() - 1;
-                    (*brd)->current_segment_ =
-                        (*brd)->get_segment(segmentId - (*brd)->startNumber_);
-                  }
-
-                  if (((*brd)->flags_ & Representation::WAITFORSEGMENT) &&
-                      (*brd)->get_next_segment((*brd)->current_segment_))
-                    (*brd)->flags_ &= ~Representation::WAITFORSEGMENT;
-
-                  Log(LOGLEVEL_DEBUG, "DASH Full update (w/ startnum): repid: %s current_start:%u",
-                      (*br)->id.c_str(), (*brd)->startNumber_);
+                  if (s.startPTS_ >= search_pts)
+                    break;
+                  ++live->startNumber_;
                 }
               }
+
+              rep->segments_.swap(live->segments_);
+              SetCurrentSegment(live, segmentId);
+
+              Log(LOGLEVEL_DEBUG, "DASH Full update (w/o startnum): repid: %s current_start:%u",
+                  rep->id.c_str(), live->startNumber_);
+              overallSeconds_ = updateTree.overallSeconds_;
+            }
+            else if (rep->startNumber_ > live->startNumber_ ||
+                     (rep->startNumber_ == live->startNumber_ &&
+                      rep->segments_.size() > live->segments_.size()))
+            {
+              unsigned int segmentId(live->getCurrentSegmentNumber());
+              rep->segments_.swap(live->segments_);
+              live->startNumber_ = rep->startNumber_;
+              SetCurrentSegment(live, segmentId);
+
+              Log(LOGLEVEL_DEBUG, "DASH Full update (w/ startnum): repid: %s current_start:%u",
+                  rep->id.c_str(), live->startNumber_);
             }
           }
         }
@@ -20,6 +20,8 @@
 
 #include "../common/AdaptiveTree.h"
 
+#include <unordered_map>
+
 #include <kodi/AddonBase.h>
 
 namespace adaptive
@@ -35,13 +37,51 @@ public:
                                AdaptationSet* adp,
                                Representation* rep,
                                StreamType type) override;
+  virtual uint32_t GetLiveStartPosition(const Period* period, const Representation* rep) override;
+  virtual uint32_t ExtendLiveSegments(const Period* period, AdaptationSet* adp) override;
 
   virtual uint64_t GetNowTime() { return time(0); };
+  virtual uint64_t GetNowTimeMs()
+  {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  };
+  // Number of the templated live segment produced at time (ms since epoch)
+  uint32_t GetLiveSegmentNumber(const Period* period,
+                                const Representation* rep,
+                                uint64_t time) const;
+  // Time (ms since epoch) the templated live segment can be requested
+  uint64_t GetLiveSegmentAvailability(const Period* period,
+                                      const Representation* rep,
+                                      uint32_t number) const;
   void SetUpdateInterval(uint32_t interval) { updateInterval_ = interval; };
   uint64_t pts_helper_, timeline_time_;
   uint32_t firstStartNumber_;
   std::string current_playready_wrmheader_;
   std::string mpd_url_;
+  // Alternates of the MPD level BaseURL, BaseURL attributes while its text is parsed
+  std::vector<BaseUrl> mpd_base_urls_;
+  BaseUrl current_base_url_;
+  // BaseURL elements seen in the current MPD / Period / AdaptationSet / Representation
+  unsigned int base_url_count_ = 0;
+
+  // Live representation a refresh is merged into, segments of a timeline
+  // up to its newest one (lastTime_) are only counted in skipped_
+  struct UpdateTarget
+  {
+    AdaptationSet* adp_ = nullptr;
+    Representation* rep_ = nullptr;
+    uint64_t lastTime_ = 0;
+    // range_begin_ of the first segment in the refreshed manifest
+    uint64_t firstTime_ = ~0ULL;
+    uint32_t skipped_ = 0;
+  };
+  // Set while a refresh is parsed: the live tree, locked for lookups only, and the targets
+  // of the parsed representations
+  DASHTree* live_tree_ = nullptr;
+  std::unordered_map<const Representation*, UpdateTarget> update_targets_;
+  UpdateTarget* current_update_target_ = nullptr;
 
 protected:
   virtual void RefreshLiveSegments() override;
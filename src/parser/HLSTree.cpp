@@ -29,27 +29,6 @@
 
 using namespace adaptive;
 
-static void parseLine(const std::string& line,
-                      size_t offset,
-                      std::map<std::string, std::string>& map)
-{
-  size_t value, end;
-  map.clear();
-  while (offset < line.size() && (value = line.find('=', offset)) != std::string::npos)
-  {
-    while (offset < line.size() && line[offset] == ' ')
-      ++offset;
-    end = value;
-    uint8_t inValue(0);
-    while (++end < line.size() && ((inValue & 1) || line[end] != ','))
-      if (line[end] == '\"')
-        ++inValue;
-    map[line.substr(offset, value - offset)] =
-        line.substr(value + (inValue ? 2 : 1), end - value - (inValue ? 3 : 1));
-    offset = end + 1;
-  }
-}
-
 static void parseResolution(std::uint16_t& width, std::uint16_t& height, const std::string& val)
 {
   std::string::size_type pos(val.find('x'));
@@ -88,15 +67,66 @@ static std::string getAudioCodec(const std::string& codecs)
     return "aac";
 }
 
+// Allocates the url of a segment, relative urls are prefixed with baseUrl
+static const char* createUrl(StringArena& arena, const std::string& baseUrl, const M3U8Value& uri)
+{
+  static const char SCHEME[] = "://";
+  const char* uriEnd(uri.data_ + uri.size_);
+  const size_t prefix(
+      uri.data_[0] != '/' && std::search(uri.data_, uriEnd, SCHEME, SCHEME + 3) == uriEnd
+          ? baseUrl.size()
+          : 0);
+  char* url(arena.Allocate(prefix + uri.size_ + 1));
+  memcpy(url, baseUrl.data(), prefix);
+  memcpy(url + prefix, uri.data_, uri.size_);
+  url[prefix + uri.size_] = 0;
+  return url;
+}
+
+// Appends the parts of a segment as own url segments
+static void addParts(StringArena& arena,
+                     std::vector<std::pair<uint64_t, M3U8Value>>& parts,
+                     const std::string& baseUrl,
+                     uint32_t sequence,
+                     AdaptiveTree::Segment segment,
+                     SPINCACHE<AdaptiveTree::Segment>& segments)
+{
+  for (const auto& part : parts)
+  {
+    segment.startPTS_ = part.first;
+    segment.range_end_ = sequence;
+    segment.url = createUrl(arena, baseUrl, part.second);
+    segments.data().push_back(segment);
+  }
+  parts.clear();
+}
+
+// Number of entries up to the newest known one, which is identified by its url.
+// A preload hint not listed anymore is replaced by the last entry of its sequence.
+static size_t countKnownEntries(const std::vector<AdaptiveTree::Segment>& segments,
+                                const AdaptiveTree::Segment& last)
+{
+  size_t pos(segments.size());
+  while (pos && strcmp(segments[pos - 1].url, last.url) != 0)
+    --pos;
+  if (!pos)
+    while (pos < segments.size() && segments[pos].range_end_ <= last.range_end_)
+      ++pos;
+  return pos;
+}
+
 HLSTree::~HLSTree()
 {
   delete m_decrypter;
 }
 
-int HLSTree::processEncryption(std::string baseUrl, std::map<std::string, std::string>& map)
+int HLSTree::processEncryption(std::string baseUrl, const M3U8Value& attributes)
 {
+  const M3U8Value method(M3U8Tokenizer::GetAttribute(attributes, "METHOD"));
+  const M3U8Value uri(M3U8Tokenizer::GetAttribute(attributes, "URI"));
+
   // NO ENCRYPTION
-  if (map["METHOD"] == "NONE")
+  if (method == "NONE")
   {
     current_pssh_.clear();
 
@@ -104,23 +134,26 @@ int HLSTree::processEncryption(std::string baseUrl, std::map<std::string, std::s
   }
 
   // AES-128
-  if (map["METHOD"] == "AES-128" && !map["URI"].empty())
+  if (method == "AES-128" && !uri.empty())
   {
-    current_pssh_ = map["URI"];
+    current_pssh_ = uri.str();
     if (current_pssh_[0] != '/' && current_pssh_.find("://") == std::string::npos)
       current_pssh_ = baseUrl + current_pssh_;
 
-    current_iv_ = m_decrypter->convertIV(map["IV"]);
+    current_iv_ = m_decrypter->convertIV(M3U8Tokenizer::GetAttribute(attributes, "IV").str());
 
     return ENCRYPTIONTYPE_AES128;
   }
 
   // WIDEVINE
-  if (map["KEYFORMAT"] == "urn:uuid:edef8ba9-79d6-4ace-a3c8-27dcd51d21ed" && !map["URI"].empty())
+  if (M3U8Tokenizer::GetAttribute(attributes, "KEYFORMAT") ==
+          "urn:uuid:edef8ba9-79d6-4ace-a3c8-27dcd51d21ed" &&
+      !uri.empty())
   {
-    if (!map["KEYID"].empty())
+    const M3U8Value keyId(M3U8Tokenizer::GetAttribute(attributes, "KEYID"));
+    if (!keyId.empty())
     {
-      std::string keyid = map["KEYID"].substr(2);
+      std::string keyid = keyId.str().substr(2);
       const char* defaultKID = keyid.c_str();
       current_defaultKID_.resize(16);
       for (unsigned int i(0); i < 16; ++i)
@@ -132,7 +165,7 @@ int HLSTree::processEncryption(std::string baseUrl, std::map<std::string, std::s
       }
     }
 
-    current_pssh_ = map["URI"].substr(23);
+    current_pssh_ = uri.str().substr(23);
     // Try to get KID from pssh, we assume len+'pssh'+version(0)+systemid+lenkid+kid
     if (current_defaultKID_.empty() && current_pssh_.size() == 68)
     {
@@ -147,9 +180,9 @@ int HLSTree::processEncryption(std::string baseUrl, std::map<std::string, std::s
   }
 
   // KNOWN UNSUPPORTED
-  if (map["METHOD"] == "SAMPLE-AES")
+  if (method == "SAMPLE-AES")
   {
-    Log(LOGLEVEL_ERROR, "Unsupported encryption method: %s", map["METHOD"].c_str());
+    Log(LOGLEVEL_ERROR, "Unsupported encryption method: %s", method.str().c_str());
     return ENCRYPTIONTYPE_INVALID;
   }
 
@@ -159,20 +192,22 @@ int HLSTree::processEncryption(std::string baseUrl, std::map<std::string, std::s
 bool HLSTree::open(const std::string& url, const std::string& manifestUpdateParam)
 {
   PrepareManifestUrl(url, manifestUpdateParam);
-  if (download(manifest_url_.c_str(), manifest_headers_, &manifest_stream))
-    return processManifest(manifest_stream);
+  std::string manifest;
+  if (download(manifest_url_.c_str(), manifest_headers_, &manifest))
+    return processManifest(manifest);
   return false;
 }
 
-bool HLSTree::processManifest(std::stringstream& stream)
+bool HLSTree::processManifest(const std::string& manifest)
 {
 #if FILEDEBUG
   FILE* f = fopen("inputstream_adaptive_master.m3u8", "w");
-  fwrite(m_stream.str().data(), 1, m_stream.str().size(), f);
+  fwrite(manifest.data(), 1, manifest.size(), f);
   fclose(f);
 #endif
 
-  std::string line;
+  M3U8Tokenizer tokenizer(manifest.data(), manifest.size());
+  M3U8Value line, attributes;
   bool startCodeFound = false;
 
   current_adaptationset_ = nullptr;
@@ -182,36 +217,28 @@ bool HLSTree::processManifest(std::stringstream& stream)
   current_period_ = periods_.back();
   current_period_->timescale_ = 1000000;
 
-  std::map<std::string, std::string> map;
-
-  while (std::getline(stream, line))
+  while (tokenizer.NextLine(line))
   {
     if (!startCodeFound)
     {
-      if (line.compare(0, 7, "#EXTM3U") == 0)
+      if (M3U8Tokenizer::IsTag(line, "#EXTM3U"))
         startCodeFound = true;
       continue;
     }
 
-    std::string::size_type sz(line.size());
-    while (sz && (line[sz - 1] == '\r' || line[sz - 1] == '\n' || line[sz - 1] == ' '))
-      --sz;
-    line.resize(sz);
-
-    if (line.compare(0, 13, "#EXT-X-MEDIA:") == 0)
+    if (M3U8Tokenizer::IsTag(line, "#EXT-X-MEDIA:", attributes))
     {
       //#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID="bipbop_audio",LANGUAGE="eng",NAME="BipBop Audio 2",AUTOSELECT=NO,DEFAULT=NO,URI="alternate_audio_aac_sinewave/prog_index.m3u8"
-      parseLine(line, 13, map);
-
+      const M3U8Value mediaType(M3U8Tokenizer::GetAttribute(attributes, "TYPE"));
       StreamType type;
-      if (map["TYPE"] == "AUDIO")
+      if (mediaType == "AUDIO")
         type = AUDIO;
-      else if (map["TYPE"] == "SUBTITLES")
+      else if (mediaType == "SUBTITLES")
         type = SUBTITLE;
       else
         continue;
 
-      EXTGROUP& group = m_extGroups[map["GROUP-ID"]];
+      EXTGROUP& group = m_extGroups[M3U8Tokenizer::GetAttribute(attributes, "GROUP-ID").str()];
 
       AdaptationSet* adp = new AdaptationSet();
       Representation* rep = new Representation();
@@ -219,20 +246,20 @@ bool HLSTree::processManifest(std::stringstream& stream)
       group.m_sets.push_back(adp);
 
       adp->type_ = type;
-      adp->language_ = map["LANGUAGE"];
+      adp->language_ = M3U8Tokenizer::GetAttribute(attributes, "LANGUAGE").str();
       adp->timescale_ = 1000000;
-      adp->name_ = map["NAME"];
-      adp->default_ = map["DEFAULT"] == "YES";
-      adp->forced_ = map["FORCED"] == "YES";
+      adp->name_ = M3U8Tokenizer::GetAttribute(attributes, "NAME").str();
+      adp->default_ = M3U8Tokenizer::GetAttribute(attributes, "DEFAULT") == "YES";
+      adp->forced_ = M3U8Tokenizer::GetAttribute(attributes, "FORCED") == "YES";
 
       rep->codecs_ = group.m_codec;
       rep->timescale_ = 1000000;
       rep->containerType_ = CONTAINERTYPE_NOTYPE;
 
-      std::map<std::string, std::string>::iterator res;
-      if ((res = map.find("URI")) != map.end())
+      const M3U8Value uri(M3U8Tokenizer::GetAttribute(attributes, "URI"));
+      if (!uri.empty())
       {
-        rep->source_url_ = BuildDownloadUrl(res->second);
+        rep->source_url_ = BuildDownloadUrl(uri.str());
 
         // default to WebVTT
         if (type == SUBTITLE)
@@ -244,20 +271,22 @@ bool HLSTree::processManifest(std::stringstream& stream)
         current_period_->included_types_ |= 1U << type;
       }
 
-      if ((res = map.find("CHANNELS")) != map.end())
-        rep->channelCount_ = atoi(res->second.c_str());
+      const M3U8Value channels(M3U8Tokenizer::GetAttribute(attributes, "CHANNELS"));
+      if (!channels.empty())
+        rep->channelCount_ = static_cast<uint32_t>(channels.ToUInt());
     }
-    else if (line.compare(0, 18, "#EXT-X-STREAM-INF:") == 0)
+    else if (M3U8Tokenizer::IsTag(line, "#EXT-X-STREAM-INF:", attributes))
     {
       // TODO: If CODECS value is not present, get StreamReps from stream program section
       //#EXT-X-STREAM-INF:BANDWIDTH=263851,CODECS="mp4a.40.2, avc1.4d400d",RESOLUTION=416x234,AUDIO="bipbop_audio",SUBTITLES="subs"
-      parseLine(line, 18, map);
-
       current_representation_ = nullptr;
 
-      if (map.find("BANDWIDTH") == map.end())
+      const M3U8Value bandwidth(M3U8Tokenizer::GetAttribute(attributes, "BANDWIDTH"));
+      if (bandwidth.empty())
         continue;
 
+      const std::string codecs(M3U8Tokenizer::GetAttribute(attributes, "CODECS").str());
+
       if (!current_adaptationset_)
       {
         current_adaptationset_ = new AdaptationSet();
@@ -268,29 +297,32 @@ bool HLSTree::processManifest(std::stringstream& stream)
       current_representation_ = new Representation();
       current_adaptationset_->representations_.push_back(current_representation_);
       current_representation_->timescale_ = 1000000;
-      current_representation_->codecs_ = getVideoCodec(map["CODECS"]);
-      current_representation_->bandwidth_ = atoi(map["BANDWIDTH"].c_str());
+      current_representation_->codecs_ = getVideoCodec(codecs);
+      current_representation_->bandwidth_ = static_cast<uint32_t>(bandwidth.ToUInt());
       current_representation_->containerType_ = CONTAINERTYPE_NOTYPE;
 
-      if (map.find("RESOLUTION") != map.end())
+      const M3U8Value resolution(M3U8Tokenizer::GetAttribute(attributes, "RESOLUTION"));
+      if (!resolution.empty())
         parseResolution(current_representation_->width_, current_representation_->height_,
-                        map["RESOLUTION"]);
+                        resolution.str());
 
-      if (map.find("AUDIO") != map.end())
-        m_extGroups[map["AUDIO"]].setCodec(getAudioCodec(map["CODECS"]));
+      const M3U8Value audio(M3U8Tokenizer::GetAttribute(attributes, "AUDIO"));
+      if (!audio.empty())
+        m_extGroups[audio.str()].setCodec(getAudioCodec(codecs));
       else
       {
         // We assume audio is included
         current_period_->included_types_ |= 1U << AUDIO;
-        m_audioCodec = getAudioCodec(map["CODECS"]);
+        m_audioCodec = getAudioCodec(codecs);
       }
-      if (map.find("FRAME-RATE") != map.end())
+      const M3U8Value frameRate(M3U8Tokenizer::GetAttribute(attributes, "FRAME-RATE"));
+      if (!frameRate.empty())
       {
-        current_representation_->fpsRate_ = static_cast<int>(std::stof(map["FRAME-RATE"]) * 1000);
+        current_representation_->fpsRate_ = static_cast<int>(frameRate.ToDouble() * 1000);
         current_representation_->fpsScale_ = 1000;
       }
     }
-    else if (line.compare(0, 8, "#EXTINF:") == 0)
+    else if (M3U8Tokenizer::IsTag(line, "#EXTINF:"))
     {
       //Uh, this is not a multi - bitrate playlist
       current_adaptationset_ = new AdaptationSet();
@@ -311,9 +343,9 @@ bool HLSTree::processManifest(std::stringstream& stream)
       m_audioCodec = getAudioCodec("");
       break;
     }
-    else if (!line.empty() && line.compare(0, 1, "#") != 0 && current_representation_)
+    else if (line.data_[0] != '#' && current_representation_)
     {
-      current_representation_->source_url_ = BuildDownloadUrl(line);
+      current_representation_->source_url_ = BuildDownloadUrl(line.str());
 
       //Ignore duplicate reps
       for (auto const* rep : current_adaptationset_->representations_)
@@ -326,11 +358,10 @@ bool HLSTree::processManifest(std::stringstream& stream)
           break;
         }
     }
-    else if (line.compare(0, 19, "#EXT-X-SESSION-KEY:") == 0)
+    else if (M3U8Tokenizer::IsTag(line, "#EXT-X-SESSION-KEY:", attributes))
     {
-      parseLine(line, 19, map);
       uint32_t encryption_type;
-      switch (encryption_type = processEncryption(base_url_, map))
+      switch (encryption_type = processEncryption(base_url_, attributes))
       {
         case ENCRYPTIONTYPE_INVALID:
           return false;
@@ -380,6 +411,66 @@ HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
                                                        AdaptationSet* adp,
                                                        Representation* rep,
                                                        bool update)
+{
+  return prepareRepresentation(period, adp, rep, update, std::string(), true);
+}
+
+HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
+                                                       AdaptationSet* adp,
+                                                       Representation* rep,
+                                                       bool update,
+                                                       const std::string& urlParams,
+                                                       bool deltaUpdate)
+{
+  PLAYLIST playlist;
+  PreparePlaylist(rep, update, urlParams, deltaUpdate, playlist);
+  if (!(rep->flags_ & Representation::DOWNLOADED))
+    DownloadPlaylist(playlist);
+
+  PREPARE_RESULT ret(prepareRepresentation(period, adp, rep, update, playlist));
+  // The current list misses skipped segments, load the whole playlist
+  if (playlist.reload)
+    return prepareRepresentation(period, adp, rep, update, urlParams, false);
+  return ret;
+}
+
+void HLSTree::PreparePlaylist(const Representation* rep,
+                              bool update,
+                              const std::string& urlParams,
+                              bool deltaUpdate,
+                              PLAYLIST& playlist) const
+{
+  playlist = PLAYLIST();
+  playlist.url = rep->source_url_;
+  std::string params(urlParams);
+
+  // The known segments can be skipped while they are younger than half the skip boundary
+  std::map<std::string, LIVEPLAYLIST>::const_iterator livePlaylist(
+      m_livePlaylists.find(rep->source_url_));
+  playlist.deltaUpdate = deltaUpdate && update && m_canSkipUntil &&
+                         (rep->flags_ & Representation::URLSEGMENTS) && !rep->segments_.empty() &&
+                         periods_.size() == 1 && livePlaylist != m_livePlaylists.end() &&
+                         std::chrono::steady_clock::now() - livePlaylist->second.updated <
+                             std::chrono::milliseconds(m_canSkipUntil / 2);
+  if (playlist.deltaUpdate)
+    params += params.empty() ? "_HLS_skip=YES" : "&_HLS_skip=YES";
+
+  if (!params.empty())
+    playlist.url += (playlist.url.find('?') == std::string::npos ? "?" : "&") + params;
+}
+
+bool HLSTree::DownloadPlaylist(PLAYLIST& playlist)
+{
+  playlist.loaded = download(playlist.url.c_str(), manifest_headers_, &playlist.data, false);
+  playlist.effectiveUrl = effective_url_;
+  return playlist.loaded;
+}
+
+HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
+                                                       AdaptationSet* adp,
+                                                       Representation* rep,
+                                                       bool update,
+                                                       PLAYLIST& loadedPlaylist)
 {
   if (!rep->source_url_.empty())
   {
@@ -387,7 +478,7 @@ HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
     unsigned int newStartNumber;
     Segment newInitialization;
     uint32_t segmentId(rep->getCurrentSegmentNumber());
-    std::stringstream stream;
+    const std::string& playlist(loadedPlaylist.data);
     uint32_t adp_pos =
         std::find(period->adaptationSets_.begin(), period->adaptationSets_.end(), adp) -
         period->adaptationSets_.begin();
@@ -400,26 +491,36 @@ HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
 
     if (rep->flags_ & Representation::DOWNLOADED)
       ;
-    else if (download(rep->source_url_.c_str(), manifest_headers_, &stream, false))
+    else if (loadedPlaylist.loaded)
     {
 #if FILEDEBUG
       FILE* f = fopen("inputstream_adaptive_sub.m3u8", "w");
-      fwrite(m_stream.str().data(), 1, m_stream.str().size(), f);
+      fwrite(playlist.data(), 1, playlist.size(), f);
       fclose(f);
 #endif
       bool byteRange(false);
       bool segmentInitialization(false);
       bool hasMap(false);
-      std::string line;
+      M3U8Tokenizer tokenizer(playlist.data(), playlist.size());
+      M3U8Value line, value;
       std::string base_url;
       std::string map_url;
 
-      std::map<std::string, std::string> map;
       bool startCodeFound(false);
       Segment segment;
       uint64_t pts(0);
       newStartNumber = 0;
 
+      // Low latency, the parts of the newest segments are played instead of the segments
+      bool useParts(false);
+      std::vector<std::pair<uint64_t, M3U8Value>> parts;
+      M3U8Value preloadHint;
+      uint64_t partPts(0);
+      uint32_t mediaSequence(0);
+
+      // Delta update, segments from skipStart on are taken from the current list
+      uint32_t skipStart(0), skipped(0);
+
       uint32_t currentEncryptionType = ENCRYPTIONTYPE_CLEAR;
 
       segment.range_begin_ = ~0ULL;
@@ -427,59 +528,106 @@ HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
       segment.startPTS_ = ~0ULL;
       segment.pssh_set_ = 0;
 
-      std::string::size_type paramPos = effective_url_.find('?');
+      const std::string& effectiveUrl(loadedPlaylist.effectiveUrl);
+      std::string::size_type paramPos = effectiveUrl.find('?');
       base_url =
-          (paramPos == std::string::npos) ? effective_url_ : effective_url_.substr(0, paramPos);
+          (paramPos == std::string::npos) ? effectiveUrl : effectiveUrl.substr(0, paramPos);
 
       paramPos = base_url.rfind('/');
       if (paramPos != std::string::npos)
         base_url = base_url.substr(0, paramPos + 1);
 
-      while (std::getline(stream, line))
+      while (tokenizer.NextLine(line))
       {
         if (!startCodeFound)
         {
-          if (line.compare(0, 7, "#EXTM3U") == 0)
+          if (M3U8Tokenizer::IsTag(line, "#EXTM3U"))
             startCodeFound = true;
           continue;
         }
 
-        std::string::size_type sz(line.size());
-        while (sz && (line[sz - 1] == '\r' || line[sz - 1] == '\n' || line[sz - 1] == ' '))
-          --sz;
-        line.resize(sz);
-
-        if (line.compare(0, 8, "#EXTINF:") == 0)
+        if (M3U8Tokenizer::IsTag(line, "#EXTINF:", value))
         {
           segment.startPTS_ = pts;
-          pts += static_cast<uint64_t>(atof(line.c_str() + 8) * rep->timescale_);
+          pts += static_cast<uint64_t>(value.ToDouble() * rep->timescale_);
+        }
+        else if (M3U8Tokenizer::IsTag(line, "#EXT-X-PART:", value))
+        {
+          //#EXT-X-PART:DURATION=1.00000,URI="seg10.part1.m4s",INDEPENDENT=YES
+          // Parts addressed by byte ranges of the growing segment are not supported
+          if (!M3U8Tokenizer::GetAttribute(value, "BYTERANGE").empty())
+          {
+            useParts = false;
+            parts.clear();
+          }
+          const M3U8Value uri(M3U8Tokenizer::GetAttribute(value, "URI"));
+          if (useParts && !uri.empty() && M3U8Tokenizer::GetAttribute(value, "GAP") != "YES")
+            parts.push_back(std::make_pair(partPts, uri));
+          partPts += static_cast<uint64_t>(
+              M3U8Tokenizer::GetAttribute(value, "DURATION").ToDouble() * rep->timescale_);
+        }
+        else if (M3U8Tokenizer::IsTag(line, "#EXT-X-PRELOAD-HINT:", value))
+        {
+          //#EXT-X-PRELOAD-HINT:TYPE=PART,URI="seg10.part2.m4s"
+          if (M3U8Tokenizer::GetAttribute(value, "TYPE") == "PART" &&
+              M3U8Tokenizer::GetAttribute(value, "BYTERANGE-START").empty())
+            preloadHint = M3U8Tokenizer::GetAttribute(value, "URI");
         }
-        else if (line.compare(0, 17, "#EXT-X-BYTERANGE:") == 0)
+        else if (M3U8Tokenizer::IsTag(line, "#EXT-X-PART-INF:", value))
         {
-          std::string::size_type bs = line.rfind('@');
-          if (bs != std::string::npos)
+          m_partTarget = static_cast<uint32_t>(
+              M3U8Tokenizer::GetAttribute(value, "PART-TARGET").ToDouble() * 1000);
+          useParts = m_partTarget != 0 && !byteRange;
+        }
+        else if (M3U8Tokenizer::IsTag(line, "#EXT-X-SERVER-CONTROL:", value))
+        {
+          //#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=3.0
+          m_canBlockReload = M3U8Tokenizer::GetAttribute(value, "CAN-BLOCK-RELOAD") == "YES";
+          const M3U8Value partHoldBack(M3U8Tokenizer::GetAttribute(value, "PART-HOLD-BACK"));
+          if (!partHoldBack.empty())
+            m_partHoldBack = static_cast<uint32_t>(partHoldBack.ToDouble() * 1000);
+          m_canSkipUntil = static_cast<uint32_t>(
+              M3U8Tokenizer::GetAttribute(value, "CAN-SKIP-UNTIL").ToDouble() * 1000);
+        }
+        else if (M3U8Tokenizer::IsTag(line, "#EXT-X-SKIP:", value))
+        {
+          //#EXT-X-SKIP:SKIPPED-SEGMENTS=120
+          skipStart = mediaSequence;
+          skipped = static_cast<uint32_t>(
+              M3U8Tokenizer::GetAttribute(value, "SKIPPED-SEGMENTS").ToUInt());
+          mediaSequence += skipped;
+        }
+        else if (M3U8Tokenizer::IsTag(line, "#EXT-X-BYTERANGE:", value))
+        {
+          const char* bs(value.data_ + value.size_);
+          while (bs != value.data_ && bs[-1] != '@')
+            --bs;
+          if (bs != value.data_)
           {
-            segment.range_begin_ = atoll(line.c_str() + (bs + 1));
-            segment.range_end_ = segment.range_begin_ + atoll(line.c_str() + 17) - 1;
+            segment.range_begin_ = M3U8Value(bs, value.data_ + value.size_ - bs).ToUInt();
+            segment.range_end_ = segment.range_begin_ + value.ToUInt() - 1;
           }
           byteRange = true;
+          useParts = false;
+          parts.clear();
         }
-        else if (!line.empty() && line.compare(0, 1, "#") != 0 && ~segment.startPTS_)
+        else if (line.data_[0] != '#' && ~segment.startPTS_)
         {
           if (rep->containerType_ == CONTAINERTYPE_NOTYPE)
           {
-            std::string::size_type paramPos = line.rfind('?');
-            std::string::size_type ext = line.rfind('.', paramPos);
+            const std::string uri(line.str());
+            std::string::size_type paramPos = uri.rfind('?');
+            std::string::size_type ext = uri.rfind('.', paramPos);
             if (ext != std::string::npos)
             {
-              if (strncmp(line.c_str() + ext, ".ts", 3) == 0)
+              if (strncmp(uri.c_str() + ext, ".ts", 3) == 0)
                 rep->containerType_ = CONTAINERTYPE_TS;
-              else if (strncmp(line.c_str() + ext, ".aac", 4) == 0)
+              else if (strncmp(uri.c_str() + ext, ".aac", 4) == 0)
                 rep->containerType_ = CONTAINERTYPE_ADTS;
-              else if (strncmp(line.c_str() + ext, ".mp4", 4) == 0)
+              else if (strncmp(uri.c_str() + ext, ".mp4", 4) == 0)
                 rep->containerType_ = CONTAINERTYPE_MP4;
-              else if (strncmp(line.c_str() + ext, ".vtt", 4) == 0 ||
-                       strncmp(line.c_str() + ext, ".webvtt", 7) == 0)
+              else if (strncmp(uri.c_str() + ext, ".vtt", 4) == 0 ||
+                       strncmp(uri.c_str() + ext, ".webvtt", 7) == 0)
                 rep->containerType_ = CONTAINERTYPE_TEXT;
               else
               {
@@ -494,20 +642,26 @@ HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
           else if (rep->containerType_ == CONTAINERTYPE_INVALID)
             continue;
 
-          if (!byteRange || rep->url_.empty())
+          if (!parts.empty())
           {
-            std::string url;
-            if (line[0] != '/' && line.find("://") == std::string::npos)
-              url = base_url + line;
-            else
-              url = line;
-            if (!byteRange)
-            {
-              segment.url = new char[url.size() + 1];
-              memcpy((char*)segment.url, url.c_str(), url.size() + 1);
-            }
-            else
-              rep->url_ = url;
+            // The segment is also available as parts, continue with them
+            addParts(url_arena_, parts, base_url, mediaSequence, segment, newSegments);
+            partPts = pts;
+            ++mediaSequence;
+            segment.startPTS_ = ~0ULL;
+            continue;
+          }
+          if (!byteRange)
+          {
+            // Sequence number of the segment, shared by its parts
+            segment.range_end_ = mediaSequence;
+            segment.url = createUrl(url_arena_, base_url, line);
+          }
+          else if (rep->url_.empty())
+          {
+            const char* url(createUrl(url_arena_, base_url, line));
+            rep->url_ = url;
+            StringArena::Release(url);
           }
           if (currentEncryptionType == ENCRYPTIONTYPE_AES128)
           {
@@ -516,30 +670,33 @@ HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
             else
               period->InsertPSSHSet(segment.pssh_set_);
           }
-          newSegments.data.push_back(segment);
+          newSegments.data().push_back(segment);
           segment.startPTS_ = ~0ULL;
+          partPts = pts;
+          ++mediaSequence;
         }
-        else if (line.compare(0, 22, "#EXT-X-MEDIA-SEQUENCE:") == 0)
+        else if (M3U8Tokenizer::IsTag(line, "#EXT-X-MEDIA-SEQUENCE:", value))
         {
-          newStartNumber = atol(line.c_str() + 22);
+          newStartNumber = static_cast<unsigned int>(value.ToUInt());
+          mediaSequence = newStartNumber;
         }
-        else if (line.compare(0, 21, "#EXT-X-PLAYLIST-TYPE:") == 0)
+        else if (M3U8Tokenizer::IsTag(line, "#EXT-X-PLAYLIST-TYPE:", value))
         {
-          if (strcmp(line.c_str() + 21, "VOD") == 0)
+          if (value == "VOD")
           {
             m_refreshPlayList = false;
             has_timeshift_buffer_ = false;
           }
         }
-        else if (line.compare(0, 22, "#EXT-X-TARGETDURATION:") == 0)
+        else if (M3U8Tokenizer::IsTag(line, "#EXT-X-TARGETDURATION:", value))
         {
-          uint32_t newInterval = atoi(line.c_str() + 22) * 1500;
+          uint32_t newInterval = static_cast<uint32_t>(value.ToUInt()) * 1500;
           if (newInterval < updateInterval_)
             updateInterval_ = newInterval;
         }
-        else if (line.compare(0, 30, "#EXT-X-DISCONTINUITY-SEQUENCE:") == 0)
+        else if (M3U8Tokenizer::IsTag(line, "#EXT-X-DISCONTINUITY-SEQUENCE:", value))
         {
-          m_discontSeq = atol(line.c_str() + 30);
+          m_discontSeq = static_cast<uint32_t>(value.ToUInt());
           if (!~initial_sequence_)
             initial_sequence_ = m_discontSeq;
           m_hasDiscontSeq = true;
@@ -571,18 +728,18 @@ HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
           adp = period->adaptationSets_[adp_pos];
           rep = adp->representations_[rep_pos];
         }
-        else if (line.compare(0, 21, "#EXT-X-DISCONTINUITY") == 0)
+        else if (M3U8Tokenizer::IsTag(line, "#EXT-X-DISCONTINUITY"))
         {
           period->sequence_ = m_discontSeq + discont_count;
           period->duration_ = newSegments.size() ? pts - newSegments[0]->startPTS_ : 0;
           if (!byteRange)
             rep->flags_ |= Representation::URLSEGMENTS;
           if (rep->containerType_ == CONTAINERTYPE_MP4 && byteRange && newSegments.size() &&
-              newSegments.data[0].range_begin_ > 0)
+              newSegments.data()[0].range_begin_ > 0)
           {
             rep->flags_ |= Representation::INITIALIZATION;
             rep->initialization_.range_begin_ = 0;
-            rep->initialization_.range_end_ = newSegments.data[0].range_begin_ - 1;
+            rep->initialization_.range_end_ = newSegments.data()[0].range_begin_ - 1;
             rep->initialization_.pssh_set_ = 0;
           }
           FreeSegments(period, rep);
@@ -593,8 +750,7 @@ HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
           {
             std::swap(rep->initialization_, newInitialization);
             // EXT-X-MAP init url must persist to next period until overrided by new tag
-            newInitialization.url = new char[map_url.size() + 1];
-            memcpy((char*)newInitialization.url, map_url.c_str(), map_url.size() + 1);
+            newInitialization.url = url_arena_.Store(map_url.c_str(), map_url.size());
           }
           if (periods_.size() == ++discont_count)
           {
@@ -605,7 +761,7 @@ HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
           else
             period = periods_[discont_count];
 
-          newStartNumber += rep->segments_.data.size();
+          newStartNumber += rep->segments_.data().size();
           adp = period->adaptationSets_[adp_pos];
           rep = adp->representations_[rep_pos];
           segment.range_begin_ = ~0ULL;
@@ -625,16 +781,18 @@ HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
             rep->containerType_ = CONTAINERTYPE_MP4;
           }
         }
-        else if (line.compare(0, 11, "#EXT-X-KEY:") == 0)
+        else if (M3U8Tokenizer::IsTag(line, "#EXT-X-KEY:", value))
         {
-          parseLine(line, 11, map);
-          switch (processEncryption(base_url, map))
+          switch (processEncryption(base_url, value))
           {
             case ENCRYPTIONTYPE_INVALID:
               return PREPARE_RESULT_FAILURE;
             case ENCRYPTIONTYPE_AES128:
               currentEncryptionType = ENCRYPTIONTYPE_AES128;
               segment.pssh_set_ = 0;
+              // The IV is derived from the segment number, which parts do not have
+              useParts = false;
+              parts.clear();
               break;
             case ENCRYPTIONTYPE_WIDEVINE:
               currentEncryptionType = ENCRYPTIONTYPE_WIDEVINE;
@@ -649,29 +807,24 @@ HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
               break;
           }
         }
-        else if (line.compare(0, 14, "#EXT-X-ENDLIST") == 0)
+        else if (M3U8Tokenizer::IsTag(line, "#EXT-X-ENDLIST"))
         {
           m_refreshPlayList = false;
           has_timeshift_buffer_ = false;
         }
-        else if (line.compare(0, 11, "#EXT-X-MAP:") == 0)
+        else if (M3U8Tokenizer::IsTag(line, "#EXT-X-MAP:", value))
         {
-          parseLine(line, 11, map);
-          if (!map["URI"].empty())
+          const M3U8Value uri(M3U8Tokenizer::GetAttribute(value, "URI"));
+          if (!uri.empty())
           {
-            if (!map["BYTERANGE"].empty())
+            if (!M3U8Tokenizer::GetAttribute(value, "BYTERANGE").empty())
               continue;
             // delete init url if persisted from previous period
             if (hasMap)
-              delete[] newInitialization.url;
+              StringArena::Release(newInitialization.url);
             segmentInitialization = true;
-            std::string uri = map["URI"];
-            if (uri[0] != '/' && uri.find("://") == std::string::npos)
-              map_url = base_url + uri;
-            else
-              map_url = uri;
-            newInitialization.url = new char[map_url.size() + 1];
-            memcpy((char*)newInitialization.url, map_url.c_str(), map_url.size() + 1);
+            newInitialization.url = createUrl(url_arena_, base_url, uri);
+            map_url = newInitialization.url;
             newInitialization.range_begin_ = ~0ULL;
             newInitialization.startPTS_ = ~0ULL;
             newInitialization.pssh_set_ = 0;
@@ -681,30 +834,80 @@ HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
           }
         }
       }
+      // Parts of the segment in production, the hinted one is served as soon as it exists
+      const uint32_t publishedParts(static_cast<uint32_t>(parts.size()));
+      if (useParts)
+      {
+        if (!preloadHint.empty())
+          parts.push_back(std::make_pair(partPts, preloadHint));
+        addParts(url_arena_, parts, base_url, mediaSequence, segment, newSegments);
+        pts = partPts;
+        if (m_refreshPlayList)
+          low_latency_ = true;
+      }
+
+      if (m_refreshPlayList)
+      {
+        LIVEPLAYLIST& live(m_livePlaylists[rep->source_url_]);
+        live.nextSequence = mediaSequence;
+        live.nextPart = publishedParts;
+        live.updated = std::chrono::steady_clock::now();
+      }
+
       if (!byteRange)
         rep->flags_ |= Representation::URLSEGMENTS;
 
       // Insert Initialization Segment
       if (rep->containerType_ == CONTAINERTYPE_MP4 && byteRange &&
-          newSegments.data[0].range_begin_ > 0)
+          newSegments.data()[0].range_begin_ > 0)
       {
         rep->flags_ |= Representation::INITIALIZATION;
         rep->initialization_.range_begin_ = 0;
-        rep->initialization_.range_end_ = newSegments.data[0].range_begin_ - 1;
+        rep->initialization_.range_end_ = newSegments.data()[0].range_begin_ - 1;
         rep->initialization_.pssh_set_ = 0;
       }
 
-      FreeSegments(period, rep);
-
-      if (newSegments.data.empty())
+      if (skipped)
       {
-        FreeSegments(period, rep);
-        rep->flags_ = 0;
-        return PREPARE_RESULT_FAILURE;
+        if (discont_count || periods_.size() != 1 ||
+            !MergeDeltaSegments(period, rep, newSegments, skipStart, skipped, pts))
+        {
+          // The current list misses skipped segments, load the whole playlist
+          for (const Segment& seg : newSegments.data())
+          {
+            --period->psshSets_[seg.pssh_set_].use_count_;
+            StringArena::Release(seg.url);
+          }
+          if (hasMap)
+            StringArena::Release(newInitialization.url);
+          loadedPlaylist.reload = loadedPlaylist.deltaUpdate;
+          return PREPARE_RESULT_FAILURE;
+        }
+        if (segmentInitialization)
+          StringArena::Release(rep->initialization_.url);
       }
+      else
+      {
+        // Parts shift the segment numbers, continue the numbering of the previous list
+        if (useParts && (rep->flags_ & Representation::URLSEGMENTS) && !rep->segments_.empty())
+        {
+          const Segment* last(rep->segments_[static_cast<uint32_t>(rep->segments_.size() - 1)]);
+          const size_t pos(countKnownEntries(newSegments.data(), *last));
+          newStartNumber = rep->startNumber_ + static_cast<uint32_t>(rep->segments_.size() - pos);
+        }
+
+        FreeSegments(period, rep);
+
+        if (newSegments.data().empty())
+        {
+          FreeSegments(period, rep);
+          rep->flags_ = 0;
+          return PREPARE_RESULT_FAILURE;
+        }
 
-      rep->segments_.swap(newSegments);
-      rep->startNumber_ = newStartNumber;
+        rep->segments_.swap(newSegments);
+        rep->startNumber_ = newStartNumber;
+      }
 
       if (segmentInitialization)
         std::swap(rep->initialization_, newInitialization);
@@ -761,9 +964,68 @@ HLSTree::PREPARE_RESULT HLSTree::prepareRepresentation(Period* period,
   return PREPARE_RESULT_FAILURE;
 };
 
+bool HLSTree::MergeDeltaSegments(Period* period,
+                                 Representation* rep,
+                                 SPINCACHE<Segment>& newSegments,
+                                 uint32_t skipStart,
+                                 uint32_t skipped,
+                                 uint64_t& pts)
+{
+  std::vector<Segment>& data(rep->segments_.data());
+  const uint32_t firstSequence(skipStart + skipped);
+
+  if (rep->segments_.basePos() || !(rep->flags_ & Representation::URLSEGMENTS))
+    return false;
+
+  // Entries before skipStart expired, the ones from firstSequence on are listed again
+  size_t expired(0);
+  while (expired < data.size() && data[expired].range_end_ < skipStart)
+    ++expired;
+  size_t end(data.size());
+  while (end > expired && data[end - 1].range_end_ >= firstSequence)
+    --end;
+  if (end == expired || data[expired].range_end_ != skipStart ||
+      data[end - 1].range_end_ + 1 != firstSequence)
+    return false;
+
+  const uint64_t ptsOffset(end < data.size() ? data[end].startPTS_
+                                             : data[0].startPTS_ + rep->duration_);
+
+  // Parts shift the segment numbers, the newest known entry keeps its number
+  const size_t pos(countKnownEntries(newSegments.data(), data.back()));
+  const uint32_t startNumber(rep->startNumber_ +
+                             static_cast<uint32_t>(data.size() - (end - expired) - pos));
+
+  for (std::vector<Segment>::iterator bs(data.begin() + end), es(data.end()); bs != es; ++bs)
+  {
+    --period->psshSets_[bs->pssh_set_].use_count_;
+    StringArena::Release(bs->url);
+  }
+  data.erase(data.begin() + end, data.end());
+  for (std::vector<Segment>::iterator bs(data.begin()), es(data.begin() + expired); bs != es; ++bs)
+  {
+    --period->psshSets_[bs->pssh_set_].use_count_;
+    StringArena::Release(bs->url);
+  }
+  data.erase(data.begin(), data.begin() + expired);
+
+  data.reserve(data.size() + newSegments.data().size());
+  for (Segment& seg : newSegments.data())
+  {
+    seg.startPTS_ += ptsOffset;
+    data.push_back(seg);
+  }
+  newSegments.clear();
+
+  rep->startNumber_ = startNumber;
+  rep->current_segment_ = nullptr;
+  pts += ptsOffset;
+  return true;
+}
+
 bool HLSTree::write_data(void* buffer, size_t buffer_size, void* opaque)
 {
-  static_cast<std::stringstream*>(opaque)->write(static_cast<const char*>(buffer), buffer_size);
+  static_cast<std::string*>(opaque)->append(static_cast<const char*>(buffer), buffer_size);
   return true;
 }
 
@@ -795,7 +1057,7 @@ void HLSTree::OnDataArrived(unsigned int segNum,
       if (pssh.defaultKID_.empty())
       {
       RETRY:
-        std::stringstream stream;
+        std::string key;
         std::map<std::string, std::string> headers;
         std::vector<std::string> keyParts(split(m_decrypter->getLicenseKey(), '|'));
         std::string url = pssh.pssh_.c_str();
@@ -812,9 +1074,9 @@ void HLSTree::OnDataArrived(unsigned int segNum,
           parseheader(headers, keyParts[1].c_str());
 
         url = BuildDownloadUrl(url);
-        if (download(url.c_str(), headers, &stream, false))
+        if (download(url.c_str(), headers, &key, false))
         {
-          pssh.defaultKID_ = stream.str();
+          pssh.defaultKID_ = key;
         }
         else if (pssh.defaultKID_ != "0")
         {
@@ -849,6 +1111,12 @@ void HLSTree::OnDataArrived(unsigned int segNum,
     AdaptiveTree::OnDataArrived(segNum, psshSet, iv, src, dst, dstOffset, dataSize);
 }
 
+bool HLSTree::SequentialDataRequired(uint16_t psshSet) const
+{
+  //AES-128 CBC decryption is chained over the whole segment
+  return psshSet && current_period_->encryptionState_ != ENCRYTIONSTATE_SUPPORTED;
+}
+
 //Called each time before we switch to a new segment
 void HLSTree::RefreshSegments(Period* period,
                               AdaptationSet* adp,
@@ -859,14 +1127,68 @@ void HLSTree::RefreshSegments(Period* period,
   {
     if (rep->flags_ & Representation::INCLUDEDSTREAM)
       return;
-    RefreshUpdateThread();
-    prepareRepresentation(period, adp, rep, true);
+    // The caller holds the tree lock, only the update thread reloads (without it)
+    RequestUpdate();
+  }
+}
+
+uint32_t HLSTree::GetLiveStartPosition(const Period* period, const Representation* rep)
+{
+  static const uint32_t PART_HOLD_BACK_PARTS = 3;
+
+  if (!low_latency_ || !(rep->flags_ & Representation::URLSEGMENTS) || rep->segments_.empty())
+    return ~0U;
+
+  const uint64_t latency(
+      static_cast<uint64_t>(live_latency_    ? live_latency_
+                            : m_partHoldBack ? m_partHoldBack
+                                             : PART_HOLD_BACK_PARTS * m_partTarget) *
+      rep->timescale_ / 1000);
+  const uint64_t end(rep->segments_[0]->startPTS_ + rep->duration_);
+
+  //Start with the newest segment (or its first part) beginning at least latency before the end
+  uint32_t pos(static_cast<uint32_t>(rep->segments_.size() - 1));
+  for (; pos; --pos)
+  {
+    const Segment* seg(rep->segments_[pos]);
+    if (seg->startPTS_ + latency <= end && seg->range_end_ != rep->segments_[pos - 1]->range_end_)
+      break;
   }
+  return pos;
+}
+
+uint32_t HLSTree::ExtendLiveSegments(const Period* period, AdaptationSet* adp)
+{
+  uint32_t wait(~0U);
+  if (!m_partTarget || !HasUpdateThread())
+    return wait;
+
+  //The caller holds the tree lock, the update thread reloads the playlists without it
+  bool request(false);
+  for (Representation* rep : adp->representations_)
+  {
+    if (!(rep->flags_ & Representation::ENABLED) ||
+        (rep->flags_ & Representation::INCLUDEDSTREAM) ||
+        rep->get_next_segment(rep->current_segment_))
+      continue;
+
+    LIVEPLAYLIST& live(m_livePlaylists[rep->source_url_]);
+    request = request || !live.reloadRequested;
+    live.reloadRequested = true;
+    if (m_partTarget / 2 < wait)
+      wait = m_partTarget / 2;
+  }
+  if (request)
+    RequestUpdate();
+  return wait;
 }
 
 //Called form update-thread
 void HLSTree::RefreshLiveSegments()
 {
+  // Playlists are downloaded without the tree lock, they are parsed into the live
+  // representations under it
+  std::unique_lock<std::mutex> lck(treeMutex_);
   if (m_refreshPlayList)
   {
     std::vector<std::tuple<AdaptationSet*, Representation*>> refresh_list;
@@ -878,7 +1200,46 @@ void HLSTree::RefreshLiveSegments()
            br != er; ++br)
         if ((*br)->flags_ & Representation::ENABLED)
           refresh_list.push_back(std::make_tuple(*ba, *br));
+    // A discontinuity may replace the period while the tree is unlocked
+    auto isLive = [this](AdaptationSet* adp, Representation* rep) {
+      const std::vector<AdaptationSet*>& adps(current_period_->adaptationSets_);
+      return m_refreshPlayList && std::find(adps.begin(), adps.end(), adp) != adps.end() &&
+             std::find(adp->representations_.begin(), adp->representations_.end(), rep) !=
+                 adp->representations_.end();
+    };
     for (auto t : refresh_list)
-      prepareRepresentation(current_period_, std::get<0>(t), std::get<1>(t), true);
+    {
+      AdaptationSet* adp(std::get<0>(t));
+      Representation* rep(std::get<1>(t));
+      if (!isLive(adp, rep) || (rep->flags_ & Representation::DOWNLOADED))
+        continue;
+
+      //The server holds the reload until the next part is published
+      const std::string sourceUrl(rep->source_url_);
+      std::string params;
+      std::map<std::string, LIVEPLAYLIST>::const_iterator live(m_livePlaylists.find(sourceUrl));
+      if (m_canBlockReload && live != m_livePlaylists.end() && live->second.reloadRequested)
+        params = "_HLS_msn=" + std::to_string(live->second.nextSequence) +
+                 "&_HLS_part=" + std::to_string(live->second.nextPart);
+
+      PLAYLIST playlist;
+      bool deltaUpdate(true);
+      do
+      {
+        PreparePlaylist(rep, true, params, deltaUpdate, playlist);
+        lck.unlock();
+        DownloadPlaylist(playlist);
+        lck.lock();
+
+        if (!isLive(adp, rep))
+          break;
+        prepareRepresentation(current_period_, adp, rep, true, playlist);
+        deltaUpdate = false;
+      } while (playlist.reload);
+
+      std::map<std::string, LIVEPLAYLIST>::iterator reloaded(m_livePlaylists.find(sourceUrl));
+      if (reloaded != m_livePlaylists.end())
+        reloaded->second.reloadRequested = false;
+    }
   }
 }
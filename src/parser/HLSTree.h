@@ -19,9 +19,10 @@
 #pragma once
 
 #include "../common/AdaptiveTree.h"
+#include "M3U8Tokenizer.h"
 
+#include <chrono>
 #include <map>
-#include <sstream>
 
 #include <kodi/AddonBase.h>
 
@@ -57,17 +58,59 @@ public:
                              uint8_t* dst,
                              size_t dstOffset,
                              size_t dataSize) override;
+  virtual bool SequentialDataRequired(uint16_t psshSet) const override;
   virtual void RefreshSegments(Period* period,
                                AdaptationSet* adp,
                                Representation* rep,
                                StreamType type) override;
-  virtual bool processManifest(std::stringstream& stream);
+  virtual uint32_t GetLiveStartPosition(const Period* period, const Representation* rep) override;
+  virtual uint32_t ExtendLiveSegments(const Period* period, AdaptationSet* adp) override;
+  virtual bool processManifest(const std::string& manifest);
 
 protected:
   virtual void RefreshLiveSegments() override;
 
 private:
-  int processEncryption(std::string baseUrl, std::map<std::string, std::string>& map);
+  struct PLAYLIST
+  {
+    // request url, downloaded media playlist and the url it was served from
+    std::string url, data, effectiveUrl;
+    bool loaded = false;
+    // Requested without the known segments, reload is set if they are needed again
+    bool deltaUpdate = false;
+    bool reload = false;
+  };
+
+  // Loads the media playlist, urlParams are appended to the playlist url (blocking reload),
+  // deltaUpdate requests a playlist without the segments already known (EXT-X-SKIP)
+  PREPARE_RESULT prepareRepresentation(Period* period,
+                                       AdaptationSet* adp,
+                                       Representation* rep,
+                                       bool update,
+                                       const std::string& urlParams,
+                                       bool deltaUpdate);
+  void PreparePlaylist(const Representation* rep,
+                       bool update,
+                       const std::string& urlParams,
+                       bool deltaUpdate,
+                       PLAYLIST& playlist) const;
+  // Only the download, it does not access the tree and runs without the tree lock
+  bool DownloadPlaylist(PLAYLIST& playlist);
+  // Parses a downloaded playlist into rep
+  PREPARE_RESULT prepareRepresentation(Period* period,
+                                       AdaptationSet* adp,
+                                       Representation* rep,
+                                       bool update,
+                                       PLAYLIST& playlist);
+  // Replaces the segments from skipStart + skipped on by the ones of a delta update,
+  // false if the current list does not contain the skipped segments
+  bool MergeDeltaSegments(Period* period,
+                          Representation* rep,
+                          SPINCACHE<Segment>& newSegments,
+                          uint32_t skipStart,
+                          uint32_t skipped,
+                          uint64_t& pts);
+  int processEncryption(std::string baseUrl, const M3U8Value& attributes);
   std::string m_audioCodec;
 
   struct EXTGROUP
@@ -90,9 +133,26 @@ private:
   bool m_refreshPlayList = true;
   uint8_t m_segmentIntervalSec = 4;
   IAESDecrypter *m_decrypter;
-  std::stringstream manifest_stream;
   bool m_hasDiscontSeq = false;
   uint32_t m_discontSeq = 0;
+
+  // Low latency (LL-HLS), parts and hold back in ms
+  uint32_t m_partTarget = 0;
+  uint32_t m_partHoldBack = 0;
+  bool m_canBlockReload = false;
+  // Delta updates can skip segments older than this (ms)
+  uint32_t m_canSkipUntil = 0;
+
+  struct LIVEPLAYLIST
+  {
+    // Media sequence / part a playlist reload blocks for
+    uint32_t nextSequence = 0, nextPart = 0;
+    std::chrono::steady_clock::time_point updated;
+    // A stream waits for the next part, the update thread reloads with blocking
+    bool reloadRequested = false;
+  };
+  // Live media playlists by url
+  std::map<std::string, LIVEPLAYLIST> m_livePlaylists;
 };
 
 } // namespace
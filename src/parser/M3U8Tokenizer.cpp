@@ -0,0 +1,131 @@
+/*
+*      Copyright (C) 2021 peak3d
+*      http://www.peak3d.de
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include "M3U8Tokenizer.h"
+
+#include <cmath>
+
+using namespace adaptive;
+
+// Not atof / strtod: independent of the locale and limited to the value
+double M3U8Value::ToDouble() const
+{
+  const char *pos(data_), *end(data_ + size_);
+  const bool negative(pos != end && *pos == '-');
+  if (pos != end && (*pos == '-' || *pos == '+'))
+    ++pos;
+  double ret(0);
+  for (; pos != end && *pos >= '0' && *pos <= '9'; ++pos)
+    ret = ret * 10 + (*pos - '0');
+  if (pos != end && *pos == '.')
+  {
+    double scale(0.1);
+    for (++pos; pos != end && *pos >= '0' && *pos <= '9'; ++pos, scale *= 0.1)
+      ret += (*pos - '0') * scale;
+  }
+  if (pos != end && (*pos == 'e' || *pos == 'E'))
+  {
+    const bool negativeExponent(++pos != end && *pos == '-');
+    if (negativeExponent)
+      ++pos;
+    const double scale(std::pow(10.0, static_cast<double>(M3U8Value(pos, end - pos).ToUInt())));
+    ret = negativeExponent ? ret / scale : ret * scale;
+  }
+  return negative ? -ret : ret;
+}
+
+uint64_t M3U8Value::ToUInt() const
+{
+  const char *pos(data_), *end(data_ + size_);
+  if (pos != end && *pos == '+')
+    ++pos;
+  uint64_t ret(0);
+  for (; pos != end && *pos >= '0' && *pos <= '9'; ++pos)
+    ret = ret * 10 + (*pos - '0');
+  return ret;
+}
+
+bool M3U8Tokenizer::NextLine(M3U8Value& line)
+{
+  while (pos_ != end_)
+  {
+    const char* next(static_cast<const char*>(memchr(pos_, '\n', end_ - pos_)));
+    const char *begin(pos_), *end(next ? next : end_);
+    pos_ = next ? next + 1 : end_;
+
+    while (end != begin && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+      --end;
+    if (end != begin)
+    {
+      line = M3U8Value(begin, end - begin);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool M3U8Tokenizer::NextAttribute(M3U8Value& list, M3U8Value& name, M3U8Value& value)
+{
+  const char *pos(list.data_), *end(list.data_ + list.size_);
+
+  while (pos != end && (*pos == ' ' || *pos == ','))
+    ++pos;
+  if (pos == end)
+  {
+    list = M3U8Value(end, 0);
+    return false;
+  }
+
+  const char* nameEnd(static_cast<const char*>(memchr(pos, '=', end - pos)));
+  if (!nameEnd)
+  {
+    list = M3U8Value(end, 0);
+    return false;
+  }
+  name = M3U8Value(pos, nameEnd - pos);
+
+  pos = nameEnd + 1;
+  if (pos != end && *pos == '"')
+  {
+    ++pos;
+    const char* quoteEnd(static_cast<const char*>(memchr(pos, '"', end - pos)));
+    if (!quoteEnd)
+      quoteEnd = end;
+    value = M3U8Value(pos, quoteEnd - pos);
+    pos = quoteEnd != end ? quoteEnd + 1 : end;
+  }
+  else
+  {
+    const char* valueEnd(static_cast<const char*>(memchr(pos, ',', end - pos)));
+    if (!valueEnd)
+      valueEnd = end;
+    value = M3U8Value(pos, valueEnd - pos);
+    pos = valueEnd;
+  }
+  list = M3U8Value(pos, end - pos);
+  return true;
+}
+
+M3U8Value M3U8Tokenizer::GetAttribute(M3U8Value list, const char* name)
+{
+  M3U8Value attrName, attrValue;
+  while (NextAttribute(list, attrName, attrValue))
+    if (attrName == name)
+      return attrValue;
+  return M3U8Value();
+}
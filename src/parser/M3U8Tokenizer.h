@@ -0,0 +1,86 @@
+/*
+*      Copyright (C) 2021 peak3d
+*      http://www.peak3d.de
+*
+*  This Program is free software; you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation; either version 2, or (at your option)
+*  any later version.
+*
+*  This Program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+*  GNU General Public License for more details.
+*
+*  <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <inttypes.h>
+#include <string.h>
+#include <string>
+
+#include <kodi/AddonBase.h>
+
+namespace adaptive
+{
+
+// Part of a playlist buffer, not terminated
+struct ATTRIBUTE_HIDDEN M3U8Value
+{
+  M3U8Value() = default;
+  M3U8Value(const char* data, size_t size) : data_(data), size_(size){};
+
+  bool empty() const { return !size_; };
+  bool operator==(const char* str) const
+  {
+    return strncmp(data_, str, size_) == 0 && str[size_] == 0;
+  };
+  bool operator!=(const char* str) const { return !(*this == str); };
+  std::string str() const { return std::string(data_, size_); };
+  // Decimal number at the beginning of the value, 0 if there is none.
+  // Like atof, ToDouble accepts a sign and an exponent.
+  double ToDouble() const;
+  uint64_t ToUInt() const;
+
+  const char* data_ = "";
+  size_t size_ = 0;
+};
+
+// Splits a M3U8 playlist into lines, tags and attributes without copying it
+class ATTRIBUTE_HIDDEN M3U8Tokenizer
+{
+public:
+  M3U8Tokenizer(const char* data, size_t size) : pos_(data), end_(data + size){};
+
+  // Next line which is not empty, without line break and trailing blanks
+  bool NextLine(M3U8Value& line);
+
+  // true if line starts with tag (including its ':'), value is the rest of the line
+  template<size_t N>
+  static bool IsTag(const M3U8Value& line, const char (&tag)[N], M3U8Value& value)
+  {
+    if (line.size_ < N - 1 || memcmp(line.data_, tag, N - 1) != 0)
+      return false;
+    value = M3U8Value(line.data_ + N - 1, line.size_ - (N - 1));
+    return true;
+  };
+  template<size_t N>
+  static bool IsTag(const M3U8Value& line, const char (&tag)[N])
+  {
+    return line.size_ >= N - 1 && memcmp(line.data_, tag, N - 1) == 0;
+  };
+
+  // Removes the next NAME=VALUE pair from an attribute list, quotes of the value are removed
+  static bool NextAttribute(M3U8Value& list, M3U8Value& name, M3U8Value& value);
+  // Value of an attribute, empty if the list does not contain it
+  static M3U8Value GetAttribute(M3U8Value list, const char* name);
+
+private:
+  const char* pos_;
+  const char* end_;
+};
+
+} // namespace adaptive
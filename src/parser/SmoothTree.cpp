@@ -182,11 +182,11 @@ static void XMLCALL start(void* data, const char* el, const char** attr)
           if (*(const char*)*attr == 't')
           {
             uint64_t lt(atoll((const char*)*(attr + 1)));
-            if (!dash->current_adaptationset_->segment_durations_.data.empty())
+            if (!dash->current_adaptationset_->segment_durations_.data().empty())
             {
               //Go back to the previous timestamp to calculate the real gap.
-              dash->pts_helper_ -= dash->current_adaptationset_->segment_durations_.data.back();
-              dash->current_adaptationset_->segment_durations_.data.back() =
+              dash->pts_helper_ -= dash->current_adaptationset_->segment_durations_.data().back();
+              dash->current_adaptationset_->segment_durations_.data().back() =
                   static_cast<uint32_t>(lt - dash->pts_helper_);
             }
             else
@@ -205,7 +205,7 @@ static void XMLCALL start(void* data, const char* el, const char** attr)
         {
           while (repeat_count--)
           {
-            dash->current_adaptationset_->segment_durations_.data.push_back(push_duration);
+            dash->current_adaptationset_->segment_durations_.data().push_back(push_duration);
             dash->pts_helper_ += push_duration;
           }
         }
@@ -232,7 +232,7 @@ static void XMLCALL start(void* data, const char* el, const char** attr)
         else if (strcmp((const char*)*attr, "TimeScale") == 0)
           dash->current_adaptationset_->timescale_ = atoi((const char*)*(attr + 1));
         else if (strcmp((const char*)*attr, "Chunks") == 0)
-          dash->current_adaptationset_->segment_durations_.data.reserve(
+          dash->current_adaptationset_->segment_durations_.data().reserve(
               atoi((const char*)*(attr + 1)));
         else if (strcmp((const char*)*attr, "Url") == 0)
           dash->current_adaptationset_->base_url_ = dash->base_url_ + (const char*)*(attr + 1);
@@ -327,7 +327,7 @@ static void XMLCALL end(void* data, const char* el)
       if (strcmp(el, "StreamIndex") == 0)
       {
         if (dash->current_adaptationset_->representations_.empty() ||
-            dash->current_adaptationset_->segment_durations_.data.empty())
+            dash->current_adaptationset_->segment_durations_.data().empty())
           dash->current_period_->adaptationSets_.pop_back();
         else
         {
@@ -380,12 +380,12 @@ bool SmoothTree::open(const std::string& url, const std::string& manifestUpdateP
          e((*ba)->representations_.end());
          b != e; ++b)
     {
-      (*b)->segments_.data.resize((*ba)->segment_durations_.data.size());
-      std::vector<uint32_t>::iterator bsd((*ba)->segment_durations_.data.begin());
+      (*b)->segments_.data().resize((*ba)->segment_durations_.data().size());
+      std::vector<uint32_t>::iterator bsd((*ba)->segment_durations_.data().begin());
       uint64_t cummulated((*ba)->startPTS_ - base_time_), index(1);
 
-      for (std::vector<SmoothTree::Segment>::iterator bs((*b)->segments_.data.begin()),
-           es((*b)->segments_.data.end());
+      for (std::vector<SmoothTree::Segment>::iterator bs((*b)->segments_.data().begin()),
+           es((*b)->segments_.data().end());
            bs != es; ++bsd, ++bs, ++index)
       {
         bs->startPTS_ = cummulated;
@@ -395,6 +395,7 @@ bool SmoothTree::open(const std::string& url, const std::string& manifestUpdateP
       }
       (*b)->pssh_set_ = psshset;
     }
+    ShareSegments(*ba);
   }
 
   SortTree();
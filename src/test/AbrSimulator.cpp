@@ -0,0 +1,298 @@
+#include "AbrSimulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+const uint64_t INITIALIZATION_BYTES = 2048;
+const size_t CHUNK_BYTES = 16384;
+
+double GetSegmentSeconds(const adaptive::AdaptiveTree::Representation* rep)
+{
+  uint64_t duration(rep->duration_);
+  if (!duration && rep->segments_.size() > 1)
+    duration = (rep->segments_[rep->segments_.size() - 1]->startPTS_ -
+                rep->segments_[0]->startPTS_) /
+               (rep->segments_.size() - 1);
+  return rep->timescale_ ? static_cast<double>(duration) / rep->timescale_ : 0.0;
+}
+} // namespace
+
+bool ThroughputTrace::Load(const std::string& fileName)
+{
+  FILE* f = fopen(fileName.c_str(), "r");
+  if (!f)
+    return false;
+
+  periods_.clear();
+  duration_ = 0.0;
+
+  char line[256];
+  uint64_t totalBytes(0);
+  while (fgets(line, sizeof(line), f))
+  {
+    unsigned long long bytes;
+    unsigned int ms;
+    if (line[0] != '#' && sscanf(line, "%llu %u", &bytes, &ms) == 2 && ms)
+    {
+      duration_ += ms / 1000.0;
+      periods_.push_back({duration_, bytes * 1000.0 / ms});
+      totalBytes += bytes;
+    }
+  }
+  fclose(f);
+  return totalBytes > 0;
+}
+
+double ThroughputTrace::GetTransferTime(double start, uint64_t bytes) const
+{
+  double base(std::floor(start / duration_) * duration_);
+  std::vector<PERIOD>::const_iterator period(std::upper_bound(
+      periods_.begin(), periods_.end(), start - base,
+      [](double offset, const PERIOD& p) { return offset < p.end; }));
+
+  double time(start), remaining(static_cast<double>(bytes));
+  while (true)
+  {
+    if (period == periods_.end())
+    {
+      base += duration_;
+      period = periods_.begin();
+    }
+    double available((base + period->end - time) * period->bytesPerSecond);
+    if (available >= remaining)
+      return time + remaining / period->bytesPerSecond - start;
+    remaining -= available;
+    time = base + period->end;
+    ++period;
+  }
+}
+
+SimulatedStream::SimulatedStream(adaptive::AdaptiveTree& tree,
+                                 const ThroughputTrace& trace,
+                                 double latency)
+  : adaptive::AdaptiveStream(tree, adaptive::AdaptiveTree::VIDEO),
+    trace_(trace),
+    latency_(latency),
+    clock_(0.0),
+    network_free_(0.0),
+    chunk_time_(0.0),
+    blocked_(false),
+    blocked_end_(0.0),
+    stopping_(false)
+{
+}
+
+SimulatedStream::~SimulatedStream()
+{
+  // The download worker may wait for the clock, release it before our members are gone
+  Stop();
+  stop();
+}
+
+AbrSimulationResult SimulatedStream::Play()
+{
+  AbrSimulationResult result;
+  player_ = std::this_thread::get_id();
+
+  SetDownloadWorkers(1, 0);
+  SetAdaptiveSwitching(true);
+  if (!start_stream(~0, 0, 0, true) || !select_stream(true))
+    return result;
+
+  // The initialization loaded by select_stream, it may come from the tree's cache
+  std::vector<uint8_t> buffer;
+  unsigned long long initSize;
+  if (!getSize(initSize))
+    return result;
+  buffer.resize(static_cast<size_t>(initSize));
+  if (initSize && read(buffer.data(), static_cast<uint32_t>(initSize)) != initSize)
+    return result;
+
+  double playEnd(0.0), bitrateSeconds(0.0);
+  uint32_t lastBandwidth(0);
+  while (true)
+  {
+    // Leave the played segment, this queues the following downloads
+    read(nullptr, 0);
+
+    REQUEST request;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      Settle(lock);
+      if (requests_.empty())
+        break;
+      request = requests_.front();
+      requests_.pop_front();
+    }
+    AdvanceTo(request.end);
+
+    buffer.resize(static_cast<size_t>(request.bytes));
+    if (read(buffer.data(), static_cast<uint32_t>(request.bytes)) != request.bytes)
+      break;
+    if (request.initialization)
+      continue;
+
+    if (!result.segments)
+      result.startupDelay = request.end;
+    else if (request.end > playEnd)
+    {
+      result.rebufferTime += request.end - playEnd;
+      ++result.rebufferCount;
+    }
+    if (lastBandwidth && request.bandwidth != lastBandwidth)
+      ++result.switchCount;
+    lastBandwidth = request.bandwidth;
+
+    ++result.segments;
+    result.playedSeconds += request.duration;
+    bitrateSeconds += request.bandwidth * request.duration;
+
+    playEnd = std::max(playEnd, request.end) + request.duration;
+    AdvanceTo(playEnd);
+  }
+  if (result.playedSeconds > 0.0)
+    result.averageBitrate = bitrateSeconds / result.playedSeconds;
+
+  Stop();
+  stop();
+  return result;
+}
+
+bool SimulatedStream::download(const char* url,
+                               const std::map<std::string, std::string>& mediaHeaders,
+                               void* opaque)
+{
+  REQUEST request;
+  const adaptive::AdaptiveTree::Representation* rep(
+      FindRepresentation(url, mediaHeaders, request.initialization));
+  if (!rep)
+    return false;
+
+  request.bandwidth = rep->bandwidth_;
+  request.duration = request.initialization ? 0.0 : GetSegmentSeconds(rep);
+  request.bytes = request.initialization
+                      ? INITIALIZATION_BYTES
+                      : static_cast<uint64_t>(rep->bandwidth_ / 8 * request.duration);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  const double start(std::max(network_free_, clock_) + latency_);
+  request.end = start + trace_.GetTransferTime(start, request.bytes);
+  network_free_ = request.end;
+
+  if (std::this_thread::get_id() == player_)
+  {
+    // Synchronous downloads (initialization on stream selection) stall the player
+    clock_ = request.end;
+    signal_.notify_all();
+  }
+  else
+  {
+    requests_.push_back(request);
+    blocked_ = true;
+    blocked_end_ = request.end;
+    signal_.notify_all();
+    signal_.wait(lock, [&] { return stopping_ || clock_ >= request.end; });
+    if (stopping_)
+      return false;
+  }
+  lock.unlock();
+
+  std::string data(CHUNK_BYTES, '\0');
+  uint64_t written(0);
+  while (written < request.bytes)
+  {
+    size_t chunk(static_cast<size_t>(std::min<uint64_t>(CHUNK_BYTES, request.bytes - written)));
+    written += chunk;
+    {
+      std::lock_guard<std::mutex> lck(mutex_);
+      chunk_time_ = start + trace_.GetTransferTime(start, written);
+    }
+    if (!write_data(data.data(), chunk, opaque))
+      return false;
+  }
+  return true;
+}
+
+std::chrono::steady_clock::time_point SimulatedStream::GetTime() const
+{
+  std::lock_guard<std::mutex> lck(mutex_);
+  // Keep clear of the zero time point, it marks a download without data
+  return std::chrono::steady_clock::time_point(std::chrono::hours(1)) +
+         std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+             std::chrono::duration<double>(chunk_time_));
+}
+
+const adaptive::AdaptiveTree::Representation* SimulatedStream::FindRepresentation(
+    const std::string& url,
+    const std::map<std::string, std::string>& mediaHeaders,
+    bool& initialization)
+{
+  const adaptive::AdaptiveTree::Representation* found(nullptr);
+  size_t foundLength(0);
+  initialization = false;
+
+  for (const adaptive::AdaptiveTree::Representation* rep : getAdaptationSet()->representations_)
+  {
+    std::string prefix(rep->url_);
+    if (rep->flags_ & adaptive::AdaptiveTree::Representation::TEMPLATE)
+    {
+      // url_ is the initialization of templated representations
+      if (rep->get_initialization() && url.compare(0, prefix.size(), prefix) == 0)
+      {
+        initialization = true;
+        return rep;
+      }
+      prefix = rep->segtpl_.media.substr(0, rep->segtpl_.media.find('$'));
+    }
+    if (prefix.size() > foundLength && url.compare(0, prefix.size(), prefix) == 0)
+    {
+      found = rep;
+      foundLength = prefix.size();
+    }
+  }
+
+  if (found && !(found->flags_ & adaptive::AdaptiveTree::Representation::TEMPLATE) &&
+      found->get_initialization() && ~found->initialization_.range_begin_)
+  {
+    std::map<std::string, std::string>::const_iterator range(mediaHeaders.find("Range"));
+    const std::string initRange("bytes=" + std::to_string(found->initialization_.range_begin_) +
+                                "-");
+    initialization =
+        range != mediaHeaders.end() && range->second.compare(0, initRange.size(), initRange) == 0;
+  }
+  return found;
+}
+
+void SimulatedStream::Settle(std::unique_lock<std::mutex>& lock)
+{
+  // Downloads start at the current virtual time, wait until the worker
+  // waits for the clock or has nothing left to download
+  while (!blocked_ && IsDownloading())
+    signal_.wait_for(lock, std::chrono::milliseconds(1));
+}
+
+void SimulatedStream::AdvanceTo(double time)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true)
+  {
+    Settle(lock);
+    if (!blocked_ || blocked_end_ > time)
+      break;
+    clock_ = blocked_end_;
+    blocked_ = false;
+    signal_.notify_all();
+  }
+  if (clock_ < time)
+    clock_ = time;
+}
+
+void SimulatedStream::Stop()
+{
+  std::lock_guard<std::mutex> lck(mutex_);
+  stopping_ = true;
+  signal_.notify_all();
+}
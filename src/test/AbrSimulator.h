@@ -0,0 +1,90 @@
+#pragma once
+
+#include "TestHelper.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Recorded network throughput, one "<bytes> <transfer time ms>" period per line.
+// The trace starts again from the beginning when it is exhausted.
+class ThroughputTrace
+{
+public:
+  bool Load(const std::string& fileName);
+  // Seconds it takes to transfer bytes when starting at time start
+  double GetTransferTime(double start, uint64_t bytes) const;
+
+private:
+  struct PERIOD
+  {
+    double end;
+    double bytesPerSecond;
+  };
+  std::vector<PERIOD> periods_;
+  double duration_ = 0.0;
+};
+
+struct AbrSimulationResult
+{
+  double startupDelay = 0.0;
+  double rebufferTime = 0.0;
+  unsigned int rebufferCount = 0;
+  double averageBitrate = 0.0;
+  unsigned int switchCount = 0;
+  unsigned int segments = 0;
+  double playedSeconds = 0.0;
+};
+
+// Plays a stream on a virtual clock, segment downloads take the time the trace allows.
+// The player consumes a segment when its playback starts and asks for the next one
+// when it has been played, downloads run ahead as far as the look-ahead allows.
+class SimulatedStream : public adaptive::AdaptiveStream
+{
+public:
+  SimulatedStream(adaptive::AdaptiveTree& tree, const ThroughputTrace& trace, double latency);
+  ~SimulatedStream() override;
+
+  // Call after prepare_stream, plays the stream until its end
+  AbrSimulationResult Play();
+
+protected:
+  bool download(const char* url,
+                const std::map<std::string, std::string>& mediaHeaders,
+                void* opaque) override;
+  std::chrono::steady_clock::time_point GetTime() const override;
+
+private:
+  struct REQUEST
+  {
+    double end;
+    uint64_t bytes;
+    uint32_t bandwidth;
+    double duration;
+    bool initialization;
+  };
+
+  const adaptive::AdaptiveTree::Representation* FindRepresentation(
+      const std::string& url,
+      const std::map<std::string, std::string>& mediaHeaders,
+      bool& initialization);
+  void Settle(std::unique_lock<std::mutex>& lock);
+  void AdvanceTo(double time);
+  void Stop();
+
+  const ThroughputTrace& trace_;
+  double latency_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable signal_;
+  std::thread::id player_;
+  // virtual time in seconds, only the player advances it
+  double clock_, network_free_, chunk_time_;
+  // the download worker waits for the clock to reach blocked_end_
+  bool blocked_;
+  double blocked_end_;
+  bool stopping_;
+  std::deque<REQUEST> requests_;
+};
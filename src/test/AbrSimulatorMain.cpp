@@ -0,0 +1,103 @@
+#include "AbrSimulator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+void Usage(const char* name)
+{
+  fprintf(stderr,
+          "Usage: %s <manifest.mpd> <trace> [options]\n"
+          "  --lookahead <segments>   segments downloaded ahead (default 3)\n"
+          "  --bandwidth <bit/s>      initial bandwidth estimate (default 4000000)\n"
+          "  --estimator ewma|hm      bandwidth estimator (default ewma)\n"
+          "  --latency <ms>           request latency (default 0)\n"
+          "The trace holds one \"<bytes> <transfer time ms>\" period per line.\n",
+          name);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  uint32_t lookAhead(3), bandwidth(4000000);
+  unsigned int latency(0);
+  adaptive::BandwidthEstimator::Type estimator(adaptive::BandwidthEstimator::TYPE_EWMA);
+  for (int i(3); i < argc; ++i)
+  {
+    if (i + 1 == argc)
+    {
+      Usage(argv[0]);
+      return 1;
+    }
+    if (strcmp(argv[i], "--lookahead") == 0)
+      lookAhead = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--bandwidth") == 0)
+      bandwidth = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--latency") == 0)
+      latency = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--estimator") == 0)
+      estimator = strcmp(argv[++i], "hm") == 0 ? adaptive::BandwidthEstimator::TYPE_HARMONIC_MEAN
+                                               : adaptive::BandwidthEstimator::TYPE_EWMA;
+    else
+    {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+
+  ThroughputTrace trace;
+  if (!trace.Load(argv[2]))
+  {
+    fprintf(stderr, "Unable to load trace %s\n", argv[2]);
+    return 1;
+  }
+
+  DASHTestTree tree;
+  testHelper::testFile = argv[1];
+  if (!tree.open("http://simulator/manifest.mpd", ""))
+  {
+    fprintf(stderr, "Unable to open manifest %s\n", argv[1]);
+    return 1;
+  }
+  tree.SetBandwidthEstimator(adaptive::BandwidthEstimator::Create(estimator));
+  tree.bandwidth_ = bandwidth;
+  tree.set_download_speed(bandwidth / 8);
+
+  adaptive::AdaptiveTree::AdaptationSet* adp(nullptr);
+  for (adaptive::AdaptiveTree::AdaptationSet* set : tree.current_period_->adaptationSets_)
+    if (set->type_ == adaptive::AdaptiveTree::VIDEO)
+    {
+      adp = set;
+      break;
+    }
+  if (!adp)
+  {
+    fprintf(stderr, "No video adaptation set in %s\n", argv[1]);
+    return 1;
+  }
+
+  SimulatedStream stream(tree, trace, latency / 1000.0);
+  stream.prepare_stream(adp, 0, 0, 0, 0, 0, 0, 0, std::map<std::string, std::string>());
+  stream.SetLookAhead(lookAhead, 0);
+  AbrSimulationResult result(stream.Play());
+  if (!result.segments)
+  {
+    fprintf(stderr, "Playback failed\n");
+    return 1;
+  }
+
+  printf("startup delay:   %.2f s\n", result.startupDelay);
+  printf("rebuffering:     %.2f s (%u stalls)\n", result.rebufferTime, result.rebufferCount);
+  printf("average bitrate: %.0f kbit/s\n", result.averageBitrate / 1000);
+  printf("switches:        %u\n", result.switchCount);
+  printf("played:          %.1f s (%u segments)\n", result.playedSeconds, result.segments);
+  return 0;
+}
@@ -0,0 +1,246 @@
+#include "TestHelper.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+// Serves the MPD from memory in download sized chunks, only the parsing is measured
+class BenchmarkTree : public adaptive::DASHTree
+{
+public:
+  BenchmarkTree(const std::string& mpd) : mpd_(mpd)
+  {
+    supportedKeySystem_ = "urn:uuid:edef8ba9-79d6-4ace-a3c8-27dcd51d21ed";
+  };
+  // The generated live MPDs start at 2021-01-01T00:00:00Z
+  uint64_t GetNowTime() override { return 1609459200L + 86400; }
+  uint64_t GetNowTimeMs() override { return GetNowTime() * 1000; }
+
+protected:
+  bool download(const char* url,
+                const std::map<std::string, std::string>& manifestHeaders,
+                void* opaque,
+                bool isManifest) override
+  {
+    static const size_t CHUNKSIZE = 16384;
+    effective_url_ = url;
+    if (isManifest && !PreparePaths(effective_url_))
+      return false;
+    for (size_t pos(0); pos < mpd_.size(); pos += CHUNKSIZE)
+      if (!write_data((void*)(mpd_.data() + pos), std::min(CHUNKSIZE, mpd_.size() - pos), opaque))
+        return false;
+    return true;
+  }
+
+private:
+  const std::string& mpd_;
+};
+
+// Live MPD with periods of segmentsPerPeriod 2 s segments (e.g. after ad insertion),
+// each with a protected video set of 6 representations, 2 audio sets and subtitles
+std::string CreateLiveMpd(unsigned int periods, unsigned int segmentsPerPeriod)
+{
+  std::string mpd("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                  "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" "
+                  "xmlns:cenc=\"urn:mpeg:cenc:2013\" type=\"dynamic\" "
+                  "availabilityStartTime=\"2021-01-01T00:00:00Z\" "
+                  "publishTime=\"2021-01-02T00:00:00Z\" minimumUpdatePeriod=\"PT6S\" "
+                  "timeShiftBufferDepth=\"PT24H\" minBufferTime=\"PT4S\" "
+                  "profiles=\"urn:mpeg:dash:profile:isoff-live:2011\">\n");
+  char buf[512];
+  uint64_t start(0);
+  for (unsigned int p(0); p < periods; ++p)
+  {
+    snprintf(buf, sizeof(buf), "  <Period id=\"p%u\" start=\"PT%" PRIu64 "S\">\n", p, start);
+    mpd += buf;
+
+    static const struct
+    {
+      const char* type;
+      const char* lang;
+      uint32_t timescale, duration;
+    } SETS[] = {{"video", nullptr, 90000, 180000},
+                {"audio", "en", 48000, 96000},
+                {"audio", "de", 48000, 96000},
+                {"text", "en", 1000, 2000}};
+    for (const auto& set : SETS)
+    {
+      snprintf(buf, sizeof(buf),
+               "    <AdaptationSet contentType=\"%s\" mimeType=\"%s\"%s%s%s "
+               "segmentAlignment=\"true\" startWithSAP=\"1\">\n",
+               set.type,
+               strcmp(set.type, "text") == 0 ? "application/mp4" : strcmp(set.type, "video") == 0
+                                                                      ? "video/mp4"
+                                                                      : "audio/mp4",
+               set.lang ? " lang=\"" : "", set.lang ? set.lang : "", set.lang ? "\"" : "");
+      mpd += buf;
+      if (strcmp(set.type, "text") != 0)
+        mpd += "      <ContentProtection schemeIdUri=\"urn:mpeg:dash:mp4protection:2011\" "
+               "value=\"cenc\" cenc:default_KID=\"10000000-1000-1000-1000-100000000001\"/>\n"
+               "      <ContentProtection "
+               "schemeIdUri=\"urn:uuid:edef8ba9-79d6-4ace-a3c8-27dcd51d21ed\">\n"
+               "        <cenc:pssh>AAAANHBzc2gAAAAA7e+LqXnWSs6jyCfc1R0h7QAAABQIARIQEAAAABAAEAAQ"
+               "AAAAAAAAAQ==</cenc:pssh>\n"
+               "      </ContentProtection>\n";
+      if (strcmp(set.type, "audio") == 0)
+        mpd += "      <Role schemeIdUri=\"urn:mpeg:dash:role:2011\" value=\"main\"/>\n"
+               "      <AudioChannelConfiguration "
+               "schemeIdUri=\"urn:mpeg:dash:23003:3:audio_channel_configuration:2011\" "
+               "value=\"2\"/>\n";
+
+      const uint64_t t(start * set.timescale);
+      snprintf(buf, sizeof(buf),
+               "      <SegmentTemplate timescale=\"%u\" presentationTimeOffset=\"%" PRIu64
+               "\" initialization=\"$RepresentationID$/init.mp4\" "
+               "media=\"$RepresentationID$/$Time$.m4s\">\n"
+               "        <SegmentTimeline>\n",
+               set.timescale, t);
+      mpd += buf;
+      // Encoders with drifting durations list every segment
+      for (unsigned int s(0); s < segmentsPerPeriod; ++s)
+      {
+        snprintf(buf, sizeof(buf), "          <S t=\"%" PRIu64 "\" d=\"%u\"/>\n",
+                 t + static_cast<uint64_t>(s) * set.duration, set.duration);
+        mpd += buf;
+      }
+      mpd += "        </SegmentTimeline>\n"
+             "      </SegmentTemplate>\n";
+
+      if (strcmp(set.type, "video") == 0)
+      {
+        static const struct
+        {
+          uint32_t bandwidth;
+          uint16_t width, height;
+        } REPS[] = {{400000, 416, 234},   {800000, 640, 360},   {1600000, 960, 540},
+                    {3000000, 1280, 720}, {4500000, 1600, 900}, {6000000, 1920, 1080}};
+        for (const auto& rep : REPS)
+        {
+          snprintf(buf, sizeof(buf),
+                   "      <Representation id=\"v%u\" bandwidth=\"%u\" codecs=\"avc1.64001f\" "
+                   "width=\"%u\" height=\"%u\" frameRate=\"25\" sar=\"1:1\" "
+                   "scanType=\"progressive\"/>\n",
+                   rep.height, rep.bandwidth, rep.width, rep.height);
+          mpd += buf;
+        }
+      }
+      else if (strcmp(set.type, "audio") == 0)
+      {
+        snprintf(buf, sizeof(buf),
+                 "      <Representation id=\"a%s\" bandwidth=\"128000\" codecs=\"mp4a.40.2\" "
+                 "audioSamplingRate=\"48000\"/>\n",
+                 set.lang);
+        mpd += buf;
+      }
+      else
+        mpd += "      <Representation id=\"t\" bandwidth=\"1000\" codecs=\"stpp\"/>\n";
+      mpd += "    </AdaptationSet>\n";
+    }
+    mpd += "  </Period>\n";
+    start += segmentsPerPeriod * 2;
+  }
+  mpd += "</MPD>\n";
+  return mpd;
+}
+
+bool LoadMpd(const char* fileName, std::string& mpd)
+{
+  FILE* f = fopen(fileName, "rb");
+  if (!f)
+    return false;
+  char buf[16384];
+  size_t nbRead;
+  while ((nbRead = fread(buf, 1, sizeof(buf), f)) > 0)
+    mpd.append(buf, nbRead);
+  fclose(f);
+  return true;
+}
+
+bool Run(const char* name, const std::string& mpd, unsigned int iterations)
+{
+  double ms(0);
+  size_t periods(0), segments(0);
+  for (unsigned int i(0); i <= iterations; ++i)
+  {
+    BenchmarkTree tree(mpd);
+    const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+    if (!tree.open("http://benchmark/manifest.mpd", ""))
+      return false;
+    // The first parse is not measured
+    if (i)
+      ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+                .count();
+
+    periods = tree.periods_.size();
+    segments = 0;
+    for (const auto* period : tree.periods_)
+      for (const auto* adp : period->adaptationSets_)
+        for (const auto* rep : adp->representations_)
+          segments += rep->segments_.size();
+  }
+  ms /= iterations;
+
+  printf("%-40s %8zu KB %4zu periods %8zu segments %9.3f ms %8.1f MB/s\n", name,
+         mpd.size() / 1024, periods, segments, ms, mpd.size() / ms / 1000);
+  return true;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+  unsigned int iterations(10);
+  std::vector<const char*> files;
+  for (int i(1); i < argc; ++i)
+  {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+      iterations = atoi(argv[++i]);
+    else if (argv[i][0] == '-')
+    {
+      fprintf(stderr,
+              "Usage: %s [manifest.mpd ...] [--iterations <count>]\n"
+              "Without manifests, live multi-period MPDs of about 1, 2 and 5 MB are generated.\n",
+              argv[0]);
+      return 1;
+    }
+    else
+      files.push_back(argv[i]);
+  }
+  if (!iterations)
+    iterations = 1;
+
+  if (files.empty())
+  {
+    static const struct
+    {
+      unsigned int periods, segments;
+    } MPDS[] = {{1, 7200}, {40, 300}, {100, 300}};
+    for (const auto& mpd : MPDS)
+    {
+      char name[64];
+      snprintf(name, sizeof(name), "live %u periods x %u segments", mpd.periods, mpd.segments);
+      if (!Run(name, CreateLiveMpd(mpd.periods, mpd.segments), iterations))
+        return 1;
+    }
+    return 0;
+  }
+
+  for (const char* file : files)
+  {
+    std::string mpd;
+    if (!LoadMpd(file, mpd))
+    {
+      fprintf(stderr, "Unable to load manifest %s\n", file);
+      return 1;
+    }
+    const char* name(strrchr(file, '/'));
+    if (!Run(name ? name + 1 : file, mpd, iterations))
+    {
+      fprintf(stderr, "Unable to parse manifest %s\n", file);
+      return 1;
+    }
+  }
+  return 0;
+}
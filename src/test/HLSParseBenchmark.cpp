@@ -0,0 +1,154 @@
+#include "TestHelper.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+// Serves the playlists from memory, only the parsing is measured
+class BenchmarkTree : public adaptive::HLSTree
+{
+public:
+  BenchmarkTree() : adaptive::HLSTree(new AESDecrypter(std::string())){};
+
+  std::string playlist_;
+
+protected:
+  bool download(const char* url,
+                const std::map<std::string, std::string>& manifestHeaders,
+                void* opaque,
+                bool isManifest) override
+  {
+    static const char* MASTER = "#EXTM3U\n"
+                                "#EXT-X-STREAM-INF:BANDWIDTH=2000000,CODECS=\"avc1.64001f,mp4a.40.2\","
+                                "RESOLUTION=1280x720\n"
+                                "stream.m3u8\n";
+    effective_url_ = url;
+    if (isManifest)
+      return PreparePaths(effective_url_) && write_data((void*)MASTER, strlen(MASTER), opaque);
+    return write_data(&playlist_[0], playlist_.size(), opaque);
+  }
+};
+
+// Live event playlist growing since hours, 2 s fMP4 segments with program date times
+std::string CreateEventPlaylist(unsigned int hours)
+{
+  const unsigned int segments(hours * 1800);
+  std::string playlist("#EXTM3U\n"
+                       "#EXT-X-VERSION:7\n"
+                       "#EXT-X-TARGETDURATION:2\n"
+                       "#EXT-X-MEDIA-SEQUENCE:0\n"
+                       "#EXT-X-PLAYLIST-TYPE:EVENT\n"
+                       "#EXT-X-MAP:URI=\"init.mp4\"\n");
+  char line[128];
+  for (unsigned int i(0); i < segments; ++i)
+  {
+    snprintf(line, sizeof(line),
+             "#EXT-X-PROGRAM-DATE-TIME:2021-01-01T%02u:%02u:%02u.000Z\n"
+             "#EXTINF:2.00000,\n"
+             "segment_%08u.m4s?token=0123456789abcdef\n",
+             (i / 1800) % 24, (i / 30) % 60, (i * 2) % 60, i);
+    playlist += line;
+  }
+  return playlist;
+}
+
+bool LoadPlaylist(const char* fileName, std::string& playlist)
+{
+  FILE* f = fopen(fileName, "rb");
+  if (!f)
+    return false;
+  char buf[16384];
+  size_t nbRead;
+  while ((nbRead = fread(buf, 1, sizeof(buf), f)) > 0)
+    playlist.append(buf, nbRead);
+  fclose(f);
+  return true;
+}
+
+bool Run(const char* name, const std::string& playlist, unsigned int iterations)
+{
+  BenchmarkTree tree;
+  if (!tree.open("http://benchmark/master.m3u8", ""))
+    return false;
+
+  adaptive::AdaptiveTree::AdaptationSet* adp(tree.current_period_->adaptationSets_[0]);
+  adaptive::AdaptiveTree::Representation* rep(adp->representations_[0]);
+  tree.playlist_ = playlist;
+
+  // The first parse is not measured
+  if (tree.prepareRepresentation(tree.current_period_, adp, rep, true) ==
+      adaptive::AdaptiveTree::PREPARE_RESULT_FAILURE)
+    return false;
+
+  const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+  for (unsigned int i(0); i < iterations; ++i)
+  {
+    // VOD playlists are otherwise not parsed again
+    rep->flags_ &= ~adaptive::AdaptiveTree::Representation::DOWNLOADED;
+    tree.prepareRepresentation(tree.current_period_, adp, rep, true);
+  }
+  const double ms(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                             start)
+                      .count() /
+                  iterations);
+
+  printf("%-40s %8zu KB %7zu segments %9.3f ms %8.1f MB/s\n", name, playlist.size() / 1024,
+         rep->segments_.size(), ms, playlist.size() / ms / 1000);
+  return true;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+  unsigned int iterations(20);
+  std::vector<const char*> files;
+  for (int i(1); i < argc; ++i)
+  {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+      iterations = atoi(argv[++i]);
+    else if (argv[i][0] == '-')
+    {
+      fprintf(stderr,
+              "Usage: %s [playlist.m3u8 ...] [--iterations <count>]\n"
+              "Without playlists, live event playlists of 1, 4 and 12 hours are generated.\n",
+              argv[0]);
+      return 1;
+    }
+    else
+      files.push_back(argv[i]);
+  }
+  if (!iterations)
+    iterations = 1;
+
+  if (files.empty())
+  {
+    for (unsigned int hours : {1, 4, 12})
+    {
+      char name[32];
+      snprintf(name, sizeof(name), "event %u h", hours);
+      if (!Run(name, CreateEventPlaylist(hours), iterations))
+        return 1;
+    }
+    return 0;
+  }
+
+  for (const char* file : files)
+  {
+    std::string playlist;
+    if (!LoadPlaylist(file, playlist))
+    {
+      fprintf(stderr, "Unable to load playlist %s\n", file);
+      return 1;
+    }
+    const char* name(strrchr(file, '/'));
+    if (!Run(name ? name + 1 : file, playlist, iterations))
+    {
+      fprintf(stderr, "Unable to parse playlist %s\n", file);
+      return 1;
+    }
+  }
+  return 0;
+}
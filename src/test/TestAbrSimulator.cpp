@@ -0,0 +1,73 @@
+#include "AbrSimulator.h"
+
+#include <gtest/gtest.h>
+
+
+class AbrSimulatorTest : public ::testing::Test
+{
+protected:
+  // Each run starts with a new tree, bandwidth estimate and initialization cache
+  AbrSimulationResult Play(const std::string& traceName, uint32_t lookAhead = 3)
+  {
+    std::string fileName;
+    SetFileName(fileName, "traces/" + traceName);
+    ThroughputTrace trace;
+    EXPECT_TRUE(trace.Load(fileName));
+
+    DASHTestTree tree;
+    SetFileName(testHelper::testFile, "mpd/segtpl_abr.mpd");
+    EXPECT_TRUE(tree.open("https://foo.bar/segtpl_abr.mpd", ""));
+    tree.bandwidth_ = 1000000;
+    tree.set_download_speed(tree.bandwidth_ / 8);
+    segments = tree.current_period_->adaptationSets_[0]->representations_[0]->segments_.size();
+
+    SimulatedStream stream(tree, trace, 0.0);
+    stream.prepare_stream(tree.current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                          mediaHeaders);
+    stream.SetLookAhead(lookAhead, 0);
+    return stream.Play();
+  }
+
+  size_t segments = 0;
+  std::map<std::string, std::string> mediaHeaders;
+};
+
+TEST_F(AbrSimulatorTest, TransferTime)
+{
+  std::string fileName;
+  SetFileName(fileName, "traces/wifi_drop.txt");
+  ThroughputTrace trace;
+  ASSERT_TRUE(trace.Load(fileName));
+
+  // First period: 860076 bytes in 910 ms
+  EXPECT_NEAR(trace.GetTransferTime(0.0, 860076), 0.91, 0.001);
+  EXPECT_NEAR(trace.GetTransferTime(0.0, 430038), 0.455, 0.001);
+  // Spans the first two periods
+  EXPECT_NEAR(trace.GetTransferTime(0.455, 430038 + 831247), 0.455 + 0.808, 0.001);
+}
+
+TEST_F(AbrSimulatorTest, StableThroughput)
+{
+  AbrSimulationResult result(Play("stable_4mbit.txt"));
+
+  EXPECT_EQ(result.segments, segments);
+  EXPECT_EQ(result.rebufferCount, 0);
+  EXPECT_GT(result.startupDelay, 0.0);
+  // 4 Mbit/s sustains 1.5 Mbit/s but not the highest representation
+  EXPECT_GT(result.averageBitrate, 1000000);
+  EXPECT_LT(result.averageBitrate, 4000000);
+}
+
+TEST_F(AbrSimulatorTest, Deterministic)
+{
+  AbrSimulationResult first(Play("wifi_drop.txt"));
+  AbrSimulationResult second(Play("wifi_drop.txt"));
+
+  EXPECT_EQ(first.segments, segments);
+  // Up on the fast start, down again after the drop
+  EXPECT_GE(first.switchCount, 2);
+  EXPECT_EQ(first.startupDelay, second.startupDelay);
+  EXPECT_EQ(first.rebufferTime, second.rebufferTime);
+  EXPECT_EQ(first.averageBitrate, second.averageBitrate);
+  EXPECT_EQ(first.switchCount, second.switchCount);
+}
@@ -0,0 +1,107 @@
+#include "../common/BandwidthEstimator.h"
+#include "TestHelper.h"
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <memory>
+
+
+class BandwidthEstimatorTest : public ::testing::Test
+{
+protected:
+  struct TRACESAMPLE
+  {
+    uint64_t bytes;
+    double seconds;
+  };
+
+  // Recorded segment downloads, one "<bytes> <transfer time ms>" per line
+  void LoadTrace(const std::string& traceName)
+  {
+    std::string fileName;
+    SetFileName(fileName, "traces/" + traceName);
+    FILE* f = fopen(fileName.c_str(), "r");
+    ASSERT_NE(f, nullptr);
+
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+    {
+      unsigned long long bytes;
+      unsigned int ms;
+      if (line[0] != '#' && sscanf(line, "%llu %u", &bytes, &ms) == 2)
+        trace.push_back({bytes, ms / 1000.0});
+    }
+    fclose(f);
+    ASSERT_FALSE(trace.empty());
+  }
+
+  // Feeds the trace samples [begin, end) and returns the estimate
+  double Replay(adaptive::BandwidthEstimator& estimator, size_t begin, size_t end)
+  {
+    for (size_t i(begin); i < end && i < trace.size(); ++i)
+      estimator.AddSample(trace[i].bytes, trace[i].seconds);
+    return estimator.GetEstimate();
+  }
+
+  std::vector<TRACESAMPLE> trace;
+  adaptive::EwmaBandwidthEstimator ewma;
+  adaptive::HarmonicMeanBandwidthEstimator harmonicMean;
+};
+
+TEST_F(BandwidthEstimatorTest, InitialEstimate)
+{
+  ewma.SetInitialEstimate(100000);
+  harmonicMean.SetInitialEstimate(100000);
+  EXPECT_EQ(ewma.GetEstimate(), 100000);
+  EXPECT_EQ(harmonicMean.GetEstimate(), 100000);
+
+  // Too small to measure throughput
+  ewma.AddSample(1000, 0.001);
+  harmonicMean.AddSample(1000, 0.001);
+  EXPECT_EQ(ewma.GetEstimate(), 100000);
+  EXPECT_EQ(harmonicMean.GetEstimate(), 100000);
+}
+
+TEST_F(BandwidthEstimatorTest, StableTrace)
+{
+  LoadTrace("stable_4mbit.txt");
+
+  EXPECT_NEAR(Replay(ewma, 0, trace.size()), 500000, 50000);
+  EXPECT_NEAR(Replay(harmonicMean, 0, trace.size()), 500000, 50000);
+}
+
+TEST_F(BandwidthEstimatorTest, ThroughputDrop)
+{
+  LoadTrace("wifi_drop.txt");
+
+  EXPECT_NEAR(Replay(ewma, 0, 15), 1000000, 150000);
+  EXPECT_NEAR(Replay(harmonicMean, 0, 15), 1000000, 150000);
+
+  // The fast average follows a drop within a few segments
+  EXPECT_LT(Replay(ewma, 15, 18), 375000);
+
+  EXPECT_NEAR(Replay(ewma, 18, trace.size()), 250000, 40000);
+  EXPECT_NEAR(Replay(harmonicMean, 15, trace.size()), 250000, 40000);
+}
+
+TEST_F(BandwidthEstimatorTest, SingleSpike)
+{
+  LoadTrace("cache_spike.txt");
+
+  double ewmaBefore(Replay(ewma, 0, 12));
+  double harmonicBefore(Replay(harmonicMean, 0, 12));
+
+  // One segment from a proxy cache must not pretend a 10x faster line
+  EXPECT_LT(Replay(ewma, 12, 13), ewmaBefore * 1.3);
+  EXPECT_LT(Replay(harmonicMean, 12, 13), harmonicBefore * 1.15);
+}
+
+TEST_F(BandwidthEstimatorTest, Create)
+{
+  std::unique_ptr<adaptive::BandwidthEstimator> estimator(
+      adaptive::BandwidthEstimator::Create(adaptive::BandwidthEstimator::TYPE_HARMONIC_MEAN));
+  EXPECT_NE(dynamic_cast<adaptive::HarmonicMeanBandwidthEstimator*>(estimator.get()), nullptr);
+
+  estimator.reset(adaptive::BandwidthEstimator::Create(adaptive::BandwidthEstimator::TYPE_EWMA));
+  EXPECT_NE(dynamic_cast<adaptive::EwmaBandwidthEstimator*>(estimator.get()), nullptr);
+}
@@ -0,0 +1,82 @@
+#include "../common/BaseUrlSelector.h"
+
+#include <gtest/gtest.h>
+
+using adaptive::BaseUrl;
+using adaptive::BaseUrlSelector;
+
+namespace
+{
+BaseUrl MakeBaseUrl(const std::string& url, uint32_t priority, uint32_t weight)
+{
+  BaseUrl baseUrl;
+  baseUrl.url = url;
+  baseUrl.priority = priority;
+  baseUrl.weight = weight;
+  return baseUrl;
+}
+} // namespace
+
+TEST(BaseUrlSelectorTest, Key)
+{
+  BaseUrl baseUrl(MakeBaseUrl("https://cdn1.foo.bar/content/", 1, 1));
+  EXPECT_EQ(BaseUrlSelector::GetKey(baseUrl), "https://cdn1.foo.bar");
+  baseUrl.serviceLocation = "cdn1";
+  EXPECT_EQ(BaseUrlSelector::GetKey(baseUrl), "cdn1");
+}
+
+TEST(BaseUrlSelectorTest, PriorityAndFailover)
+{
+  BaseUrlSelector selector(1);
+  std::vector<BaseUrl> baseUrls{MakeBaseUrl("https://cdn2.foo.bar/", 2, 1),
+                                MakeBaseUrl("https://cdn1.foo.bar/", 1, 1)};
+
+  EXPECT_EQ(selector.Select(baseUrls), 1);
+  selector.AddResult(baseUrls[1], false, 0.0);
+  EXPECT_TRUE(selector.IsBlocked(baseUrls[1]));
+  EXPECT_EQ(selector.Select(baseUrls), 0);
+
+  // All blocked: the one blocked shortest
+  selector.AddResult(baseUrls[0], false, 0.0);
+  selector.AddResult(baseUrls[0], false, 0.0);
+  EXPECT_EQ(selector.Select(baseUrls), 1);
+}
+
+TEST(BaseUrlSelectorTest, WeightAndStickiness)
+{
+  std::vector<BaseUrl> baseUrls{MakeBaseUrl("https://cdn1.foo.bar/", 1, 3),
+                                MakeBaseUrl("https://cdn2.foo.bar/", 1, 1)};
+
+  // New sessions are spread by weight
+  unsigned int first(0);
+  for (uint32_t seed(0); seed < 400; ++seed)
+  {
+    BaseUrlSelector selector(seed);
+    if (selector.Select(baseUrls) == 0)
+      ++first;
+  }
+  EXPECT_GT(first, 250);
+  EXPECT_LT(first, 350);
+
+  // A session stays with its location
+  BaseUrlSelector selector(1);
+  size_t selected(selector.Select(baseUrls));
+  for (unsigned int i(0); i < 10; ++i)
+    EXPECT_EQ(selector.Select(baseUrls), selected);
+}
+
+TEST(BaseUrlSelectorTest, LeaveSlowLocation)
+{
+  BaseUrlSelector selector(1);
+  std::vector<BaseUrl> baseUrls{MakeBaseUrl("https://cdn1.foo.bar/", 1, 1),
+                                MakeBaseUrl("https://cdn2.foo.bar/", 1, 1)};
+
+  size_t selected(selector.Select(baseUrls));
+  size_t other(1 - selected);
+  selector.AddResult(baseUrls[other], true, 0.05);
+  selector.AddResult(baseUrls[selected], true, 0.08);
+  EXPECT_EQ(selector.Select(baseUrls), selected);
+  selector.AddResult(baseUrls[selected], true, 2.0);
+  selector.AddResult(baseUrls[selected], true, 2.0);
+  EXPECT_EQ(selector.Select(baseUrls), other);
+}
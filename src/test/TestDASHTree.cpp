@@ -1,6 +1,8 @@
 #include "TestHelper.h"
 
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <thread>
 
 
 class DASHTreeTest : public ::testing::Test
@@ -41,6 +43,11 @@ protected:
   void SetUp() override
   {
     testHelper::lastDownloadUrl.clear();
+    testHelper::failingUrls.clear();
+    testHelper::failingRanges.clear();
+    testHelper::breakingUrls.clear();
+    testHelper::holdBreak = false;
+    testHelper::ignoreRanges = false;
     DASHTreeTest::SetUp();
     videoStream = new TestAdaptiveStream(*tree, adaptive::AdaptiveTree::StreamType::VIDEO);
   }
@@ -177,6 +184,90 @@ TEST_F(DASHTreeTest, CalculateCorrectSegmentNumbersFromSegmentTimeline)
   EXPECT_EQ(segments[12]->range_end_, 487062);
 }
 
+TEST_F(DASHTreeTest, ShareSegmentsOfSegmentTimeline)
+{
+  OpenTestFile("mpd/segtimeline_live_ast.mpd", "", "");
+
+  // The representations of an adaptation set keep one copy of the timeline
+  const adaptive::AdaptiveTree::AdaptationSet* adp(tree->periods_[0]->adaptationSets_[0]);
+  ASSERT_EQ(adp->representations_.size(), 4);
+  for (const auto* rep : adp->representations_)
+    EXPECT_TRUE(rep->segments_.shares(adp->representations_[0]->segments_));
+  EXPECT_EQ(adp->representations_[3]->segments_[12]->range_end_, 487062);
+
+  EXPECT_FALSE(tree->periods_[0]->adaptationSets_[1]->representations_[0]->segments_.shares(
+      adp->representations_[0]->segments_));
+}
+
+TEST_F(DASHTreeTest, RefreshSegmentTimeline)
+{
+  OpenTestFile("mpd/segtimeline_live_refresh1.mpd", "", "");
+
+  adaptive::AdaptiveTree::Period* period(tree->periods_[0]);
+  adaptive::AdaptiveTree::Representation* video(period->adaptationSets_[0]->representations_[0]);
+  adaptive::AdaptiveTree::Representation* audio(period->adaptationSets_[1]->representations_[0]);
+  ASSERT_EQ(video->segments_.size(), 5);
+  video->current_segment_ = video->segments_[3];
+
+  // The window moved by 2 segments, 3 are new
+  SetFileName(testHelper::testFile, "mpd/segtimeline_live_refresh2.mpd");
+  ASSERT_TRUE(tree->HasUpdateThread());
+  tree->RefreshSegments(period, period->adaptationSets_[0], video,
+                        adaptive::AdaptiveTree::VIDEO);
+
+  // Loaded by the update thread, the tree is only locked while the segments are merged
+  for (unsigned int i(0); i < 200; ++i)
+  {
+    {
+      std::lock_guard<std::mutex> lck(tree->GetTreeMutex());
+      if (video->startNumber_ != 100)
+        break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  EXPECT_EQ(video->segments_.size(), 6);
+  EXPECT_EQ(video->startNumber_, 102);
+  EXPECT_EQ(video->segments_[0]->range_end_, 102);
+  EXPECT_EQ(video->segments_[5]->range_end_, 107);
+  EXPECT_EQ(video->segments_[5]->range_begin_, 642000);
+  EXPECT_EQ(video->getCurrentSegmentNumber(), 103);
+  EXPECT_EQ(video->current_segment_->range_begin_, 618000);
+
+  adaptive::AdaptiveTree::Representation* video2(period->adaptationSets_[0]->representations_[1]);
+  EXPECT_TRUE(video2->segments_.shares(video->segments_));
+  EXPECT_EQ(video2->startNumber_, 102);
+
+  EXPECT_EQ(audio->segments_.size(), 6);
+  EXPECT_EQ(audio->startNumber_, 3);
+  EXPECT_EQ(audio->segments_[0]->range_begin_, 612000);
+  EXPECT_EQ(audio->segments_[5]->range_begin_, 642000);
+}
+
+TEST_F(DASHTreeTest, FindRepresentationByIndex)
+{
+  OpenTestFile("mpd/segtimeline_live_refresh1.mpd", "", "");
+
+  adaptive::AdaptiveTree::Period* period(tree->periods_[0]);
+  adaptive::AdaptiveTree::AdaptationSet* video(period->adaptationSets_[0]);
+  adaptive::AdaptiveTree::AdaptationSet* audio(period->adaptationSets_[1]);
+  EXPECT_EQ(period->representation_index_.size(), 3);
+
+  adaptive::AdaptiveTree::AdaptationSet* found(nullptr);
+  EXPECT_EQ(period->FindRepresentation(video, video->representations_[1], &found),
+            video->representations_[1]);
+  EXPECT_EQ(found, video);
+
+  // Same representation id in an adaptation set with another key
+  adaptive::AdaptiveTree::AdaptationSet other;
+  other.CopyBasicData(audio);
+  other.language_ = "de";
+  EXPECT_EQ(period->FindRepresentation(&other, other.representations_[0]), nullptr);
+  other.language_ = audio->language_;
+  EXPECT_EQ(period->FindRepresentation(&other, other.representations_[0]),
+            audio->representations_[0]);
+}
+
 TEST_F(DASHTreeTest, CalculateCorrectSegmentNumbersFromSegmentTemplateWithPTO)
 {
   tree->mock_time = 1617223929L;
@@ -297,6 +388,519 @@ TEST_F(DASHTreeAdaptiveStreamTest, replacePlaceHolders)
   EXPECT_EQ(downloadedUrls.back(), "https://foo.bar/videosd-400x224/segment.m4s");
 }
 
+TEST_F(DASHTreeAdaptiveStreamTest, segmentLookAhead)
+{
+  OpenTestFile("mpd/placeholders.mpd", "https://foo.bar/placeholders.mpd", "");
+
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->SetLookAhead(3, 0);
+  videoStream->start_stream(~0, 0, 0, true);
+  testHelper::downloadList.clear();
+
+  // Segments arrive in order while the worker downloads ahead
+  for (unsigned int i = 0; i < 5; i++)
+  {
+    ASSERT_EQ(videoStream->read(buf, 16), 16);
+    EXPECT_EQ(std::string(reinterpret_cast<const char*>(buf), 16), "Sixteen bytes!!!");
+  }
+  videoStream->stop();
+
+  ASSERT_GE(testHelper::downloadList.size(), 5);
+  EXPECT_LE(testHelper::downloadList.size(), 8);
+  EXPECT_EQ(testHelper::downloadList[0], "https://foo.bar/videosd-400x224/segment_487050.m4s");
+  EXPECT_EQ(testHelper::downloadList[4], "https://foo.bar/videosd-400x224/segment_487054.m4s");
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, segmentMetrics)
+{
+  OpenTestFile("mpd/placeholders.mpd", "https://foo.bar/placeholders.mpd", "");
+
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->SetLookAhead(3, 0);
+  videoStream->start_stream(~0, 0, 0, true);
+  ReadSegments(videoStream, 16, 5);
+  videoStream->stop();
+
+  // Segments are recorded when the reader leaves them
+  std::vector<adaptive::StreamMetrics::SEGMENT> segments(
+      videoStream->GetMetrics().GetSegments());
+  ASSERT_EQ(segments.size(), 4);
+  EXPECT_EQ(segments[0].segmentNumber, 487050);
+  EXPECT_EQ(segments[3].segmentNumber, 487053);
+  EXPECT_EQ(segments[0].representation,
+            tree->current_period_->adaptationSets_[0]->representations_[0]->id);
+  EXPECT_EQ(segments[0].bytes, 16);
+  EXPECT_FALSE(segments[0].failed);
+
+  adaptive::StreamMetrics::COUNTERS counters(videoStream->GetMetrics().GetCounters());
+  EXPECT_EQ(counters.segments, 4);
+  EXPECT_EQ(counters.bytes, 64);
+  EXPECT_EQ(counters.failedSegments, 0);
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, lowLatencyLive)
+{
+  // 1000 s after availabilityStartTime, segments are 2 s and can be requested 1.9 s early
+  tree->mock_time = 1609459200L + 1000;
+  OpenTestFile("mpd/segtpl_lowlatency.mpd", "https://foo.bar/segtpl_lowlatency.mpd", "");
+
+  EXPECT_TRUE(tree->low_latency_);
+  EXPECT_EQ(tree->live_latency_, 3000);
+  adaptive::AdaptiveTree::Representation* rep(
+      tree->current_period_->adaptationSets_[0]->representations_[0]);
+  ASSERT_EQ(rep->segments_.size(), 11);
+  EXPECT_EQ(rep->segments_[0]->range_end_, 490);
+  // Segment 501 is produced from 1000 s on and can be requested at 1000.1 s
+  EXPECT_EQ(rep->segments_[10]->range_end_, 500);
+
+  // The stream follows the period of the opened tree
+  delete videoStream;
+  videoStream = new TestAdaptiveStream(*tree, adaptive::AdaptiveTree::StreamType::VIDEO);
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->start_stream(~0, 0, 0, false);
+
+  // Starts 3 s behind the live edge instead of at least 12 s
+  ReadSegments(videoStream, 16, 3);
+  ASSERT_EQ(downloadedUrls.size(), 2);
+  EXPECT_EQ(downloadedUrls[0], "https://foo.bar/V500/499.m4s");
+  EXPECT_EQ(downloadedUrls[1], "https://foo.bar/V500/500.m4s");
+  EXPECT_TRUE(videoStream->waitingForSegment());
+
+  tree->mock_time += 2;
+  ReadSegments(videoStream, 16, 1);
+  ASSERT_EQ(downloadedUrls.size(), 1);
+  EXPECT_EQ(downloadedUrls[0], "https://foo.bar/V500/501.m4s");
+  EXPECT_FALSE(videoStream->waitingForSegment());
+  EXPECT_EQ(rep->segments_[0]->range_end_, 491);
+  EXPECT_EQ(rep->segments_[10]->range_end_, 501);
+
+  // The other representation shares the extended segments
+  const adaptive::AdaptiveTree::Representation* other(
+      tree->current_period_->adaptationSets_[0]->representations_[1]);
+  EXPECT_TRUE(other->segments_.shares(rep->segments_));
+  EXPECT_EQ(other->startNumber_, rep->startNumber_);
+  videoStream->stop();
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, segmentParallelDownload)
+{
+  OpenTestFile("mpd/placeholders.mpd", "https://foo.bar/placeholders.mpd", "");
+
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->SetLookAhead(4, 0);
+  videoStream->SetDownloadWorkers(3, 0);
+  videoStream->start_stream(~0, 0, 0, true);
+  testHelper::downloadList.clear();
+
+  // Downloads may complete in any order, segments are still read one after another
+  for (unsigned int i = 0; i < 6; i++)
+  {
+    ASSERT_EQ(videoStream->read(buf, 16), 16);
+    EXPECT_EQ(videoStream->getSegmentPos(), i);
+  }
+  videoStream->stop();
+
+  std::lock_guard<std::mutex> lck(testHelper::downloadMutex);
+  std::sort(testHelper::downloadList.begin(), testHelper::downloadList.end());
+  ASSERT_GE(testHelper::downloadList.size(), 6);
+  EXPECT_EQ(testHelper::downloadList[0], "https://foo.bar/videosd-400x224/segment_487050.m4s");
+  EXPECT_EQ(testHelper::downloadList[5], "https://foo.bar/videosd-400x224/segment_487055.m4s");
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, segmentRangeSplit)
+{
+  OpenTestFile("mpd/segmentlist_ranges.mpd", "https://foo.bar/segmentlist_ranges.mpd", "");
+
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->SetRangeSplitSize(32);
+  videoStream->start_stream(~0, 0, 0, true);
+  testHelper::downloadList.clear();
+
+  // The split parts must be joined in file order
+  const uint32_t segmentSizes[3] = {100, 40, 16};
+  uint64_t fileOffset(1000);
+  char data[100];
+  for (uint32_t segmentSize : segmentSizes)
+  {
+    std::string expected;
+    for (uint32_t i = 0; i < segmentSize; i++)
+      expected += static_cast<char>('a' + (fileOffset + i) % 26);
+    fileOffset += segmentSize;
+
+    ASSERT_EQ(videoStream->read(data, segmentSize), segmentSize);
+    EXPECT_EQ(std::string(data, segmentSize), expected);
+  }
+  videoStream->stop();
+
+  // 4 parts for the first segment, 2 for the second one, the last one is not split
+  EXPECT_EQ(testHelper::downloadList.size(), 7);
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, segmentRangeSplitRetry)
+{
+  OpenTestFile("mpd/segmentlist_ranges.mpd", "https://foo.bar/segmentlist_ranges.mpd", "");
+
+  adaptive::RetryPolicy::SETTINGS retrySettings;
+  retrySettings.initialDelay = 0.001;
+  testHelper::failingRanges.push_back("bytes=1050-1074");
+  videoStream->SetRetryPolicy(retrySettings);
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->SetRangeSplitSize(32);
+  videoStream->start_stream(~0, 0, 0, true);
+  testHelper::downloadList.clear();
+
+  // The parts received before the failed one must not be kept twice
+  std::string expected;
+  for (uint32_t i = 0; i < 100; i++)
+    expected += static_cast<char>('a' + (1000 + i) % 26);
+
+  char data[101];
+  ASSERT_EQ(videoStream->read(data, 100), 100);
+  EXPECT_EQ(std::string(data, 100), expected);
+  EXPECT_EQ(videoStream->tell(), 1100);
+  ASSERT_EQ(videoStream->read(data, 40), 40);
+  EXPECT_EQ(data[0], static_cast<char>('a' + 1100 % 26));
+  ASSERT_EQ(videoStream->read(data, 16), 16);
+  videoStream->stop();
+
+  // The failed segment is requested again with all of its parts
+  EXPECT_EQ(testHelper::downloadList.size(), 8 + 2 + 1);
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, segmentRangeSplitIgnored)
+{
+  OpenTestFile("mpd/segmentlist_ranges.mpd", "https://foo.bar/segmentlist_ranges.mpd", "");
+
+  testHelper::ignoreRanges = true;
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->SetRangeSplitSize(32);
+  videoStream->start_stream(~0, 0, 0, true);
+  testHelper::downloadList.clear();
+
+  // Only the range of each segment is taken from the whole file the server sends
+  const uint32_t segmentSizes[3] = {100, 40, 16};
+  uint64_t fileOffset(1000);
+  char data[100];
+  for (uint32_t segmentSize : segmentSizes)
+  {
+    std::string expected;
+    for (uint32_t i = 0; i < segmentSize; i++)
+      expected += static_cast<char>('a' + (fileOffset + i) % 26);
+    fileOffset += segmentSize;
+
+    ASSERT_EQ(videoStream->read(data, segmentSize), segmentSize);
+    EXPECT_EQ(std::string(data, segmentSize), expected);
+  }
+  videoStream->stop();
+
+  // The split segments are loaded again with a single request
+  EXPECT_EQ(testHelper::downloadList.size(), 4 + 1 + 2 + 1 + 1);
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, segmentBorrow)
+{
+  OpenTestFile("mpd/segmentlist_ranges.mpd", "https://foo.bar/segmentlist_ranges.mpd", "");
+
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->SetLookAhead(2, 0);
+  videoStream->start_stream(~0, 0, 0, true);
+
+  // borrow() returns nullptr as long as the segment is downloading
+  auto borrowLoaded = [this](uint32_t bytes) {
+    const uint8_t* data(nullptr);
+    for (unsigned int i = 0; !data && i < 500; ++i)
+    {
+      if (!(data = videoStream->borrow(bytes)))
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return data;
+  };
+
+  const uint8_t* data(borrowLoaded(60));
+  ASSERT_NE(data, nullptr);
+  EXPECT_EQ(std::string(reinterpret_cast<const char*>(data), 4), "mnop");
+
+  // Not enough data left in the segment
+  EXPECT_EQ(videoStream->borrow(41), nullptr);
+
+  data = videoStream->borrow(40);
+  ASSERT_NE(data, nullptr);
+  // tell() moves on to the next segment, the borrowed data has to stay valid
+  EXPECT_EQ(videoStream->tell(), 1100);
+  EXPECT_EQ(std::string(reinterpret_cast<const char*>(data), 4), "uvwx");
+
+  data = borrowLoaded(40);
+  ASSERT_NE(data, nullptr);
+  EXPECT_EQ(std::string(reinterpret_cast<const char*>(data), 4), "ijkl");
+  videoStream->stop();
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, segmentBorrowDownloading)
+{
+  OpenTestFile("mpd/segtpl_baseurl_cdn.mpd", "https://foo.bar/segtpl_baseurl_cdn.mpd", "");
+
+  // The download of segment 2 stalls after the first bytes
+  testHelper::breakingUrls.push_back("https://cdn1.foo.bar/content/video/V500/2.m4s");
+  testHelper::holdBreak = true;
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->start_stream(~0, 0, 0, true);
+
+  char data[16];
+  ASSERT_EQ(videoStream->read(data, 16), 16);
+
+  // borrow() doesn't wait for a running download, read() delivers the data
+  EXPECT_EQ(videoStream->borrow(4), nullptr);
+  EXPECT_EQ(videoStream->tell(), 16);
+  testHelper::holdBreak = false;
+  ASSERT_EQ(videoStream->read(data, 16), 16);
+  EXPECT_EQ(std::string(data, 16), "Sixteen bytes!!!");
+  videoStream->stop();
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, initializationPrefetch)
+{
+  OpenTestFile("mpd/segmentlist_ranges.mpd", "https://foo.bar/segmentlist_ranges.mpd", "");
+
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  testHelper::downloadList.clear();
+  videoStream->PrefetchInitialization();
+  videoStream->start_stream(~0, 0, 0, true);
+  EXPECT_TRUE(videoStream->select_stream(true));
+
+  // select_stream takes the prefetched initialization instead of downloading it again
+  ASSERT_EQ(testHelper::downloadList.size(), 1);
+  EXPECT_EQ(testHelper::downloadList[0], "https://foo.bar/video/vid.mp4");
+
+  char data[4];
+  ASSERT_EQ(videoStream->read(data, 4), 4);
+  EXPECT_EQ(std::string(data, 4), "abcd");
+  videoStream->stop();
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, initializationCache)
+{
+  OpenTestFile("mpd/segmentlist_ranges.mpd", "https://foo.bar/segmentlist_ranges.mpd", "");
+
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->start_stream(~0, 0, 0, true);
+  testHelper::downloadList.clear();
+  EXPECT_TRUE(videoStream->select_stream(true));
+  EXPECT_TRUE(videoStream->select_stream(true));
+  videoStream->stop();
+
+  // A second stream on the same tree shares the cached initialization
+  TestAdaptiveStream otherStream(*tree, adaptive::AdaptiveTree::VIDEO);
+  otherStream.prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                             mediaHeaders);
+  otherStream.start_stream(~0, 0, 0, true);
+  EXPECT_TRUE(otherStream.select_stream(true));
+
+  char data[4];
+  ASSERT_EQ(otherStream.read(data, 4), 4);
+  EXPECT_EQ(std::string(data, 4), "abcd");
+  otherStream.stop();
+
+  EXPECT_EQ(testHelper::downloadList.size(), 1);
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, adaptiveSwitching)
+{
+  OpenTestFile("mpd/segtpl_abr.mpd", "https://foo.bar/segtpl_abr.mpd", "");
+  const std::vector<adaptive::AdaptiveTree::Representation*>& reps(
+      tree->current_period_->adaptationSets_[0]->representations_);
+
+  tree->bandwidth_ = 500000;
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->SetLookAhead(2, 0);
+  videoStream->SetAdaptiveSwitching(true);
+  videoStream->start_stream(~0, 0, 0, true);
+  EXPECT_TRUE(videoStream->select_stream(true));
+  EXPECT_EQ(videoStream->getRepresentation(), reps[0]);
+
+  // The connection turns out to be much faster than the startup guess
+  tree->set_download_speed(10000000 / 8);
+  testHelper::downloadList.clear();
+  ReadSegments(videoStream, 16, 6);
+  videoStream->stop();
+
+  // The highest representation continues with the next segment after its initialization
+  std::vector<std::string>::const_iterator init(
+      std::find(testHelper::downloadList.begin(), testHelper::downloadList.end(),
+                "https://foo.bar/V4000/init.mp4"));
+  ASSERT_NE(init, testHelper::downloadList.end());
+  ASSERT_NE(init, testHelper::downloadList.begin());
+  ASSERT_NE(init + 1, testHelper::downloadList.end());
+  EXPECT_EQ(*(init - 1), "https://foo.bar/V500/1.m4s");
+  EXPECT_EQ(*(init + 1), "https://foo.bar/V4000/2.m4s");
+  EXPECT_EQ(videoStream->getRepresentation(), reps[2]);
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, segmentRetry)
+{
+  OpenTestFile("mpd/segtpl_abr.mpd", "https://foo.bar/segtpl_abr.mpd", "");
+
+  adaptive::RetryPolicy::SETTINGS retrySettings;
+  retrySettings.maxRetries = 2;
+  retrySettings.initialDelay = 0.001;
+  testHelper::failingUrls.push_back("https://foo.bar/V500/2.m4s");
+  videoStream->SetRetryPolicy(retrySettings);
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->start_stream(~0, 0, 0, true);
+  testHelper::downloadList.clear();
+  ReadSegments(videoStream, 16, 3);
+  videoStream->stop();
+
+  // Without switching the stream ends at the failed segment after the retries
+  EXPECT_EQ(downloadedUrls.size(), 1);
+  EXPECT_EQ(std::count(testHelper::downloadList.begin(), testHelper::downloadList.end(),
+                       "https://foo.bar/V500/2.m4s"),
+            3);
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, segmentFailover)
+{
+  OpenTestFile("mpd/segtpl_abr.mpd", "https://foo.bar/segtpl_abr.mpd", "");
+  const std::vector<adaptive::AdaptiveTree::Representation*>& reps(
+      tree->current_period_->adaptationSets_[0]->representations_);
+
+  adaptive::RetryPolicy::SETTINGS retrySettings;
+  retrySettings.initialDelay = 0.001;
+  testHelper::failingUrls.push_back("https://foo.bar/V1500/2.m4s");
+  tree->bandwidth_ = 2000000;
+  videoStream->SetRetryPolicy(retrySettings);
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->SetLookAhead(1, 0);
+  videoStream->SetAdaptiveSwitching(true);
+  videoStream->start_stream(~0, 1280, 720, true);
+  EXPECT_TRUE(videoStream->select_stream(true));
+  ASSERT_EQ(videoStream->getRepresentation(), reps[1]);
+
+  tree->set_download_speed(2000000 / 8);
+  testHelper::downloadList.clear();
+  ReadSegments(videoStream, 16, 4);
+  videoStream->stop();
+
+  // After the second failed attempt the segment is loaded from the lower representation
+  EXPECT_EQ(downloadedUrls.size(), 4);
+  EXPECT_EQ(std::count(testHelper::downloadList.begin(), testHelper::downloadList.end(),
+                       "https://foo.bar/V1500/2.m4s"),
+            2);
+  std::vector<std::string>::const_iterator init(
+      std::find(testHelper::downloadList.begin(), testHelper::downloadList.end(),
+                "https://foo.bar/V500/init.mp4"));
+  ASSERT_NE(init, testHelper::downloadList.end());
+  ASSERT_NE(init + 1, testHelper::downloadList.end());
+  EXPECT_EQ(*(init + 1), "https://foo.bar/V500/2.m4s");
+}
+
+TEST_F(DASHTreeTest, AlternateBaseUrls)
+{
+  OpenTestFile("mpd/segtpl_baseurl_cdn.mpd", "https://foo.bar/segtpl_baseurl_cdn.mpd", "");
+  const std::vector<adaptive::AdaptiveTree::Representation*>& reps(
+      tree->current_period_->adaptationSets_[0]->representations_);
+
+  // The relative AdaptationSet BaseURL is served by both locations of the MPD
+  ASSERT_EQ(reps[0]->base_urls_.size(), 2);
+  EXPECT_EQ(reps[0]->base_url_, "https://cdn1.foo.bar/content/video/");
+  EXPECT_EQ(reps[0]->base_urls_[0].url, "https://cdn1.foo.bar/content/video/");
+  EXPECT_EQ(reps[0]->base_urls_[0].serviceLocation, "cdn1");
+  EXPECT_EQ(reps[0]->base_urls_[0].priority, 1);
+  EXPECT_EQ(reps[0]->base_urls_[1].url, "https://cdn2.foo.bar/content/video/");
+  EXPECT_EQ(reps[0]->base_urls_[1].serviceLocation, "cdn2");
+  EXPECT_EQ(reps[0]->base_urls_[1].priority, 2);
+  EXPECT_EQ(reps[0]->segtpl_.media, "https://cdn1.foo.bar/content/video/V500/$Number$.m4s");
+
+  // An absolute BaseURL replaces the inherited locations
+  ASSERT_EQ(reps[1]->base_urls_.size(), 1);
+  EXPECT_EQ(reps[1]->base_urls_[0].url, "https://origin.foo.bar/video/");
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, baseUrlFailover)
+{
+  OpenTestFile("mpd/segtpl_baseurl_cdn.mpd", "https://foo.bar/segtpl_baseurl_cdn.mpd", "");
+
+  testHelper::failingUrls.push_back("https://cdn1.foo.bar/content/video/V500/2.m4s");
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->start_stream(~0, 0, 0, true);
+  testHelper::downloadList.clear();
+  ReadSegments(videoStream, 16, 3);
+  videoStream->stop();
+
+  // The preferred location fails once, the next segments come from the alternate
+  EXPECT_EQ(downloadedUrls.size(), 3);
+  ASSERT_GE(testHelper::downloadList.size(), 4);
+  EXPECT_EQ(testHelper::downloadList[0], "https://cdn1.foo.bar/content/video/V500/1.m4s");
+  EXPECT_EQ(testHelper::downloadList[1], "https://cdn1.foo.bar/content/video/V500/2.m4s");
+  EXPECT_EQ(testHelper::downloadList[2], "https://cdn2.foo.bar/content/video/V500/2.m4s");
+  EXPECT_EQ(testHelper::downloadList[3], "https://cdn2.foo.bar/content/video/V500/3.m4s");
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, baseUrlFailoverPartialSegment)
+{
+  OpenTestFile("mpd/segtpl_baseurl_cdn.mpd", "https://foo.bar/segtpl_baseurl_cdn.mpd", "");
+
+  testHelper::breakingUrls.push_back("https://cdn1.foo.bar/content/video/V500/2.m4s");
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->start_stream(~0, 0, 0, true);
+  testHelper::downloadList.clear();
+
+  // The bytes received from the failed location are neither lost nor duplicated
+  char data[16];
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    ASSERT_EQ(videoStream->read(data, 4), 4);
+    ASSERT_EQ(videoStream->read(data + 4, 12), 12);
+    EXPECT_EQ(std::string(data, 16), "Sixteen bytes!!!");
+  }
+  EXPECT_EQ(videoStream->tell(), 48);
+  videoStream->stop();
+
+  ASSERT_GE(testHelper::downloadList.size(), 3);
+  EXPECT_EQ(testHelper::downloadList[1], "https://cdn1.foo.bar/content/video/V500/2.m4s");
+  EXPECT_EQ(testHelper::downloadList[2], "https://cdn2.foo.bar/content/video/V500/2.m4s");
+}
+
+TEST_F(DASHTreeAdaptiveStreamTest, baseUrlFailoverResumeIgnored)
+{
+  OpenTestFile("mpd/segtpl_baseurl_cdn.mpd", "https://foo.bar/segtpl_baseurl_cdn.mpd", "");
+
+  // cdn1 breaks off segment 2 after the reader consumed a part of it,
+  // cdn2 answers the resume with the whole segment
+  testHelper::breakingUrls.push_back("https://cdn1.foo.bar/content/video/V500/2.m4s");
+  testHelper::holdBreak = true;
+  testHelper::ignoreRanges = true;
+  videoStream->prepare_stream(tree->current_period_->adaptationSets_[0], 0, 0, 0, 0, 0, 0, 0,
+                              mediaHeaders);
+  videoStream->start_stream(~0, 0, 0, true);
+
+  char data[16];
+  ASSERT_EQ(videoStream->read(data, 16), 16);
+  ASSERT_EQ(videoStream->read(data, 4), 4);
+  testHelper::holdBreak = false;
+  ASSERT_EQ(videoStream->read(data + 4, 12), 12);
+  EXPECT_EQ(std::string(data, 16), "Sixteen bytes!!!");
+  ASSERT_EQ(videoStream->read(data, 16), 16);
+  EXPECT_EQ(std::string(data, 16), "Sixteen bytes!!!");
+  EXPECT_EQ(videoStream->tell(), 48);
+  videoStream->stop();
+}
+
 TEST_F(DASHTreeTest, updateParameterLiveSegmentTimeline)
 {
   OpenTestFile("mpd/segtimeline_live_pd.mpd", "", "");
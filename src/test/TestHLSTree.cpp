@@ -1,6 +1,8 @@
 #include "TestHelper.h"
 #include <gtest/gtest.h>
 
+#include <thread>
+
 
 class HLSTreeTest : public ::testing::Test
 {
@@ -52,6 +54,7 @@ TEST_F(HLSTreeTest, CalculateSourceUrl)
   adaptive::HLSTree::PREPARE_RESULT res = OpenTestFileVariant(
       "hls/fmp4_noenc_v_stream_2.m3u8", "https://foo.bar/stream_2/out.m3u8",
       tree->current_period_, tree->current_adaptationset_, tree->current_representation_);
+  EXPECT_EQ(res, adaptive::HLSTree::PREPARE_RESULT_OK);
 
   std::string rep_url = tree->BuildDownloadUrl(
       tree->current_period_->adaptationSets_[0]->representations_[0]->source_url_);
@@ -260,7 +263,7 @@ TEST_F(HLSTreeTest, PtsSetInMultiPeriod)
                           tree->periods_[0]->adaptationSets_[0]->representations_[1]);
 
   uint64_t pts =
-      tree->periods_[1]->adaptationSets_[0]->representations_[1]->segments_.data[0].startPTS_;
+      tree->periods_[1]->adaptationSets_[0]->representations_[1]->segments_.data()[0].startPTS_;
   EXPECT_EQ(res, adaptive::HLSTree::PREPARE_RESULT_OK);
   EXPECT_EQ(pts, 21000000);
 
@@ -271,7 +274,117 @@ TEST_F(HLSTreeTest, PtsSetInMultiPeriod)
                             tree->periods_[1], tree->periods_[1]->adaptationSets_[1],
                             tree->periods_[1]->adaptationSets_[1]->representations_[0]);
 
-  pts = tree->periods_[1]->adaptationSets_[1]->representations_[0]->segments_.data[0].startPTS_;
+  pts = tree->periods_[1]->adaptationSets_[1]->representations_[0]->segments_.data()[0].startPTS_;
   EXPECT_EQ(res, adaptive::HLSTree::PREPARE_RESULT_OK);
   EXPECT_EQ(pts, 20993000);
 }
+
+TEST_F(HLSTreeTest, LowLatencyParts)
+{
+  OpenTestFileMaster("hls/1v_master.m3u8", "https://foo.bar/live/master.m3u8", "");
+  adaptive::AdaptiveTree::AdaptationSet* adp(tree->current_period_->adaptationSets_[0]);
+  adaptive::AdaptiveTree::Representation* rep(adp->representations_[0]);
+
+  adaptive::HLSTree::PREPARE_RESULT res =
+      OpenTestFileVariant("hls/ll_fmp4_v_stream.m3u8", "https://foo.bar/live/stream.m3u8",
+                          tree->current_period_, adp, rep);
+
+  EXPECT_EQ(res, adaptive::HLSTree::PREPARE_RESULT_OK);
+  EXPECT_TRUE(tree->low_latency_);
+  // 2 segments, the 4 parts of seg102 in place of it, 2 parts of seg103 and the hinted one
+  ASSERT_EQ(rep->segments_.size(), 9);
+  EXPECT_EQ(rep->startNumber_, 100);
+  EXPECT_STREQ(rep->segments_[1]->url, "https://foo.bar/live/seg101.m4s");
+  EXPECT_STREQ(rep->segments_[2]->url, "https://foo.bar/live/seg102.0.m4s");
+  EXPECT_STREQ(rep->segments_[8]->url, "https://foo.bar/live/seg103.2.m4s");
+  EXPECT_EQ(rep->segments_[7]->startPTS_, 13000000);
+  EXPECT_EQ(rep->duration_, 14000000);
+
+  // PART-HOLD-BACK 3 s, the first segment beginning before that is seg102
+  EXPECT_EQ(tree->GetLiveStartPosition(tree->current_period_, rep), 2);
+
+  // The hinted part was played, the update thread reloads blocking for the next one
+  ASSERT_TRUE(tree->HasUpdateThread());
+  SetFileName(testHelper::testFile, "hls/ll_fmp4_v_stream_update.m3u8");
+  {
+    std::lock_guard<std::mutex> lck(tree->GetTreeMutex());
+    rep->flags_ |= adaptive::AdaptiveTree::Representation::ENABLED;
+    rep->current_segment_ = rep->get_segment(8);
+    EXPECT_EQ(tree->ExtendLiveSegments(tree->current_period_, adp), 500);
+  }
+  for (unsigned int i = 0; i < 200; ++i)
+  {
+    {
+      std::lock_guard<std::mutex> lck(tree->GetTreeMutex());
+      if (rep->get_next_segment(rep->current_segment_))
+        break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::lock_guard<std::mutex> lck(tree->GetTreeMutex());
+  EXPECT_EQ(tree->effective_url_,
+            "https://foo.bar/live/stream.m3u8?_HLS_msn=103&_HLS_part=2&_HLS_skip=YES");
+
+  // Numbering continues from the previous list
+  ASSERT_EQ(rep->segments_.size(), 11);
+  EXPECT_EQ(rep->startNumber_, 101);
+  EXPECT_EQ(rep->getCurrentSegmentNumber(), 108);
+  EXPECT_STREQ(rep->current_segment_->url, "https://foo.bar/live/seg103.2.m4s");
+  EXPECT_STREQ(rep->get_next_segment(rep->current_segment_)->url,
+               "https://foo.bar/live/seg103.3.m4s");
+}
+
+TEST_F(HLSTreeTest, LowLatencyHintDropped)
+{
+  OpenTestFileMaster("hls/1v_master.m3u8", "https://foo.bar/live/master.m3u8", "");
+  adaptive::AdaptiveTree::AdaptationSet* adp(tree->current_period_->adaptationSets_[0]);
+  adaptive::AdaptiveTree::Representation* rep(adp->representations_[0]);
+
+  OpenTestFileVariant("hls/ll_fmp4_v_stream.m3u8", "https://foo.bar/live/stream.m3u8",
+                      tree->current_period_, adp, rep);
+  ASSERT_EQ(rep->segments_.size(), 9);
+  rep->current_segment_ = rep->get_segment(8);
+
+  // seg103 is complete, neither its parts nor the hinted one are listed anymore
+  SetFileName(testHelper::testFile, "hls/ll_fmp4_v_stream_nohint.m3u8");
+  EXPECT_EQ(tree->prepareRepresentation(tree->current_period_, adp, rep, true),
+            adaptive::HLSTree::PREPARE_RESULT_OK);
+
+  // The numbering follows the media sequence, playback continues with seg104
+  ASSERT_EQ(rep->segments_.size(), 5);
+  EXPECT_EQ(rep->startNumber_, 106);
+  ASSERT_NE(rep->current_segment_, nullptr);
+  EXPECT_EQ(rep->getCurrentSegmentNumber(), 108);
+  EXPECT_STREQ(rep->current_segment_->url, "https://foo.bar/live/seg103.m4s");
+  EXPECT_STREQ(rep->get_next_segment(rep->current_segment_)->url,
+               "https://foo.bar/live/seg104.0.m4s");
+}
+
+TEST_F(HLSTreeTest, DeltaUpdate)
+{
+  OpenTestFileMaster("hls/1v_master.m3u8", "https://foo.bar/live/master.m3u8", "");
+  adaptive::AdaptiveTree::AdaptationSet* adp(tree->current_period_->adaptationSets_[0]);
+  adaptive::AdaptiveTree::Representation* rep(adp->representations_[0]);
+
+  OpenTestFileVariant("hls/live_fmp4_v_stream.m3u8", "https://foo.bar/live/stream.m3u8",
+                      tree->current_period_, adp, rep);
+  ASSERT_EQ(rep->segments_.size(), 10);
+  rep->current_segment_ = rep->get_segment(8);
+  const char* keptUrl(rep->segments_[1]->url);
+
+  SetFileName(testHelper::testFile, "hls/live_fmp4_v_stream_delta.m3u8");
+  EXPECT_EQ(tree->prepareRepresentation(tree->current_period_, adp, rep, true),
+            adaptive::HLSTree::PREPARE_RESULT_OK);
+  EXPECT_EQ(tree->effective_url_, "https://foo.bar/live/stream.m3u8?_HLS_skip=YES");
+
+  // seg200 expired, seg201 - seg206 are kept, seg207 - seg211 come from the update
+  ASSERT_EQ(rep->segments_.size(), 11);
+  EXPECT_EQ(rep->startNumber_, 201);
+  EXPECT_EQ(rep->segments_[0]->url, keptUrl);
+  EXPECT_STREQ(rep->segments_[6]->url, "https://foo.bar/live/seg207.m4s");
+  EXPECT_EQ(rep->segments_[6]->startPTS_, 14000000);
+  EXPECT_EQ(rep->segments_[10]->startPTS_, 22000000);
+  EXPECT_EQ(rep->duration_, 22000000);
+  EXPECT_EQ(rep->getCurrentSegmentNumber(), 208);
+  EXPECT_STREQ(rep->current_segment_->url, "https://foo.bar/live/seg208.m4s");
+}
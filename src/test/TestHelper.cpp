@@ -1,8 +1,19 @@
 #include "TestHelper.h"
 
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
 std::string testHelper::testFile;
 std::string testHelper::effectiveUrl;
 std::string testHelper::lastDownloadUrl;
+std::vector<std::string> testHelper::downloadList;
+std::vector<std::string> testHelper::failingUrls;
+std::vector<std::string> testHelper::failingRanges;
+std::vector<std::string> testHelper::breakingUrls;
+std::atomic<bool> testHelper::holdBreak(false);
+bool testHelper::ignoreRanges(false);
+std::mutex testHelper::downloadMutex;
 
 void Log(const LogLevel loglevel, const char* format, ...){}
 
@@ -55,16 +66,77 @@ bool adaptive::AdaptiveTree::download(const char* url,
 }
 
 bool TestAdaptiveStream::download(const char* url,
-                                  const std::map<std::string, std::string>& mediaHeaders)
+                                  const std::map<std::string, std::string>& mediaHeaders,
+                                  void* opaque)
 {
-  testHelper::lastDownloadUrl = url;
+  bool breaking(false);
+  {
+    std::lock_guard<std::mutex> lck(testHelper::downloadMutex);
+    testHelper::lastDownloadUrl = url;
+    testHelper::downloadList.push_back(url);
+    if (std::find(testHelper::failingUrls.begin(), testHelper::failingUrls.end(), url) !=
+        testHelper::failingUrls.end())
+      return false;
+    std::map<std::string, std::string>::const_iterator range(mediaHeaders.find("Range"));
+    if (range != mediaHeaders.end())
+    {
+      std::vector<std::string>::iterator failing(std::find(
+          testHelper::failingRanges.begin(), testHelper::failingRanges.end(), range->second));
+      if (failing != testHelper::failingRanges.end())
+      {
+        testHelper::failingRanges.erase(failing);
+        return false;
+      }
+    }
+    std::vector<std::string>::iterator breakingUrl(
+        std::find(testHelper::breakingUrls.begin(), testHelper::breakingUrls.end(), url));
+    if ((breaking = breakingUrl != testHelper::breakingUrls.end()))
+      testHelper::breakingUrls.erase(breakingUrl);
+  }
   size_t nbRead = ~0UL;
   std::stringstream ss("Sixteen bytes!!!");
 
+  // Byte range requests are answered with the letters a-z repeated over the whole file
+  std::map<std::string, std::string>::const_iterator range(mediaHeaders.find("Range"));
+  uint64_t rangeBegin, rangeEnd;
+  int rangeValues(range != mediaHeaders.end()
+                      ? sscanf(range->second.c_str(), "bytes=%" SCNu64 "-%" SCNu64, &rangeBegin,
+                               &rangeEnd)
+                      : 0);
+  if (rangeValues && testHelper::ignoreRanges)
+  {
+    if (!range_ignored(opaque))
+      return false;
+    rangeBegin = 0;
+    rangeEnd = testHelper::RANGEFILESIZE - 1;
+    rangeValues = rangeValues == 2 ? 2 : 0;
+  }
+  if (rangeValues == 2)
+  {
+    std::string data;
+    for (uint64_t pos(rangeBegin); pos <= rangeEnd; ++pos)
+      data += static_cast<char>('a' + pos % 26);
+    ss.str(data);
+  }
+  else
+  {
+    // Open ended ranges continue an interrupted download
+    if (rangeValues == 1)
+      ss.str(ss.str().substr(static_cast<size_t>(rangeBegin)));
+    reserve_data(ss.str().size(), opaque);
+  }
+
   char buf[16];
   size_t nbReadOverall = 0;
-  while ((nbRead = ss.readsome(buf, 16)) > 0 && ~nbRead && write_data(buf, nbRead))
+  while ((nbRead = ss.readsome(buf, breaking ? 8 : 16)) > 0 && ~nbRead &&
+         write_data(buf, nbRead, opaque))
+  {
     nbReadOverall += nbRead;
+    for (unsigned int i = 0; breaking && testHelper::holdBreak && i < 500; ++i)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (breaking)
+      return false;
+  }
 
   if (!nbReadOverall)
   {
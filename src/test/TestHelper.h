@@ -4,6 +4,8 @@
 #include "../parser/DASHTree.h"
 #include "../parser/HLSTree.h"
 
+#include <atomic>
+
 std::string GetEnv(const std::string& var);
 void SetFileName(std::string& file, const std::string name);
 void Log(const LogLevel loglevel, const char* format, ...);
@@ -14,6 +16,19 @@ public:
   static std::string testFile;
   static std::string effectiveUrl;
   static std::string lastDownloadUrl;
+  static std::vector<std::string> downloadList;
+  // Media downloads of these urls fail
+  static std::vector<std::string> failingUrls;
+  // Media downloads with one of these Range headers fail once
+  static std::vector<std::string> failingRanges;
+  // Media downloads of these urls break off after 8 bytes once,
+  // while holdBreak is set they wait for it to be cleared before
+  static std::vector<std::string> breakingUrls;
+  static std::atomic<bool> holdBreak;
+  // Range requests are answered with the whole file (RANGEFILESIZE letters / 16 bytes)
+  static bool ignoreRanges;
+  static const uint64_t RANGEFILESIZE = 2048;
+  static std::mutex downloadMutex;
 };
 
 class TestAdaptiveStream : public adaptive::AdaptiveStream
@@ -24,7 +39,8 @@ public:
 
 protected:
   virtual bool download(const char* url,
-                        const std::map<std::string, std::string>& mediaHeaders) override;
+                        const std::map<std::string, std::string>& mediaHeaders,
+                        void* opaque) override;
 };
 
 class AESDecrypter : public IAESDecrypter
@@ -53,4 +69,5 @@ public:
   uint64_t mock_time = 10000000L;
   DASHTestTree();
   uint64_t GetNowTime() override { return mock_time; }
+  uint64_t GetNowTimeMs() override { return mock_time * 1000; }
 };
@@ -0,0 +1,62 @@
+#include "../parser/M3U8Tokenizer.h"
+
+#include <gtest/gtest.h>
+
+using adaptive::M3U8Tokenizer;
+using adaptive::M3U8Value;
+
+TEST(M3U8TokenizerTest, Lines)
+{
+  const std::string playlist("#EXTM3U\r\n\n#EXTINF:4.5, title \r\nseg1.ts\n\n  \nseg2.ts");
+  M3U8Tokenizer tokenizer(playlist.data(), playlist.size());
+  M3U8Value line, value;
+
+  ASSERT_TRUE(tokenizer.NextLine(line));
+  EXPECT_EQ(line.str(), "#EXTM3U");
+  ASSERT_TRUE(tokenizer.NextLine(line));
+  ASSERT_TRUE(M3U8Tokenizer::IsTag(line, "#EXTINF:", value));
+  EXPECT_EQ(value.str(), "4.5, title");
+  EXPECT_DOUBLE_EQ(value.ToDouble(), 4.5);
+  EXPECT_FALSE(M3U8Tokenizer::IsTag(line, "#EXT-X-KEY:"));
+  ASSERT_TRUE(tokenizer.NextLine(line));
+  EXPECT_EQ(line.str(), "seg1.ts");
+  ASSERT_TRUE(tokenizer.NextLine(line));
+  EXPECT_EQ(line.str(), "seg2.ts");
+  EXPECT_FALSE(tokenizer.NextLine(line));
+}
+
+TEST(M3U8TokenizerTest, Numbers)
+{
+  EXPECT_DOUBLE_EQ(M3U8Value("-1.5", 4).ToDouble(), -1.5);
+  EXPECT_DOUBLE_EQ(M3U8Value("+2.25", 5).ToDouble(), 2.25);
+  EXPECT_DOUBLE_EQ(M3U8Value("1e3", 3).ToDouble(), 1000);
+  EXPECT_DOUBLE_EQ(M3U8Value("-2.5E-2", 7).ToDouble(), -0.025);
+  EXPECT_DOUBLE_EQ(M3U8Value("4.5e+1,", 7).ToDouble(), 45);
+  EXPECT_DOUBLE_EQ(M3U8Value("abc", 3).ToDouble(), 0);
+  // The value ends before the exponent
+  EXPECT_DOUBLE_EQ(M3U8Value("3e2", 1).ToDouble(), 3);
+
+  EXPECT_EQ(M3U8Value("+42", 3).ToUInt(), 42U);
+  EXPECT_EQ(M3U8Value("-42", 3).ToUInt(), 0U);
+  EXPECT_EQ(M3U8Value("12345", 3).ToUInt(), 123U);
+
+  const std::string line("TIME-OFFSET=-12.5,PRECISE=YES");
+  EXPECT_DOUBLE_EQ(
+      M3U8Tokenizer::GetAttribute(M3U8Value(line.data(), line.size()), "TIME-OFFSET").ToDouble(),
+      -12.5);
+}
+
+TEST(M3U8TokenizerTest, Attributes)
+{
+  const std::string line("BANDWIDTH=263851,CODECS=\"mp4a.40.2, avc1.4d400d\",RESOLUTION=416x234, "
+                         "FRAME-RATE=29.970,AUDIO=\"\"");
+  const M3U8Value list(line.data(), line.size());
+
+  EXPECT_EQ(M3U8Tokenizer::GetAttribute(list, "BANDWIDTH").ToUInt(), 263851U);
+  EXPECT_EQ(M3U8Tokenizer::GetAttribute(list, "CODECS"), "mp4a.40.2, avc1.4d400d");
+  EXPECT_EQ(M3U8Tokenizer::GetAttribute(list, "RESOLUTION"), "416x234");
+  EXPECT_DOUBLE_EQ(M3U8Tokenizer::GetAttribute(list, "FRAME-RATE").ToDouble(), 29.97);
+  EXPECT_TRUE(M3U8Tokenizer::GetAttribute(list, "AUDIO").empty());
+  EXPECT_TRUE(M3U8Tokenizer::GetAttribute(list, "SUBTITLES").empty());
+  EXPECT_NE(M3U8Tokenizer::GetAttribute(list, "RESOLUTION"), "416x2");
+}
@@ -0,0 +1,54 @@
+#include "../common/RepresentationChooser.h"
+#include <gtest/gtest.h>
+
+
+class RepresentationChooserTest : public ::testing::Test
+{
+protected:
+  // 4 second segments, the look-ahead holds 16 seconds
+  size_t Choose(size_t current, double bufferLevel, double throughput)
+  {
+    return chooser.Choose(bitrates, current, bufferLevel, 16.0, 4.0, throughput);
+  }
+
+  adaptive::RepresentationChooser chooser;
+  std::vector<uint32_t> bitrates = {500000, 1500000, 4000000};
+};
+
+TEST_F(RepresentationChooserTest, ThroughputOnly)
+{
+  // Without look-ahead the buffer level is meaningless
+  EXPECT_EQ(chooser.Choose(bitrates, 0, 0.0, 0.0, 4.0, 1000000), 0);
+  EXPECT_EQ(chooser.Choose(bitrates, 0, 0.0, 0.0, 4.0, 2000000), 1);
+  EXPECT_EQ(chooser.Choose(bitrates, 2, 0.0, 0.0, 4.0, 10000000), 2);
+  EXPECT_EQ(chooser.Choose(bitrates, 2, 0.0, 0.0, 4.0, 100000), 0);
+
+  // Startup: the buffer is empty
+  EXPECT_EQ(Choose(0, 0.0, 10000000), 2);
+}
+
+TEST_F(RepresentationChooserTest, BufferLevel)
+{
+  // A draining buffer switches down although the throughput is fine
+  EXPECT_EQ(Choose(2, 4.0, 2000000), 0);
+  // A filling buffer switches up step by step
+  EXPECT_EQ(Choose(0, 8.0, 10000000), 1);
+  EXPECT_EQ(Choose(1, 16.0, 10000000), 2);
+}
+
+TEST_F(RepresentationChooserTest, NoOscillation)
+{
+  // Never up beyond the throughput
+  EXPECT_EQ(Choose(0, 16.0, 2000000), 1);
+  // A full buffer keeps the current bitrate during a short throughput dip
+  EXPECT_EQ(Choose(2, 16.0, 1000000), 2);
+  // The current bitrate stays as long as the throughput sustains it
+  EXPECT_EQ(Choose(2, 8.0, 10000000), 2);
+}
+
+TEST_F(RepresentationChooserTest, SingleBitrate)
+{
+  bitrates.resize(1);
+  EXPECT_EQ(Choose(0, 16.0, 10000000), 0);
+  EXPECT_EQ(Choose(0, 0.0, 100), 0);
+}
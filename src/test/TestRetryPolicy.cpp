@@ -0,0 +1,42 @@
+#include "../common/RetryPolicy.h"
+
+#include <gtest/gtest.h>
+
+using adaptive::RetryPolicy;
+
+TEST(RetryPolicyTest, BackoffWithJitter)
+{
+  RetryPolicy policy(RetryPolicy::SETTINGS(), 1);
+
+  // Doubled per failed attempt, randomized between half and the full backoff
+  double backoff(0.5);
+  for (unsigned int attempt(1); attempt <= 6; ++attempt)
+  {
+    double delay(policy.GetDelay(attempt));
+    EXPECT_GE(delay, backoff / 2);
+    EXPECT_LE(delay, backoff);
+    if (backoff < 4.0)
+      backoff *= 2;
+  }
+}
+
+TEST(RetryPolicyTest, Limits)
+{
+  RetryPolicy policy;
+
+  EXPECT_TRUE(policy.Retry(10, 5.0));
+  EXPECT_FALSE(policy.Retry(11, 5.0));
+  EXPECT_FALSE(policy.Retry(1, 10.0));
+}
+
+TEST(RetryPolicyTest, FailoverDeadline)
+{
+  RetryPolicy policy;
+
+  EXPECT_FALSE(policy.Failover(1, 1.0, 0.0));
+  EXPECT_TRUE(policy.Failover(2, 1.0, 0.0));
+  // The buffer level extends the deadline
+  EXPECT_TRUE(policy.Failover(1, 3.0, 0.0));
+  EXPECT_FALSE(policy.Failover(1, 3.0, 8.0));
+  EXPECT_TRUE(policy.Failover(1, 8.0, 8.0));
+}
@@ -0,0 +1,60 @@
+#include "../common/StreamMetrics.h"
+
+#include <gtest/gtest.h>
+
+using adaptive::StreamMetrics;
+
+namespace
+{
+StreamMetrics::SEGMENT MakeSegment(uint32_t number, uint64_t bytes)
+{
+  StreamMetrics::SEGMENT segment;
+  segment.representation = "rep";
+  segment.segmentNumber = number;
+  segment.bytes = bytes;
+  segment.downloadTime = 0.5;
+  return segment;
+}
+} // namespace
+
+TEST(StreamMetricsTest, RingBufferKeepsNewest)
+{
+  StreamMetrics metrics(3);
+  for (uint32_t i(0); i < 5; ++i)
+    metrics.AddSegment(MakeSegment(i, 100));
+
+  std::vector<StreamMetrics::SEGMENT> segments(metrics.GetSegments());
+  ASSERT_EQ(segments.size(), 3);
+  EXPECT_EQ(segments[0].segmentNumber, 2);
+  EXPECT_EQ(segments[1].segmentNumber, 3);
+  EXPECT_EQ(segments[2].segmentNumber, 4);
+
+  // Counters are not limited by the capacity
+  StreamMetrics::COUNTERS counters(metrics.GetCounters());
+  EXPECT_EQ(counters.segments, 5);
+  EXPECT_EQ(counters.bytes, 500);
+  EXPECT_DOUBLE_EQ(counters.downloadTime, 2.5);
+}
+
+TEST(StreamMetricsTest, FailuresAndStalls)
+{
+  StreamMetrics metrics;
+  StreamMetrics::SEGMENT segment(MakeSegment(1, 0));
+  segment.failed = true;
+  segment.retries = 2;
+  metrics.AddSegment(segment);
+  segment = MakeSegment(2, 100);
+  segment.stallTime = 0.25;
+  metrics.AddSegment(segment);
+
+  StreamMetrics::COUNTERS counters(metrics.GetCounters());
+  EXPECT_EQ(counters.failedSegments, 1);
+  EXPECT_EQ(counters.retries, 2);
+  EXPECT_EQ(counters.stalls, 1);
+  EXPECT_DOUBLE_EQ(counters.stallTime, 0.25);
+  EXPECT_NE(StreamMetrics::Format(counters).find("1 stalls"), std::string::npos);
+
+  metrics.Clear();
+  EXPECT_TRUE(metrics.GetSegments().empty());
+  EXPECT_EQ(metrics.GetCounters().segments, 0);
+}
@@ -0,0 +1,62 @@
+#include "../common/StringArena.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+using adaptive::StringArena;
+
+TEST(StringArenaTest, Store)
+{
+  StringArena arena(256);
+
+  const char* a(arena.Store("segment1.ts?token=1", 10));
+  const char* b(arena.Store("segment2.ts", 11));
+  EXPECT_STREQ(a, "segment1.t");
+  EXPECT_STREQ(b, "segment2.ts");
+  // Placed one after another in the same chunk
+  EXPECT_LT(b - a, 32);
+
+  StringArena::Release(a);
+  StringArena::Release(b);
+  StringArena::Release(nullptr);
+}
+
+TEST(StringArenaTest, ChunksFreedWhenReleased)
+{
+  const uint32_t chunks(StringArena::GetChunkCount());
+  std::vector<const char*> strings;
+  {
+    StringArena arena(256);
+    for (unsigned int i(0); i < 20; ++i)
+      strings.push_back(arena.Store("0123456789012345678901234567890", 31));
+    EXPECT_GT(StringArena::GetChunkCount(), chunks + 1);
+
+    // The oldest chunk is freed once all its strings are released
+    const uint32_t used(StringArena::GetChunkCount());
+    for (unsigned int i(0); i < 8; ++i)
+      StringArena::Release(strings[i]);
+    strings.erase(strings.begin(), strings.begin() + 8);
+    EXPECT_LT(StringArena::GetChunkCount(), used);
+  }
+
+  // Strings outlive their arena
+  EXPECT_STREQ(strings.back(), "0123456789012345678901234567890");
+  for (const char* str : strings)
+    StringArena::Release(str);
+  EXPECT_EQ(StringArena::GetChunkCount(), chunks);
+}
+
+TEST(StringArenaTest, LargeStrings)
+{
+  const uint32_t chunks(StringArena::GetChunkCount());
+  StringArena arena(256);
+
+  std::string large(200, 'x');
+  const char* str(arena.Store(large.c_str(), large.size()));
+  EXPECT_EQ(strlen(str), 200);
+  EXPECT_EQ(StringArena::GetChunkCount(), chunks + 1);
+  StringArena::Release(str);
+  EXPECT_EQ(StringArena::GetChunkCount(), chunks);
+}
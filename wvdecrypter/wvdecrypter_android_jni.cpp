@@ -304,11 +304,28 @@ public:
     // array of <subsample_count> integers. NULL if subsample_count is 0
     const AP4_UI32* bytes_of_encrypted_data) override;
 
+  virtual AP4_Result DecryptSecureSampleData(AP4_UI32 pool_id,
+    AP4_DataBuffer& data_in,
+    AP4_DataBuffer& data_out,
+    const AP4_UI08* iv,
+    unsigned int    subsample_count,
+    const AP4_UI16* bytes_of_cleartext_data,
+    const AP4_UI32* bytes_of_encrypted_data,
+    AP4_CencSecureSampleInfo& sample_info) override;
+
   void GetCapabilities(const uint8_t *keyid, uint32_t media, SSD_DECRYPTER::SSD_CAPS &caps);
 
   void RequestNewKeys() { keyUpdateRequested = true; };
 
 private:
+  AP4_Result DecryptSample(AP4_UI32 pool_id,
+    AP4_DataBuffer& data_in,
+    AP4_DataBuffer& data_out,
+    const AP4_UI08* iv,
+    unsigned int    subsample_count,
+    const AP4_UI16* bytes_of_cleartext_data,
+    const AP4_UI32* bytes_of_encrypted_data,
+    AP4_CencSecureSampleInfo* sample_info);
   bool ProvisionRequest();
   bool KeyUpdateRequest(bool waitForKeys);
   bool SendSessionMessage(const std::vector<char> &keyRequestData);
@@ -1034,6 +1051,38 @@ AP4_Result WV_CencSingleSampleDecrypter::DecryptSampleData(AP4_UI32 pool_id,
   unsigned int    subsample_count,
   const AP4_UI16* bytes_of_cleartext_data,
   const AP4_UI32* bytes_of_encrypted_data)
+{
+  return DecryptSample(pool_id, data_in, data_out, iv, subsample_count, bytes_of_cleartext_data,
+    bytes_of_encrypted_data, nullptr);
+}
+
+/*----------------------------------------------------------------------
+|   WV_CencSingleSampleDecrypter::DecryptSecureSampleData
++---------------------------------------------------------------------*/
+AP4_Result WV_CencSingleSampleDecrypter::DecryptSecureSampleData(AP4_UI32 pool_id,
+  AP4_DataBuffer& data_in,
+  AP4_DataBuffer& data_out,
+  const AP4_UI08* iv,
+  unsigned int    subsample_count,
+  const AP4_UI16* bytes_of_cleartext_data,
+  const AP4_UI32* bytes_of_encrypted_data,
+  AP4_CencSecureSampleInfo& sample_info)
+{
+  return DecryptSample(pool_id, data_in, data_out, iv, subsample_count, bytes_of_cleartext_data,
+    bytes_of_encrypted_data, &sample_info);
+}
+
+/*----------------------------------------------------------------------
+|   WV_CencSingleSampleDecrypter::DecryptSample
++---------------------------------------------------------------------*/
+AP4_Result WV_CencSingleSampleDecrypter::DecryptSample(AP4_UI32 pool_id,
+  AP4_DataBuffer& data_in,
+  AP4_DataBuffer& data_out,
+  const AP4_UI08* iv,
+  unsigned int    subsample_count,
+  const AP4_UI16* bytes_of_cleartext_data,
+  const AP4_UI32* bytes_of_encrypted_data,
+  AP4_CencSecureSampleInfo* sample_info)
 {
   if (!media_drm_.GetMediaDrm())
     return AP4_ERROR_INVALID_STATE;
@@ -1060,11 +1109,23 @@ AP4_Result WV_CencSingleSampleDecrypter::DecryptSampleData(AP4_UI32 pool_id,
         bytes_of_encrypted_data = &dummyCipher;
       }
 
-      data_out.SetData(reinterpret_cast<const AP4_Byte*>(&subsample_count), sizeof(subsample_count));
-      data_out.AppendData(reinterpret_cast<const AP4_Byte*>(bytes_of_cleartext_data), subsample_count * sizeof(AP4_UI16));
-      data_out.AppendData(reinterpret_cast<const AP4_Byte*>(bytes_of_encrypted_data), subsample_count * sizeof(AP4_UI32));
-      data_out.AppendData(reinterpret_cast<const AP4_Byte*>(iv), 16);
-      data_out.AppendData(reinterpret_cast<const AP4_Byte*>(fragInfo.key_), 16);
+      if (sample_info)
+      {
+        sample_info->subsample_count = static_cast<AP4_UI16>(subsample_count);
+        memcpy(sample_info->bytes_of_cleartext_data, bytes_of_cleartext_data, subsample_count * sizeof(AP4_UI16));
+        memcpy(sample_info->bytes_of_encrypted_data, bytes_of_encrypted_data, subsample_count * sizeof(AP4_UI32));
+        memcpy(sample_info->iv, iv, 16);
+        memcpy(sample_info->kid, fragInfo.key_, 16);
+        data_out.SetDataSize(0);
+      }
+      else
+      {
+        data_out.SetData(reinterpret_cast<const AP4_Byte*>(&subsample_count), sizeof(subsample_count));
+        data_out.AppendData(reinterpret_cast<const AP4_Byte*>(bytes_of_cleartext_data), subsample_count * sizeof(AP4_UI16));
+        data_out.AppendData(reinterpret_cast<const AP4_Byte*>(bytes_of_encrypted_data), subsample_count * sizeof(AP4_UI32));
+        data_out.AppendData(reinterpret_cast<const AP4_Byte*>(iv), 16);
+        data_out.AppendData(reinterpret_cast<const AP4_Byte*>(fragInfo.key_), 16);
+      }
     }
     else
     {
@@ -1080,7 +1141,8 @@ AP4_Result WV_CencSingleSampleDecrypter::DecryptSampleData(AP4_UI32 pool_id,
       //check NAL / subsample
       const AP4_Byte *packet_in(data_in.GetData()), *packet_in_e(data_in.GetData() + data_in.GetDataSize());
       AP4_Byte *packet_out(data_out.UseData() + data_out.GetDataSize());
-      AP4_UI16 *clrb_out(iv ? reinterpret_cast<AP4_UI16*>(data_out.UseData() + sizeof(subsample_count)) : nullptr);
+      AP4_UI16 *clrb_out(!iv ? nullptr : sample_info ? sample_info->bytes_of_cleartext_data
+        : reinterpret_cast<AP4_UI16*>(data_out.UseData() + sizeof(subsample_count)));
       unsigned int nalunitcount(0), nalunitsum(0), configSize(0);
 
       while (packet_in < packet_in_e)